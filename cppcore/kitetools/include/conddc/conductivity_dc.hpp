@@ -18,14 +18,22 @@ class conductivity_dc{
     T beta;
     bool default_temp;
 
+    // Lists of temperatures and broadenings processed in a single pass. The
+    // contraction with Gamma is done once per broadening and only the
+    // integration with the Fermi function is repeated for each temperature
+    std::vector<double> temperatures;
+    std::vector<T> scats;
+    bool print_all;
+
+    // Also compute the thermoelectric coefficients L0, L1 and L2 from the same Gamma
+    bool thermoelectric;
+
     // Functions to calculate. They will require the objects present in
     // the configuration file
     int direction;
     int NumDisorder;
     int NumMoments;
     int MaxMoments;
-    int Moments_D;
-    int Moments_G;
     bool default_NumMoments;
     int full_range;
     bool default_full_range;
@@ -63,10 +71,19 @@ class conductivity_dc{
     // Input from the shell to override the configuration file
     shell_input variables;
 
-    // Objects required to successfully calculate the conductivity
-    //Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Gamma;
-    Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma;
-    Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma_Padded;
+    // Objects required to successfully calculate the conductivity. The Gamma
+    // matrix is not kept in memory; it is read from the file in panels
+    std::string GammaName;
+
+    // Number of columns of Gamma read from the file at a time in triple_product
+    int PanelCols;
+
+    // Extrapolation of Gamma by linear prediction (disabled if Extrapolate <= 0). The
+    // extrapolated matrix has to be kept in memory, and is used instead of the file
+    int Extrapolate;
+    int PredictionOrder;
+    extrapolation_info<T> extrapolation;
+    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> GammaMatrix;
 
 
     conductivity_dc(system_info<T, DIM>&, shell_input &);
@@ -78,15 +95,24 @@ class conductivity_dc{
     void override_parameters();
     void calculate();
     void calculate2();
+    void extrapolate_gamma_matrix();
+    void contract(Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>&, std::vector<Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>>&);
     void calculate_imag();
     Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor> fill_delta();
     Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> fill_dgreenR();
     Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> triple_product(
-            Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>,
-                    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>);
+            const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>&,
+                    const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>&);
 
+    Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> fermi_weights(T);
+    Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> thermo_weights(T, int);
     Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> calc_cond(
-        Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>);
+        const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>&);
 
     void save_to_file(Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>);
+    void save_to_file(Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>, std::string);
+    void save_to_hdf5(const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>&,
+                      const std::vector<Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>>&,
+                      const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>&);
+    void save_thermo_to_file(const std::vector<Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>>&, int, std::string);
 };
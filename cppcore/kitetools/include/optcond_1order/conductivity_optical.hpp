@@ -56,6 +56,11 @@ class conductivity_optical{
     bool default_minfreqs;
     bool default_maxfreqs;
 
+    // Memory (in MB) available for the tables of Green's functions. The
+    // frequencies are processed in blocks that fit in this memory
+    int MaxMemory;
+    bool default_MaxMemory;
+
     std::string name;
     std::string filename;
     bool default_filename;
@@ -66,9 +71,11 @@ class conductivity_optical{
     // Objects required to successfully calculate the conductivity
     shell_input variables;
 
-    // Objects required to successfully calculate the conductivity
-    Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma;
-    Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma_Padded;
+    // Objects required to successfully calculate the conductivity. The Gamma
+    // matrix is read from the file in panels of PanelCols columns, or in the
+    // blocks of calculateBlocks
+    std::string GammaName;
+    int PanelCols;
     Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Lambda;
     Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Lambda_Padded;
 
@@ -80,5 +87,8 @@ class conductivity_optical{
     void printOpt();
     void calculate();
     void calculateBlocks();
+    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> contract_green(
+        const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> &, int, int,
+        const Eigen::Matrix<T, Eigen::Dynamic, 1> &, const Eigen::Matrix<T, Eigen::Dynamic, 1> &);
 	
 };
@@ -63,7 +63,10 @@ class conductivity_nonlinear{
     Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma0;
     Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma1;
     Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma2;
-    Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma3;
+    // Gamma3 is too big to be kept in memory. It is read from the file in slabs
+    // of SlabMoments moments along the index each thread is parallelized over
+    std::string Gamma3Name;
+    int SlabMoments;
 
     std::string dirName;
 
@@ -48,6 +48,11 @@ class arpes{
     bool default_kernel;
     bool default_kernel_parameter;
 
+    // Extrapolation of the moments by linear prediction (disabled if Extrapolate <= 0)
+    int Extrapolate;
+    int PredictionOrder;
+    extrapolation_info<T> extrapolation;
+
     std::string filename;                          // Saving results to file with this name
     Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> arpes_k_vectors;     // Position of the lattice sites
     Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> energies;                  // Energies specified to be calculated
@@ -70,6 +75,8 @@ class arpes{
     void set_default_parameters();
 	  void override_parameters();                 // If shell variables were given, this function overrides the current parameters
     void calculate();                           // Compute the local density of states
+    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> chebyshev_sum(     // ARPES from the Chebyshev moments
+        const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>&, int);
 	
 };
 
@@ -29,6 +29,11 @@ class dos{
         double kernel_parameter;
         bool default_kernel;
         bool default_kernel_parameter;
+
+        // Extrapolation of the moments by linear prediction (disabled if Extrapolate <= 0)
+        int Extrapolate;
+        int PredictionOrder;
+        extrapolation_info<T> extrapolation;
         
         std::string filename;
         bool default_filename;
@@ -52,6 +57,8 @@ class dos{
         bool fetch_parameters();
         void override_parameters();
         void calculate();
+        Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> spectrum(
+            const Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>&, int);
 	
 };
 
@@ -34,6 +34,11 @@ class ldos{
     bool default_kernel;
     bool default_kernel_parameter;
 
+    // Extrapolation of the moments by linear prediction (disabled if Extrapolate <= 0)
+    int Extrapolate;
+    int PredictionOrder;
+    extrapolation_info<T> extrapolation;
+
     // Aditional variables
     system_info<T, DIM> *systemInfo;            // information about the Hamiltonian
     shell_input variables;                      // Input from the shell to override the configuration file
@@ -41,6 +46,12 @@ class ldos{
     // Objects required to successfully calculate the conductivity
     Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> lMU;
 
+    // Coefficients of the recursion method, one column per position and disorder realization
+    bool recursion;
+    int NumDisorder;
+    Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> RecursionA;
+    Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> RecursionB;
+
     std::string name;
 
     // Class methods
@@ -51,6 +62,9 @@ class ldos{
     void set_default_parameters();
     void override_parameters();                 // If shell variables were given, this function overrides the current parameters
     void calculate();                           // Compute the local density of states
+    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> continued_fraction();  // LDOS from the recursion coefficients
+    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> chebyshev_sum(        // LDOS from the Chebyshev moments
+        const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>&, int);
 	
 };
 
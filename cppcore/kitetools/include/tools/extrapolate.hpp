@@ -0,0 +1,50 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+class results_file;
+
+template <typename T>
+struct extrapolation_info{
+    // Diagnostics of the extrapolation of one or more sequences of Chebyshev moments.
+    // When several sequences are extrapolated together, the errors are relative to the
+    // norm of all of them, so that small and noisy sequences do not dominate
+    int from = 0;           // number of moments calculated by KITEx
+    int to = 0;             // number of moments after the extrapolation
+    int order = 0;          // order of the linear prediction
+    int sequences = 0;      // number of sequences extrapolated
+    int unstable = 0;       // growing modes reflected into the unit circle
+    T fit_error = 0;        // squared error of the fit of the moments that were calculated
+    T fit_norm = 0;         // and their squared norm
+    T back_error = 0;       // squared error of the last quarter of the moments, predicted from the rest
+    T back_norm = 0;        // and their squared norm
+
+    T residual() const;
+    T backtest() const;
+    void merge(const extrapolation_info<T> &);
+    void print() const;
+    void save(results_file &) const;    // as attributes of the group of the results
+};
+
+// Extends the Chebyshev moments mu_0, ..., mu_{M-1} up to NTarget moments by linear prediction,
+// mu_n = sum_i a_i mu_{n-i}, continued as a sum of decaying modes. Order <= 0 picks a default
+template <typename T>
+Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> extrapolate_moments(
+    const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> &, int NTarget, int order, extrapolation_info<T> &);
+
+// Extrapolates each column of the matrix
+template <typename T>
+Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> extrapolate_columns(
+    const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> &, int NTarget, int order,
+    int NumThreads, extrapolation_info<T> &);
+
+// Extrapolates a Gamma matrix along both of its indices, first the rows and then the columns
+template <typename T>
+Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> extrapolate_gamma(
+    const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> &, int NTarget, int order,
+    int NumThreads, extrapolation_info<T> &);
+
+int default_prediction_order(int NumMoments);
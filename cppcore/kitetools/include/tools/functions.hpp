@@ -14,10 +14,16 @@
 template <typename T>	
 std::complex<T> integrate(Eigen::Matrix<T, Eigen::Dynamic, 1> energies, Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> integrand);
 
+template <typename T>
+Eigen::Matrix<T, Eigen::Dynamic, 1> simpson_weights(int N, T dE);
+
 
 template <typename T>
 T fermi_function(T energy, T mu, T beta);
 
+template <typename T>
+T fermi_tail(int order, T x);
+
 
 std::string num2str3f(int dir_num);
 std::string num2str2f(int dir_num);
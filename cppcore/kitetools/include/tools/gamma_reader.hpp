@@ -0,0 +1,37 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+template <typename T>
+class gamma_reader{
+    // Reads sections of a Gamma matrix directly from the .h5 file, so that the
+    // whole matrix never has to be in memory. The dataset is seen as the 2D array
+    // in which KITEx stored it: each row of the dataset is a column of the Eigen
+    // matrix. A read may be started in the background with prefetch() and
+    // collected later with fetch(), so that the next section of the matrix is
+    // read from the disk while the current one is being processed.
+
+    H5::H5File file;
+    H5::DataSet dataset;
+    std::future<Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>> pending;
+
+    public:
+    bool isComplex;
+    hsize_t rows;   // number of rows of the dataset in the file
+    hsize_t cols;   // number of columns of the dataset in the file
+
+    gamma_reader(const std::string &, const std::string &, bool);
+    ~gamma_reader();
+
+    // Reads the rows [row0, row0 + nrows) of the dataset. In each row, reads ncount
+    // blocks of 'block' consecutive elements, starting at col0 and separated by 'stride'.
+    // The result has one column per row of the dataset.
+    Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> read(hsize_t row0, hsize_t nrows,
+            hsize_t col0, hsize_t ncount, hsize_t stride = 1, hsize_t block = 1);
+
+    void prefetch(hsize_t row0, hsize_t nrows, hsize_t col0, hsize_t ncount, hsize_t stride = 1, hsize_t block = 1);
+    Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> fetch();
+};
@@ -10,17 +10,21 @@ class shell_input{
 
     public:
         // DC conductivity
-        double CondDC_Temp; 
+        std::vector<double> CondDC_Temp; 
         int CondDC_NumEnergies; 
         int CondDC_NumMoments; 
         int CondDC_integrate;
         int CondDC_nthreads;
-        double CondDC_Scat; 
+        std::vector<double> CondDC_Scat; 
         double CondDC_deltaScat;
         double CondDC_FermiMin; 
         double CondDC_FermiMax; 
         int CondDC_NumFermi; 
         std::string CondDC_Name;
+        int CondDC_print_all;
+        int CondDC_thermo;
+        int CondDC_Extrapolate;
+        int CondDC_PredictionOrder;
         bool CondDC_Exclusive;
         bool CondDC_is_required;
 
@@ -35,6 +39,7 @@ class shell_input{
         double CondOpt_FreqMin; 
         double CondOpt_FreqMax; 
         int CondOpt_NumFreq; 
+        int CondOpt_MaxMemory;
         std::string CondOpt_Name;
         bool CondOpt_Exclusive;
         bool CondOpt_is_required;
@@ -47,6 +52,8 @@ class shell_input{
         double DOS_kernel_parameter;
         double DOS_Emin;
         double DOS_Emax;
+        int DOS_Extrapolate;
+        int DOS_PredictionOrder;
         std::string DOS_Name;
         bool DOS_Exclusive;
         bool DOS_is_required;
@@ -58,6 +65,8 @@ class shell_input{
         int lDOS_NumMoments;
         std::string lDOS_kernel;
         double lDOS_kernel_parameter;
+        int lDOS_Extrapolate;
+        int lDOS_PredictionOrder;
 
         // ARPES
         std::string ARPES_Name;
@@ -67,6 +76,8 @@ class shell_input{
         int ARPES_NumMoments;
         std::string ARPES_kernel;
         double ARPES_kernel_parameter;
+        int ARPES_Extrapolate;
+        int ARPES_PredictionOrder;
         double ARPES_Emin;
         double ARPES_Emax;
         double ARPES_NumEnergies;
@@ -90,6 +101,11 @@ class shell_input{
         double CondOpt2_ratio;
         int CondOpt2_print_all;
 
+        // Output of the results
+        std::string Output_Name;    // HDF5 file with the /Results group
+        bool Output_hdf5;           // write the results to Output_Name?
+        bool Output_text;           // write the results to .dat files?
+
         // Help menu
         bool help;
 
@@ -116,6 +132,7 @@ class shell_input{
         void parse_DOS(int argc, char *argv[]);
         void parse_lDOS(int argc, char *argv[]);
         void parse_ARPES(int argc, char *argv[]);
+        void parse_Output(int argc, char *argv[]);
         int get_num_exclusives();
 
 };
@@ -0,0 +1,31 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+class results_file{
+    // Writes the results of one of the quantities calculated by KITE-tools to the
+    // group /Results/<quantity> of an HDF5 file. The file is created if it does not
+    // exist. Otherwise, only the group of this quantity is replaced, so that the
+    // results of several quantities and several runs may share the same file.
+    // Each dataset has the same shape as the Eigen array it was written from.
+    // Complex numbers are stored with the same compound type ("r", "i") that KITEx uses.
+
+    H5::H5File file;
+    H5::Group group;
+
+    template <typename U>
+    void write_data(const std::string &, const U *, int, const hsize_t *, const std::string &);
+
+    public:
+    results_file(const std::string &, const std::string &);
+    ~results_file();
+
+    template <typename U>
+    void write(const std::string &, const Eigen::Array<U, Eigen::Dynamic, Eigen::Dynamic> &, const std::string &);
+    template <typename U>
+    void write_vector(const std::string &, const Eigen::Array<U, Eigen::Dynamic, 1> &, const std::string &);
+    void attribute(const std::string &, double);
+};
@@ -11,14 +11,17 @@
 #include <complex>
 #include <vector>
 #include <string>
+#include <future>
 #include <omp.h>
 
 #include <H5Cpp.h>
 #include "tools/ComplexTraits.hpp"
 #include "tools/myHDF5.hpp"
+#include "tools/gamma_reader.hpp"
 
 #include "tools/parse_input.hpp"
 #include "tools/systemInfo.hpp"
+#include "tools/extrapolate.hpp"
 #include "conddc/conductivity_dc.hpp"
 #include "tools/functions.hpp"
 
@@ -123,6 +126,11 @@ void conductivity_dc<T, DIM>::set_default_parameters(){
     NEnergies           = 513;              // Number of energies used in the energy integration
     default_NEnergies   = true;
 
+    PanelCols           = 256;              // Columns of Gamma read from the file at a time
+
+    Extrapolate         = -1;               // no extrapolation of Gamma
+    PredictionOrder     = -1;
+
     deltascat           = static_cast<T>(0.01/scale);       // scattering parameter in the delta function
     scat                = static_cast<T>(0.01/scale);       // scattering parameter of 10meV in
     default_scat        = true;             // the Green's functions in KPM reduced units
@@ -130,11 +138,16 @@ void conductivity_dc<T, DIM>::set_default_parameters(){
 
     filename            = "condDC.dat";     // Filename to save the final result
     default_filename    = true;
+    print_all           = true;             // one .dat file per temperature and broadening
+    thermoelectric      = false;            // L0, L1, L2, Seebeck and thermal conductivity
 
     // Temperature is in energy units, so it is actually kb*T, where kb is Boltzmann's constant
     temperature         = 0.001/scale;      
     beta                = static_cast<T>(1.0/temperature);
     default_temp        = true;
+
+    temperatures        = std::vector<double>{temperature};
+    scats               = std::vector<T>{scat};
 }
 
 template <typename T, unsigned DIM>
@@ -174,9 +187,12 @@ bool conductivity_dc<T, DIM>::fetch_parameters(){
   // Fetch the number of Chebyshev Moments
 	get_hdf5(&MaxMoments, &file, (char*)(dirName+"NumMoments").c_str());	
 
-  // Fetch the temperature from the .h5 file
+  // Fetch the temperatures from the .h5 file. There may be more than one.
   // The temperature (kb*T) is in energy units. It is already reduced by SCALE from within the python script
-	get_hdf5(&temperature, &file, (char*)(dirName+"Temperature").c_str());	
+  H5::DataSet tempSet = file.openDataSet(dirName+"Temperature");
+  temperatures = std::vector<double>(tempSet.getSpace().getSimpleExtentNpoints());
+  tempSet.read(temperatures.data(), H5::PredType::NATIVE_DOUBLE);
+  temperature = temperatures.at(0);
   beta = static_cast<T>(1.0/temperature);
   default_temp = false;
 
@@ -191,24 +207,16 @@ bool conductivity_dc<T, DIM>::fetch_parameters(){
   // Check whether the matrices we're going to retrieve are complex or not
   int complex = systemInfo.isComplex;
 
-  // Retrieve the Gamma Matrix
-  std::string MatrixName = dirName + "Gamma" + dirString;
+  // Check that the Gamma matrix is there. It is only read, in panels, when the
+  // conductivity is calculated, so that it never has to fit in memory as a whole
+  GammaName = dirName + "Gamma" + dirString;
   bool possible = false;
   try{
-    debug_message("Filling the Gamma matrix.\n");
-    Gamma = Eigen::Array<std::complex<T>,Eigen::Dynamic,Eigen::Dynamic>::Zero(NumMoments, NumMoments);
-  
-    if(complex)
-      get_hdf5(Gamma.data(), &file, (char*)MatrixName.c_str());
-    
-    if(!complex){
-      Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic> GammaReal;
-      GammaReal = Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic>::Zero(NumMoments, NumMoments);
-      get_hdf5(GammaReal.data(), &file, (char*)MatrixName.c_str());
-      
-      Gamma = GammaReal.template cast<std::complex<T>>();
-    }				
-
+    gamma_reader<T> reader(systemInfo.filename, GammaName, complex);
+    if(static_cast<int>(reader.rows) < MaxMoments || static_cast<int>(reader.cols) < MaxMoments){
+      std::cout << "The Gamma matrix in the file is smaller than NumMoments. Aborting.\n";
+      exit(1);
+    }
     possible = true;
   } catch(H5::Exception&) {
       debug_message("Conductivity DC: There is no Gamma matrix.\n");
@@ -229,8 +237,11 @@ void conductivity_dc<T, DIM>::override_parameters(){
     double scale = systemInfo.energy_scale;
     double shift = systemInfo.energy_shift;
 
-    if(variables.CondDC_Temp != -1){
-        temperature     = variables.CondDC_Temp/scale;
+    if(!variables.CondDC_Temp.empty()){
+        temperatures.clear();
+        for(double t: variables.CondDC_Temp)
+            temperatures.push_back(t/scale);
+        temperature     = temperatures.at(0);
         beta            = static_cast<T>(1.0/temperature);
         default_temp    = false;
     }
@@ -271,8 +282,11 @@ void conductivity_dc<T, DIM>::override_parameters(){
     }
 
 
-    if(variables.CondDC_Scat != -8888){
-        scat            = static_cast<T>(variables.CondDC_Scat/scale);
+    if(!variables.CondDC_Scat.empty()){
+        scats.clear();
+        for(double sc: variables.CondDC_Scat)
+            scats.push_back(static_cast<T>(sc/scale));
+        scat            = scats.at(0);
         default_scat    = false;
     }
 
@@ -303,20 +317,30 @@ void conductivity_dc<T, DIM>::override_parameters(){
         filename            = variables.CondDC_Name;
         default_filename    = false;
     }
+
+    if(variables.CondDC_print_all != -1)
+        print_all = variables.CondDC_print_all;
+
+    if(variables.CondDC_thermo != -1)
+        thermoelectric = variables.CondDC_thermo;
+
+    if(variables.CondDC_Extrapolate != -1){
+        Extrapolate     = variables.CondDC_Extrapolate;
+        PredictionOrder = variables.CondDC_PredictionOrder;
+        if(Extrapolate <= NumMoments){
+          std::cout << "The number of extrapolated moments has to be larger than"
+            " the number of moments used (" << NumMoments << "). Aborting.\n";
+          exit(1);
+        }
+    }
+
+    for(double t: temperatures){
+        if(t <= 0){
+          std::cout << "The temperature has to be positive. Aborting.\n";
+          exit(1);
+        }
+    }
     
-  debug_message("Padding Gamma");
-  //int N_threads = systemInfo.NumThreads;
-  int rest = NumMoments % NumThreads;
-  Moments_D = NumMoments - rest + (rest != 0)*NumThreads;
-  Moments_G = NumMoments;
-  //std::cout << "rest: " << rest << "\n";
-  //std::cout << "N_threads: " << N_threads << "\n";
-  //std::cout << "D: " << Moments_D << "G: " << Moments_G << "\n";
-
-  Gamma_Padded = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(Moments_D, Moments_G);
-  Gamma_Padded.block(0,0,NumMoments, NumMoments) = Gamma.block(0,0,NumMoments, NumMoments);
-
-  //std::cout << "Gamma_Padded: " << Gamma_Padded << "\n";
 }
 
 
@@ -326,11 +350,15 @@ void conductivity_dc<T, DIM>::printDC(){
     double shift = systemInfo.energy_shift;
     std::string energy_range = "[" + std::to_string(minEnergy*scale + shift) + ", " + std::to_string(maxEnergy*scale + shift) + "]";
 
+    std::string temp_list, scat_list;
+    for(double t: temperatures) temp_list += " " + std::to_string(t*scale);
+    for(T sc: scats)            scat_list += " " + std::to_string(sc*scale);
+
     // Prints all the information about the parameters
     std::cout << "The DC conductivity will be calculated with these parameters: (eV, Kelvin)\n"
-        "   Temperature: "             << temperature*scale             << ((default_temp)?         " (default)":"") << "\n"
-        "   Broadening: "              << scat*scale                    << ((default_scat)?         " (default)":"") << "\n"
-        "   Delta broadening: "        << deltascat*scale               << ((default_deltascat)?    " (default)":"") << "\n"
+        "   Temperature:"              << temp_list                     << ((default_temp)?         " (default)":"") << "\n"
+        "   Broadening:"               << scat_list                     << ((default_scat)?         " (default)":"") << "\n"
+        "   Delta broadening: "        << ((default_deltascat)? std::string("same as broadening") : std::to_string(deltascat*scale)) << "\n"
         "   Max Fermi energy: "        << maxFermiEnergy*scale + shift  << ((default_MFermi)?       " (default)":"") << "\n"
         "   Min Fermi energy: "        << minFermiEnergy*scale + shift  << ((default_mFermi)?       " (default)":"") << "\n"
         "   Number Fermi energies: "   << NFermiEnergies                << ((default_NFermi)?       " (default)":"") << "\n"
@@ -338,11 +366,76 @@ void conductivity_dc<T, DIM>::printDC(){
         "   Integration range: "       << energy_range                  << ((default_energy_limits)?" (default)":" (Estimated from DoS)") << "\n"
         "   Num integration points: "  << NEnergies                     << ((default_NEnergies)?    " (default)":"") << "\n"
         "   Num Chebychev moments: "   << NumMoments                    << ((default_NumMoments)?   " (default)":"") << "\n"
-        "   Num threads: "             << NumThreads                    << ((default_NumThreads)?   " (default)":"") << "\n"; 
+        "   Num threads: "             << NumThreads                    << ((default_NumThreads)?   " (default)":"") << "\n"
+        "   Thermoelectric: "          << ((thermoelectric)? "yes" : "no") << "\n";
+    if(Extrapolate > 0)
+        std::cout << "   Extrapolated moments: " << Extrapolate << "\n";
 }
 
 
 
+template <typename T, unsigned DIM>
+void conductivity_dc<T, DIM>::contract(Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>& condDC,
+  std::vector<Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>>& onsager){
+  // Conductivity (and thermoelectric coefficients, if onsager is not empty) for every
+  // broadening and temperature, with the current NumMoments
+
+  int NTemps = static_cast<int>(temperatures.size());
+  int NScats  = static_cast<int>(scats.size());
+  T den = static_cast<T>(systemInfo.num_orbitals*systemInfo.spin_degeneracy/systemInfo.unit_cell_area/units);
+
+  // Imaginary part of the Green's function: Dirac delta (greenR)
+  // Derivative of the Green's function: dgreenR
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor> greenR;
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> dgreenR;
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> GammaE;
+
+  for(int s = 0; s < NScats; s++){
+    scat = scats.at(s);
+    if(default_deltascat)
+      deltascat = scat;
+
+    // Fill the matrices that are going to be used in the multiplication
+    // This is an operation of order ~ (NG + ND) * NE
+    // and uses (ND + NG) * NE memory (complex U)
+    if(s == 0 || default_deltascat)
+      greenR  = fill_delta();
+    dgreenR = fill_dgreenR();
+
+
+    // Product of all the matrices:
+    // dgreenR * Gamma * greenR
+    // This is an operation of order N^2 * NE. Gamma is read from the file in panels of
+    // PanelCols columns while the previous panel is being contracted, so it uses
+    // 2 * N * PanelCols   +   NE * PanelCols  on top of the shared tables
+    // It does not depend on the temperature, so it is done once per broadening
+    GammaE = triple_product(greenR, dgreenR);
+
+
+    // integrate over the whole energy range for each Fermi energy
+    // This is only an operation of order NE * NFermi for each temperature
+    for(int t = 0; t < NTemps; t++){
+      beta = static_cast<T>(1.0/temperatures.at(t));
+      condDC.col(s*NTemps + t) = calc_cond(GammaE)*den;
+
+      // The thermoelectric coefficients reuse GammaE with the weights of their Fermi windows
+      for(unsigned k = 0; k < onsager.size(); k++)
+        onsager.at(k).col(s*NTemps + t) = thermo_weights(beta, k).transpose().template cast<std::complex<T>>()*GammaE.col(0)*den;
+    }
+  }
+}
+
+template <typename T, unsigned DIM>
+void conductivity_dc<T, DIM>::extrapolate_gamma_matrix(){
+  // Reads the whole Gamma matrix and extends it along both indices up to Extrapolate moments.
+  // From then on, triple_product uses the matrix in memory instead of the file
+  gamma_reader<T> reader(systemInfo.filename, GammaName, systemInfo.isComplex);
+  GammaMatrix = reader.read(0, NumMoments, 0, NumMoments).matrix();
+  GammaMatrix = extrapolate_gamma<T>(GammaMatrix, Extrapolate, PredictionOrder, NumThreads, extrapolation);
+  NumMoments = Extrapolate;
+  extrapolation.print();
+}
+
 template <typename T, unsigned DIM>
 void conductivity_dc<T, DIM>::calculate2(){
 
@@ -354,33 +447,58 @@ void conductivity_dc<T, DIM>::calculate2(){
     fermiEnergies = Eigen::Matrix<T, Eigen::Dynamic, 1>::LinSpaced(NFermiEnergies, minFermiEnergy, static_cast<T>(maxFermiEnergy));
 
 
-  // Imaginary part of the Green's function: Dirac delta (greenR)
-  // Derivative of the Green's function: dgreenR
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor> greenR;
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> dgreenR;
+  int NTemps = static_cast<int>(temperatures.size());
+  int NScats  = static_cast<int>(scats.size());
 
-  // Fill the matrices that are going to be used in the multiplication
-  // This is an operation of order ~ (NG + ND) * NE
-  // and uses (ND + NG) * NE memory (complex U)
-  greenR  = fill_delta();
-  dgreenR = fill_dgreenR();
+  // One column per (broadening, temperature) pair, the temperature running fastest
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> condDC;
+  condDC = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NFermiEnergies, NTemps*NScats);
 
+  // Thermoelectric coefficients L0, L1 and L2, with the same layout
+  std::vector<Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>> onsager;
+  if(thermoelectric)
+    onsager.assign(3, Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NFermiEnergies, NTemps*NScats));
 
-  // Product of all the matrices:
-  // dgreenR * Gamma_Padded * greenR
-  // This is an operation of order N^2 * NE and is parallelized
-  // It uses T * NG * NE   +  NE * ND   +   2 * NE
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> GammaE;
-  GammaE = triple_product(greenR, dgreenR);
+  // With extrapolation, the conductivity from the moments calculated by KITEx
+  // is kept to compare it with the extrapolated one
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> reference;
+  if(Extrapolate > 0){
+    std::vector<Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>> none;
+    reference = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NFermiEnergies, NTemps*NScats);
+    contract(reference, none);
+    extrapolate_gamma_matrix();
+  }
 
+  contract(condDC, onsager);
 
-  // integrate over the whole energy range for each Fermi energy
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> condDC;
-  T den = static_cast<T>(systemInfo.num_orbitals*systemInfo.spin_degeneracy/systemInfo.unit_cell_area/units);
-  condDC = calc_cond(GammaE)*den;
+  if(Extrapolate > 0)
+    std::cout << "   Relative difference with the conductivity without extrapolation: "
+      << (condDC.real() - reference.real()).norm()/reference.real().norm() << "\n";
 
   // save to a file
-  save_to_file(condDC);
+  if(variables.Output_hdf5)
+    save_to_hdf5(condDC, onsager, reference);
+
+  if(!variables.Output_text)
+    return;
+
+  std::string stem = filename.substr(0, filename.find_last_of('.'));
+  if(NTemps*NScats == 1){
+    save_to_file(condDC);
+    if(thermoelectric)
+      save_thermo_to_file(onsager, 0, stem + "_thermo.dat");
+    return;
+  }
+
+  if(print_all){
+    for(int s = 0; s < NScats; s++)
+      for(int t = 0; t < NTemps; t++){
+        std::string suffix = "_T" + std::to_string(t) + "_S" + std::to_string(s);
+        save_to_file(condDC.col(s*NTemps + t), stem + suffix + ".dat");
+        if(thermoelectric)
+          save_thermo_to_file(onsager, s*NTemps + t, stem + suffix + "_thermo.dat");
+      }
+  }
 }
 
 
@@ -466,4 +584,24 @@ template void conductivity_dc<double, 3u>::calculate2();
 template void conductivity_dc<long double, 1u>::calculate2();
 template void conductivity_dc<long double, 2u>::calculate2();
 template void conductivity_dc<long double, 3u>::calculate2();
+
+template void conductivity_dc<float, 1u>::contract(Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>&, std::vector<Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>>&);
+template void conductivity_dc<float, 2u>::contract(Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>&, std::vector<Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>>&);
+template void conductivity_dc<float, 3u>::contract(Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>&, std::vector<Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>>&);
+template void conductivity_dc<double, 1u>::contract(Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>&, std::vector<Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>>&);
+template void conductivity_dc<double, 2u>::contract(Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>&, std::vector<Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>>&);
+template void conductivity_dc<double, 3u>::contract(Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>&, std::vector<Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>>&);
+template void conductivity_dc<long double, 1u>::contract(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>&, std::vector<Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>>&);
+template void conductivity_dc<long double, 2u>::contract(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>&, std::vector<Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>>&);
+template void conductivity_dc<long double, 3u>::contract(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>&, std::vector<Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>>&);
+
+template void conductivity_dc<float, 1u>::extrapolate_gamma_matrix();
+template void conductivity_dc<float, 2u>::extrapolate_gamma_matrix();
+template void conductivity_dc<float, 3u>::extrapolate_gamma_matrix();
+template void conductivity_dc<double, 1u>::extrapolate_gamma_matrix();
+template void conductivity_dc<double, 2u>::extrapolate_gamma_matrix();
+template void conductivity_dc<double, 3u>::extrapolate_gamma_matrix();
+template void conductivity_dc<long double, 1u>::extrapolate_gamma_matrix();
+template void conductivity_dc<long double, 2u>::extrapolate_gamma_matrix();
+template void conductivity_dc<long double, 3u>::extrapolate_gamma_matrix();
 #endif
\ No newline at end of file
@@ -10,12 +10,20 @@
 #include <complex>
 #include <H5Cpp.h>
 #include <vector>
+#include <string>
+#include <future>
+#include "tools/ComplexTraits.hpp"
+#include "tools/myHDF5.hpp"
+#include "tools/gamma_reader.hpp"
+#include "tools/results.hpp"
 #include "tools/parse_input.hpp"
 #include "tools/systemInfo.hpp"
+#include "tools/extrapolate.hpp"
 #include "conddc/conductivity_dc.hpp"
 #include "tools/functions.hpp"
 #include <fstream>
 #include <cmath>
+#include <algorithm>
 #include <omp.h>
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -25,14 +33,14 @@ template <typename T, unsigned DIM>
 Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor> conductivity_dc<T, DIM>::fill_delta(){
 
   Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor> greenR;
-  greenR = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(Moments_G, NEnergies);
+  greenR = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NumMoments, NEnergies);
 
   // Imaginary part of the Green's function: Dirac delta
   T factor;
   std::complex<T> complexEnergy;
   for(int i = 0; i < NEnergies; i++){
     complexEnergy = std::complex<T>(energies(i), deltascat);
-    for(int m = 0; m < Moments_G; m++){
+    for(int m = 0; m < NumMoments; m++){
       factor = static_cast<T>(-1.0/(1.0 + static_cast<T>(m==0))/M_PI);
       greenR(m, i) = green(m, 1, complexEnergy).imag()*factor;
     }
@@ -45,12 +53,12 @@ Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
   std::complex<T> complexEnergyP;
 
   Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> dgreenR;
-  dgreenR = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NEnergies, Moments_D);
+  dgreenR = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NEnergies, NumMoments);
 
   T factor;
   for(int i = 0; i < NEnergies; i++){
     complexEnergyP = std::complex<T>(energies(i), scat);
-    for(int m = 0; m < Moments_D; m++){
+    for(int m = 0; m < NumMoments; m++){
       factor = static_cast<T>(1.0/(1.0 + static_cast<T>(m==0)));
       dgreenR(i, m) = dgreen<T>(m,  1, complexEnergyP)*factor;
     }
@@ -61,68 +69,157 @@ Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
 
 template <typename T, unsigned DIM>
 Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<T, DIM>::triple_product(
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor> greenR,
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> dgreenR){
+  const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>& greenR,
+  const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>& dgreenR){
+
+  // The contraction dgreenR * Gamma * greenR is done in column panels of Gamma,
+  // which are read from the file one at a time: while a panel is being
+  // contracted, the next one is already being read in the background. Each
+  // panel is multiplied by the shared dgreenR table (GEMM) and only the diagonal
+  // in energy is kept after contracting with the matching rows of greenR.
+  // The whole Gamma matrix is never in memory, only two panels of it, unless it
+  // has been extrapolated: then the panels are taken from GammaMatrix instead.
 
   // GammaE has NE elements
   Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> GammaE;
   GammaE = Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NEnergies, 1);
 
-  omp_set_num_threads(NumThreads);
-#pragma omp parallel firstprivate(greenR)
-  {
+  int panel = std::max(1, std::min(PanelCols, NumMoments));
+  int NumPanels = (NumMoments + panel - 1)/panel;
 
-#pragma omp for schedule(static, 1) nowait
-    for(int thread = 0; thread < NumThreads; thread++){
-      int localMoments = Moments_D/NumThreads;
+  // A column of Gamma is a row of the dataset in the file
+  bool in_memory = GammaMatrix.size() > 0;
+  gamma_reader<T> reader(systemInfo.filename, GammaName, systemInfo.isComplex);
+  if(!in_memory)
+    reader.prefetch(0, panel, 0, NumMoments);
 
-      Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> LocalGamma;
-      Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> local_dgreenR;
-      Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor> GammaEN;
-      Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> LocalGammaE;
+  Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> GammaPanel;
+  omp_set_num_threads(NumThreads);
+  for(int p = 0; p < NumPanels; p++){
+    int col0 = p*panel;
+    int cols = std::min(panel, NumMoments - col0);
+
+    if(in_memory)
+      GammaPanel = GammaMatrix.block(0, col0, NumMoments, cols).array();
+    else {
+      GammaPanel = reader.fetch();
+      if(p + 1 < NumPanels)
+        reader.prefetch(col0 + cols, std::min(panel, NumMoments - col0 - cols), 0, NumMoments);
+    }
 
-      LocalGamma = Gamma_Padded.matrix().block(thread*localMoments, 0, localMoments, Moments_G);
-      local_dgreenR = dgreenR.matrix().block(0, thread*localMoments, NEnergies, localMoments);
+    // The columns of the panel are divided among the threads
+#pragma omp parallel
+    {
+      int NThreads = omp_get_num_threads();
+      int width = (cols + NThreads - 1)/NThreads;
 
-      // GammaEN has NE * ND/T elements
-      GammaEN = LocalGamma*greenR;
+      Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor> GammaEN;
+      Eigen::Array<T, Eigen::Dynamic, 1> LocalGammaE;
+      LocalGammaE = Eigen::Array<T, Eigen::Dynamic, 1>::Zero(NEnergies);
 
-      // LocalGammaE has NE elements
-      LocalGammaE = Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NEnergies, 1);
-      for(int i = 0; i < NEnergies; i++)
-        LocalGammaE(i) = std::complex<T>(local_dgreenR.row(i)*GammaEN.col(i));
+#pragma omp for schedule(static, 1) nowait
+      for(int t = 0; t < NThreads; t++){
+        int c0 = t*width;
+        int w = std::min(width, cols - c0);
+        if(w > 0){
+          // GammaEN has NE * width elements
+          GammaEN.noalias() = dgreenR*GammaPanel.matrix().block(0, c0, NumMoments, w);
+
+          // diagonal of GammaEN * greenR.block
+          LocalGammaE += (GammaEN.array()*greenR.block(col0 + c0, 0, w, NEnergies).transpose().array()).rowwise().sum().imag();
+        }
+      }
 
 #pragma omp critical
       {
-      GammaE += 2*LocalGammaE.imag();
+        GammaE += 2*LocalGammaE.template cast<std::complex<T>>();
       }
     }
-#pragma omp barrier
   }
   return GammaE;
 
 }
 
+template <typename U, unsigned DIM>
+Eigen::Matrix<U, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<U, DIM>::fermi_weights(U beta1){
+  // Integration weights of the energy integral for every Fermi energy:
+  // W(j, i) = simpson(j) * f(E_j, mu_i). With these, the integration over
+  // energies for all the Fermi energies is a single matrix product with GammaE.
 
+  Eigen::Matrix<U, Eigen::Dynamic, Eigen::Dynamic> weights;
+  weights = Eigen::Matrix<U, Eigen::Dynamic, Eigen::Dynamic>::Zero(NEnergies, NFermiEnergies);
 
-template <typename U, unsigned DIM>
-Eigen::Matrix<std::complex<U>, Eigen::Dynamic, 1> conductivity_dc<U, DIM>::calc_cond(Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> GammaE){
+  // Simpson 1/3 weights, the same as the ones used in 'integrate'
+  Eigen::Matrix<U, Eigen::Dynamic, 1> simpson = simpson_weights<U>(NEnergies, energies(1) - energies(0));
 
-  Eigen::Matrix<std::complex<U>, Eigen::Dynamic, 1> condDC;
-  Eigen::Matrix<std::complex<U>, Eigen::Dynamic, 1> integrand;
+  for(int i = 0; i < NFermiEnergies; i++)
+    for(int j = 0; j < NEnergies; j++)
+      weights(j, i) = simpson(j)*fermi_function(energies(j), fermiEnergies(i), beta1);
 
+  return weights;
+}
 
-  condDC = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, 1>::Zero(NFermiEnergies, 1);
-  integrand = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, 1>::Zero(NEnergies, 1);
+template <typename U, unsigned DIM>
+Eigen::Matrix<U, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<U, DIM>::thermo_weights(U beta1, int order){
+  // Integration weights of the thermoelectric coefficients
+  //
+  //   L_k(mu) = int dE (-df/dE) (E - mu)^k sigma(E) = int dE g_k(E, mu) GammaE(E)
+  //
+  // where sigma(E) = int_{-inf}^{E} GammaE is the conductivity at zero temperature and
+  // g_k(E, mu) = beta^(-k) fermi_tail(k, beta(E - mu)), so that L_0 is the conductivity.
+  // g_1 and g_2 are peaked within a few kT of mu, which the energy grid does not resolve
+  // at low temperatures. So GammaE is interpolated with the same parabolas as the Simpson
+  // rule and g_k is integrated exactly against them, with Gauss-Legendre quadrature on
+  // intervals shorter than kT. Far from mu, g_k is constant over the Simpson panel.
+
+  Eigen::Matrix<U, Eigen::Dynamic, Eigen::Dynamic> weights;
+  weights = Eigen::Matrix<U, Eigen::Dynamic, Eigen::Dynamic>::Zero(NEnergies, NFermiEnergies);
+
+  const U nodes[]   = {U(-0.9602898564975363), U(-0.7966664774136267), U(-0.5255324099163290), U(-0.1834346424956498),
+                       U( 0.1834346424956498), U( 0.5255324099163290), U( 0.7966664774136267), U( 0.9602898564975363)};
+  const U gweights[] = {U(0.1012285362903763), U(0.2223810344533745), U(0.3137066458778873), U(0.3626837833783620),
+                        U(0.3626837833783620), U(0.3137066458778873), U(0.2223810344533745), U(0.1012285362903763)};
+
+  U dE = energies(1) - energies(0);
+  int NPanels = (NEnergies - 1)/2;
+  int NSub = std::max(1, static_cast<int>(std::ceil(2*dE*beta1)));
+  U kT = std::pow(U(1.0)/beta1, order);
 
-  U fermi;
+  omp_set_num_threads(NumThreads);
+#pragma omp parallel for
   for(int i = 0; i < NFermiEnergies; i++){
-    fermi = fermiEnergies(i);
-    for(int j = 0; j < NEnergies; j++){
-      integrand(j) = GammaE(j)*fermi_function(energies(j), fermi, beta);
+    for(int p = 0; p < NPanels; p++){
+      U E0 = energies(2*p);
+      U x0 = beta1*(E0 - fermiEnergies(i));
+      U x1 = beta1*(E0 + 2*dE - fermiEnergies(i));
+      if(x0 > U(40.0) || x1 < U(-40.0)){
+        U g = kT*fermi_tail(order, x0);
+        weights(2*p, i)     += g*dE/U(3.0);
+        weights(2*p + 1, i) += g*dE*U(4.0)/U(3.0);
+        weights(2*p + 2, i) += g*dE/U(3.0);
+        continue;
+      }
+      // u runs from 0 to 2 along the panel, in units of dE
+      U du = U(2.0)/U(NSub);
+      for(int sub = 0; sub < NSub; sub++)
+        for(int q = 0; q < 8; q++){
+          U u = du*(U(sub) + (nodes[q] + U(1.0))/U(2.0));
+          U g = kT*fermi_tail(order, beta1*(E0 + u*dE - fermiEnergies(i)))*gweights[q]*du/U(2.0)*dE;
+          weights(2*p, i)     += g*(u - U(1.0))*(u - U(2.0))/U(2.0);
+          weights(2*p + 1, i) += g*u*(U(2.0) - u);
+          weights(2*p + 2, i) += g*u*(u - U(1.0))/U(2.0);
+        }
     }
-    condDC(i) = integrate(energies, integrand);
   }
+  return weights;
+}
+
+template <typename U, unsigned DIM>
+Eigen::Matrix<std::complex<U>, Eigen::Dynamic, 1> conductivity_dc<U, DIM>::calc_cond(const Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic>& GammaE){
+
+  // integrate over the whole energy range for each Fermi energy
+  Eigen::Matrix<std::complex<U>, Eigen::Dynamic, 1> condDC;
+  condDC = fermi_weights(beta).transpose().template cast<std::complex<U>>()*GammaE.col(0);
 
   return condDC;
 }
@@ -131,11 +228,16 @@ Eigen::Matrix<std::complex<U>, Eigen::Dynamic, 1> conductivity_dc<U, DIM>::calc_
 
 template <typename U, unsigned DIM>
 void conductivity_dc<U, DIM>::save_to_file(Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> condDC){
+  save_to_file(condDC, filename);
+}
+
+template <typename U, unsigned DIM>
+void conductivity_dc<U, DIM>::save_to_file(Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> condDC, std::string name){
 
   std::complex<U> cond;
   U energy;
   std::ofstream myfile;
-  myfile.open(filename);
+  myfile.open(name);
   for(int i=0; i < NFermiEnergies; i++){
     energy = static_cast<U>(fermiEnergies(i) * systemInfo.energy_scale + systemInfo.energy_shift);
     cond = condDC(i);
@@ -147,6 +249,85 @@ void conductivity_dc<U, DIM>::save_to_file(Eigen::Matrix<std::complex<U>, Eigen:
 
 }
 
+template <typename U, unsigned DIM>
+void conductivity_dc<U, DIM>::save_thermo_to_file(
+  const std::vector<Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic>>& onsager, int col, std::string name){
+  // Fermi energy, L0, L1 (eV), L2 (eV^2), Seebeck coefficient (kB/e) and thermal conductivity
+  // (kB^2 T/e^2 times the units of the conductivity). Only the real parts are written
+
+  double scale = systemInfo.energy_scale;
+  double kT = temperatures.at(col%temperatures.size());
+  std::ofstream myfile;
+  myfile.open(name);
+  for(int i=0; i < NFermiEnergies; i++){
+    double L0 = static_cast<double>(onsager.at(0)(i, col).real());
+    double L1 = static_cast<double>(onsager.at(1)(i, col).real());
+    double L2 = static_cast<double>(onsager.at(2)(i, col).real());
+    myfile  << static_cast<double>(fermiEnergies(i))*scale + systemInfo.energy_shift << " "
+            << L0 << " " << L1*scale << " " << L2*scale*scale << " "
+            << -L1/(kT*L0) << " " << (L2 - L1*L1/L0)/(kT*kT) << "\n";
+  }
+  myfile.close();
+}
+
+template <typename U, unsigned DIM>
+void conductivity_dc<U, DIM>::save_to_hdf5(const Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic>& condDC,
+  const std::vector<Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic>>& onsager,
+  const Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic>& reference){
+  // Saves the conductivity for all the temperatures and broadenings to the
+  // /Results/CondDC group of the results file. Each row of 'Conductivity' is the
+  // conductivity as a function of the Fermi energy for the temperature and
+  // broadening in the same row of 'Temperature' and 'Broadening'. Everything is in eV.
+  // The thermoelectric coefficients, when requested, have the same layout, and so does
+  // the conductivity without extrapolation when Gamma has been extrapolated
+
+  double scale = systemInfo.energy_scale;
+  double shift = systemInfo.energy_shift;
+  int NTemps = static_cast<int>(temperatures.size());
+  int NCols  = static_cast<int>(condDC.cols());
+
+  Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> energy, temp, broad;
+  energy = fermiEnergies.template cast<double>().array()*scale + shift;
+  temp   = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(NCols, 1);
+  broad  = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(NCols, 1);
+  for(int i = 0; i < NCols; i++){
+    temp(i)  = temperatures.at(i%NTemps)*scale;
+    broad(i) = static_cast<double>(scats.at(i/NTemps))*scale;
+  }
+
+  results_file results(variables.Output_Name, "CondDC");
+  results.write_vector<double>("FermiEnergies", energy, "Fermi energies (eV)");
+  results.write_vector<double>("Temperature", temp, "Temperature (eV) of each row of Conductivity");
+  results.write_vector<double>("Broadening", broad, "Broadening (eV) of each row of Conductivity");
+  results.write<std::complex<double>>("Conductivity", condDC.transpose().template cast<std::complex<double>>().array(),
+      "DC conductivity (e^2/h), one row per temperature and broadening");
+
+  if(reference.size() > 0){
+    results.write<std::complex<double>>("ConductivityWithoutExtrapolation",
+        reference.transpose().template cast<std::complex<double>>().array(),
+        "DC conductivity (e^2/h) from the moments calculated by KITEx, one row per temperature and broadening");
+    results.attribute("RelativeDifference", static_cast<double>((condDC.real() - reference.real()).norm()/reference.real().norm()));
+    extrapolation.save(results);
+  }
+
+  if(onsager.empty())
+    return;
+
+  Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> L0, L1, L2, kT;
+  L0 = onsager.at(0).transpose().real().template cast<double>().array();
+  L1 = onsager.at(1).transpose().real().template cast<double>().array();
+  L2 = onsager.at(2).transpose().real().template cast<double>().array();
+  kT = (temp/scale).replicate(1, NFermiEnergies);
+  for(int k = 0; k < 3; k++)
+    results.write<std::complex<double>>("L" + std::to_string(k),
+        (onsager.at(k).transpose().template cast<std::complex<double>>()*std::pow(scale, k)).array(),
+        "Thermoelectric coefficient L" + std::to_string(k) + " (conductivity times eV^" + std::to_string(k) +
+        "), one row per temperature and broadening");
+  results.write<double>("Seebeck", -L1/(kT*L0), "Seebeck coefficient (kB/e), one row per temperature and broadening");
+  results.write<double>("ThermalConductivity", (L2 - L1*L1/L0)/(kT*kT),
+      "Electronic thermal conductivity (kB^2 T/e^2 times the units of the conductivity), one row per temperature and broadening");
+}
+
 template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor> conductivity_dc<float, 1u>::fill_delta();
 template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor> conductivity_dc<float, 2u>::fill_delta();
 template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor> conductivity_dc<float, 3u>::fill_delta();
@@ -179,32 +360,56 @@ template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic
 
 
 
-template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<float, 1u>::triple_product(Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>, Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>);
-template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<float, 2u>::triple_product(Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>, Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>);
-template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<float, 3u>::triple_product(Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>, Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>);
+template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<float, 1u>::triple_product(const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>&, const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>&);
+template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<float, 2u>::triple_product(const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>&, const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>&);
+template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<float, 3u>::triple_product(const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>&, const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>&);
+
+template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<double, 1u>::triple_product(const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>&, const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>&);
+template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<double, 2u>::triple_product(const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>&, const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>&);
+template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<double, 3u>::triple_product(const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>&, const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>&);
+
+template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<long double, 1u>::triple_product(const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>&, const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>&);
+template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<long double, 2u>::triple_product(const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>&, const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>&);
+template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<long double, 3u>::triple_product(const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>&, const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>&);
+
 
-template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<double, 1u>::triple_product(Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>, Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>);
-template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<double, 2u>::triple_product(Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>, Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>);
-template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<double, 3u>::triple_product(Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>, Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>);
 
-template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<long double, 1u>::triple_product(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>, Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>);
-template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<long double, 2u>::triple_product(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>, Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>);
-template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<long double, 3u>::triple_product(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>, Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>);
 
+template Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<float, 1u>::fermi_weights(float);
+template Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<float, 2u>::fermi_weights(float);
+template Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<float, 3u>::fermi_weights(float);
 
+template Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<double, 1u>::fermi_weights(double);
+template Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<double, 2u>::fermi_weights(double);
+template Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<double, 3u>::fermi_weights(double);
 
+template Eigen::Matrix<long double, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<long double, 1u>::fermi_weights(long double);
+template Eigen::Matrix<long double, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<long double, 2u>::fermi_weights(long double);
+template Eigen::Matrix<long double, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<long double, 3u>::fermi_weights(long double);
 
-template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, 1> conductivity_dc<float, 1u>::calc_cond(Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>);
-template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, 1> conductivity_dc<float, 2u>::calc_cond(Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>);
-template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, 1> conductivity_dc<float, 3u>::calc_cond(Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>);
+template Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<float, 1u>::thermo_weights(float, int);
+template Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<float, 2u>::thermo_weights(float, int);
+template Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<float, 3u>::thermo_weights(float, int);
 
-template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, 1> conductivity_dc<double, 1u>::calc_cond(Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>);
-template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, 1> conductivity_dc<double, 2u>::calc_cond(Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>);
-template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, 1> conductivity_dc<double, 3u>::calc_cond(Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>);
+template Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<double, 1u>::thermo_weights(double, int);
+template Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<double, 2u>::thermo_weights(double, int);
+template Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<double, 3u>::thermo_weights(double, int);
 
-template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, 1> conductivity_dc<long double, 1u>::calc_cond(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>);
-template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, 1> conductivity_dc<long double, 2u>::calc_cond(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>);
-template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, 1> conductivity_dc<long double, 3u>::calc_cond(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>);
+template Eigen::Matrix<long double, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<long double, 1u>::thermo_weights(long double, int);
+template Eigen::Matrix<long double, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<long double, 2u>::thermo_weights(long double, int);
+template Eigen::Matrix<long double, Eigen::Dynamic, Eigen::Dynamic> conductivity_dc<long double, 3u>::thermo_weights(long double, int);
+
+template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, 1> conductivity_dc<float, 1u>::calc_cond(const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>&);
+template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, 1> conductivity_dc<float, 2u>::calc_cond(const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>&);
+template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, 1> conductivity_dc<float, 3u>::calc_cond(const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>&);
+
+template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, 1> conductivity_dc<double, 1u>::calc_cond(const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>&);
+template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, 1> conductivity_dc<double, 2u>::calc_cond(const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>&);
+template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, 1> conductivity_dc<double, 3u>::calc_cond(const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>&);
+
+template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, 1> conductivity_dc<long double, 1u>::calc_cond(const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>&);
+template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, 1> conductivity_dc<long double, 2u>::calc_cond(const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>&);
+template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, 1> conductivity_dc<long double, 3u>::calc_cond(const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>&);
 
 
 
@@ -219,3 +424,41 @@ template void conductivity_dc<double, 3u>::save_to_file(Eigen::Matrix<std::compl
 template void conductivity_dc<long double, 1u>::save_to_file(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>);
 template void conductivity_dc<long double, 2u>::save_to_file(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>);
 template void conductivity_dc<long double, 3u>::save_to_file(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>);
+
+template void conductivity_dc<float, 1u>::save_to_file(Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>, std::string);
+template void conductivity_dc<float, 2u>::save_to_file(Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>, std::string);
+template void conductivity_dc<float, 3u>::save_to_file(Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>, std::string);
+
+template void conductivity_dc<double, 1u>::save_to_file(Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>, std::string);
+template void conductivity_dc<double, 2u>::save_to_file(Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>, std::string);
+template void conductivity_dc<double, 3u>::save_to_file(Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>, std::string);
+
+template void conductivity_dc<long double, 1u>::save_to_file(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>, std::string);
+template void conductivity_dc<long double, 2u>::save_to_file(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>, std::string);
+template void conductivity_dc<long double, 3u>::save_to_file(Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>, std::string);
+
+
+template void conductivity_dc<float, 1u>::save_thermo_to_file(const std::vector<Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>>&, int, std::string);
+template void conductivity_dc<float, 2u>::save_thermo_to_file(const std::vector<Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>>&, int, std::string);
+template void conductivity_dc<float, 3u>::save_thermo_to_file(const std::vector<Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>>&, int, std::string);
+
+template void conductivity_dc<double, 1u>::save_thermo_to_file(const std::vector<Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>>&, int, std::string);
+template void conductivity_dc<double, 2u>::save_thermo_to_file(const std::vector<Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>>&, int, std::string);
+template void conductivity_dc<double, 3u>::save_thermo_to_file(const std::vector<Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>>&, int, std::string);
+
+template void conductivity_dc<long double, 1u>::save_thermo_to_file(const std::vector<Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>>&, int, std::string);
+template void conductivity_dc<long double, 2u>::save_thermo_to_file(const std::vector<Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>>&, int, std::string);
+template void conductivity_dc<long double, 3u>::save_thermo_to_file(const std::vector<Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>>&, int, std::string);
+
+
+template void conductivity_dc<float, 1u>::save_to_hdf5(const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>&, const std::vector<Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>>&, const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>&);
+template void conductivity_dc<float, 2u>::save_to_hdf5(const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>&, const std::vector<Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>>&, const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>&);
+template void conductivity_dc<float, 3u>::save_to_hdf5(const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>&, const std::vector<Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>>&, const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic>&);
+
+template void conductivity_dc<double, 1u>::save_to_hdf5(const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>&, const std::vector<Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>>&, const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>&);
+template void conductivity_dc<double, 2u>::save_to_hdf5(const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>&, const std::vector<Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>>&, const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>&);
+template void conductivity_dc<double, 3u>::save_to_hdf5(const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>&, const std::vector<Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>>&, const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>&);
+
+template void conductivity_dc<long double, 1u>::save_to_hdf5(const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>&, const std::vector<Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>>&, const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>&);
+template void conductivity_dc<long double, 2u>::save_to_hdf5(const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>&, const std::vector<Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>>&, const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>&);
+template void conductivity_dc<long double, 3u>::save_to_hdf5(const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>&, const std::vector<Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>>&, const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic>&);
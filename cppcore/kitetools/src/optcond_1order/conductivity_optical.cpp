@@ -11,11 +11,15 @@
 #include <complex>
 #include <vector>
 #include <string>
+#include <future>
+#include <algorithm>
 #include <omp.h>
 
 #include <H5Cpp.h>
 #include "tools/ComplexTraits.hpp"
 #include "tools/myHDF5.hpp"
+#include "tools/gamma_reader.hpp"
+#include "tools/results.hpp"
 
 #include "tools/parse_input.hpp"
 #include "tools/systemInfo.hpp"
@@ -24,6 +28,25 @@
 
 #include "macros.hpp"
 
+template <typename T>
+static void green_moments(std::complex<T> * out, long stride, int k0, int nk, T energy, T scat){
+  // Writes greenA(k, energy, scat) for k = k0, ..., k0 + nk - 1 to out[(k - k0)*stride].
+  // Consecutive moments differ by the factor exp(i*acos(z)), so only one in
+  // every 64 moments has to be evaluated from scratch
+  const std::complex<T> imaginary(0.0, 1.0);
+  std::complex<T> z(energy, -scat);
+  std::complex<T> ratio = exp(imaginary*acos(z));
+  std::complex<T> g;
+
+  for(int k = 0; k < nk; k++){
+    if(k%64 == 0)
+      g = green(k0 + k, -1, z);
+    else
+      g *= ratio;
+    out[k*stride] = (k0 + k == 0)? g*static_cast<T>(0.5) : g;
+  }
+}
+
 template <typename T, unsigned DIM>
 conductivity_optical<T, DIM>::conductivity_optical(system_info<T, DIM>& info, shell_input & vari){
     name = info.filename;
@@ -75,6 +98,7 @@ void conductivity_optical<T, DIM>::printOpt(){
     "   Number of delta blocks: " << Convergence_D      << ((default_Convergence_D)?   " (default)":"") << "\n"
     "   Number of green blocks: " << Convergence_G      << ((default_Convergence_G)?   " (default)":"") << "\n"
     "   Num integration points: " << N_energies         << ((default_NEnergies)?    " (default)":"") << "\n"
+    "   Memory for Green's functions: " << MaxMemory << " MB" << ((default_MaxMemory)? " (default)":"") << "\n"
     "   Kernel for Dirac deltas: "<< "jackson"          << " (default)\n"
     "   Filename: "               << filename           << ((default_filename)?     " (default)":"") << "\n";
   if(!Moments_divisible)
@@ -123,6 +147,10 @@ void conductivity_optical<T, DIM>::set_default_parameters(){
     filename  = "optcond.dat";      // Filename to save final result
     default_filename = true;
 
+    PanelCols = 256;                // Columns of Gamma read from the file at a time
+    MaxMemory = 1024;               // MB available for the tables of Green's functions
+    default_MaxMemory = true;
+
     lim = static_cast<T>(0.99);
 }
 
@@ -192,24 +220,13 @@ bool conductivity_optical<T, DIM>::fetch_parameters(){
   // Check whether the matrices we're going to retrieve are complex or not
   int complex = systemInfo.isComplex;
 
-  // Retrieve the Gamma Matrix
-  std::string MatrixName = dirName + "Gamma" + dirString;
+  // Check that the Gamma matrix is there. It is only read when the
+  // conductivity is calculated, so that it never has to fit in memory as a whole
+  GammaName = dirName + "Gamma" + dirString;
+  std::string MatrixName;
   bool possibleGamma = false;
   try{
-		debug_message("Filling the Gamma matrix.\n");
-		Gamma = Eigen::Array<std::complex<T>,Eigen::Dynamic,Eigen::Dynamic>::Zero(NumMoments, NumMoments);
-		
-		if(complex)
-			get_hdf5(Gamma.data(), &file, (char*)MatrixName.c_str());
-		
-		if(!complex){
-			Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic> GammaReal;
-			GammaReal = Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic>::Zero(NumMoments, NumMoments);
-			get_hdf5(GammaReal.data(), &file, (char*)MatrixName.c_str());
-			
-			Gamma = GammaReal.template cast<std::complex<T>>();
-		}				
-
+    gamma_reader<T> reader(name, GammaName, complex);
     possibleGamma = true;
   } catch(H5::Exception&) {
     debug_message("Conductivity optical: There is no Gamma matrix.\n");
@@ -309,6 +326,16 @@ void conductivity_optical<T, DIM>::override_parameters(){
       default_Nfreqs = false;
     }
 
+    if(variables.CondOpt_MaxMemory != -1){
+      debug_message("Overriding MaxMemory");
+      if(variables.CondOpt_MaxMemory < 1){
+        std::cout << "CondOpt: The memory for the Green's functions must be at least 1 MB. Exiting.\n";
+        exit(1);
+      }
+      MaxMemory   = variables.CondOpt_MaxMemory;
+      default_MaxMemory = false;
+    }
+
     if(variables.CondOpt_Fermi != -8888){
       debug_message("Overriding e_fermi");
       e_fermi     = static_cast<T>((variables.CondOpt_Fermi - shift)/scale);
@@ -341,11 +368,6 @@ void conductivity_optical<T, DIM>::override_parameters(){
     Moments_divisible = false;
     Moments_G = NumMoments + Convergence_G - NumMoments%Convergence_G;
   }
-  //Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma_Padded;
-  debug_message("Padding Gamma");
-  Gamma_Padded = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(Moments_D, Moments_G);
-  Gamma_Padded.block(0,0,NumMoments, NumMoments) = Gamma.block(0,0,NumMoments, NumMoments);
-
   debug_message("Padding Lambda");
   Lambda_Padded = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(Moments_D, 1);
   Lambda_Padded.block(0,0,NumMoments,1) = Lambda.block(0,0,NumMoments,1);
@@ -383,6 +405,7 @@ void conductivity_optical<T, DIM>::calculateBlocks(){
   Eigen::Matrix<T, Eigen::Dynamic, 1> frequencies;
   energies    = Eigen::Matrix<T, Eigen::Dynamic, 1>::LinSpaced(N_energies, -lim, lim);
   frequencies = Eigen::Matrix<T, Eigen::Dynamic, 1>::LinSpaced(N_omegas, minFreq, maxFreq);
+  Eigen::Matrix<T, Eigen::Dynamic, 1> weights = simpson_weights<T>(N_energies, energies(1) - energies(0));
 
 
   
@@ -405,94 +428,58 @@ void conductivity_optical<T, DIM>::calculateBlocks(){
       DeltaMatrix(e,n) = deltaF(n, energies(e)); 
 
 
-
-  // declarations and memory allocations
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>** matrices;
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>** deltas;
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>** gammas_EN;
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1>**  gammas_E;
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>** cond;
-  matrices  = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>*[Nmax*Mmax];
-  deltas    = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>*[Nmax];
-  gammas_EN = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>*[Nmax*Mmax];
-  gammas_E  = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic,  1>*[Nmax*Mmax];
-  cond      = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>*[Nmax*Mmax];
-
-  // Copy the Gamma matrix into several different blocks 
-  // that will be used later for parallelization. Each thread will be
-  // assigned a block. The Gamma matrix is padded with zeros when the number
-  // of polynomials does not divide Mmax and Nmax.
-  for(unsigned j = 0; j < Nmax*Mmax; j++){
-    matrices[j]  = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>;
-
-    // block index j = n + Nmax*m
-    int n = j % Nmax;
-    int m = j / Nmax;
-    //*matrices[j] = Gamma.block(n*nmax, m*mmax, nmax, mmax);
-    *matrices[j] = Gamma_Padded.block(n*nmax, m*mmax, nmax, mmax);
-  }
-
-
-  // Copy the DeltaMatrix into blocks
-  for(unsigned j = 0; j < Nmax; j++){
-    deltas[j]  = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>;
-    *deltas[j] = DeltaMatrix.block(0, j*nmax, N_energies, nmax);
+  // Contribution of each block to the conductivity, one row per block j = n + Nmax*m.
+  // All the delta blocks n that share the same Green's function block m are contracted
+  // with the Green's functions together, so the table of Green's functions of each
+  // block m is only built once. Each block of Gamma is read from the file when it is
+  // needed and padded with zeros when the number of polynomials does not divide Mmax
+  // and Nmax, so only one nmax x mmax block of Gamma is in memory at any time
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> cond;
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> GammaEW;
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> GammaRows;
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> GammaBlock;
+  cond      = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(Nmax*Mmax, N_omegas);
+  GammaRows = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(Nmax, N_energies*mmax);
+
+  gamma_reader<T> reader(name, GammaName, systemInfo.isComplex);
+  for(unsigned m = 0; m < Mmax; m++){
+    for(unsigned n = 0; n < Nmax; n++){
+      // Rows of the dataset are the columns of Gamma
+      int row0 = m*mmax, col0 = n*nmax;
+      int nrows = std::max(0, std::min(static_cast<int>(mmax), NumMoments - row0));
+      int ncols = std::max(0, std::min(static_cast<int>(nmax), NumMoments - col0));
+      GammaBlock = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(nmax, mmax);
+      if(nrows > 0 && ncols > 0)
+        GammaBlock.topLeftCorner(ncols, nrows) = reader.read(row0, nrows, col0, ncols).matrix();
+
+      // Matrix product of Gamma and Delta, weighted for the integration over energies
+      GammaEW = weights.asDiagonal()*(DeltaMatrix.block(0, n*nmax, N_energies, nmax)*GammaBlock);
+      GammaRows.row(n) = Eigen::Map<Eigen::Matrix<std::complex<T>, 1, Eigen::Dynamic>>(GammaEW.data(), N_energies*mmax);
+    }
+    cond.middleRows(m*Nmax, Nmax) = contract_green(GammaRows, m*mmax, mmax, energies, frequencies);
   }
 
 
 
-#pragma omp parallel 
-{
-#pragma omp for schedule(static, 1) nowait
-  for(int j = 0; j < static_cast<int>(Nmax*Mmax); j++){
-    // block index j = n + Nmax*m
-    int n = j % Nmax;
-    int m = j / Nmax;
-
-    // Matrix product of Gamma and Delta
-    gammas_EN[j] = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>;
-    *gammas_EN[j] = (*deltas[n])*(*matrices[j]);
-
-
-    gammas_E[j]  = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1>;
-    cond[j]      = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>;
-    *gammas_E[j] = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1>::Zero(N_energies, 1);
-    *cond[j]     = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(N_omegas, 1);
-
-
-    T freq_p, freq_n;
-    std::complex<T> GammaEp, GammaEn;
-    for(unsigned w = 0; w < N_omegas; w++){
-      freq_p =  frequencies(w);
-      freq_n = -frequencies(w);
-
-      for(int e = 0; e < N_energies; e++){
-        GammaEp = 0;
-        GammaEn = 0;
-        for(unsigned int p = 0; p < mmax; p++){
-          GammaEp += (*gammas_EN[j])(e, p)*greenAscat<T>(scat)(m*mmax + p, energies(e) - freq_p);      // contracting with the positive frequencies
-          GammaEn += (*gammas_EN[j])(e, p)*greenAscat<T>(scat)(m*mmax + p, energies(e) - freq_n);      // contracting with the negative frequencies
-        }
-        (*gammas_E[j])(e) = GammaEp + std::conj(GammaEn);
-      }
-      (*cond[j])(w) = integrate(energies, *gammas_E[j]);
-    }
-
-
-    // free all the unneeded allocated memory. The only
-    // object we need to keep now is the conductivity
-    delete gammas_E[j];  
-    delete gammas_EN[j];  
-    delete matrices[j];
-  }
+  // Partial conductivities: the contribution of all the blocks up to (n, m)
+  std::complex<T> factor = -imaginary * static_cast<T>(systemInfo.num_orbitals*systemInfo.spin_degeneracy/systemInfo.unit_cell_area/units);
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> partial_cond;
+  partial_cond = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(Nmax*Mmax, N_omegas);
+  for(unsigned n = 0; n < Nmax; n++)
+    for(unsigned m = 0; m < Mmax; m++)
+      for(unsigned n1 = 0; n1 <= n; n1++)
+        for(unsigned m1 = 0; m1 <= m; m1++)
+          partial_cond.row(n + m*Nmax) += cond.row(n1 + m1*Nmax)*factor;
   
-#pragma omp barrier
-}
-  delete gammas_E;
-  delete matrices;
-  delete gammas_EN;
-
 
+  // Second part of the conductivity
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> Lambda_E;
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> partial_temp3;
+  partial_temp3 = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1>::Zero(Nmax);
+  for(unsigned j = 0; j < Nmax; j++){
+    Lambda_E = DeltaMatrix.block(0, j*nmax, N_energies, nmax)*Lambda_Padded.matrix().block(nmax*j,0,nmax,1);
+    partial_temp3(j) = integrate(energies, Lambda_E) + ((j > 0)? partial_temp3(j-1) : std::complex<T>(0));
+  }  
 
 
   // divide by the frequency
@@ -500,95 +487,96 @@ void conductivity_optical<T, DIM>::calculateBlocks(){
   for(unsigned j = 0; j < Mmax*Nmax; j++){
     for(unsigned i = 0; i < N_omegas; i++){
       freq = std::complex<T>(frequencies(i), scat);
-      (*cond[j])(i) /= freq;
+      partial_cond(j, i) = (partial_cond(j, i) + partial_temp3(j%Nmax)*factor)/freq;
     }
   }
-  
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> total_cond;
-  total_cond = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(N_omegas, 1);
 
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>** partial_cond;
-  partial_cond = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>*[Nmax*Mmax];
-  std::complex<T> factor = -imaginary * static_cast<T>(systemInfo.num_orbitals*systemInfo.spin_degeneracy/systemInfo.unit_cell_area/units);
-  
-  for(unsigned n = 0; n < Nmax; n++){
-    for(unsigned m = 0; m < Mmax; m++){
-      partial_cond[n + m*Nmax] = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>;
-      (*partial_cond[n + m*Nmax]) = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(N_omegas, 1);
-      for(unsigned n1 = 0; n1 <= n; n1++){
-        for(unsigned m1 = 0; m1 <= m; m1++){
-          (*partial_cond[n + m*Nmax]) += (*cond[n1 + m1*Nmax])*factor;
+  if(variables.Output_text){
+    std::ofstream myfile;
+    std::complex<T> cn;
+    for(unsigned n = 0; n < Nmax; n++){
+      for(unsigned m = 0; m < Mmax; m++){
+        myfile.open("g" + std::to_string(mmax*(m+1)) + "_d" + std::to_string(nmax*(n+1)) + "_" + filename);
+        for(unsigned int i=0; i < N_omegas; i++){
+          cn = partial_cond(n + m*Nmax, i);
+          myfile << frequencies.real()(i)*systemInfo.energy_scale << " " << cn.real() << " " << cn.imag() << "\n";
         }
+        myfile.close();
       }
     }
   }
-  
-
-  // Second part of the conductivity
-  std::complex<T>* temp3;
-  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1>** Lambda_E;
-  temp3    = new std::complex<T>[Nmax];
-  Lambda_E = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1>*[Nmax];
-
-  for(unsigned j = 0; j < Nmax; j++){
-    Lambda_E[j] = new Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1>;
-    (*Lambda_E[j]) = (*deltas[j])*Lambda_Padded.matrix().block(nmax*j,0,nmax,1);
-    temp3[j] = integrate(energies, *Lambda_E[j]);
-  }  
-  
-  for(unsigned j = 0; j < Nmax; j++){
-    delete deltas[j];  
-    delete Lambda_E[j];
-  }
-
-  delete deltas;
-  delete Lambda_E;
-
-  std::complex<T>* partial_temp3;
-  partial_temp3 = new std::complex<T>[Nmax];
-  partial_temp3[0] = temp3[0];
-  for(unsigned j = 1; j < Nmax; j++){
-    partial_temp3[j] = temp3[j] + partial_temp3[j-1];
-  }
-  delete temp3;
 
-
-
-  for(unsigned j = 0; j < Mmax*Nmax; j++){
-    for(unsigned i = 0; i < N_omegas; i++){
-      freq = std::complex<T>(frequencies(i), scat);
-      (*partial_cond[j])(i) += partial_temp3[j%Nmax]/freq*factor;
-    }
-  }
-  total_cond = *partial_cond[Nmax*Mmax - 1];
-  
-  delete partial_temp3;
-
-  std::ofstream myfile;
-  std::complex<T> cn;
-  for(unsigned n = 0; n < Nmax; n++){
-    for(unsigned m = 0; m < Mmax; m++){
-      myfile.open("g" + std::to_string(mmax*(m+1)) + "_d" + std::to_string(nmax*(n+1)) + "_" + filename);
-      for(unsigned int i=0; i < N_omegas; i++){
-        freq = std::complex<T>(frequencies(i), scat);
-        cn = (*partial_cond[n + m*Nmax])(i);
-        myfile << frequencies.real()(i)*systemInfo.energy_scale << " " << cn.real() << " " << cn.imag() << "\n";
-      }
-      myfile.close();
+  // Row n + Nmax*m of Conductivity uses the moments in the same row of
+  // DeltaMoments and GreenMoments
+  if(variables.Output_hdf5){
+    Eigen::Array<int, Eigen::Dynamic, 1> delta_counts, green_counts;
+    delta_counts = Eigen::Array<int, Eigen::Dynamic, 1>::Zero(Nmax*Mmax);
+    green_counts = Eigen::Array<int, Eigen::Dynamic, 1>::Zero(Nmax*Mmax);
+    for(unsigned j = 0; j < Nmax*Mmax; j++){
+      delta_counts(j) = nmax*(j%Nmax + 1);
+      green_counts(j) = mmax*(j/Nmax + 1);
     }
+
+    results_file results(variables.Output_Name, "CondOpt");
+    results.write_vector<double>("Frequencies", frequencies.array().template cast<double>()*systemInfo.energy_scale, "Frequencies (eV)");
+    results.write_vector<int>("DeltaMoments", delta_counts, "Moments of the Dirac delta used in each row of Conductivity");
+    results.write_vector<int>("GreenMoments", green_counts, "Moments of the Green's function used in each row of Conductivity");
+    results.write<std::complex<double>>("Conductivity", partial_cond.template cast<std::complex<double>>().array(),
+        "Optical conductivity (e^2/h), one row per number of moments");
+    results.attribute("Temperature", temperature*systemInfo.energy_scale);
+    results.attribute("FermiEnergy", e_fermi*systemInfo.energy_scale + systemInfo.energy_shift);
+    results.attribute("Broadening", scat*systemInfo.energy_scale);
   }
 	
   
   debug_message("Left calc_optical_cond.\n");
-  
-  for(unsigned j = 0; j < Mmax*Nmax; j++){
-    delete cond[j];  
-    delete partial_cond[j];
-  }
-  delete cond;
-  delete partial_cond;
+}
 
+template <typename T, unsigned DIM>
+Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> conductivity_optical<T, DIM>::contract_green(
+    const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> & GammaRows, int k0, int nk,
+    const Eigen::Matrix<T, Eigen::Dynamic, 1> & energies, const Eigen::Matrix<T, Eigen::Dynamic, 1> & frequencies){
+  /* Contracts Gamma with the advanced Green's functions at all the frequencies.
+   * Each row of GammaRows is a N_energies x nk matrix, already contracted with the
+   * Dirac delta and multiplied by the integration weights, flattened in column-major
+   * order. Its columns are the Chebyshev indices k0, ..., k0 + nk - 1 of the Green's
+   * function. The Green's functions are tabulated with the same layout, with one
+   * frequency per column, so that the integrals for a block of frequencies are a single
+   * matrix product. The frequency blocks are as large as MaxMemory allows. Returns one
+   * row per row of GammaRows and one column per frequency. */
+  debug_message("Entered conductivity_optical::contract_green.\n");
+
+  typedef Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+  int NE = N_energies;
+  long rows = static_cast<long>(NE)*nk;
+  int Nfreqs = static_cast<int>(N_omegas);
+
+  // Two tables per frequency: one for +w and another for -w
+  double bytes_per_freq = 2.0*rows*sizeof(std::complex<T>);
+  int freq_block = static_cast<int>(std::min<double>(Nfreqs, std::max(1.0, MaxMemory*1024.0*1024.0/bytes_per_freq)));
+
+  Matrix result  = Matrix::Zero(GammaRows.rows(), Nfreqs);
+  Matrix GreenP  = Matrix::Zero(rows, freq_block);
+  Matrix GreenN  = Matrix::Zero(rows, freq_block);
+
+  for(int w0 = 0; w0 < Nfreqs; w0 += freq_block){
+    int nw = std::min(freq_block, Nfreqs - w0);
+
+#pragma omp parallel for schedule(static)
+    for(int i = 0; i < nw*NE; i++){
+      int w = i / NE;
+      int e = i % NE;
+      green_moments<T>(&GreenP(e, w), NE, k0, nk, energies(e) - frequencies(w0 + w), scat);   // positive frequencies
+      green_moments<T>(&GreenN(e, w), NE, k0, nk, energies(e) + frequencies(w0 + w), scat);   // negative frequencies
+    }
 
+    // This is equivalent to the two frequency-dependent terms in the formula
+    result.middleCols(w0, nw).noalias()  = GammaRows*GreenP.leftCols(nw);
+    result.middleCols(w0, nw).noalias() += (GammaRows*GreenN.leftCols(nw)).conjugate();
+  }
+
+  debug_message("Left conductivity_optical::contract_green.\n");
+  return result;
 }
 
 
@@ -640,76 +628,34 @@ void conductivity_optical<T, DIM>::calculate(){
       DeltaMatrix(e,n) = deltaF(n, energies(e)); 
 
 
-  int N_threads;
-  int thread_num;
-  int local_NumMoments;
-  omp_set_num_threads(systemInfo.NumThreads);
-#pragma omp parallel shared(N_threads) private(thread_num)
-{
-#pragma omp master
-{
-  N_threads = omp_get_num_threads();
-  // check if each thread will get the same number of moments
-  //if(NumMoments%N_threads != 0){
-    //std::cout << "The number of Chebyshev moments in the optical conductivity must"
-      //"be a multiple of the number of threads\n" << std::flush;
-    //exit(1);
-  //}
-}
-#pragma omp barrier
-
-
-#pragma omp for schedule(static, 1) nowait
-  for(int i = 0; i < N_threads; i++){
-    local_NumMoments = Moments_G/N_threads;
-    thread_num = omp_get_thread_num();
-
-    // The Gamma matrix has been divided among the threads
-    // Each thread has one section of that matrix, called local_Gamma
-    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> local_Gamma;
-    local_Gamma = Gamma.matrix().block(0, local_NumMoments*thread_num, 
-        Moments_D, local_NumMoments);
-
-    // Result of contracting the indices with the delta function
-    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> GammaEM;
-    GammaEM = DeltaMatrix*local_Gamma;
-
-    Eigen::Matrix<std::complex<T>,Eigen::Dynamic, 1> GammaEp;
-    Eigen::Matrix<std::complex<T>,Eigen::Dynamic, 1> GammaEn;
-    Eigen::Matrix<std::complex<T>,Eigen::Dynamic, 1> GammaE;
-    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> local_cond;
-    GammaEp = Eigen::Matrix<std::complex<T>,Eigen::Dynamic, 1>::Zero(N_energies, 1);
-    GammaEn = Eigen::Matrix<std::complex<T>,Eigen::Dynamic, 1>::Zero(N_energies, 1);
-    GammaE  = Eigen::Matrix<std::complex<T>,Eigen::Dynamic, 1>::Zero(N_energies, 1);
-    local_cond = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1>::Zero(N_omegas, 1);
-
-    // Loop over the frequencies
-    T freq_p, freq_n;
-    for(unsigned int w = 0; w < N_omegas; w++){
-      freq_p =  frequencies(w);
-      freq_n = -frequencies(w);
-
-      for(int e = 0; e < N_energies; e++){
-        GammaEp(e) = 0;
-        GammaEn(e) = 0;
-        for(int m = 0; m < local_NumMoments; m++){
-          GammaEp(e) += GammaEM(e, m)*greenAscat<T>(scat)(local_NumMoments*thread_num + m, energies(e) - freq_p);      // contracting with the positive frequencies
-          GammaEn(e) += GammaEM(e, m)*greenAscat<T>(scat)(local_NumMoments*thread_num + m, energies(e) - freq_n);      // contracting with the negative frequencies
-        }
-      }
-    
-      GammaE = GammaEp + GammaEn.conjugate();                                            // This is equivalent to the two frequency-dependent terms in the formula
-      local_cond(w) = integrate(energies, GammaE);
-    }
+  // Gamma is read from the file in panels of columns. While one panel is
+  // contracted, the next one is read in the background. Only two panels of Gamma
+  // are in memory at any time
+  int panel = std::max(1, std::min(PanelCols, NumMoments));
+  int NumPanels = (NumMoments + panel - 1)/panel;
+  Eigen::Matrix<T, Eigen::Dynamic, 1> weights = simpson_weights<T>(N_energies, energies(1) - energies(0));
 
-    
-#pragma omp critical
-    {
-      cond += local_cond;
-    }
+  gamma_reader<T> reader(name, GammaName, systemInfo.isComplex);
+  reader.prefetch(0, panel, 0, NumMoments);
+
+  Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> GammaPanel;
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> GammaEW;
+  omp_set_num_threads(systemInfo.NumThreads);
+  for(int p = 0; p < NumPanels; p++){
+    int col0 = p*panel;
+    int cols = std::min(panel, NumMoments - col0);
+
+    GammaPanel = reader.fetch();
+    if(p + 1 < NumPanels)
+      reader.prefetch(col0 + cols, std::min(panel, NumMoments - col0 - cols), 0, NumMoments);
+
+    // Result of contracting the indices with the delta function, weighted for the
+    // integration over energies. The contraction with the Green's functions at
+    // all frequencies is then a single product with their tables
+    GammaEW = weights.asDiagonal()*(DeltaMatrix.leftCols(NumMoments)*GammaPanel.matrix());
+    Eigen::Map<Eigen::Matrix<std::complex<T>, 1, Eigen::Dynamic>> GammaRow(GammaEW.data(), N_energies*cols);
+    cond += contract_green(GammaRow, col0, cols, energies, frequencies).transpose();
   }
-#pragma omp barrier
-}
 
   
   temp3 = contract1<T>(deltaF, Moments_D, Lambda, energies);
@@ -728,13 +674,23 @@ void conductivity_optical<T, DIM>::calculate(){
 	
   
   //Output to a file
-  std::ofstream myfile;
-  myfile.open(filename);
-  for(unsigned int i=0; i < N_omegas; i++){
-    freq = std::complex<T>(frequencies(i), scat);
-    myfile << frequencies.real()(i)*systemInfo.energy_scale << " " << cond.real()(i) << " " << cond.imag()(i) << "\n";
+  if(variables.Output_text){
+    std::ofstream myfile;
+    myfile.open(filename);
+    for(unsigned int i=0; i < N_omegas; i++){
+      myfile << frequencies.real()(i)*systemInfo.energy_scale << " " << cond.real()(i) << " " << cond.imag()(i) << "\n";
+    }
+    myfile.close();
+  }
+
+  if(variables.Output_hdf5){
+    results_file results(variables.Output_Name, "CondOpt");
+    results.write_vector<double>("Frequencies", frequencies.array().template cast<double>()*systemInfo.energy_scale, "Frequencies (eV)");
+    results.write_vector<std::complex<double>>("Conductivity", cond.template cast<std::complex<double>>().array(), "Optical conductivity (e^2/h)");
+    results.attribute("Temperature", temperature*systemInfo.energy_scale);
+    results.attribute("FermiEnergy", e_fermi*systemInfo.energy_scale + systemInfo.energy_shift);
+    results.attribute("Broadening", scat*systemInfo.energy_scale);
   }
-  myfile.close();
   debug_message("Left calc_optical_cond.\n");
 
 
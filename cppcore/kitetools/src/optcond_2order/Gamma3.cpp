@@ -9,7 +9,11 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <future>
 #include <H5Cpp.h>
+#include "tools/ComplexTraits.hpp"
+#include "tools/myHDF5.hpp"
+#include "tools/gamma_reader.hpp"
 #include "tools/parse_input.hpp"
 #include "tools/systemInfo.hpp"
 #include "tools/functions.hpp"
@@ -45,6 +49,8 @@ Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
   global_omega_energies = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(N_energies, N_omegas);
   omega_energies = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(N_energies, N_omegas);
   
+  // Gamma3 is read from the file in slabs. Each thread reads the slab it needs
+  gamma_reader<T> reader(systemInfo.filename, Gamma3Name, complex);
   omp_set_num_threads(systemInfo.NumThreads);
   // Start the parallelization. It is done in the direction p
 #pragma omp parallel shared(N_threads, global_omega_energies) firstprivate(omega_energies)
@@ -65,13 +71,6 @@ Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
 #pragma omp for schedule(static, 1) nowait
   for(int i = 0; i < N_threads; i++){
     local_NumMoments = N2/N_threads;
-    
-    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Gamma3Aligned;
-    Gamma3Aligned = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N0*local_NumMoments, N1);
-    for(long int p = i*local_NumMoments; p < local_NumMoments*(i+1); p++)
-      for(long int m = 0; m < N1; m++)
-        for(long int n = 0; n < N0; n++)
-          Gamma3Aligned((p-i*local_NumMoments)*N0 + n, m) = Gamma3(N0*N1*p + N0*m + n);
       
     // Delta matrix of chebyshev moments and energies
     Eigen::Matrix<std::complex<T>,Eigen::Dynamic, Eigen::Dynamic> DeltaMatrix;
@@ -81,38 +80,50 @@ Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
       for(int e = 0; e < N_energies; e++)
         DeltaMatrix(n,e) = deltaF(n, energies(e)); 
 
-    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma3NNE;
-    Gamma3NNE = Gamma3Aligned*DeltaMatrix;
-    
-    
     // Matrix of Green's functions
     Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> GreenR, GreenA;
     GreenR  = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N_energies, N0);
-    GreenA  = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N_energies, local_NumMoments);
 
-    
-    
-    T w1, w2;
-    for(int w = 0; w < N_omegas; w++){
-      w1 = frequencies2(w,0);
-      w2 = frequencies2(w,1);
-      
-      // The scat term is the same in both cases because greenRscat and greenAscat already
-      // take into account that the sign of scat is different in those cases
-      for(int n = 0; n < N0; n++)
-        for(int e = 0; e < N_energies; e++)
-          GreenR(e, n) = greenRscat<T>(scat)(n, energies(e) + w1);
-      
-      for(int p = 0; p < local_NumMoments; p++)
-        for(int e = 0; e < N_energies; e++)
-          GreenA(e, p) = greenAscat<T>(scat)(i*local_NumMoments + p, energies(e) - w2);
-      
-      Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> temp;
-      temp = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(1,1);
-      for(int col = 0; col < N_energies; col++){
-        for(int p = 0; p < local_NumMoments; p++){
-          temp = GreenR.row(col)*Gamma3NNE.block(p*N0, col, N0, 1);
-          omega_energies(col, w) += temp(0,0)*GreenA(col, p);
+    // The moments p of this thread are read from the file in slabs of SlabMoments.
+    // The N0 x N1 matrix of each p is contiguous in the slab, so it is contracted
+    // with the Dirac deltas in place
+    for(int s0 = 0; s0 < local_NumMoments; s0 += SlabMoments){
+      int ns = std::min(SlabMoments, local_NumMoments - s0);
+      int p0 = i*local_NumMoments + s0;
+
+      Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma3Slab;
+      Gamma3Slab = reader.read(p0, ns, 0, N0*N1);
+
+      Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma3NNE;
+      Gamma3NNE = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(N0*ns, N_energies);
+      for(int p = 0; p < ns; p++)
+        Gamma3NNE.middleRows(p*N0, N0) = Eigen::Map<Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>>(Gamma3Slab.col(p).data(), N0, N1)*DeltaMatrix;
+      Gamma3Slab.resize(0, 0);
+
+      GreenA  = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N_energies, ns);
+
+      T w1, w2;
+      for(int w = 0; w < N_omegas; w++){
+        w1 = frequencies2(w,0);
+        w2 = frequencies2(w,1);
+        
+        // The scat term is the same in both cases because greenRscat and greenAscat already
+        // take into account that the sign of scat is different in those cases
+        for(int n = 0; n < N0; n++)
+          for(int e = 0; e < N_energies; e++)
+            GreenR(e, n) = greenRscat<T>(scat)(n, energies(e) + w1);
+        
+        for(int p = 0; p < ns; p++)
+          for(int e = 0; e < N_energies; e++)
+            GreenA(e, p) = greenAscat<T>(scat)(p0 + p, energies(e) - w2);
+        
+        Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> temp;
+        temp = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(1,1);
+        for(int col = 0; col < N_energies; col++){
+          for(int p = 0; p < ns; p++){
+            temp = GreenR.row(col)*Gamma3NNE.block(p*N0, col, N0, 1);
+            omega_energies(col, w) += temp(0,0)*GreenA(col, p);
+          }
         }
       }
     }
@@ -155,6 +166,8 @@ Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
   global_omega_energies = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(N_energies, N_omegas);
   omega_energies = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(N_energies, N_omegas);
   
+  // Gamma3 is read from the file in slabs. Each thread reads the slab it needs
+  gamma_reader<T> reader(systemInfo.filename, Gamma3Name, complex);
   omp_set_num_threads(systemInfo.NumThreads);
   // Start the parallelization. It is done in the direction p
 #pragma omp parallel shared(N_threads, global_omega_energies) firstprivate(omega_energies)
@@ -175,13 +188,6 @@ Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
 #pragma omp for schedule(static, 1) nowait
   for(int i = 0; i < N_threads; i++){
     local_NumMoments = N0/N_threads;
-    
-    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Gamma3Aligned;
-    Gamma3Aligned = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N1*local_NumMoments, N2);
-    for(long int n = i*local_NumMoments; n < local_NumMoments*(i+1); n++)
-      for(long int p = 0; p < N2; p++)
-        for(long int m = 0; m < N1; m++)
-          Gamma3Aligned((n-i*local_NumMoments)*N1 + m, p) = Gamma3(N0*N1*p + N0*m + n);
       
     // Delta matrix of chebyshev moments and energies
     Eigen::Matrix<std::complex<T>,Eigen::Dynamic, Eigen::Dynamic> DeltaMatrix;
@@ -191,40 +197,45 @@ Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
       for(int e = 0; e < N_energies; e++)
         DeltaMatrix(n,e) = deltaF(n, energies(e)); 
 
-    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma3NNE;
-    Gamma3NNE = Gamma3Aligned*DeltaMatrix;
-    
-    
     // Matrix of Green's functions
     Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Green2R, GreenR;
-    Green2R = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N_energies, local_NumMoments);
     GreenR  = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N_energies, N1);
 
-    
-    
-    T w1, w2;
-    for(int w = 0; w < N_omegas; w++){
-      w1 = frequencies2(w,0);
-      w2 = frequencies2(w,1);
-      //std::cout << "w1: " << w1 << " w2: " << w2 << "\n";
-      
-      
-      // The scat term is the same in both cases because greenRscat and greenAscat already
-      // take into account that the sign of scat is different in those cases
-      for(int m = 0; m < N1; m++)
-        for(int e = 0; e < N_energies; e++)
-          GreenR(e, m) = greenRscat<T>(scat)(m, energies(e) + w2);
-      
-      for(int n = 0; n < local_NumMoments; n++)
-        for(int e = 0; e < N_energies; e++)
-          Green2R(e, n) = greenRscat<T>(static_cast<T>(2.0*scat))(i*local_NumMoments + n, energies(e) + w1 + w2);
-      
-      Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> temp;
-      temp = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(1,1);
-      for(int col = 0; col < N_energies; col++){
-        for(int n = 0; n < local_NumMoments; n++){
-          temp = GreenR.row(col)*Gamma3NNE.block(n*N1, col, N1, 1);
-          omega_energies(col, w) += temp(0,0)*Green2R(col, n);
+    // The moments n of this thread are read from the file in slabs of SlabMoments.
+    // Row ns*m + n of the slab holds Gamma3(p, m, n0 + n) for all p, so the slab
+    // is contracted with the Dirac deltas as it is
+    for(int s0 = 0; s0 < local_NumMoments; s0 += SlabMoments){
+      int ns = std::min(SlabMoments, local_NumMoments - s0);
+      int n0 = i*local_NumMoments + s0;
+
+      Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma3NNE;
+      Gamma3NNE = reader.read(0, N2, n0, N1, N0, ns).matrix()*DeltaMatrix;
+
+      Green2R = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N_energies, ns);
+
+      T w1, w2;
+      for(int w = 0; w < N_omegas; w++){
+        w1 = frequencies2(w,0);
+        w2 = frequencies2(w,1);
+        
+        // The scat term is the same in both cases because greenRscat and greenAscat already
+        // take into account that the sign of scat is different in those cases
+        for(int m = 0; m < N1; m++)
+          for(int e = 0; e < N_energies; e++)
+            GreenR(e, m) = greenRscat<T>(scat)(m, energies(e) + w2);
+        
+        for(int n = 0; n < ns; n++)
+          for(int e = 0; e < N_energies; e++)
+            Green2R(e, n) = greenRscat<T>(static_cast<T>(2.0*scat))(n0 + n, energies(e) + w1 + w2);
+        
+        Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> temp;
+        temp = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(1,1);
+        for(int col = 0; col < N_energies; col++){
+          for(int n = 0; n < ns; n++){
+            Eigen::Map<Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1>, 0, Eigen::InnerStride<>> Gamma3col(&Gamma3NNE(n, col), N1, Eigen::InnerStride<>(ns));
+            temp = GreenR.row(col)*Gamma3col;
+            omega_energies(col, w) += temp(0,0)*Green2R(col, n);
+          }
         }
       }
     }
@@ -267,6 +278,8 @@ Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
   global_omega_energies = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(N_energies, N_omegas);
   omega_energies = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(N_energies, N_omegas);
   
+  // Gamma3 is read from the file in slabs. Each thread reads the slab it needs
+  gamma_reader<T> reader(systemInfo.filename, Gamma3Name, complex);
   omp_set_num_threads(systemInfo.NumThreads);
   // Start the parallelization. It is done in the direction p
 #pragma omp parallel shared(N_threads, global_omega_energies) firstprivate(omega_energies)
@@ -287,13 +300,6 @@ Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
 #pragma omp for schedule(static, 1) nowait
   for(int i = 0; i < N_threads; i++){
     local_NumMoments = N1/N_threads;
-    
-    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Gamma3Aligned;
-    Gamma3Aligned = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N2*local_NumMoments, N0);
-    for(long int m = i*local_NumMoments; m < local_NumMoments*(i+1); m++)
-      for(long int n = 0; n < N0; n++)
-        for(long int p = 0; p < N2; p++)
-          Gamma3Aligned((m-i*local_NumMoments)*N2 + p, n) = Gamma3(N0*N1*p + N0*m + n);
       
     // Delta matrix of chebyshev moments and energies
     Eigen::Matrix<std::complex<T>,Eigen::Dynamic, Eigen::Dynamic> DeltaMatrix;
@@ -303,39 +309,50 @@ Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
       for(int e = 0; e < N_energies; e++)
         DeltaMatrix(n,e) = deltaF(n, energies(e)); 
 
-    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma3NNE;
-    Gamma3NNE = Gamma3Aligned*DeltaMatrix;
-    
-    
     // Matrix of Green's functions
     Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> GreenA, Green2A;
     Green2A = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N_energies, N2);
-    GreenA  = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N_energies, local_NumMoments);
 
-    
-    
-    T w1, w2;
-    for(int w = 0; w < N_omegas; w++){
-      w1 = frequencies2(w,0);
-      w2 = frequencies2(w,1);
-      
-      // The scat term is the same in both cases because greenRscat and greenAscat already
-      // take into account that the sign of scat is different in those cases
-      for(int p = 0; p < N2; p++)
-        for(int e = 0; e < N_energies; e++)
-          Green2A(e, p) = greenAscat<T>(2*scat)(p, energies(e) - w1 - w2);
-      
-      for(int m = 0; m < local_NumMoments; m++)
-        for(int e = 0; e < N_energies; e++)
-          GreenA(e, m) = greenAscat<T>(scat)(i*local_NumMoments + m, energies(e) - w1);
-
-      
-      Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> temp;
-      temp = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(1,1);
-      for(int col = 0; col < N_energies; col++){
-        for(int m = 0; m < local_NumMoments; m++){
-          temp = Green2A.row(col)*Gamma3NNE.block(m*N2, col, N2, 1);
-          omega_energies(col, w) += temp(0,0)*GreenA(col, m);
+    // The moments m of this thread are read from the file in slabs of SlabMoments.
+    // Column p of the slab holds Gamma3(p, m0 + m, n) at row N0*m + n
+    for(int s0 = 0; s0 < local_NumMoments; s0 += SlabMoments){
+      int ns = std::min(SlabMoments, local_NumMoments - s0);
+      int m0 = i*local_NumMoments + s0;
+
+      Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma3Slab;
+      Gamma3Slab = reader.read(0, N2, N0*m0, N0*ns);
+
+      Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Gamma3NNE;
+      Gamma3NNE = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(N2*ns, N_energies);
+      for(int m = 0; m < ns; m++)
+        Gamma3NNE.middleRows(m*N2, N2) = Gamma3Slab.matrix().block(m*N0, 0, N0, N2).transpose()*DeltaMatrix;
+      Gamma3Slab.resize(0, 0);
+
+      GreenA  = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N_energies, ns);
+
+      T w1, w2;
+      for(int w = 0; w < N_omegas; w++){
+        w1 = frequencies2(w,0);
+        w2 = frequencies2(w,1);
+        
+        // The scat term is the same in both cases because greenRscat and greenAscat already
+        // take into account that the sign of scat is different in those cases
+        for(int p = 0; p < N2; p++)
+          for(int e = 0; e < N_energies; e++)
+            Green2A(e, p) = greenAscat<T>(2*scat)(p, energies(e) - w1 - w2);
+        
+        for(int m = 0; m < ns; m++)
+          for(int e = 0; e < N_energies; e++)
+            GreenA(e, m) = greenAscat<T>(scat)(m0 + m, energies(e) - w1);
+
+        
+        Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> temp;
+        temp = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(1,1);
+        for(int col = 0; col < N_energies; col++){
+          for(int m = 0; m < ns; m++){
+            temp = Green2A.row(col)*Gamma3NNE.block(m*N2, col, N2, 1);
+            omega_energies(col, w) += temp(0,0)*GreenA(col, m);
+          }
         }
       }
     }
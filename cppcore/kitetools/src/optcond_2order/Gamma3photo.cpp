@@ -9,7 +9,11 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <future>
 #include <H5Cpp.h>
+#include "tools/ComplexTraits.hpp"
+#include "tools/myHDF5.hpp"
+#include "tools/gamma_reader.hpp"
 #include "tools/parse_input.hpp"
 #include "tools/systemInfo.hpp"
 #include "tools/functions.hpp"
@@ -64,6 +68,8 @@ Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
           DeltaGreenAMatrix(e, p*N0 + n) = deltaF(n, energies(e))*greenAscat<U>(2*scat)(p + block*N2/N_blocks, energies(e)); 
         }
 
+    // Gamma3 is read from the file in slabs. Each thread reads the slab it needs
+    gamma_reader<U> reader(systemInfo.filename, Gamma3Name, complex);
     omp_set_num_threads(systemInfo.NumThreads);
 #pragma omp parallel shared(N_threads, global_omega_energies) firstprivate(DeltaGreenAMatrix, DeltaGreenRMatrix, omega_energies)
   {
@@ -88,45 +94,48 @@ Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
       local_NumMoments = N1/N_threads;
 
       // The operations that will be done next on the Gamma3 matrix are very time-consuming
-      // and are of order NumMoments^3 * N_energies, so we want to reduce the computation time
-      // as much as possible. For that reason, this block aligns the matrix entries in thememory so
-      // that the matrix multiplication that follows is as fast as possible. This operation is
-      // of order NumMoments^3
+      // and are of order NumMoments^3 * N_energies, so we want them to be matrix products.
+      // Column m of Gamma3Aligned holds Gamma3(p, m, n) at row p*N0 + n. This is the
+      // layout in which a single m is read from the file, so the columns are read one by
+      // one straight into place, for a slab of SlabMoments moments m at a time
       Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor> Gamma3Aligned;
-      Gamma3Aligned = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>::Zero(N0*N2/N_blocks, local_NumMoments);
-      for(long int p = 0; p < N2/N_blocks; p++)
-        for(long int m = i*local_NumMoments; m < (i+1)*local_NumMoments; m++)
-          for(long int n = 0; n < N0; n++)
-            Gamma3Aligned(p*N0 + n, m - i*local_NumMoments) = Gamma3(N0*N1*(p + block*N2/N_blocks) + N0*m + n);
-        
-      
-      // Perform the matrix product of Gamma3Aligned with the matrix of 
-      // Green functions and Dirac Deltas
+      Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> GreenR, GreenA;
       Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Gamma3NER;
       Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Gamma3NEA;
 
-      Gamma3NER = DeltaGreenRMatrix*Gamma3Aligned;
-      Gamma3NEA = DeltaGreenAMatrix*Gamma3Aligned;
-      
-      // Matrix of Green's functions
-      Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> GreenR, GreenA;
-      GreenR = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(local_NumMoments, N_energies);
-      GreenA = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(local_NumMoments, N_energies);
-      
-      for(int w = 0; w < N_omegas; w++){
-        // The scat term is the same in both cases because greenRscat and greenAscat already
-        // take into account that the sign of scat is different in those cases
-        for(int m = 0; m < local_NumMoments; m++)
+      for(int s0 = 0; s0 < local_NumMoments; s0 += SlabMoments){
+        int ns = std::min(SlabMoments, local_NumMoments - s0);
+        int m0 = i*local_NumMoments + s0;
+
+        Gamma3Aligned = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>::Zero(N0*N2/N_blocks, ns);
+        for(int m = 0; m < ns; m++)
+          Gamma3Aligned.col(m) = Eigen::Map<Eigen::Matrix<std::complex<U>, Eigen::Dynamic, 1>>(
+              reader.read(block*N2/N_blocks, N2/N_blocks, N0*(m0 + m), N0).data(), N0*N2/N_blocks);
+        
+        // Perform the matrix product of Gamma3Aligned with the matrix of 
+        // Green functions and Dirac Deltas
+        Gamma3NER = DeltaGreenRMatrix*Gamma3Aligned;
+        Gamma3NEA = DeltaGreenAMatrix*Gamma3Aligned;
+        
+        // Matrix of Green's functions
+        GreenR = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(ns, N_energies);
+        GreenA = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(ns, N_energies);
+        
+        for(int w = 0; w < N_omegas; w++){
+          // The scat term is the same in both cases because greenRscat and greenAscat already
+          // take into account that the sign of scat is different in those cases
+          for(int m = 0; m < ns; m++)
+            for(int e = 0; e < N_energies; e++){
+              GreenR(m, e) = greenRscat<U>(scat)(m0 + m, energies(e) - frequencies(w)); 
+              GreenA(m, e) = greenAscat<U>(scat)(m0 + m, energies(e) - frequencies(w)); 
+            }
+          
+          Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> temp;
           for(int e = 0; e < N_energies; e++){
-            GreenR(m, e) = greenRscat<U>(scat)(m + i*local_NumMoments, energies(e) - frequencies(w)); 
-            GreenA(m, e) = greenAscat<U>(scat)(m + i*local_NumMoments, energies(e) - frequencies(w)); 
+            temp  = Gamma3NER.row(e)*GreenR.col(e); 
+            temp += Gamma3NEA.row(e)*GreenA.col(e); 
+            omega_energies(e, w) += temp(0,0);
           }
-        
-        Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> temp;
-        for(int e = 0; e < N_energies; e++){
-          temp  = Gamma3NER.row(e)*GreenR.col(e); 
-          temp += Gamma3NEA.row(e)*GreenA.col(e); 
-          omega_energies(e, w) = temp(0,0);
         }
       }
     }
@@ -167,6 +176,9 @@ Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
 
   omega_energies = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic>::Zero(N_energies, N_omegas);
   
+  // Gamma3 is read from the file in slabs. Each thread reads the slab it needs
+  gamma_reader<U> reader(systemInfo.filename, Gamma3Name, complex);
+
   // Start the parallelization. It is done in the direction p
   omp_set_num_threads(systemInfo.NumThreads);
 #pragma omp parallel shared(N_threads, global_omega_energies) firstprivate(omega_energies)
@@ -187,13 +199,6 @@ Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
 #pragma omp for schedule(static, 1) nowait
   for(int i = 0; i < N_threads; i++){
     local_NumMoments = N2/N_threads;
-    
-    Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Gamma3Aligned;
-    Gamma3Aligned = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N0*local_NumMoments, N1);
-    for(long int p = i*local_NumMoments; p < local_NumMoments*(i+1); p++)
-      for(long int m = 0; m < N1; m++)
-        for(long int n = 0; n < N0; n++)
-          Gamma3Aligned((p-i*local_NumMoments)*N0 + n, m) = Gamma3(N0*N1*p + N0*m + n);
       
     // Delta matrix of chebyshev moments and energies
     Eigen::Matrix<std::complex<U>,Eigen::Dynamic, Eigen::Dynamic> DeltaMatrix;
@@ -203,37 +208,46 @@ Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> conductivity_nonl
       for(int e = 0; e < N_energies; e++)
         DeltaMatrix(n,e) = deltaF(n, energies(e)); 
 
-    Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> Gamma3NNE;
-    Gamma3NNE = Gamma3Aligned*DeltaMatrix;
-    
-    
     // Matrix of Green's functions
     Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> GreenR, GreenA;
-    GreenR = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N_energies, N0);
-    GreenA = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N_energies, local_NumMoments);
+    GreenR  = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N_energies, N0);
 
+    // The moments p of this thread are read from the file in slabs of SlabMoments.
+    // The N0 x N1 matrix of each p is contiguous in the slab, so it is contracted
+    // with the Dirac deltas in place
+    for(int s0 = 0; s0 < local_NumMoments; s0 += SlabMoments){
+      int ns = std::min(SlabMoments, local_NumMoments - s0);
+      int p0 = i*local_NumMoments + s0;
 
+      Eigen::Array<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> Gamma3Slab;
+      Gamma3Slab = reader.read(p0, ns, 0, N0*N1);
 
-    
-    for(int w = 0; w < N_omegas; w++){
-      
-      // The scat term is the same in both cases because greenRscat and greenAscat already
-      // take into account that the sign of scat is different in those cases
-      
-      for(int n = 0; n < N0; n++)
-        for(int e = 0; e < N_energies; e++)
-          GreenR(e, n) = greenRscat<U>(scat)(n, energies(e) + frequencies(w)); 
-
-      for(int p = 0; p < local_NumMoments; p++)
-        for(int e = 0; e < N_energies; e++)
-          GreenA(e, p) = greenAscat<U>(scat)(i*local_NumMoments + p, energies(e) + frequencies(w)); 
-
-      Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> temp;
-      temp = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic>::Zero(1,1);
-      for(int col = 0; col < N_energies; col++){
-        for(int p = 0; p < local_NumMoments; p++){
-          temp = GreenR.row(col)*Gamma3NNE.block(p*N0, col, N0, 1);
-          omega_energies(col, w) += temp(0,0)*GreenA(col, p);
+      Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> Gamma3NNE;
+      Gamma3NNE = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic>::Zero(N0*ns, N_energies);
+      for(int p = 0; p < ns; p++)
+        Gamma3NNE.middleRows(p*N0, N0) = Eigen::Map<Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic>>(Gamma3Slab.col(p).data(), N0, N1)*DeltaMatrix;
+      Gamma3Slab.resize(0, 0);
+
+      GreenA  = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(N_energies, ns);
+
+            for(int w = 0; w < N_omegas; w++){
+        // The scat term is the same in both cases because greenRscat and greenAscat already
+        // take into account that the sign of scat is different in those cases
+        for(int n = 0; n < N0; n++)
+          for(int e = 0; e < N_energies; e++)
+            GreenR(e, n) = greenRscat<U>(scat)(n, energies(e) + frequencies(w));
+        
+        for(int p = 0; p < ns; p++)
+          for(int e = 0; e < N_energies; e++)
+            GreenA(e, p) = greenAscat<U>(scat)(p0 + p, energies(e) + frequencies(w));
+        
+        Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic> temp;
+        temp = Eigen::Matrix<std::complex<U>, Eigen::Dynamic, Eigen::Dynamic>::Zero(1,1);
+        for(int col = 0; col < N_energies; col++){
+          for(int p = 0; p < ns; p++){
+            temp = GreenR.row(col)*Gamma3NNE.block(p*N0, col, N0, 1);
+            omega_energies(col, w) += temp(0,0)*GreenA(col, p);
+          }
         }
       }
     }
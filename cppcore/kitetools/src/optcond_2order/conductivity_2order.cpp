@@ -11,11 +11,14 @@
 #include <complex>
 #include <string>
 #include <vector>
+#include <future>
 #include <omp.h>
 
 #include "tools/ComplexTraits.hpp"
 #include <H5Cpp.h>
 #include "tools/myHDF5.hpp"
+#include "tools/gamma_reader.hpp"
+#include "tools/results.hpp"
 
 #include "tools/parse_input.hpp"
 #include "tools/systemInfo.hpp"
@@ -115,25 +118,18 @@ int conductivity_nonlinear<T, DIM>::fetch_gamma2(){
   
 template <typename T, unsigned DIM>
 int conductivity_nonlinear<T, DIM>::fetch_gamma3(){
-  // Retrieve the Gamma3 Matrix. This is the biggest matrix and doesn't need to be
-  // calculated when we want hBN because it is identically zero.
+  // Check that the Gamma3 Matrix is there. This is the biggest matrix and doesn't need to be
+  // calculated when we want hBN because it is identically zero. It is not read
+  // here; each contraction reads the slabs of Gamma3 it needs from the file.
 
   int hasGamma3 = 0;
-  std::string MatrixName = dirName + "Gamma3" + dirString;
+  Gamma3Name = dirName + "Gamma3" + dirString;
   try{
-    debug_message("Filling the Gamma3 matrix.\n");
-    Gamma3 = Eigen::Array<std::complex<T>,Eigen::Dynamic,Eigen::Dynamic>::Zero(1, NumMoments*NumMoments*NumMoments);
-      
-    if(complex)
-      get_hdf5(Gamma3.data(), &file, (char*)MatrixName.c_str());
-     
-    if(!complex){
-      Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic> Gamma3Real;
-      Gamma3Real = Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic>::Zero(1, NumMoments*NumMoments*NumMoments);
-      get_hdf5(Gamma3Real.data(), &file, (char*)MatrixName.c_str());
-        
-      Gamma3 = Gamma3Real.template cast<std::complex<T>>();
-    }				
+    gamma_reader<T> reader(systemInfo.filename, Gamma3Name, complex);
+    if(reader.rows*reader.cols != static_cast<hsize_t>(NumMoments)*NumMoments*NumMoments){
+      std::cout << "The Gamma3 matrix in the file does not have NumMoments^3 elements. Exiting.\n";
+      exit(1);
+    }
 
     hasGamma3 = 1;
   } catch(H5::Exception&) {
@@ -143,6 +139,19 @@ int conductivity_nonlinear<T, DIM>::fetch_gamma3(){
   return hasGamma3;
 }
 
+template <typename T, unsigned DIM>
+static void write_parameters(results_file & results, conductivity_nonlinear<T, DIM> & cond){
+  // Frequencies and parameters of the nonlinear conductivity, in eV. Each row
+  // of Frequencies2 has the two frequencies of the same row of Frequencies
+  double scale = cond.systemInfo.energy_scale;
+  results.write_vector<double>("Frequencies", cond.frequencies.array().template cast<double>()*scale, "Frequencies (eV)");
+  results.write<double>("Frequencies2", cond.frequencies2.array().template cast<double>()*scale, "Frequencies w1 and w2 (eV)");
+  results.attribute("Temperature", cond.temperature*scale);
+  results.attribute("FermiEnergy", cond.e_fermi*scale + cond.systemInfo.energy_shift);
+  results.attribute("Broadening", cond.scat*scale);
+  results.attribute("Ratio", cond.ratio);
+}
+
 template <typename T, unsigned DIM>
 conductivity_nonlinear<T, DIM>::conductivity_nonlinear(system_info<T, DIM>& info, shell_input & vari){
   // Constructor of the conductivity_nonlinear class. This function simply checks
@@ -219,6 +228,7 @@ void conductivity_nonlinear<T, DIM>::set_default_parameters(){
   default_NEnergies = true;
 
   lim         = 0.995;
+  SlabMoments = 16;     // Moments of Gamma3 read from the file at a time by each thread
 
   maxFreq     = 7.0/systemInfo.energy_scale; 
   minFreq     = 0.0/systemInfo.energy_scale;
@@ -375,37 +385,51 @@ void conductivity_nonlinear<T, DIM>::calculate_photo(){
   cond4 *= factor;
   cond = cond1 + cond2 + cond3 + cond4;
 
-  std::ofstream myfile;
-  std::ofstream myfile0, myfile1, myfile2, myfile3, myfile4;
+  if(variables.Output_text){
+    std::ofstream myfile;
+    std::ofstream myfile0, myfile1, myfile2, myfile3, myfile4;
 
-  myfile.open(filename);
+    myfile.open(filename);
 
-  if(print_all){
-    myfile0.open(filename + "0");
-    myfile1.open(filename + "1");
-    myfile2.open(filename + "2");
-    myfile3.open(filename + "RR_AA");
-    myfile4.open(filename + "RA");
-  }
+    if(print_all){
+      myfile0.open(filename + "0");
+      myfile1.open(filename + "1");
+      myfile2.open(filename + "2");
+      myfile3.open(filename + "RR_AA");
+      myfile4.open(filename + "RA");
+    }
 
 
-  for(int i=0; i < N_omegas; i++){
-    freq = static_cast<T>(std::real(frequencies(i))*systemInfo.energy_scale);
-    myfile  << freq << " " << cond.real()(i) << " " << cond.imag()(i) << "\n";
-    if(print_all){
-      myfile0 << freq << " " << cond0.real()(i) << " " << cond0.imag()(i) << "\n";
-      myfile1 << freq << " " << cond1.real()(i) << " " << cond1.imag()(i) << "\n";
-      myfile2 << freq << " " << cond2.real()(i) << " " << cond2.imag()(i) << "\n";
-      myfile3 << freq << " " << cond3.real()(i) << " " << cond3.imag()(i) << "\n";
-      myfile4 << freq << " " << cond4.real()(i) << " " << cond4.imag()(i) << "\n";
-    } 
+    for(int i=0; i < N_omegas; i++){
+      freq = static_cast<T>(std::real(frequencies(i))*systemInfo.energy_scale);
+      myfile  << freq << " " << cond.real()(i) << " " << cond.imag()(i) << "\n";
+      if(print_all){
+        myfile0 << freq << " " << cond0.real()(i) << " " << cond0.imag()(i) << "\n";
+        myfile1 << freq << " " << cond1.real()(i) << " " << cond1.imag()(i) << "\n";
+        myfile2 << freq << " " << cond2.real()(i) << " " << cond2.imag()(i) << "\n";
+        myfile3 << freq << " " << cond3.real()(i) << " " << cond3.imag()(i) << "\n";
+        myfile4 << freq << " " << cond4.real()(i) << " " << cond4.imag()(i) << "\n";
+      } 
+    }
+    myfile.close();
+    myfile0.close();
+    myfile1.close();
+    myfile2.close();
+    myfile3.close();
+    myfile4.close();
+  }
+
+  // All the terms are always written to the HDF5 file
+  if(variables.Output_hdf5){
+    results_file results(variables.Output_Name, "CondOpt2");
+    write_parameters(results, *this);
+    results.write_vector<std::complex<double>>("Conductivity", cond.transpose().template cast<std::complex<double>>().array(), "Photoconductivity");
+    results.write_vector<std::complex<double>>("Term0",    cond0.transpose().template cast<std::complex<double>>().array(), "Term 0 of the photoconductivity");
+    results.write_vector<std::complex<double>>("Term1",    cond1.transpose().template cast<std::complex<double>>().array(), "Term 1 of the photoconductivity");
+    results.write_vector<std::complex<double>>("Term2",    cond2.transpose().template cast<std::complex<double>>().array(), "Term 2 of the photoconductivity");
+    results.write_vector<std::complex<double>>("TermRR_AA", cond3.transpose().template cast<std::complex<double>>().array(), "RR and AA terms of the photoconductivity");
+    results.write_vector<std::complex<double>>("TermRA",   cond4.transpose().template cast<std::complex<double>>().array(), "RA term of the photoconductivity");
   }
-  myfile.close();
-  myfile0.close();
-  myfile1.close();
-  myfile2.close();
-  myfile3.close();
-  myfile4.close();
 }
 
 template <typename T, unsigned DIM>
@@ -485,42 +509,57 @@ void conductivity_nonlinear<T, DIM>::calculate_general(){
 
   cond_shg = cond0shg + cond1shg + cond2shg + cond3shg1 + cond3shg2 + cond3shg3;
 
-  std::ofstream myfile_shg;
-  std::ofstream myfile3shg1, myfile3shg2, myfile3shg3, myfile2shg, myfile1shg, myfile0shg;
+  if(variables.Output_text){
+    std::ofstream myfile_shg;
+    std::ofstream myfile3shg1, myfile3shg2, myfile3shg3, myfile2shg, myfile1shg, myfile0shg;
 
-  myfile_shg.open(filename);
+    myfile_shg.open(filename);
 
-  if(print_all){
+    if(print_all){
 
-    myfile3shg1.open(filename + "RA");
-    myfile3shg2.open(filename + "RR");
-    myfile3shg3.open(filename + "AA");
-    myfile2shg.open(filename + "2");
-    myfile1shg.open(filename + "1");
-    myfile0shg.open(filename + "0");
-  }
+      myfile3shg1.open(filename + "RA");
+      myfile3shg2.open(filename + "RR");
+      myfile3shg3.open(filename + "AA");
+      myfile2shg.open(filename + "2");
+      myfile1shg.open(filename + "1");
+      myfile0shg.open(filename + "0");
+    }
 
 
-  for(int i=0; i < N_omegas; i++){
-    freq = std::real(frequencies(i))*static_cast<T>(systemInfo.energy_scale);
-    myfile_shg  << freq << " " << cond_shg.real()(i) << " " << cond_shg.imag()(i) << "\n";
-    if(print_all){
+    for(int i=0; i < N_omegas; i++){
+      freq = std::real(frequencies(i))*static_cast<T>(systemInfo.energy_scale);
+      myfile_shg  << freq << " " << cond_shg.real()(i) << " " << cond_shg.imag()(i) << "\n";
+      if(print_all){
+
+        myfile3shg1 << freq << " " << cond3shg1.real()(i) << " " << cond3shg1.imag()(i) << "\n";
+        myfile3shg2 << freq << " " << cond3shg2.real()(i) << " " << cond3shg2.imag()(i) << "\n";
+        myfile3shg3 << freq << " " << cond3shg3.real()(i) << " " << cond3shg3.imag()(i) << "\n";
+        myfile2shg  << freq << " " << cond2shg.real()(i)  << " " << cond2shg.imag()(i)  << "\n";
+        myfile1shg  << freq << " " << cond1shg.real()(i)  << " " << cond1shg.imag()(i)  << "\n";
+        myfile0shg  << freq << " " << cond0shg.real()(i)  << " " << cond0shg.imag()(i)  << "\n";
+      } 
+    }
+    myfile_shg.close();
+    myfile3shg1.close();
+    myfile3shg2.close();
+    myfile3shg3.close();
+    myfile2shg.close();
+    myfile1shg.close();
+    myfile0shg.close();
+  }
 
-      myfile3shg1 << freq << " " << cond3shg1.real()(i) << " " << cond3shg1.imag()(i) << "\n";
-      myfile3shg2 << freq << " " << cond3shg2.real()(i) << " " << cond3shg2.imag()(i) << "\n";
-      myfile3shg3 << freq << " " << cond3shg3.real()(i) << " " << cond3shg3.imag()(i) << "\n";
-      myfile2shg  << freq << " " << cond2shg.real()(i)  << " " << cond2shg.imag()(i)  << "\n";
-      myfile1shg  << freq << " " << cond1shg.real()(i)  << " " << cond1shg.imag()(i)  << "\n";
-      myfile0shg  << freq << " " << cond0shg.real()(i)  << " " << cond0shg.imag()(i)  << "\n";
-    } 
+  // All the terms are always written to the HDF5 file
+  if(variables.Output_hdf5){
+    results_file results(variables.Output_Name, "CondOpt2");
+    write_parameters(results, *this);
+    results.write_vector<std::complex<double>>("Conductivity", cond_shg.transpose().template cast<std::complex<double>>().array(), "Second-order conductivity");
+    results.write_vector<std::complex<double>>("Term0",  cond0shg.transpose().template cast<std::complex<double>>().array(), "Term 0 of the second-order conductivity");
+    results.write_vector<std::complex<double>>("Term1",  cond1shg.transpose().template cast<std::complex<double>>().array(), "Term 1 of the second-order conductivity");
+    results.write_vector<std::complex<double>>("Term2",  cond2shg.transpose().template cast<std::complex<double>>().array(), "Term 2 of the second-order conductivity");
+    results.write_vector<std::complex<double>>("TermRA", cond3shg1.transpose().template cast<std::complex<double>>().array(), "RA term of the second-order conductivity");
+    results.write_vector<std::complex<double>>("TermRR", cond3shg2.transpose().template cast<std::complex<double>>().array(), "RR term of the second-order conductivity");
+    results.write_vector<std::complex<double>>("TermAA", cond3shg3.transpose().template cast<std::complex<double>>().array(), "AA term of the second-order conductivity");
   }
-  myfile_shg.close();
-  myfile3shg1.close();
-  myfile3shg2.close();
-  myfile3shg3.close();
-  myfile2shg.close();
-  myfile1shg.close();
-  myfile0shg.close();
 }
 
 template <typename T, unsigned DIM>
@@ -16,9 +16,11 @@
 #include <H5Cpp.h>
 #include "tools/ComplexTraits.hpp"
 #include "tools/myHDF5.hpp"
+#include "tools/results.hpp"
 
 #include "tools/parse_input.hpp"
 #include "tools/systemInfo.hpp"
+#include "tools/extrapolate.hpp"
 #include "spectral/arpes.hpp"
 
 #include "tools/functions.hpp"
@@ -81,6 +83,8 @@ void arpes<T, DIM>::printARPES(){
     if(kernel == "green"){
         std::cout << "   Kernel parameter: "     << kernel_parameter*scale << ((default_kernel_parameter)? " (default)":"") << "\n";
     }
+    if(Extrapolate > 0)
+        std::cout << "   Extrapolated moments: " << Extrapolate << "\n";
 }
 
 template <typename T, unsigned DIM>
@@ -152,6 +156,16 @@ void arpes<T, DIM>::override_parameters(){
         default_NumMoments = false;
     }
 
+    if(variables.ARPES_Extrapolate != -1){
+        Extrapolate     = variables.ARPES_Extrapolate;
+        PredictionOrder = variables.ARPES_PredictionOrder;
+        if(Extrapolate <= NumMoments){
+          std::cout << "ARPES: The number of extrapolated moments has to be larger"
+            " than the number of moments used (" << NumMoments << "). Exiting.\n";
+          exit(1);
+        }
+    }
+
     if(!variables.ARPES_kernel.empty()){
         kernel         = variables.ARPES_kernel;
         default_kernel = false;
@@ -220,6 +234,9 @@ void arpes<T, DIM>::set_default_parameters(){
   kernel = "jackson";
   default_kernel = true;
   default_kernel_parameter = true;
+
+  Extrapolate = -1;
+  PredictionOrder = -1;
 }
 
 
@@ -290,20 +307,21 @@ bool arpes<T, DIM>::fetch_parameters(){
 }
 
 template <typename T, unsigned DIM>
-void arpes<T, DIM>::calculate(){
-  debug_message("Entered arpes::calculate\n");
-    
+Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> arpes<T, DIM>::chebyshev_sum(
+  const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>& moments, int N){
+  // Spectral function (times the Fermi function) from the first N moments,
+  // one row per energy and one column per k-vector
 
   Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> ARPES = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NumEnergies, NumVectors);
   Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> OrderedMU;
-  OrderedMU = kMU;
+  OrderedMU = moments.topRows(N);
 
   
   debug_message("starting parallelization\n");
   omp_set_num_threads(systemInfo->NumThreads);
 #pragma omp parallel 
 {
-  int localN = NumMoments/systemInfo->NumThreads;
+  int localN = N/systemInfo->NumThreads;
   int thread_id = omp_get_thread_num();
   long offset = thread_id*localN*NumVectors;
   Eigen::Map<Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> localkMU(OrderedMU.data() + offset, localN, NumVectors);
@@ -320,7 +338,7 @@ void arpes<T, DIM>::calculate(){
   if(kernel =="jackson"){
       for(int m = 0; m < localN; m++){
         factor = static_cast<T>(1.0/(1.0 + static_cast<T>((m + thread_id*localN)==0)));
-        kern   = kernel_jackson<T>(m + thread_id*localN, NumMoments)*factor;
+        kern   = kernel_jackson<T>(m + thread_id*localN, N)*factor;
         for(int i = 0; i < NumEnergies; i++){
           
           ferm = 1.0;
@@ -355,6 +373,29 @@ void arpes<T, DIM>::calculate(){
 #pragma omp critical
   ARPES += GammaE*localkMU;
 }
+  return ARPES;
+}
+
+template <typename T, unsigned DIM>
+void arpes<T, DIM>::calculate(){
+  debug_message("Entered arpes::calculate\n");
+
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> ARPES, reference;
+
+  T difference = 0;
+  if(Extrapolate > 0){
+    // The result from the moments calculated by KITEx is kept to compare it with the extrapolated one
+    reference = chebyshev_sum(kMU, NumMoments);
+    kMU = extrapolate_columns<T>(kMU.topRows(NumMoments), Extrapolate, PredictionOrder, systemInfo->NumThreads, extrapolation);
+    NumMoments = Extrapolate;
+    extrapolation.print();
+  }
+
+  ARPES = chebyshev_sum(kMU, NumMoments);
+  if(Extrapolate > 0){
+    difference = (ARPES.real() - reference.real()).norm()/reference.real().norm();
+    std::cout << "   Relative difference with the spectral function without extrapolation: " << difference << "\n";
+  }
 
   // Save the density of states to a file
   double scale = systemInfo->energy_scale;
@@ -380,20 +421,38 @@ void arpes<T, DIM>::calculate(){
 
     for(unsigned ii = 0; ii < NumVectors; ii++){
       ARPES.col(ii) *= static_cast<T>(modulation(ii)*modulation(ii));
+      if(Extrapolate > 0)
+        reference.col(ii) *= static_cast<T>(modulation(ii)*modulation(ii));
     }
   }
 
 
 
-  std::ofstream myfile;
-  myfile.open(filename + ".dat");
-  myfile << "k-vectors:\n";
-  for(unsigned int i = 0; i < NumVectors; i++)  myfile << arpes_k_vectors(0,i) << " " << arpes_k_vectors(1,i) << "\n";
-  myfile << "Energies:\n";
-  myfile << energies*scale + shifts << "\n";
-  myfile << "ARPES:\n";
-  myfile << ARPES.real() << "\n";
-  myfile.close();
+  if(variables.Output_text){
+    std::ofstream myfile;
+    myfile.open(filename + ".dat");
+    myfile << "k-vectors:\n";
+    for(unsigned int i = 0; i < NumVectors; i++)  myfile << arpes_k_vectors(0,i) << " " << arpes_k_vectors(1,i) << "\n";
+    myfile << "Energies:\n";
+    myfile << energies*scale + shifts << "\n";
+    myfile << "ARPES:\n";
+    myfile << ARPES.real() << "\n";
+    myfile.close();
+  }
+
+  // One row of ARPES per energy and one column per k-vector
+  if(variables.Output_hdf5){
+    results_file results(variables.Output_Name, "ARPES");
+    results.write<double>("KVectors", arpes_k_vectors.transpose().array(), "k-vectors, one per row");
+    results.write_vector<double>("Energies", (energies*scale + shifts).template cast<double>().array(), "Energies (eV)");
+    results.write<double>("ARPES", ARPES.real().template cast<double>().array(), "ARPES, one row per energy and one column per k-vector");
+    if(Extrapolate > 0){
+      results.write<double>("ARPESWithoutExtrapolation", reference.real().template cast<double>().array(),
+          "ARPES from the moments calculated by KITEx, one row per energy and one column per k-vector");
+      results.attribute("RelativeDifference", static_cast<double>(difference));
+      extrapolation.save(results);
+    }
+  }
   debug_message("Left arpes::calculate\n");
 }
 
@@ -14,9 +14,11 @@
 #include <H5Cpp.h>
 #include "tools/ComplexTraits.hpp"
 #include "tools/myHDF5.hpp"
+#include "tools/results.hpp"
 
 #include "tools/parse_input.hpp"
 #include "tools/systemInfo.hpp"
+#include "tools/extrapolate.hpp"
 #include "spectral/dos.hpp"
 #include "tools/functions.hpp"
 
@@ -104,6 +106,9 @@ void dos<T, DIM>::set_default_parameters(){
     default_kernel = true;
     default_kernel_parameter = true;
 
+    Extrapolate = -1;
+    PredictionOrder = -1;
+
 }
 	
 template <typename T, unsigned DIM>
@@ -160,6 +165,16 @@ void dos<T, DIM>::override_parameters(){
         filename            = variables.DOS_Name;
         default_filename    = false;
     }
+
+    if(variables.DOS_Extrapolate != -1){
+        Extrapolate         = variables.DOS_Extrapolate;
+        PredictionOrder     = variables.DOS_PredictionOrder;
+        if(Extrapolate <= NumMoments){
+          std::cout << "DOS: The number of extrapolated moments has to be larger"
+            " than the number of moments used (" << NumMoments << "). Exiting.\n";
+          exit(1);
+        }
+    }
 }
 
 template <typename T, unsigned DIM>
@@ -241,30 +256,30 @@ void dos<T, DIM>::printDOS(){
     if(kernel == "green"){
         std::cout << "   Kernel parameter: "     << kernel_parameter*scale << ((default_kernel_parameter)? " (default)":"") << "\n";
     }
+    if(Extrapolate > 0)
+        std::cout << "   Extrapolated moments: " << Extrapolate << "\n";
 }
 
 
 template <typename T, unsigned DIM>
-void dos<T, DIM>::calculate(){
+Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> dos<T, DIM>::spectrum(
+  const Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>& moments, int N){
   
-  using namespace std::placeholders;  // for _1, _2, _3...
-  
-  // First perform the part of the product that only depends on the
-  // chebyshev polynomial of the first kind
-  GammaE = Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NEnergies, 1);
+  // Density of states from the first N moments
+  Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> result;
+  result = Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NEnergies, 1);
   
   T scale = static_cast<T>(systemInfo->energy_scale);
   T mult = static_cast<T>(1.0/scale);
   T factor;
-  T shift = static_cast<T>(systemInfo->energy_shift);
   
   // Choosing the kernel/exact green expansion
   
   if(kernel == "jackson"){
     for(int i = 0; i < NEnergies; i++){
-      for(int m = 0; m < NumMoments; m++){
+      for(int m = 0; m < N; m++){
         factor = static_cast<T>(1.0/(1.0 + static_cast<T>(m==0)));
-        GammaE(i) += MU(m)*delta(m,energies(i))*kernel_jackson<T>(m, NumMoments)*factor*mult;
+        result(i) += moments(m)*delta(m,energies(i))*kernel_jackson<T>(m, N)*factor*mult;
       }
     }
   }
@@ -273,20 +288,61 @@ void dos<T, DIM>::calculate(){
   if(kernel == "green"){
     for(int i = 0; i < NEnergies; i++){
       c_energy = std::complex<T>(energies(i), kernel_parameter);
-      for(int m = 0; m < NumMoments; m++){
+      for(int m = 0; m < N; m++){
         factor = static_cast<T>(1.0/(1.0 + static_cast<T>(m==0))/M_PI);
-        GammaE(i) += -MU(m)*factor*mult*green<std::complex<T>>(m, 1, c_energy).imag();
+        result(i) += -moments(m)*factor*mult*green<std::complex<T>>(m, 1, c_energy).imag();
       }
     }
   }
+  return result;
+}
+
+template <typename T, unsigned DIM>
+void dos<T, DIM>::calculate(){
+  
+  T scale = static_cast<T>(systemInfo->energy_scale);
+  T shift = static_cast<T>(systemInfo->energy_shift);
+
+  // With extrapolation, the density of states from the moments calculated by
+  // KITEx is kept to compare it with the extrapolated one
+  Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> reference;
+  if(Extrapolate > 0){
+    reference = spectrum(MU, NumMoments);
+    Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> moments;
+    moments = MU.row(0).head(NumMoments).transpose().matrix();
+    MU = extrapolate_moments<T>(moments, Extrapolate, PredictionOrder, extrapolation).transpose().array();
+    NumMoments = Extrapolate;
+    extrapolation.print();
+  }
+
+  GammaE = spectrum(MU, NumMoments);
+
+  T difference = 0;
+  if(Extrapolate > 0){
+    difference = (GammaE.real() - reference.real()).matrix().norm()/reference.real().matrix().norm();
+    std::cout << "   Relative difference with the density of states without extrapolation: " << difference << "\n";
+  }
   
   // Save the density of states to a file and find its maximum value
-  std::ofstream myfile;
-  myfile.open(filename);
-  for(int i=0; i < NEnergies; i++){
-    myfile  << energies(i)*scale + shift << " " << GammaE.real()(i) /*<< " " << GammaE.imag()(i)*/ << "\n";
+  if(variables.Output_text){
+    std::ofstream myfile;
+    myfile.open(filename);
+    for(int i=0; i < NEnergies; i++){
+      myfile  << energies(i)*scale + shift << " " << GammaE.real()(i) /*<< " " << GammaE.imag()(i)*/ << "\n";
+    }
+    myfile.close();     
+  }
+  if(variables.Output_hdf5){
+    results_file results(variables.Output_Name, "DOS");
+    results.write_vector<double>("Energies", (energies.array()*scale + shift).template cast<double>(), "Energies (eV)");
+    results.write_vector<double>("DOS", GammaE.real().template cast<double>(), "Density of states");
+    if(Extrapolate > 0){
+      results.write_vector<double>("DOSWithoutExtrapolation", reference.real().template cast<double>(),
+          "Density of states from the moments calculated by KITEx");
+      results.attribute("RelativeDifference", static_cast<double>(difference));
+      extrapolation.save(results);
+    }
   }
-  myfile.close();     
   dos_finished = true;
   find_limits();      
 }
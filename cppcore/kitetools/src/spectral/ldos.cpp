@@ -16,9 +16,11 @@
 #include <H5Cpp.h>
 #include "tools/ComplexTraits.hpp"
 #include "tools/myHDF5.hpp"
+#include "tools/results.hpp"
 
 #include "tools/parse_input.hpp"
 #include "tools/systemInfo.hpp"
+#include "tools/extrapolate.hpp"
 #include "spectral/ldos.hpp"
 
 #include "tools/functions.hpp"
@@ -57,11 +59,18 @@ void ldos<T, DIM>::printLDOS(){
     std::cout << "The local density of states will be calculated with the following parameters:\n"
         "   Number of energies: " << NumEnergies << "\n"
         "   Number of positions: " << NumPositions << "\n"
-        "   Filename: " << filename  << "X.dat" << ((default_filename)?" (default)":"") << "\n"
-        "   Kernel: "               << kernel           << ((default_kernel)?           " (default)":"") << "\n";
+        "   Filename: " << filename  << "X.dat" << ((default_filename)?" (default)":"") << "\n";
+    if(recursion){
+        std::cout << "   Method: recursion, " << NumMoments << " levels and square root terminator\n"
+          "   Broadening: " << kernel_parameter*scale << ((default_kernel_parameter)? " (default)":"") << "\n";
+        return;
+    }
+    std::cout << "   Kernel: "               << kernel           << ((default_kernel)?           " (default)":"") << "\n";
     if(kernel == "green"){
         std::cout << "   Kernel parameter: "     << kernel_parameter*scale << ((default_kernel_parameter)? " (default)":"") << "\n";
     }
+    if(Extrapolate > 0)
+        std::cout << "   Extrapolated moments: " << Extrapolate << "\n";
 }
 
 template <typename T, unsigned DIM>
@@ -102,6 +111,21 @@ void ldos<T, DIM>::override_parameters(){
         }
     }
 
+    if(variables.lDOS_Extrapolate != -1){
+        Extrapolate     = variables.lDOS_Extrapolate;
+        PredictionOrder = variables.lDOS_PredictionOrder;
+        if(recursion){
+          std::cout << "lDOS: The moments can only be extrapolated with the Chebyshev expansion,"
+            " not with the recursion method. Exiting.\n";
+          exit(1);
+        }
+        if(Extrapolate <= NumMoments){
+          std::cout << "lDOS: The number of extrapolated moments has to be larger"
+            " than the number of moments used (" << NumMoments << "). Exiting.\n";
+          exit(1);
+        }
+    }
+
     //std::cout << "variables kernel:" << variables.lDOS_kernel << "\n";
     if(variables.lDOS_kernel != ""){
       //std::cout << "entered if \n";
@@ -129,6 +153,13 @@ void ldos<T, DIM>::set_default_parameters(){
     default_kernel = true;
     default_kernel_parameter = true;
 
+    Extrapolate = -1;
+    PredictionOrder = -1;
+
+    // the recursion method is only broadened with the green kernel parameter
+    kernel_parameter = 0;
+    recursion = false;
+
 }
 
 
@@ -198,6 +229,23 @@ bool ldos<T, DIM>::fetch_parameters(){
   int complex = systemInfo->isComplex;
   
   bool result = false;
+
+  // Coefficients of the recursion method, stored instead of the Chebyshev moments
+  try{
+    H5::Exception::dontPrint();
+    debug_message("Filling the recursion coefficients.\n");
+    get_hdf5(&NumDisorder, &file, (char*)(dirName+"NumDisorder").c_str());
+    RecursionA = Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic>::Zero(MaxMoments, NumPositions*NumDisorder);
+    RecursionB = Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic>::Zero(MaxMoments + 1, NumPositions*NumDisorder);
+    get_hdf5(RecursionA.data(), &file, (char*)(dirName+"RecursionA").c_str());
+    get_hdf5(RecursionB.data(), &file, (char*)(dirName+"RecursionB").c_str());
+    recursion = true;
+    NumMoments = MaxMoments;
+    file.close();
+    debug_message("Left lDOS::fetch_parameters.\n");
+    return true;
+  } catch(H5::Exception&) {debug_message("lDOS: There are no recursion coefficients.\n");}
+
   // Retrieve the lmu Matrix
   std::string MatrixName = dirName + "lMU";
   try{
@@ -227,14 +275,67 @@ bool ldos<T, DIM>::fetch_parameters(){
 
 
 template <typename T, unsigned DIM>
-void ldos<T, DIM>::calculate(){
+Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> ldos<T, DIM>::continued_fraction(){
+  // G(z) = b_0^2/(z - a_0 - b_1^2/(z - a_1 - ... - b_N^2 t(z))), averaged over the disorder
+  // realizations. The tail is replaced by the Green function t(z) of a semi-infinite chain with
+  // the mean coefficients of the second half of the recursion (square root terminator), unless
+  // the recursion closed exactly (b_n = 0)
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> LDOS;
+  LDOS = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NumEnergies, NumPositions);
+  const T pi = static_cast<T>(M_PI);
+
+  omp_set_num_threads(systemInfo->NumThreads);
+#pragma omp parallel for
+  for(long col = 0; col < static_cast<long>(NumPositions)*NumDisorder; col++){
+    int levels = NumMoments;
+    for(int n = 1; n <= NumMoments; n++)
+      if(RecursionB(n, col) == T(0)){
+        levels = n;
+        break;
+      }
+
+    T a_inf = 0, b_inf = 0;
+    const bool terminator = levels == NumMoments && NumMoments > 1;
+    if(terminator){
+      for(int n = NumMoments/2; n < NumMoments; n++){
+        a_inf += RecursionA(n, col);
+        b_inf += RecursionB(n + 1, col);
+      }
+      a_inf /= static_cast<T>(NumMoments - NumMoments/2);
+      b_inf /= static_cast<T>(NumMoments - NumMoments/2);
+    }
+
+    for(int i = 0; i < NumEnergies; i++){
+      std::complex<T> z(energies(i), kernel_parameter), g(0, 0);
+      if(terminator){
+        // of the two roots, the physical one decays along the chain (|t| < 1/b) and is retarded
+        std::complex<T> w = z - a_inf, s = std::sqrt(w*w - T(4)*b_inf*b_inf);
+        std::complex<T> t1 = (w - s)/(T(2)*b_inf*b_inf), t2 = (w + s)/(T(2)*b_inf*b_inf);
+        g = t1;
+        if(t2.imag() < t1.imag() || (t2.imag() == t1.imag() && std::abs(t2) < std::abs(t1)))
+          g = t2;
+      }
+      for(int n = levels - 1; n >= 0; n--)
+        g = T(1)/(z - RecursionA(n, col) - (n + 1 < levels || terminator ? RecursionB(n + 1, col)*RecursionB(n + 1, col) : T(0))*g);
+      g *= RecursionB(0, col)*RecursionB(0, col);
+
+#pragma omp critical
+      LDOS(i, col % NumPositions) += -g.imag()/(pi*static_cast<T>(NumDisorder));
+    }
+  }
+  return LDOS;
+}
+
+template <typename T, unsigned DIM>
+Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> ldos<T, DIM>::chebyshev_sum(
+  const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>& moments, int N){
+  // LDOS from the first N moments, one row per energy and one column per position
   
   Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> LDOS;
   LDOS = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NumEnergies, NumPositions);
   
   Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> OrderedMU;
-  OrderedMU = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>::Zero(NumEnergies, NumPositions);
-  OrderedMU = lMU;
+  OrderedMU = moments.topRows(N);
   
   omp_set_num_threads(systemInfo->NumThreads);
   //omp_set_num_threads(1);
@@ -242,7 +343,7 @@ void ldos<T, DIM>::calculate(){
   {
 #pragma omp critical
     {
-      int localN = NumMoments/systemInfo->NumThreads;
+      int localN = N/systemInfo->NumThreads;
       //int localN = NumMoments;
       int thread_id = omp_get_thread_num();
       //std::cout << "thread_id: " << thread_id << "\n";
@@ -262,7 +363,7 @@ void ldos<T, DIM>::calculate(){
 	for(int i = 0; i < NumEnergies; i++){
 	  for(int m = 0; m < localN; m++){
 	    factor = static_cast<T>(1.0/(1.0 + static_cast<T>((m + thread_id*localN)==0)));
-	    GammaE(i,m) += delta(m + thread_id*localN,energies(i))*kernel_jackson<T>(m + thread_id*localN, NumMoments)*factor;
+	    GammaE(i,m) += delta(m + thread_id*localN,energies(i))*kernel_jackson<T>(m + thread_id*localN, N)*factor;
 	  }
 	}
       }
@@ -273,8 +374,8 @@ void ldos<T, DIM>::calculate(){
 	for(int i = 0; i < NumEnergies; i++){
 	  c_energy = std::complex<T>(energies(i), kernel_parameter);
 	  for(int m = 0; m < localN; m++){
-	    factor = static_cast<T>(1.0/(1.0 + static_cast<T>((m + thread_id*localN)==0)));
-	    GammaE(i,m) += -factor*green<std::complex<T>>(m, 1, c_energy).imag();
+	    factor = static_cast<T>(1.0/(1.0 + static_cast<T>((m + thread_id*localN)==0))/M_PI);
+	    GammaE(i,m) += -factor*green<std::complex<T>>(m + thread_id*localN, 1, c_energy).imag();
 	  }
 	}
       }
@@ -294,33 +395,72 @@ void ldos<T, DIM>::calculate(){
       LDOS += localLDOS;
     }
   }
+  return LDOS;
+}
+
+template <typename T, unsigned DIM>
+void ldos<T, DIM>::calculate(){
+  
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> LDOS, reference;
+  
+  T difference = 0;
+  if(recursion)
+    LDOS = continued_fraction();
+  else if(Extrapolate > 0){
+    // The LDOS from the moments calculated by KITEx is kept to compare it with the extrapolated one
+    reference = chebyshev_sum(lMU, NumMoments);
+    lMU = extrapolate_columns<T>(lMU.topRows(NumMoments), Extrapolate, PredictionOrder, systemInfo->NumThreads, extrapolation);
+    NumMoments = Extrapolate;
+    extrapolation.print();
+    LDOS = chebyshev_sum(lMU, NumMoments);
+    difference = (LDOS.real() - reference.real()).norm()/reference.real().norm();
+    std::cout << "   Relative difference with the LDOS without extrapolation: " << difference << "\n";
+  } else
+    LDOS = chebyshev_sum(lMU, NumMoments);
   
   // Save the density of states to a file
   T mult = static_cast<T>(1.0/systemInfo->energy_scale);
-  std::ofstream myfile;
   double scale = systemInfo->energy_scale;
   double shift = systemInfo->energy_shift;
-  for(int i=0; i < NumEnergies; i++){
-    myfile.open(filename + std::to_string(energies(i)*scale + shift) + ".dat");
-    if(DIM == 2){
-      for(unsigned pos = 0; pos < NumPositions; pos++){
-	int x, y, orb;
-	x = global_positions(pos,0);
-	y = global_positions(pos,1);
-	orb = global_positions(pos,2);
-	myfile  << x << " " << y << " " << orb << " " << LDOS(i,pos).real()*mult << "\n";
-      };
-    } else if(DIM == 3){
-      for(unsigned pos = 0; pos < NumPositions; pos++){
-	int x, y, z, orb;
-	x = global_positions(pos,0);
-	y = global_positions(pos,1);
-	z = global_positions(pos,2);
-	orb = global_positions(pos,3);
-	myfile  << x << " " << y << " " << z << " " << orb << " " << LDOS(i,pos).real()*mult << "\n";
-      };
+  if(variables.Output_text){
+    std::ofstream myfile;
+    for(int i=0; i < NumEnergies; i++){
+      myfile.open(filename + std::to_string(energies(i)*scale + shift) + ".dat");
+      if(DIM == 2){
+        for(unsigned pos = 0; pos < NumPositions; pos++){
+          int x, y, orb;
+          x = global_positions(pos,0);
+          y = global_positions(pos,1);
+          orb = global_positions(pos,2);
+          myfile  << x << " " << y << " " << orb << " " << LDOS(i,pos).real()*mult << "\n";
+        };
+      } else if(DIM == 3){
+        for(unsigned pos = 0; pos < NumPositions; pos++){
+          int x, y, z, orb;
+          x = global_positions(pos,0);
+          y = global_positions(pos,1);
+          z = global_positions(pos,2);
+          orb = global_positions(pos,3);
+          myfile  << x << " " << y << " " << z << " " << orb << " " << LDOS(i,pos).real()*mult << "\n";
+        };
+      }
+      myfile.close();
+    }
+  }
+
+  // One row of LDOS per energy and one column per position. Each row of
+  // Positions has the lattice coordinates of a position followed by its orbital
+  if(variables.Output_hdf5){
+    results_file results(variables.Output_Name, "LDOS");
+    results.write_vector<double>("Energies", (energies.array().template cast<double>()*scale + shift), "Energies (eV)");
+    results.write<int>("Positions", global_positions.template cast<int>().array(), "Lattice coordinates and orbital of each position");
+    results.write<double>("LDOS", (LDOS.real()*mult).template cast<double>().array(), "Local density of states, one row per energy");
+    if(Extrapolate > 0){
+      results.write<double>("LDOSWithoutExtrapolation", (reference.real()*mult).template cast<double>().array(),
+          "Local density of states from the moments calculated by KITEx, one row per energy");
+      results.attribute("RelativeDifference", static_cast<double>(difference));
+      extrapolation.save(results);
     }
-    myfile.close();
   }
 }
 
@@ -19,6 +19,7 @@
 
 #include "tools/parse_input.hpp"
 #include "tools/systemInfo.hpp"
+#include "tools/extrapolate.hpp"
 #include "spectral/dos.hpp"
 #include "spectral/ldos.hpp"
 #include "spectral/arpes.hpp"
@@ -0,0 +1,241 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+#include <iostream>
+#include <complex>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Dense>
+#include <H5Cpp.h>
+#include <omp.h>
+#include "tools/results.hpp"
+#include "tools/extrapolate.hpp"
+#include "macros.hpp"
+
+int default_prediction_order(int NumMoments){
+  // Long enough to follow several features of the spectrum, short enough to
+  // leave most of the moments as equations of the fit
+  return std::max(1, std::min(NumMoments/8, 100));
+}
+
+template <typename T>
+T extrapolation_info<T>::residual() const{
+  return (fit_norm > T(0))? std::sqrt(fit_error/fit_norm) : T(0);
+}
+
+template <typename T>
+T extrapolation_info<T>::backtest() const{
+  return (back_norm > T(0))? std::sqrt(back_error/back_norm) : T(0);
+}
+
+template <typename T>
+void extrapolation_info<T>::merge(const extrapolation_info<T> & other){
+  from        = std::max(from, other.from);
+  to          = std::max(to, other.to);
+  order       = std::max(order, other.order);
+  sequences  += other.sequences;
+  unstable   += other.unstable;
+  fit_error  += other.fit_error;
+  fit_norm   += other.fit_norm;
+  back_error += other.back_error;
+  back_norm  += other.back_norm;
+}
+
+template <typename T>
+void extrapolation_info<T>::print() const{
+  std::cout << "   Extrapolation: " << from << " to " << to << " moments, linear prediction of order " << order << "\n"
+    "   Fit residual: " << residual() << ", backtest error: " << backtest() << ", growing modes reflected: " << unstable << "\n";
+  if(backtest() > T(0.05))
+    std::cout << "   WARNING: the last moments are poorly predicted from the first ones. "
+      "The extrapolated result may not be reliable; compare it with the one without extrapolation.\n";
+}
+
+template <typename T>
+void extrapolation_info<T>::save(results_file & results) const{
+  results.attribute("ExtrapolatedFrom", from);
+  results.attribute("ExtrapolatedTo", to);
+  results.attribute("PredictionOrder", order);
+  results.attribute("FitResidual", static_cast<double>(residual()));
+  results.attribute("BacktestError", static_cast<double>(backtest()));
+  results.attribute("ReflectedModes", unstable);
+}
+
+static void check_prediction_order(int M, int order){
+  // The fit needs at least twice as many equations as coefficients
+  if(M - std::max(order, M/4) < 2*order){
+    std::cout << "The order of the linear prediction (" << order << ") is too large for "
+      << M << " moments. It cannot be larger than " << M/3 << ". Exiting.\n";
+    exit(1);
+  }
+}
+
+template <typename T>
+static Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> predict(
+  const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> & mu, int MFit, int NTarget, int order,
+  T & error, T & norm, int & unstable){
+  // Fits mu_n = sum_{i=1}^{order} a_i mu_{n-i} to the moments n in [n0, MFit) by least squares. The
+  // first moments are left out of the fit: they carry the broad features of the spectrum, which a
+  // short recursion does not describe well. The roots z_k of the characteristic polynomial are the
+  // modes of the moments, mu_n = sum_k c_k z_k^n. Roots outside the unit circle would make the
+  // moments grow without bound, so they are reflected into it, z -> 1/conj(z), and the amplitudes
+  // c_k are fitted again to the moments before continuing the sum up to NTarget
+  typedef Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+  typedef Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> Vector;
+
+  Vector out = Vector::Zero(NTarget);
+  out.head(MFit) = mu.head(MFit);
+  error = 0;
+  norm = 0;
+  unstable = 0;
+
+  int n0 = std::max(order, MFit/4);
+  int rows = MFit - n0;
+  Matrix X(rows, order);
+  Vector y(rows);
+  for(int r = 0; r < rows; r++){
+    y(r) = mu(n0 + r);
+    for(int i = 0; i < order; i++)
+      X(r, i) = mu(n0 + r - i - 1);
+  }
+
+  norm = y.squaredNorm();
+  if(norm == T(0))
+    return out;
+
+  // Normal equations with a small Tikhonov term, which keeps the fit well defined
+  // when the moments are nearly linearly dependent (a few sharp peaks)
+  Matrix A = X.adjoint()*X;
+  Vector b = X.adjoint()*y;
+  T reg = std::sqrt(std::numeric_limits<T>::epsilon())*A.diagonal().real().maxCoeff();
+  A.diagonal().array() += std::complex<T>(reg, 0);
+  Vector a = A.ldlt().solve(b);
+
+  // Roots of z^p - a_1 z^{p-1} - ... - a_p are the eigenvalues of the companion matrix
+  Matrix C = Matrix::Zero(order, order);
+  C.row(0) = a.transpose();
+  for(int i = 1; i < order; i++)
+    C(i, i - 1) = 1;
+  Eigen::ComplexEigenSolver<Matrix> solver(C, false);
+  Vector roots = solver.eigenvalues();
+
+  for(int k = 0; k < order; k++)
+    if(std::abs(roots(k)) > T(1)){
+      roots(k) = T(1)/std::conj(roots(k));
+      unstable++;
+    }
+
+  // Amplitudes of the modes, mu_{n0+r} = sum_k c_k z_k^r
+  Matrix V(rows, order);
+  V.row(0).setOnes();
+  for(int r = 1; r < rows; r++)
+    V.row(r) = V.row(r - 1).cwiseProduct(roots.transpose());
+  Vector c = V.colPivHouseholderQr().solve(y);
+  error = (V*c - y).squaredNorm();
+
+  Vector power = V.row(rows - 1).transpose().cwiseProduct(roots);
+  for(int n = MFit; n < NTarget; n++){
+    out(n) = power.cwiseProduct(c).sum();
+    power = power.cwiseProduct(roots);
+  }
+
+  return out;
+}
+
+template <typename T>
+Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> extrapolate_moments(
+  const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> & mu, int NTarget, int order, extrapolation_info<T> & info){
+
+  int M = static_cast<int>(mu.size());
+  if(order <= 0)
+    order = default_prediction_order(M);
+  check_prediction_order(M, order);
+
+  info = extrapolation_info<T>();
+  info.from = M;
+  info.to = NTarget;
+  info.order = order;
+  info.sequences = 1;
+  if(NTarget <= M)
+    return mu.head(NTarget);
+
+  int unstable;
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> out;
+  out = predict(mu, M, NTarget, order, info.fit_error, info.fit_norm, info.unstable);
+
+  // Stability check: predict the last quarter of the moments from the others
+  int MBack = M - M/4;
+  int orderBack = std::min(order, std::max(1, (MBack - std::max(order, MBack/4))/2));
+  T error, norm;
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, 1> back;
+  back = predict(mu, MBack, M, orderBack, error, norm, unstable);
+  info.back_error = (back.tail(M - MBack) - mu.tail(M - MBack)).squaredNorm();
+  info.back_norm = mu.tail(M - MBack).squaredNorm();
+
+  // The roots of real moments come in complex conjugate pairs, so their prediction is real up to rounding
+  if(mu.imag().isZero(T(0)))
+    out = out.real().template cast<std::complex<T>>();
+
+  return out;
+}
+
+template <typename T>
+Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> extrapolate_columns(
+  const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> & mu, int NTarget, int order,
+  int NumThreads, extrapolation_info<T> & info){
+
+  long NCols = static_cast<long>(mu.cols());
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> out;
+  out = Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(NTarget, NCols);
+
+  check_prediction_order(static_cast<int>(mu.rows()), (order <= 0)? default_prediction_order(static_cast<int>(mu.rows())) : order);
+
+  info = extrapolation_info<T>();
+  omp_set_num_threads(NumThreads);
+#pragma omp parallel
+  {
+    extrapolation_info<T> local, column;
+#pragma omp for schedule(dynamic)
+    for(long c = 0; c < NCols; c++){
+      out.col(c) = extrapolate_moments<T>(mu.col(c), NTarget, order, column);
+      local.merge(column);
+    }
+#pragma omp critical
+    info.merge(local);
+  }
+  return out;
+}
+
+template <typename T>
+Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> extrapolate_gamma(
+  const Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> & Gamma, int NTarget, int order,
+  int NumThreads, extrapolation_info<T> & info){
+
+  extrapolation_info<T> cols;
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> rows;
+  rows = extrapolate_columns<T>(Gamma.transpose(), NTarget, order, NumThreads, info).transpose();
+  Eigen::Matrix<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> out;
+  out = extrapolate_columns<T>(rows, NTarget, order, NumThreads, cols);
+  info.merge(cols);
+  return out;
+}
+
+template struct extrapolation_info<float>;
+template struct extrapolation_info<double>;
+template struct extrapolation_info<long double>;
+
+template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, 1> extrapolate_moments<float>(const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, 1> &, int, int, extrapolation_info<float> &);
+template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, 1> extrapolate_moments<double>(const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, 1> &, int, int, extrapolation_info<double> &);
+template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, 1> extrapolate_moments<long double>(const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, 1> &, int, int, extrapolation_info<long double> &);
+
+template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic> extrapolate_columns<float>(const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic> &, int, int, int, extrapolation_info<float> &);
+template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic> extrapolate_columns<double>(const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic> &, int, int, int, extrapolation_info<double> &);
+template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic> extrapolate_columns<long double>(const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic> &, int, int, int, extrapolation_info<long double> &);
+
+template Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic> extrapolate_gamma<float>(const Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic> &, int, int, int, extrapolation_info<float> &);
+template Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic> extrapolate_gamma<double>(const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic> &, int, int, int, extrapolation_info<double> &);
+template Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic> extrapolate_gamma<long double>(const Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, Eigen::Dynamic> &, int, int, int, extrapolation_info<long double> &);
@@ -42,6 +42,29 @@ template std::complex<float> integrate<float>(Eigen::Matrix<float, Eigen::Dynami
 template std::complex<double> integrate<double>(Eigen::Matrix<double, Eigen::Dynamic, 1>, Eigen::Matrix<std::complex<double>, Eigen::Dynamic, 1>);
 template std::complex<long double> integrate<long double>(Eigen::Matrix<long double, Eigen::Dynamic, 1>, Eigen::Matrix<std::complex<long double>, Eigen::Dynamic, 1>);
 
+template <typename T>
+Eigen::Matrix<T, Eigen::Dynamic, 1> simpson_weights(int N, T dE){
+    // Weights of the Simpson 1/3 rule used in integrate(), so that an integral
+    // can be written as a dot product with the integrand. N must be odd
+    if(N % 2 != 1) {
+        std::cout << "Number of energies in the final integraton process must be odd. Exiting.\n";
+        exit(1);
+    }
+
+    Eigen::Matrix<T, Eigen::Dynamic, 1> weights;
+    weights = Eigen::Matrix<T, Eigen::Dynamic, 1>::Zero(N);
+    for(int i = 1; i < N - 1; i++)
+        weights(i) = (i%2 == 1)? T(4.0) : T(2.0);
+    weights(0) = T(1.0);
+    weights(N-1) = T(1.0);
+
+    return weights/T(3.0)*dE;
+}
+
+template Eigen::Matrix<float, Eigen::Dynamic, 1> simpson_weights<float>(int, float);
+template Eigen::Matrix<double, Eigen::Dynamic, 1> simpson_weights<double>(int, double);
+template Eigen::Matrix<long double, Eigen::Dynamic, 1> simpson_weights<long double>(int, long double);
+
 template <typename T>
 T fermi_function(T energy, T mu, T beta){
 	return 1.0/(1.0 + exp(beta*(energy - mu)));
@@ -50,6 +73,46 @@ template float fermi_function(float, float, float);
 template double fermi_function(double, double, double);
 template long double fermi_function(long double, long double, long double);
 
+template <typename T>
+T dilogarithm(T y){
+    // Li2(y) for -1 <= y <= 0, from its series in powers of u = -log(1 - y) with
+    // the Bernoulli numbers as coefficients. |u| <= log(2), so it converges quickly
+    const T bernoulli[] = {T(1.0), T(-1.0/2), T(1.0/6), T(-1.0/30), T(1.0/42), T(-1.0/30), T(5.0/66),
+                           T(-691.0/2730), T(7.0/6), T(-3617.0/510), T(43867.0/798), T(-174611.0/330)};
+    T u = -std::log1p(-y);
+    T sum = bernoulli[0]*u + bernoulli[1]*u*u/T(2.0);
+    T power = u, factorial = T(1.0);
+    for(int n = 2; n <= 22; n += 2){
+        power *= u*u;
+        factorial *= T(n)*T(n + 1);
+        sum += bernoulli[n/2 + 1]*power/factorial;
+    }
+    return sum;
+}
+
+template <typename T>
+T fermi_tail(int order, T x){
+    // Integral from x to infinity of t^order * (-df/dt), with f(t) = 1/(1 + e^t),
+    // for order = 0, 1, 2. The Fermi window (E - mu)^order (-df/dE) of the
+    // thermoelectric coefficients integrates to beta^(-order) fermi_tail(order, beta(E - mu)).
+    // The symmetry of -df/dt about t = 0 is used for negative x
+    if(x < 0){
+        T mirror = fermi_tail(order, -x);
+        if(order == 0) return T(1.0) - mirror;
+        if(order == 1) return mirror;
+        return T(M_PI*M_PI/3.0) - mirror;
+    }
+    T e = std::exp(-x);
+    T f = e/(T(1.0) + e);
+    T l = std::log1p(e);
+    if(order == 0) return f;
+    if(order == 1) return x*f + l;
+    return x*x*f + T(2.0)*(x*l - dilogarithm(-e));
+}
+template float fermi_tail(int, float);
+template double fermi_tail(int, double);
+template long double fermi_tail(int, long double);
+
 std::string num2str3f(int dir_num){
   std::string dir;
  
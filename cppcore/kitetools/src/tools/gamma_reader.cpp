@@ -0,0 +1,119 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+#include <iostream>
+#include <complex>
+#include <string>
+#include <future>
+#include <mutex>
+#include <Eigen/Dense>
+#include <H5Cpp.h>
+#include "tools/ComplexTraits.hpp"
+#include "tools/myHDF5.hpp"
+#include "tools/gamma_reader.hpp"
+#include "macros.hpp"
+
+// The HDF5 library is not necessarily thread-safe, so all the reads go through this lock.
+// Several threads may then share the same reader without any further care.
+static std::mutex hdf5_lock;
+
+template <typename T>
+gamma_reader<T>::gamma_reader(const std::string & filename, const std::string & name, bool complex){
+    // Opens the dataset and finds its dimensions. Throws an H5::Exception
+    // if the dataset does not exist, just like get_hdf5 does.
+    std::lock_guard<std::mutex> guard(hdf5_lock);
+    isComplex = complex;
+
+    file    = H5::H5File(filename.c_str(), H5F_ACC_RDONLY);
+    dataset = file.openDataSet(name);
+
+    hsize_t dims[2] = {1, 1};
+    H5::DataSpace space = dataset.getSpace();
+    space.getSimpleExtentDims(dims);
+    if(space.getSimpleExtentNdims() == 1){
+        dims[1] = dims[0];
+        dims[0] = 1;
+    }
+    rows = dims[0];
+    cols = dims[1];
+}
+
+template <typename T>
+gamma_reader<T>::~gamma_reader(){
+    // Make sure no read is still running when the file is closed
+    if(pending.valid())
+        pending.wait();
+
+    std::lock_guard<std::mutex> guard(hdf5_lock);
+    dataset.close();
+    file.close();
+}
+
+template <typename T>
+Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> gamma_reader<T>::read(hsize_t row0, hsize_t nrows,
+        hsize_t col0, hsize_t ncount, hsize_t stride, hsize_t block){
+    debug_message("Entered gamma_reader::read\n");
+
+    Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> section;
+    section = Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic>::Zero(ncount*block, nrows);
+
+    hsize_t start[2]    = {row0, col0};
+    hsize_t count[2]    = {nrows, ncount};
+    hsize_t strides[2]  = {1, stride};
+    hsize_t blocks[2]   = {1, block};
+    hsize_t mem_dims[2] = {nrows, ncount*block};
+
+    std::lock_guard<std::mutex> guard(hdf5_lock);
+    H5::DataSpace filespace = dataset.getSpace();
+    if(filespace.getSimpleExtentNdims() == 1){
+        // a single row stored as a 1D dataset
+        filespace.selectHyperslab(H5S_SELECT_SET, count + 1, start + 1, strides + 1, blocks + 1);
+    } else {
+        filespace.selectHyperslab(H5S_SELECT_SET, count, start, strides, blocks);
+    }
+    H5::DataSpace memspace(2, mem_dims);
+
+    if(isComplex){
+        H5::CompType complex_data_type(sizeof(std::complex<T>));
+        complex_data_type.insertMember("r", 0, DataTypeFor<T>::value);
+        complex_data_type.insertMember("i", sizeof(T), DataTypeFor<T>::value);
+        dataset.read(section.data(), complex_data_type, memspace, filespace);
+    } else {
+        Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> sectionReal;
+        sectionReal = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(ncount*block, nrows);
+        dataset.read(sectionReal.data(), DataTypeFor<T>::value, memspace, filespace);
+        section = sectionReal.template cast<std::complex<T>>();
+    }
+
+    debug_message("Left gamma_reader::read\n");
+    return section;
+}
+
+template <typename T>
+void gamma_reader<T>::prefetch(hsize_t row0, hsize_t nrows, hsize_t col0, hsize_t ncount, hsize_t stride, hsize_t block){
+    // Starts reading the section in the background. Only one section may be pending
+    if(pending.valid())
+        pending.wait();
+
+    pending = std::async(std::launch::async, [this, row0, nrows, col0, ncount, stride, block](){
+        return read(row0, nrows, col0, ncount, stride, block);
+    });
+}
+
+template <typename T>
+Eigen::Array<std::complex<T>, Eigen::Dynamic, Eigen::Dynamic> gamma_reader<T>::fetch(){
+    // Waits for the section started by prefetch() and returns it
+    if(!pending.valid()){
+        std::cout << "gamma_reader: fetch() was called without a prefetch(). Exiting.\n";
+        exit(1);
+    }
+    return pending.get();
+}
+
+template class gamma_reader<float>;
+template class gamma_reader<double>;
+template class gamma_reader<long double>;
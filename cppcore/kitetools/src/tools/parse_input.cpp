@@ -9,6 +9,7 @@
 #include <Eigen/Dense>
 #include <vector>
 #include <string>
+#include <cctype>
 #include <complex>
 #include <H5Cpp.h>
 #include "tools/ComplexTraits.hpp"
@@ -21,16 +22,31 @@ void shell_input::printDC(){
 
     // DC Conductivity
     std::cout << "Printing parameters for the DC conductivity obtained from the shell:\n";
-    if(CondDC_Temp != -1)           std::cout << "    temperature: "                << CondDC_Temp << "\n";
+    if(!CondDC_Temp.empty()){
+        std::cout << "    temperature:";
+        for(double t: CondDC_Temp){
+            std::cout << " " << t;
+        }
+        std::cout << "\n";
+    }
     if(CondDC_NumEnergies != -1)    std::cout << "    number of energy points: "    << CondDC_NumEnergies << "\n";
     if(CondDC_NumMoments != -1)     std::cout << "    number of moments: "          << CondDC_NumMoments << "\n";
-    if(CondDC_Scat != -8888)        std::cout << "    scattering parameter: "       << CondDC_Scat << "\n";
+    if(!CondDC_Scat.empty()){
+        std::cout << "    scattering parameter:";
+        for(double s: CondDC_Scat){
+            std::cout << " " << s;
+        }
+        std::cout << "\n";
+    }
     if(CondDC_deltaScat != -8888)   std::cout << "    delta scattering parameter: " << CondDC_deltaScat << "\n";
     if(CondDC_integrate != -8888)   std::cout << "    default integration region? " << CondDC_integrate << "\n";
     if(CondDC_FermiMin != -8888)    std::cout << "    minimum Fermi energy: "       << CondDC_FermiMin << "\n";
     if(CondDC_FermiMax != -8888)    std::cout << "    maximum Fermi energy: "       << CondDC_FermiMax << "\n";
     if(CondDC_NumFermi != -1)       std::cout << "    number of Fermi energies: "   << CondDC_NumFermi << "\n";
     if(CondDC_Name != "")           std::cout << "    name of the output file: "    << CondDC_Name << "\n";
+    if(CondDC_print_all != -1)      std::cout << "    separate file per temperature? " << CondDC_print_all << "\n";
+    if(CondDC_thermo != -1)         std::cout << "    thermoelectric coefficients? " << CondDC_thermo << "\n";
+    if(CondDC_Extrapolate != -1)    std::cout << "    extrapolated moments: "       << CondDC_Extrapolate << "\n";
     if(CondDC_Exclusive == true)    std::cout << "    Exclusive.\n";
     std::cout << "\n";
 } 
@@ -44,6 +60,7 @@ void shell_input::printOpt(){
     if(CondOpt_NumFreq != -1)       std::cout << "    number of frequencies: "      << CondOpt_NumFreq << "\n";
     if(CondOpt_Fermi != -8888)      std::cout << "    number of Fermi energies: "   << CondOpt_Fermi << "\n";
     if(CondOpt_Name != "")          std::cout << "    name of the output file: "    << CondOpt_Name << "\n";
+    if(CondOpt_MaxMemory != -1)     std::cout << "    memory for the Green's functions (MB): " << CondOpt_MaxMemory << "\n";
     if(CondOpt_Exclusive == true)   std::cout << "    Exclusive.\n";
     std::cout << "\n";
 }
@@ -68,6 +85,7 @@ void shell_input::printDOS(){
     std::cout << "Printing parameters for the Density of States obtained from the shell:\n";
     if(DOS_NumEnergies != -1 )      std::cout << "    number of energy points: "    << DOS_NumEnergies << "\n";
     if(DOS_Name != "")              std::cout << "    name of the output file: "    << DOS_Name << "\n";
+    if(DOS_Extrapolate != -1)       std::cout << "    extrapolated moments: "       << DOS_Extrapolate << "\n";
     if(DOS_Exclusive == true)       std::cout << "    Exclusive.\n";
     std::cout << "\n";
 }
@@ -105,13 +123,15 @@ void shell_input::printHelp(){
     std::cout << "--LDOS       Local density of states\n";
     std::cout << "--CondDC     DC conductivity\n";
     std::cout << "--CondOpt    Optical conductivity\n";
-    std::cout << "--CondOpt2   Second-order optical conductivity (photoconductivity)\n\n";
+    std::cout << "--CondOpt2   Second-order optical conductivity (photoconductivity)\n";
+    std::cout << "--Output     Files to which the results are written\n\n";
 
     std::cout << "After each of these keywords, the program will be expecting the subparameters associated with that word (always separated by spaces):\n\n";
 
     std::cout << "--LDOS     -N              Name of the output file\n";
     std::cout << "           -M              Number of Chebyshev moments\n";
     std::cout << "           -K              Kernel to use (jackson/green). green requires broadening parameter. Example: -K green 0.01\n";
+    std::cout << "           -x num [order]  Extrapolate the Chebyshev moments up to num moments by linear prediction\n";
     std::cout << "           -X              Exclusive. Only calculate this quantity\n\n";
 
     std::cout << "--ARPES    -N              Name of the output file\n";
@@ -122,23 +142,28 @@ void shell_input::printHelp(){
     std::cout << "           -O              Frequency of the incident wave\n";
     std::cout << "           -M              Number of Chebyshev moments\n";
     std::cout << "           -K              Kernel to use (jackson/green). green requires broadening parameter. Example: -K green 0.01\n";
+    std::cout << "           -x num [order]  Extrapolate the Chebyshev moments up to num moments by linear prediction\n";
     std::cout << "           -X              Exclusive. Only calculate this quantity\n\n";
 
     std::cout << "--DOS      -E              Number of energy points\n";
     std::cout << "           -N              Name of the output file\n";
     std::cout << "           -M              Number of Chebyshev moments\n";
     std::cout << "           -K              Kernel to use (jackson/green). green requires broadening parameter. Example: -K green 0.01\n";
+    std::cout << "           -x num [order]  Extrapolate the Chebyshev moments up to num moments by linear prediction\n";
     std::cout << "           -X              Exclusive. Only calculate this quantity\n\n";
 
     std::cout << "--CondDC   -E              Number of energy points used in the integration\n";
-    std::cout << "           -T              Temperature\n";
-    std::cout << "           -S              Broadening parameter of the Green's function\n";
+    std::cout << "           -T t1 t2 ...    Temperature. Several values may be given\n";
+    std::cout << "           -S s1 s2 ...    Broadening parameter of the Green's function. Several values may be given\n";
     std::cout << "           -d              Broadening parameter of the Dirac delta\n";
     std::cout << "           -I              If 0, uses the DoS to estimate integration range\n";
     std::cout << "           -F min max num  Fermi energies. min and max may be ommited.\n";
     std::cout << "           -N              Name of the output file\n";
     std::cout << "           -M              Number of Chebyshev moments to use in the calculation\n";
     std::cout << "           -t              Number of threads\n";
+    std::cout << "           -P              If 0, does not write a .dat file per temperature and broadening\n";
+    std::cout << "           -x num [order]  Extrapolate the Gamma matrix up to num moments by linear prediction\n";
+    std::cout << "           -L              If 1, also computes the thermoelectric coefficients L0, L1, L2, the Seebeck coefficient and the thermal conductivity\n";
     std::cout << "           -X              Exclusive. Only calculate this quantity\n\n";
 
     std::cout << "--CondOpt  -E              Number of energy points used in the integration\n";
@@ -149,6 +174,7 @@ void shell_input::printHelp(){
     std::cout << "           -N              Name of the output file\n";
     std::cout << "           -M              Number of Chebyshev moments\n";
     std::cout << "           -C num_d num_g  Output CondOpt at num_d moments of the Dirac delta and num_g moments of the Green's function.\n";
+    std::cout << "           -m              Memory (in MB) for the tables of Green's functions. Default: 1024\n";
     std::cout << "           -X              Exclusive. Only calculate this quantity\n\n";
 
     std::cout << "--CondOpt2 -E              Number of energy points used in the integration\n";
@@ -161,6 +187,10 @@ void shell_input::printHelp(){
     std::cout << "           -N              Name of the output file\n";
     std::cout << "           -X              Exclusive. Only calculate this quantity\n\n";
 
+    std::cout << "--Output   -N              Name of the HDF5 file where the results are written. Default: results.h5\n";
+    std::cout << "           -H              If 0, the results are not written to the HDF5 file\n";
+    std::cout << "           -D              If 0, the results are not written to .dat files\n\n";
+
     std::cout << "All the quantities are in the same units as the ones in the python configuration script. All quantities are double-precision numbers except for the ones representing integers, such as the numbers of points.\n\n";
 
     std::cout << "Examples:\n\n";
@@ -173,6 +203,9 @@ void shell_input::printHelp(){
     std::cout << "Example 3\n";
     std::cout << "    ./KITE-tools h5_file.h5 --CondDC -T 0.4 -F 500\n";
     std::cout << "    Calculates the DC conductivity using a temperature of 0.4 and 500 equidistant Fermi energies spanning the spectrum of the Hamiltonian.\n\n";
+    std::cout << "Example 3b\n";
+    std::cout << "    ./KITE-tools h5_file.h5 --CondDC -T 10 100 300 -S 0.01 0.02\n";
+    std::cout << "    Calculates the DC conductivity for the three temperatures and the two broadenings in a single pass over the Gamma matrix.\n\n";
     std::cout << "Example 4\n";
     std::cout << "    ./KITE-tools h5_file.h --CondDC -F -1.2 2.5 30 --CondOpt -T 93\n";
     std::cout << "    Calculates the DC conductivity using 30 equidistant Fermi energies in the range [-1.2, 2.5] and the optical conductivity using a temperature of 93.\n";
@@ -191,7 +224,7 @@ shell_input::shell_input(int argc, char *argv[]){
 	// Processes the input that this program recieves from the command line	
 
     // First, find the position of each of the following functions:
-    valid_keys = std::vector<std::string>{"--DOS", "--CondOpt","--CondDC", "--CondOpt2", "--LDOS", "--ARPES"};
+    valid_keys = std::vector<std::string>{"--DOS", "--CondOpt","--CondDC", "--CondOpt2", "--LDOS", "--ARPES", "--Output"};
     len = static_cast<int>(valid_keys.size());   // length of valid_keys?
     keys_pos = std::vector<int>(len, -1);
     keys_len = std::vector<int>(len, -1);
@@ -232,6 +265,7 @@ shell_input::shell_input(int argc, char *argv[]){
     parse_ARPES(argc, argv);
     parse_CondOpt(argc, argv);
     parse_CondOpt2(argc, argv);
+    parse_Output(argc, argv);
 
     // Process the exclusive flag. If there are no exclusive functions, 
     // all will be calculated. If there's only one, that's the only one
@@ -280,37 +314,65 @@ int shell_input::get_num_exclusives(){
     return N_exclusives;
 }
 
+static void read_extrapolation(char *argv[], int k, int last, int & target, int & order){
+    // -x num [order]: extrapolate the Chebyshev moments up to num moments with a
+    // linear prediction of the given order. The order is optional
+    target = atoi(argv[k + 1]);
+    if(k + 2 <= last){
+        std::string n2 = argv[k + 2];
+        if(!(n2.size() > 1 && n2[0] == '-' && isalpha(n2[1])))
+            order = atoi(n2.c_str());
+    }
+}
+
 void shell_input::parse_CondDC(int argc, char *argv[]){
     // This function looks at the command-line input pertaining to CondDC and
     // finds the parameters for the temperature "T", number of energy points "E", 
     // scattering parameter "S" and Fermi energy min, max and num "F"
     
-    CondDC_Temp = -1;
+    CondDC_Temp.clear();
     CondDC_NumEnergies = -1;
     CondDC_NumMoments = -1;
     CondDC_integrate = -1;
     CondDC_FermiMin = -8888; // Some stupid values that I hope no-one will ever pick
     CondDC_FermiMax = -8888;
     CondDC_NumFermi = -1;
-    CondDC_Scat = -8888;
+    CondDC_Scat.clear();
     CondDC_deltaScat = -8888;
     CondDC_Name = "";
+    CondDC_print_all = -1;
+    CondDC_thermo = -1;
+    CondDC_Extrapolate = -1;
+    CondDC_PredictionOrder = -1;
     CondDC_Exclusive = false;
     CondDC_nthreads = -1;
     // Process CondDC
     int j = 2;
     int pos = keys_pos.at(j);
+
+    // -T and -S accept a list of values, which extends until the next flag
+    auto read_list = [&](int k){
+        std::vector<double> values;
+        for(int ii = k + 1; ii <= keys_len.at(j); ii++){
+            std::string value = argv[ii + pos];
+            if(value.size() > 1 && value[0] == '-' && isalpha(value[1]))
+                break;
+            values.push_back(atof(value.c_str()));
+        }
+        return values;
+    };
+
     if(pos != -1){
         for(int k = 1; k < keys_len.at(j); k++){
             std::string name = argv[k + pos];
             std::string n1 = argv[k + pos + 1];
 
             if(name == "-T")
-                CondDC_Temp = atof(n1.c_str());
+                CondDC_Temp = read_list(k);
             if(name == "-E")
                 CondDC_NumEnergies = atoi(n1.c_str());
             if(name == "-S")
-                CondDC_Scat = atof(n1.c_str());
+                CondDC_Scat = read_list(k);
             if(name == "-d")
                 CondDC_deltaScat = atof(n1.c_str());
             if(name == "-M")
@@ -319,6 +381,12 @@ void shell_input::parse_CondDC(int argc, char *argv[]){
                 CondDC_integrate = atoi(n1.c_str());
             if(name == "-t")
                 CondDC_nthreads = atoi(n1.c_str());
+            if(name == "-P")
+                CondDC_print_all = atoi(n1.c_str());
+            if(name == "-L")
+                CondDC_thermo = atoi(n1.c_str());
+            if(name == "-x")
+                read_extrapolation(argv, k + pos, keys_len.at(j) + pos, CondDC_Extrapolate, CondDC_PredictionOrder);
             if(name == "-N")
                 CondDC_Name = n1;
             if(name == "-X" || n1 == "-X")
@@ -329,7 +397,7 @@ void shell_input::parse_CondDC(int argc, char *argv[]){
                     continue;
                 } else {
                     std::string n2 = argv[k + pos + 2];
-                    if(n2 == "-T" || n2 == "-E" || n2 == "-F" || n2 == "-S" || n2 == "-N" || n2 == "-X"){
+                    if(n2 == "-T" || n2 == "-E" || n2 == "-F" || n2 == "-S" || n2 == "-N" || n2 == "-X" || n2 == "-x"){
                         CondDC_NumFermi = atoi(n1.c_str());
                     } else {
                         std::string n3 = argv[k + pos + 3];
@@ -362,6 +430,7 @@ void shell_input::parse_CondOpt(int argc, char* argv[]){
     CondOpt_FreqMin = -8888;
     CondOpt_FreqMax = -8888;
     CondOpt_NumFreq = -1;
+    CondOpt_MaxMemory = -1;
     CondOpt_Fermi = -8888;
     CondOpt_Scat = -8888;
     CondOpt_Exclusive = false;
@@ -392,6 +461,8 @@ void shell_input::parse_CondOpt(int argc, char* argv[]){
             }
             if(name == "-F")
                 CondOpt_Fermi = atof(n1.c_str());
+            if(name == "-m")
+                CondOpt_MaxMemory = atoi(n1.c_str());
             if(name == "-X" || n1 == "-X")
                 CondOpt_Exclusive = true;
             if(name == "-O"){
@@ -481,6 +552,8 @@ void shell_input::parse_DOS(int argc, char* argv[]){
     DOS_Name = "";
     DOS_Exclusive = false;
     DOS_kernel_parameter = -8888.8;
+    DOS_Extrapolate = -1;
+    DOS_PredictionOrder = -1;
 
     int pos = keys_pos.at(0); // Position of the DoS (0) in the list of command line arguments
     if(pos != -1){
@@ -492,6 +565,8 @@ void shell_input::parse_DOS(int argc, char* argv[]){
                 DOS_Name = n1;
             if(name == "-M")
                 DOS_NumMoments = atoi(n1.c_str());
+            if(name == "-x")
+                read_extrapolation(argv, k + pos, keys_len.at(0) + pos, DOS_Extrapolate, DOS_PredictionOrder);
             if(name == "-K"){
                 DOS_kernel = n1;
                 if(n1 == "green"){
@@ -515,7 +590,7 @@ void shell_input::parse_DOS(int argc, char* argv[]){
                 // If the DoS is not the penultimate element, then there are other
                 // keys after it, so accessing k+pos+2 will be allowed
                 std::string n2 = argv[k + pos + 2];
-                if(n2=="-N" || n2=="-M" || n2=="-K" || n2=="-X"){
+                if(n2=="-N" || n2=="-M" || n2=="-K" || n2=="-X" || n2=="-x"){
                     DOS_NumEnergies = atoi(n1.c_str());
                     continue;
                 }
@@ -555,6 +630,8 @@ void shell_input::parse_lDOS(int argc, char* argv[]){
     lDOS_NumMoments = -1;
     lDOS_kernel = "";
     lDOS_kernel_parameter = -8888.8;
+    lDOS_Extrapolate = -1;
+    lDOS_PredictionOrder = -1;
     int pos = keys_pos.at(4);
     if(pos != -1){
         for(int k = 1; k < keys_len.at(4); k++){
@@ -564,6 +641,8 @@ void shell_input::parse_lDOS(int argc, char* argv[]){
                 lDOS_Name = n1;
             if(name == "-M")
                 lDOS_NumMoments = atoi(n1.c_str());
+            if(name == "-x")
+                read_extrapolation(argv, k + pos, keys_len.at(4) + pos, lDOS_Extrapolate, lDOS_PredictionOrder);
             if(name == "-K"){
                 lDOS_kernel = n1;
                 if(n1 == "green"){
@@ -590,7 +669,7 @@ void shell_input::parse_lDOS(int argc, char* argv[]){
 
 
 bool is_key(std::string n){
-  return n == "-T" || n == "-O" || n == "-F" || n == "-N" || n == "-X" || n == "-V" || n == "-E";
+  return n == "-T" || n == "-O" || n == "-F" || n == "-N" || n == "-X" || n == "-V" || n == "-E" || n == "-x";
 }
 
 void shell_input::parse_ARPES(int argc, char* argv[]){
@@ -610,6 +689,8 @@ void shell_input::parse_ARPES(int argc, char* argv[]){
     ARPES_NumMoments = -1;
     ARPES_kernel = "";
     ARPES_kernel_parameter = -8888.8;
+    ARPES_Extrapolate = -1;
+    ARPES_PredictionOrder = -1;
     ARPES_calculate_full_arpes = true;
     double v1, v2, v3;
 
@@ -636,6 +717,8 @@ void shell_input::parse_ARPES(int argc, char* argv[]){
                 ARPES_Exclusive = true;
             if(name == "-M")
                 ARPES_NumMoments = atoi(n1.c_str());
+            if(name == "-x")
+                read_extrapolation(argv, k + pos, keys_len.at(j) + pos, ARPES_Extrapolate, ARPES_PredictionOrder);
             if(name == "-K"){
                 ARPES_kernel = n1;
                 if(n1 == "green"){
@@ -715,3 +798,34 @@ void shell_input::parse_ARPES(int argc, char* argv[]){
     }
     debug_message("Left parse_ARPES\n");
 }
+
+void shell_input::parse_Output(int argc, char* argv[]){
+    // This function looks at the command-line input pertaining to the output
+    // and finds the name of the HDF5 file "N" and whether the results
+    // should be written to the HDF5 file "H" and to .dat files "D"
+    debug_message("Entered parse_Output\n");
+
+    Output_Name = "results.h5";
+    Output_hdf5 = true;
+    Output_text = true;
+
+    int j = 6;
+    int pos = keys_pos.at(j);
+    if(pos != -1){
+        for(int k = 1; k < keys_len.at(j); k++){
+            std::string name = argv[k + pos];
+            std::string n1 = argv[k + pos + 1];
+
+            if(name == "-N")
+                Output_Name = n1;
+            if(name == "-H")
+                Output_hdf5 = atoi(n1.c_str()) != 0;
+            if(name == "-D")
+                Output_text = atoi(n1.c_str()) != 0;
+        }
+    }
+
+    if(!Output_hdf5 && !Output_text)
+        std::cout << "Warning: both the HDF5 and the text output are disabled. No results will be written.\n";
+    debug_message("Left parse_Output\n");
+}
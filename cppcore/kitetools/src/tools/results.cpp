@@ -0,0 +1,117 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <complex>
+#include <string>
+#include <algorithm>
+#include <Eigen/Dense>
+#include <H5Cpp.h>
+#include "tools/ComplexTraits.hpp"
+#include "tools/myHDF5.hpp"
+#include "tools/results.hpp"
+#include "macros.hpp"
+
+// Size of the chunks in which the datasets are stored. A chunk can be read
+// on its own, so large results may be read in parts or by several processes
+static const hsize_t chunk_bytes = 1 << 20;
+
+static H5::DataType results_type(const int *){ return DataTypeFor<int>::value; }
+static H5::DataType results_type(const double *){ return DataTypeFor<double>::value; }
+static H5::DataType results_type(const std::complex<double> *){
+    H5::CompType complex_data_type(sizeof(std::complex<double>));
+    complex_data_type.insertMember("r", 0, DataTypeFor<double>::value);
+    complex_data_type.insertMember("i", sizeof(double), DataTypeFor<double>::value);
+    return complex_data_type;
+}
+
+results_file::results_file(const std::string & filename, const std::string & quantity){
+    debug_message("Entered results_file::results_file\n");
+    try{
+        H5::Exception::dontPrint();
+        std::ifstream exists(filename);
+        if(exists.good()){
+            exists.close();
+            file = H5::H5File(filename, H5F_ACC_RDWR);
+        } else {
+            file = H5::H5File(filename, H5F_ACC_TRUNC);
+        }
+
+        if(H5Lexists(file.getId(), "/Results", H5P_DEFAULT) <= 0)
+            file.createGroup("/Results");
+
+        std::string path = "/Results/" + quantity;
+        if(H5Lexists(file.getId(), path.c_str(), H5P_DEFAULT) > 0)
+            file.unlink(path);
+        group = file.createGroup(path);
+    } catch(H5::Exception&){
+        std::cout << "Could not write the results to " << filename << ". Make sure it is "
+            "an HDF5 file and that it is not opened by another program. Exiting.\n";
+        exit(1);
+    }
+    debug_message("Left results_file::results_file\n");
+}
+
+results_file::~results_file(){
+    group.close();
+    file.close();
+}
+
+template <typename U>
+void results_file::write_data(const std::string & name, const U * data, int rank, const hsize_t * dims,
+        const std::string & description){
+    // Writes a dataset of the given rank (1 or 2) in row-major order
+    H5::DSetCreatPropList plist;
+    if(dims[0] > 0 && (rank == 1 || dims[1] > 0)){
+        hsize_t chunk_dims[2];
+        hsize_t inner = dims[rank - 1];
+        chunk_dims[rank - 1] = std::min<hsize_t>(inner, std::max<hsize_t>(1, chunk_bytes/sizeof(U)));
+        if(rank == 2)
+            chunk_dims[0] = std::min<hsize_t>(dims[0], std::max<hsize_t>(1, chunk_bytes/sizeof(U)/chunk_dims[1]));
+        plist.setChunk(rank, chunk_dims);
+    }
+
+    H5::DataType type = results_type(data);
+    H5::DataSpace dataspace(rank, dims);
+    H5::DataSet dataset = group.createDataSet(name, type, dataspace, plist);
+    dataset.write(data, type);
+
+    H5::StrType string_type(H5::PredType::C_S1, std::max<size_t>(1, description.size()));
+    H5::Attribute attr = dataset.createAttribute("Description", string_type, H5::DataSpace(H5S_SCALAR));
+    attr.write(string_type, description);
+}
+
+template <typename U>
+void results_file::write(const std::string & name, const Eigen::Array<U, Eigen::Dynamic, Eigen::Dynamic> & data,
+        const std::string & description){
+    // Eigen is column-major and HDF5 is row-major, so the array is copied into
+    // a row-major array for the dataset to have the same shape
+    Eigen::Array<U, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> data_rows = data;
+    hsize_t dims[2] = {static_cast<hsize_t>(data.rows()), static_cast<hsize_t>(data.cols())};
+    write_data(name, data_rows.data(), 2, dims, description);
+}
+
+template <typename U>
+void results_file::write_vector(const std::string & name, const Eigen::Array<U, Eigen::Dynamic, 1> & data,
+        const std::string & description){
+    hsize_t dims[1] = {static_cast<hsize_t>(data.rows())};
+    write_data(name, data.data(), 1, dims, description);
+}
+
+void results_file::attribute(const std::string & name, double value){
+    // Scalar parameters of the calculation, such as the temperature
+    H5::Attribute attr = group.createAttribute(name, DataTypeFor<double>::value, H5::DataSpace(H5S_SCALAR));
+    attr.write(DataTypeFor<double>::value, &value);
+}
+
+template void results_file::write<int>(const std::string &, const Eigen::Array<int, Eigen::Dynamic, Eigen::Dynamic> &, const std::string &);
+template void results_file::write<double>(const std::string &, const Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> &, const std::string &);
+template void results_file::write<std::complex<double>>(const std::string &, const Eigen::Array<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic> &, const std::string &);
+template void results_file::write_vector<int>(const std::string &, const Eigen::Array<int, Eigen::Dynamic, 1> &, const std::string &);
+template void results_file::write_vector<double>(const std::string &, const Eigen::Array<double, Eigen::Dynamic, 1> &, const std::string &);
+template void results_file::write_vector<std::complex<double>>(const std::string &, const Eigen::Array<std::complex<double>, Eigen::Dynamic, 1> &, const std::string &);
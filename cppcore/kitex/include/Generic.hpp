@@ -35,6 +35,8 @@
 // Set of compilation parameters chosen in the Makefile
 // MEMORY is the number of KPM vectors stored in the memory while calculating Gamma2D
 // TILE is the size of the memory blocks used in the program
+// TILE_ORDER is the order in which the tiles are visited: 0 row by row, 1 along a Morton (Z-order) curve
+// SSBATCH is the number of energies that share the Chebyshev iterations of the single-shot Hall conductivity
 // COMPILE_MAIN is a flag to prevent compilation of unnecessary parts of the code when testing
 #ifndef MEMORY
 #define MEMORY 16
@@ -44,6 +46,14 @@
 #define TILE 8
 #endif
 
+#ifndef TILE_ORDER
+#define TILE_ORDER 0
+#endif
+
+#ifndef SSBATCH
+#define SSBATCH 16
+#endif
+
 #ifndef DEBUG
 #define DEBUG 0
 #endif
@@ -38,6 +38,16 @@ public:
 
   // Some checks
   bool twists_set;
+  bool is_chiral; // bipartite hoppings and no local energies: H anticommutes with the sublattice operator
+
+  /* Decoupled orbital sectors */
+  std::vector<value_type> sector_weight;   // sqrt of the number of copies of the sector of each orbital, zero for the copies
+  bool reduced_sectors;                    // Some sectors are exact copies of others
+  bool use_sectors;                        // Iterate only the first copy of each sector (set during the traces)
+
+  /* On-site orbital operators, combined with the velocity of the same slot (see KPM_VectorBasis::Velocity) */
+  std::vector<Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic>> orbital_operator; // One per slot, empty if there is none
+  bool operators_set;
 
   // Custom user-defined local potential. This can be read from the
   // HDF file, or defined in runtime with a function in the ../lib
@@ -45,6 +55,7 @@ public:
   Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic> custom_local;
   bool is_custom_local_set;
   bool print_custom;
+  std::string custom_plugin;               // Shared library with the potential (empty: uncorrelated_wrapper)
   void generate_custom_local();
   Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic> fetch_type1();
 
@@ -62,7 +73,13 @@ public:
   void build_vacancies_disorder();
   void build_Anderson_disorder();
   void build_velocity(std::vector<unsigned> & components, unsigned n);
+  void set_operator(unsigned n, const Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic> & O);
+  void clear_operators();
+  bool has_operator(unsigned n);
+  void apply_operator(unsigned n, const T * phi, T * phi_final);
   void distribute_AndersonDisorder();
+  void build_sectors();
+  bool equivalent_sectors(const std::vector<unsigned> &, const std::vector<unsigned> &);
 };
 
 
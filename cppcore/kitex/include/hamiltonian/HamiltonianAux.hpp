@@ -13,3 +13,13 @@ double uncorrelated_wrapper(double *vec, unsigned orb);
     //return 0;
 //};
 
+// Custom local potential loaded at runtime from a shared library. The library exports
+//
+//   extern "C" void kite_local_potential(std::size_t n, unsigned dim, const double *positions,
+//                                        const unsigned *orbitals, double *V);
+//
+// which writes in V[i] the local energy (in the units of the model) of the site i, with
+// real-space position positions[i*dim], ..., positions[i*dim + dim - 1] and orbital orbitals[i].
+typedef void (*local_potential_function)(std::size_t, unsigned, const double *, const unsigned *, double *);
+
+local_potential_function load_local_potential(const std::string & path);
@@ -20,7 +20,16 @@ struct Periodic_Operator : public ComplexTraits<T> {
   Eigen::Array<   T, Eigen::Dynamic, Eigen::Dynamic> hopping;                 // Hopping
   std::vector<Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>>        v;
   Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic> dist; 
+  bool is_bipartite;                                                          // The hoppings only connect two sublattices
+  std::vector<int> sublattice;                                                // Sublattice of each orbital in the unit cell at the origin
+  unsigned sublattice_parity[D];                                              // The sublattice also alternates from cell to cell along these directions
+  std::vector<unsigned> sector;                                               // Sector of each orbital: the orbitals of different sectors never couple
+  unsigned NSectors;                                                          // Number of decoupled sectors
+  Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> peierls;                    // Peierls phase of each hopping in each row of the slow coordinate (field profiles)
   Periodic_Operator<T,D>(char *, LatticeStructure <D> & );
   void Convert_Build (  LatticeStructure <D> &  );
+  void test_bipartite();
+  void find_sectors();
+  void build_peierls();
   void build_velocity(std::vector<unsigned> & components, unsigned n);  
 };
@@ -0,0 +1,26 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+template <typename T, unsigned D>
+struct Sparse_Operator : public ComplexTraits<T> {
+  typedef typename extract_value_type<T>::value_type         value_type;
+  SparseStructure<T,D> & s;
+  unsigned thread_id;                                                 // thread identification
+  std::size_t N;                                                      // Number of sites owned by this thread
+  std::size_t Nd;                                                     // Number of sites, including the halo
+  std::vector<std::size_t> site;                                      // Global index of the owned sites, followed by the halo
+  Eigen::Matrix<double, D, Eigen::Dynamic> position;                  // Position of each local site
+  std::vector<std::size_t> row;                                       // CSR row pointers of the owned sites
+  std::vector<std::size_t> column;                                    // Local column index of each element
+  std::vector<T> hopping;                                             // Value of each element
+  std::vector<std::vector<value_type>> v;                             // Generalized velocities of each element
+  std::vector<std::size_t> border;                                    // Owned sites in the halo of other threads
+  std::vector<std::size_t> border_slot;                               // Their position in the exchange buffer
+  std::vector<std::size_t> halo_slot;                                 // Position of each halo site in the exchange buffer
+  Sparse_Operator(SparseStructure<T,D> &);
+  void build_velocity(std::vector<unsigned> & components, unsigned n);
+};
@@ -18,6 +18,7 @@ struct Vacancy_Operator {
   std::vector <std::vector<int>>         positions_fixed;
   Vacancy_Operator(char *, LatticeStructure <D> & , KPMRandom <T> &);
   void generate_disorder();
+  void add_padding();
   void add_model(double p, std::vector <int> & orb, std::vector<int> & positions);
   void add_conflict_with_defect(std::size_t element, unsigned istride);
   bool test_vacancy(Coordinates<std::size_t,D + 1> & Latt);
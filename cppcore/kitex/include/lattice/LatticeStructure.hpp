@@ -22,7 +22,9 @@ public:
   
   unsigned Lt[D+1]; // Dimensions of the global sample
   unsigned Ld[D+1]; // Dimensions of each sub-domain (domain  + ghosts) 
-  unsigned ld[D+1]; // Dimensions of each sub-domain (domain) 
+  unsigned ld[D+1]; // Dimensions of each sub-domain (domain, including the padding) 
+  unsigned lr[D+1]; // Dimensions of the part of this sub-domain that belongs to the sample (without padding)
+  unsigned lo[D+1]; // Global coordinates of the first site of this sub-domain
   unsigned Bd[D+1]; // Information about periodic or non-periodic boundary conditions
   unsigned lStr[D+1];
   unsigned lB3[D+1];
@@ -32,12 +34,18 @@ public:
   std::size_t Nt; // Number of lattice postions of the global sample
   std::size_t Nd; // Number of lattice postions of the sub-domain with ghosts
   std::size_t N; // Number of lattice postions of the sub-domain without ghosts
+  std::size_t Nr; // Number of lattice postions of the sub-domain that belong to the sample
   std::size_t NStr; // Number of lattice postions of the sub-domain without ghosts
   unsigned Orb; // Number of orbitals
   unsigned thread_id; // thread identification
   int MagneticField = 0;
   bool boundary[D][2]; // Information about the Global border in the subdomain 
   Eigen::Matrix<double, D, D> ghost_pot; // ghosts_correlation potential
+  bool field_profile = false;              // The magnetic field changes along the slow coordinate
+  std::vector<double> vector_potential;    // Integrated flux (times 2 pi) below each row of the slow coordinate
+  Eigen::Matrix<double, D, Eigen::Dynamic> rOrbFrac; // Orbital positions in units of the lattice vectors
+  std::vector<std::size_t> tile_order;     // Tiles that belong to the sample, in the order they are multiplied
+  std::vector<std::size_t> tile_rank;      // Position of each tile in tile_order (NStr if it is only padding)
   
   explicit LatticeStructure(char *);
   unsigned get_BorderSize();
@@ -46,7 +54,14 @@ public:
   unsigned domain_number (long index);
   void     print_coordinates(std::size_t pos1, std::size_t pos2);
   bool     test_ghosts(  Coordinates<std::size_t, D + 1> & Latt);
-  void     test_divisibility();
+  void     test_domains();
+  unsigned domain_start(unsigned i, unsigned n);
+  unsigned domain_length(unsigned i, unsigned n);
+  unsigned domain_coordinate(unsigned i, std::size_t coord);
+  double   gauge(double y);
+  double   mean_gauge(double y1, double y2);
+  void     build_tile_order();
+  double   peierls_phase(Coordinates<std::ptrdiff_t, D + 1> & a, Coordinates<std::ptrdiff_t, D + 1> & b);
   
 };
 
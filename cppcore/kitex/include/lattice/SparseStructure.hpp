@@ -0,0 +1,34 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+
+template <typename T, unsigned D>
+struct SparseStructure {
+  /*
+    Hamiltonian given as a sparse matrix (CSR format) with the positions of the sites,
+    for systems that are not built from a periodic lattice. This structure is shared by
+    all the threads: it holds the whole input until each thread has copied its own part,
+    and the buffer used to exchange the border sites between threads.
+  */
+  std::size_t Nt;                                   // Number of sites of the sample
+  unsigned n_threads;                               // Number of threads
+  unsigned Bd[D];                                   // Periodic (1) or open (0) boundaries of the box
+  Eigen::Matrix<double, D, D> rLat;                 // The vectors of the box are organized by columns
+  Eigen::Matrix<double, D, Eigen::Dynamic> position;// Position of each site, organized by columns
+  std::vector<unsigned long> row;                   // CSR row pointers
+  std::vector<unsigned> column;                     // CSR column indices
+  std::vector<T> hopping;                           // CSR values, already scaled
+  std::vector<unsigned> owner;                      // Thread that owns each site
+  std::vector<std::size_t> local;                   // Index of each site among the sites of its owner
+  std::vector<std::ptrdiff_t> slot;                 // Position of each border site in the buffer, -1 elsewhere
+  std::vector<T> buffer;                            // Values of the border sites, shared between threads
+
+  explicit SparseStructure(char *);
+  void partition();
+  void bisect(std::size_t *, std::size_t *, unsigned, unsigned);
+  void release();
+};
@@ -27,6 +27,11 @@ struct GLOBAL_VARIABLES {
   Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> avg_z;
   Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> avg_ident;
   Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> avg_results;
+  Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> avg_current;
+  Eigen::Array <double, Eigen::Dynamic, Eigen::Dynamic> bond_currents;
+  Eigen::Array <double, Eigen::Dynamic, Eigen::Dynamic> chern_marker;
+  Eigen::Array <double, Eigen::Dynamic, Eigen::Dynamic> hartree;
+  Eigen::Array <double, Eigen::Dynamic, Eigen::Dynamic> hartree_sums;
   Eigen::Array <double,3,1> GlobBTwist; // Glob Boundary Twist Angles
   double kpm_iteration_time;
   
@@ -38,6 +43,10 @@ struct GLOBAL_VARIABLES {
   bool calculate_condopt;
   bool calculate_condopt2;
   bool calculate_singleshot;
+  bool calculate_singleshot_optical;
+  bool calculate_bond_currents;
+  bool calculate_chern_marker;
+  bool calculate_hartree;
 
   GLOBAL_VARIABLES();
   void addbond ( std::size_t, std::ptrdiff_t, T );
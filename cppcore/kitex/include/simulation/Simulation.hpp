@@ -21,12 +21,14 @@ public:
   GLOBAL_VARIABLES <T> & Global;
   char                 * name;
   Hamiltonian<T,D>       h;
+  std::vector<std::string> fused;   // Datasets already calculated by calc_fused
   
   Simulation(char *, GLOBAL_VARIABLES <T> &);
 
   //void Measure_Gamma(measurement_queue);
 
   void Gamma1D(int, int, int, std::vector<std::vector<unsigned>>, std::string );
+  void Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string> );
   void Gamma2D(int, int, std::vector<int>,  std::vector<std::vector<unsigned>>, std::string );
   void Gamma3D(int, int, std::vector<int>,  std::vector<std::vector<unsigned>>, std::string );
   void GammaGeneral(int, int, const std::vector<int>&, const std::vector<std::vector<unsigned>>&, const std::string& );
@@ -36,6 +38,7 @@ public:
   void store_gamma1D(Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> *, std::string );
   void store_gamma3D(Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> *, std::vector<int>, std::vector<std::vector<unsigned>>, std::string );
   std::vector<std::vector<unsigned>> process_string(std::string);
+  bool load_operators(const std::string &, unsigned);
   double time_kpm(int);
 
   void calc_singleshot();
@@ -44,8 +47,37 @@ public:
   Eigen::Array<int, Eigen::Dynamic, 1> preserve_disorders,
   Eigen::Array<int, Eigen::Dynamic, 1> moments,
   int NDisorder, int NRandom, std::string direction_string);
+  void singleshot_hall(Eigen::Array<double, Eigen::Dynamic, 1> energies,
+  Eigen::Array<double, Eigen::Dynamic, 1> gammas,
+  Eigen::Array<int, Eigen::Dynamic, 1> preserve_disorders,
+  Eigen::Array<int, Eigen::Dynamic, 1> moments,
+  int NDisorder, int NRandom, std::string direction_string, double temperature, int NPoints,
+  double min_energy);
+
+  void calc_singleshot_optical();
+  void singleshot_optical(Eigen::Array<double, Eigen::Dynamic, 1> energies,
+  Eigen::Array<double, Eigen::Dynamic, 1> frequencies,
+  Eigen::Array<double, Eigen::Dynamic, 1> gammas,
+  Eigen::Array<int, Eigen::Dynamic, 1> moments,
+  int NDisorder, int NRandom, std::string direction_string, double temperature, int NPoints);
+
+  void calc_bond_currents();
+  void bond_currents(Eigen::Array<double, Eigen::Dynamic, 1> energies, double gamma, int NMoments,
+  int NDisorder, int NRandom, std::string direction_string);
 
+  void calc_chern_marker();
+  void chern_marker(Eigen::Array<double, Eigen::Dynamic, 1> energies, int NMoments, int NDisorder, int NRandom,
+  Eigen::Array<unsigned long, Eigen::Dynamic, 1> sites, Eigen::Array<int, Eigen::Dynamic, Eigen::Dynamic> regions);
+
+  void calc_hartree();
+  void hartree(double fermi_energy, double temperature, int NMoments, int NRandom, int Probing, int NIterations,
+  double tolerance, double mixing, int History, Eigen::Array<double, Eigen::Dynamic, 1> reference,
+  Eigen::Array<double, Eigen::Dynamic, 1> initial, Eigen::Array<int, Eigen::Dynamic, Eigen::Dynamic> kernel_sites,
+  Eigen::Array<double, Eigen::Dynamic, 1> kernel_values, double energy_scale);
   
+  void calc_fused();
+  bool is_fused(const std::string &);
+
   void calc_conddc();
   void CondDC(int, int, int, int);
   
@@ -65,6 +97,7 @@ public:
   void LMU(int, int, Eigen::Array<unsigned long, Eigen::Dynamic, 1>);
   void calc_LDOS();
   void store_LMU(Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> *);
+  void LDOS_Recursion(int, int, Eigen::Array<unsigned long, Eigen::Dynamic, 1>);
 	
   void calc_ARPES();
   void ARPES(int NDisorder, int NMoments, Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> & k_vectors, Eigen::Matrix<T, Eigen::Dynamic, 1> & weight);
@@ -0,0 +1,41 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+template <typename T,unsigned D>
+class SparseSimulation : public ComplexTraits<T> {
+  /*
+    Counterpart of Simulation for Hamiltonians given as sparse matrices. The moments are
+    stored in the same datasets, so they are processed by KITE-tools in the same way.
+  */
+public:
+  typedef typename extract_value_type<T>::value_type value_type;
+  KPMRandom <T>          rnd;
+  GLOBAL_VARIABLES <T> & Global;
+  char                 * name;
+  Sparse_Operator<T,D>   h;
+
+  SparseSimulation(char *, GLOBAL_VARIABLES <T> &, SparseStructure<T,D> &);
+  bool requested(std::string);
+  std::vector<std::vector<unsigned>> process_string(std::string);
+  void Gamma1D(int, int, std::vector<std::vector<unsigned>>, std::string);
+  void Gamma2D(int, int, std::vector<std::vector<unsigned>>, std::string);
+  void store_gamma(Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> *, int, std::vector<std::vector<unsigned>>, std::string);
+
+  void calc_DOS();
+  void calc_conddc();
+  void calc_condopt();
+  void calc_unsupported();
+};
+
+template <typename T, unsigned D>
+class GlobalSparseSimulation {
+private:
+  GLOBAL_VARIABLES <T> Global;
+  SparseStructure <T,D> sglobal;
+public:
+  explicit GlobalSparseSimulation(char *);
+};
@@ -44,6 +44,7 @@ void print_flags_message(){
   verbose_message("Flags set at compilation:\n");
   verbose_message("DEBUG: "); verbose_message(DEBUG); verbose_message("\n");
   verbose_message("VERBOSE: "); verbose_message(VERBOSE); verbose_message("\n");
+  verbose_message("TILE_ORDER: "); verbose_message(TILE_ORDER); verbose_message("\n");
   //verbose_message("ESTIMATE_TIME: "); verbose_message(ESTIMATE_TIME); verbose_message("\n");
   verbose_message("-------------------------\n");
 }
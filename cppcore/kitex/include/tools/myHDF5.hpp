@@ -32,6 +32,10 @@ typename std::enable_if<!is_tt<std::complex, T>::value, void>::type write_hdf5(c
 template <typename T>
 typename std::enable_if<is_tt<std::complex, T>::value, void>::type write_hdf5(const Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic > &, H5::H5File *, std::string);
 
+void write_samples(H5::H5File *, const std::string, long);
+
+void write_map(const double *, const std::vector<hsize_t> &, H5::H5File *, const std::string);
+
 
 
 
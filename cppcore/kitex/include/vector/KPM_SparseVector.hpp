@@ -0,0 +1,39 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+template <typename T, unsigned D>
+class SparseSimulation;
+
+template <typename T, unsigned D>
+class KPM_SparseVector : public ComplexTraits<T> {
+  /*
+    KPM vector of a sparse Hamiltonian: the sites owned by this thread followed by its halo.
+    It follows the conventions of KPM_VectorBasis: the columns are used as a circular memory,
+    and each multiplication writes into the next column.
+  */
+  int index;
+  const int memory;
+  SparseSimulation<T,D> & simul;
+  Sparse_Operator<T,D> & h;
+public:
+  typedef typename extract_value_type<T>::value_type value_type;
+  Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> v;
+
+  KPM_SparseVector(int mem, SparseSimulation<T,D> & sim);
+  void     set_index(int i);
+  void     inc_index();
+  void     dec_index();
+  unsigned get_index();
+  void     initiate_vector();
+  template <unsigned MULT, bool VELOCITY>
+  void     KPM_MOTOR(KPM_SparseVector<T,D> * kpm_final, unsigned axis);
+  template <unsigned MULT>
+  void     Multiply();
+  void     Velocity(KPM_SparseVector<T,D> * kpm_final, std::vector<std::vector<unsigned>> & indices, int axis);
+  void     cheb_iteration(unsigned);
+  void     Exchange_Boundaries();
+};
@@ -61,6 +61,7 @@ public:
   template <unsigned MULT, bool VELOCITY>
   void KPM_MOTOR(KPM_Vector<T,D> * kpm_final,  unsigned axis);
   void measure_wave_packet(T * bra, T * ket, T * results);  
+  void bond_currents(const T * psi, const T * chi, std::size_t NBonds, double * map);
   void Exchange_Boundaries();
   void test_boundaries_system();
   void empty_ghosts(int mem_index);
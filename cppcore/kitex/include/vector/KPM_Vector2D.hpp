@@ -20,6 +20,7 @@ private:
   std::size_t  transf_bound[D][2]; // [d][edged]
   Hamiltonian<T,2u>          & h;
   T               ***mult_t1_ghost_cor;
+  T               ***phase_rows;  // Phases of the rows of tiles, mult_t1_ghost_cor points to the current one
   Coordinates<std::size_t,3>   x;
   T                        *phi0;
   T                       *phiM1;
@@ -28,6 +29,7 @@ private:
 public:
   typedef typename extract_value_type<T>::value_type value_type;
   T *Fact_Bnd[D][3]; //3 Modos [Salto Positivo, Não Salto, Salto Negativo]
+  bool *Twist_Tile[D][3]; // Tiles where some Fact_Bnd differs from one, for each of the 3 modes
   using KPM_VectorBasis<T,2>::simul;
   using KPM_VectorBasis<T,2>::index;
   using KPM_VectorBasis<T,2>::v;
@@ -51,6 +53,10 @@ public:
 
   template < unsigned MULT,bool VELOCITY> 
   void build_regular_phases(int i1, unsigned axis);
+  template < unsigned MULT,bool VELOCITY> 
+  void build_phase_rows(unsigned axis);
+  template < unsigned MULT,bool VELOCITY> 
+  void select_phase_row(std::size_t row, unsigned axis);
   template < unsigned MULT> 
   void initiate_stride(std::size_t & istr);
   template < unsigned MULT> 
@@ -63,6 +69,7 @@ public:
   void multiply_defect(std::size_t , T* & , T* & , unsigned axis);
   
   void measure_wave_packet(T * bra, T * ket, T * results);  
+  void bond_currents(const T * psi, const T * chi, std::size_t NBonds, double * map);
   void Exchange_Boundaries();
   void test_boundaries_system();
   void empty_ghosts(int mem_index);
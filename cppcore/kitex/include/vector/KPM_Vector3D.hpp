@@ -18,6 +18,7 @@ private:
   std::size_t           transf_max[3][3]; // [d][Maximum lateral bondary lengh]
   std::size_t      transf_bound[3][2][3]; // [d][edged][Lateral boundary lengh]
   T                 ***mult_t1_ghost_cor;
+  T                 ***phase_rows;  // Phases of the planes of tiles, mult_t1_ghost_cor points to the current one
   T                                *phi0;
   T                               *phiM1;
   T                               *phiM2;
@@ -27,6 +28,7 @@ public:
   //  Coordinates<std::size_t,4>           x;
   typedef typename extract_value_type<T>::value_type value_type;
   T *Fact_Bnd[D][3]; //3 Modos [Salto Positivo, Não Salto, Salto Negativo]
+  bool *Twist_Tile[D][3]; // Tiles where some Fact_Bnd differs from one, for each of the 3 modes
   using KPM_VectorBasis<T,3>::simul;
   using KPM_VectorBasis<T,3>::index;
   using KPM_VectorBasis<T,3>::v;
@@ -47,6 +49,10 @@ public:
                          Eigen::Matrix<double,1,2> & vb);
   template < unsigned MULT,bool VELOCITY> 
   void build_regular_phases(int i1, unsigned axis);
+  template < unsigned MULT,bool VELOCITY> 
+  void build_phase_rows(unsigned axis);
+  template < unsigned MULT,bool VELOCITY> 
+  void select_phase_row(std::size_t plane, unsigned axis);
   template < unsigned MULT> 
   void initiate_stride(std::size_t & istr);
   template < unsigned MULT> 
@@ -55,6 +61,7 @@ public:
   template <unsigned MULT, bool VELOCITY>
   void KPM_MOTOR(KPM_Vector<T,3> *kpm_final, unsigned axis);
   void measure_wave_packet(T * bra, T * ket, T * results);  
+  void bond_currents(const T * psi, const T * chi, std::size_t NBonds, double * map);
   void Exchange_Boundaries();
   void test_boundaries_system();
   void empty_ghosts(int mem_index);
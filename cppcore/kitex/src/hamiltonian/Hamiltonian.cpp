@@ -35,6 +35,14 @@ Hamiltonian<T,D>::Hamiltonian(char *filename,  LatticeStructure<D> & rr, GLOBAL_
   build_Anderson_disorder();
   build_vacancies_disorder();
   build_structural_disorder();
+
+  // Vacancies and bond phases keep the chiral symmetry, but local energies break it.
+  // The structural defects are not analysed, so any of them disables it
+  is_chiral = hr.is_bipartite && !is_custom_local_set && hd.empty() &&
+    std::all_of(Anderson_orb_address.begin(), Anderson_orb_address.end(), [](int a){ return a == -2; });
+
+  build_sectors();
+  operators_set = false;
 }
 
 template <typename T, unsigned D>
@@ -235,6 +243,97 @@ void Hamiltonian<T,D>::build_Anderson_disorder() {
     U_Anderson.resize( sum * r.Nd);    
 }
 
+template <typename T, unsigned D>
+void Hamiltonian<T,D>::build_sectors()
+{
+  /*
+    The Hamiltonian and the velocities are block diagonal in the decoupled sectors of the
+    hopping table, so every trace is a sum over the sectors. A sector that is an exact copy
+    of an earlier one (spin up and down without spin-orbit coupling, identical layers) has
+    the same trace: only the first copy is iterated, and the random vector is weighted with
+    the square root of the number of copies. The copies must share the Anderson disorder and
+    vacancy models, so that they see the same random potential and vacancies in every
+    realization. Copies with independent models only have the same trace on average over
+    the disorder, and equivalent_sectors rejects them.
+  */
+  sector_weight.assign(r.Orb, value_type(1));
+  reduced_sectors = false;
+  use_sectors = false;
+  
+  // The structural defects and the custom potential are not analysed
+  if(!hd.empty() || is_custom_local_set || hr.NSectors < 2)
+    return;
+
+  std::vector<std::vector<unsigned>> members(hr.NSectors);
+  for(unsigned io = 0; io < r.Orb; io++)
+    members.at(hr.sector.at(io)).push_back(io);
+
+  std::vector<unsigned> copies(hr.NSectors, 1);
+  for(unsigned s = 1; s < hr.NSectors; s++)
+    for(unsigned t = 0; t < s; t++)
+      if(copies.at(t) > 0 && equivalent_sectors(members.at(t), members.at(s)))
+        {
+          copies.at(t)++;
+          copies.at(s) = 0;
+          reduced_sectors = true;
+          break;
+        }
+
+  for(unsigned io = 0; io < r.Orb; io++)
+    sector_weight.at(io) = sqrt(value_type(copies.at(hr.sector.at(io))));
+}
+
+template <typename T, unsigned D>
+bool Hamiltonian<T,D>::equivalent_sectors(const std::vector<unsigned> & a, const std::vector<unsigned> & b)
+{
+  // The k-th orbital of a is mapped to the k-th orbital of b: positions, local disorder,
+  // vacancies and hoppings (including the magnetic phases) must all be identical
+  if(a.size() != b.size())
+    return false;
+  
+  std::vector<int> position(r.Orb, -1);
+  for(unsigned k = 0; k < a.size(); k++)
+    position.at(a.at(k)) = int(k);
+  
+  unsigned l[D + 1];
+  std::fill_n(l, D, 3);
+  l[D]  = r.Orb;
+  Coordinates<std::ptrdiff_t, D + 1> b3(l);
+  
+  for(unsigned k = 0; k < a.size(); k++)
+    {
+      const unsigned ia = a.at(k), ib = b.at(k);
+      if(r.rOrb.col(ia) != r.rOrb.col(ib) || Anderson_orb_address.at(ia) != Anderson_orb_address.at(ib) || U_Orbital.at(ia) != U_Orbital.at(ib))
+        return false;
+      
+      for(auto & orb : hV.orbitals)
+        if((std::find(orb.begin(), orb.end(), int(ia)) == orb.end()) != (std::find(orb.begin(), orb.end(), int(ib)) == orb.end()))
+          return false;
+
+      unsigned na = 0, nb = 0;
+      for(unsigned j = 0; j < hr.NHoppings(ib); j++)
+        nb += (hr.hopping(j, ib) != T(0));
+      
+      for(unsigned i = 0; i < hr.NHoppings(ia); i++)
+        {
+          if(hr.hopping(i, ia) == T(0))
+            continue;
+          na++;
+          b3.set_coord(hr.dist(i, ia));
+          b3.coord[D] = b.at(position.at(b3.coord[D]));
+          const std::ptrdiff_t target = b3.set_index(b3.coord).index;
+          bool found = false;
+          for(unsigned j = 0; j < hr.NHoppings(ib) && !found; j++)
+            found = hr.hopping(j, ib) == hr.hopping(i, ia) && hr.dist(j, ib) == target;
+          if(!found)
+            return false;
+        }
+      if(na != nb)
+        return false;
+    }
+  return true;
+}
+
 template <typename T, unsigned D>
 void Hamiltonian<T,D>::build_velocity(std::vector<unsigned> & components, unsigned n)
 {
@@ -243,6 +342,69 @@ void Hamiltonian<T,D>::build_velocity(std::vector<unsigned> & components, unsign
     i->build_velocity(components, n);
 }
 
+template <typename T, unsigned D>
+void Hamiltonian<T,D>::set_operator(unsigned n, const Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic> & O)
+{
+  /*
+    The on-site operator O acts on the orbitals of every unit cell. In the slot n it replaces the
+    velocity v_n by the anti-commutator (O v_n + v_n O)/2, or by O itself if the slot has no
+    velocity components. The traces are symmetrized assuming that v_n^dagger = (-1)^k v_n,
+    k being the number of components, so O has to be Hermitian
+  */
+  if(O.rows() != Eigen::Index(r.Orb) || O.cols() != Eigen::Index(r.Orb))
+    {
+      std::cout << "Error in Hamiltonian::set_operator. The orbital operator of the slot " << n << " is a "
+                << O.rows() << "x" << O.cols() << " matrix, but there are " << r.Orb << " orbitals. Exiting.\n";
+      exit(1);
+    }
+  if((O - O.adjoint()).norm() > 1e-6*O.norm())
+    {
+      std::cout << "Error in Hamiltonian::set_operator. The orbital operator of the slot " << n
+                << " is not Hermitian. Exiting.\n";
+      exit(1);
+    }
+  if(orbital_operator.size() <= n)
+    orbital_operator.resize(n + 1);
+  orbital_operator.at(n) = O;
+  operators_set = true;
+}
+
+template <typename T, unsigned D>
+void Hamiltonian<T,D>::clear_operators()
+{
+  orbital_operator.clear();
+  operators_set = false;
+}
+
+template <typename T, unsigned D>
+bool Hamiltonian<T,D>::has_operator(unsigned n)
+{
+  return n < orbital_operator.size() && orbital_operator.at(n).size() > 0;
+}
+
+template <typename T, unsigned D>
+void Hamiltonian<T,D>::apply_operator(unsigned n, const T * phi, T * phi_final)
+{
+  // phi_final = O phi on the whole domain, ghosts included. The orbital is the slowest index
+  // of the KPM vectors, so O mixes blocks of r.Nd entries
+  const Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic> & O = orbital_operator.at(n);
+  for(unsigned io = 0; io < r.Orb; io++)
+    {
+      Eigen::Map<Eigen::Matrix<T,Eigen::Dynamic,1>> out(phi_final + io * r.Nd, r.Nd);
+      out.setZero();
+      for(unsigned jo = 0; jo < r.Orb; jo++)
+        if(O(io, jo) != T(0))
+          out += O(io, jo) * Eigen::Map<const Eigen::Matrix<T,Eigen::Dynamic,1>>(phi + jo * r.Nd, r.Nd);
+    }
+
+  // The vacancies are removed from every orbital they could have been mixed into
+  for(auto & tile : hV.position)
+    for(auto k = tile.begin(); k != tile.end(); k++)
+      phi_final[*k] = 0.;
+  for(auto vc = hV.vacancies_with_defects.begin(); vc != hV.vacancies_with_defects.end(); vc++)
+    phi_final[*vc] = 0.;
+}
+
 
 
 template <typename T, unsigned D>  
@@ -309,6 +471,14 @@ void Hamiltonian<T,D>::generate_custom_local(){
       auto *file = new H5::H5File(name, H5F_ACC_RDONLY);
       get_hdf5(&custom_required, file, (char*)"Hamiltonian/CustomLocalEnergy");
       get_hdf5(&print_flag, file, (char*)"Hamiltonian/PrintCustomLocalEnergy");
+
+      // Optional shared library with the potential, used instead of uncorrelated_wrapper
+      try {
+        H5::Exception::dontPrint();
+        H5::DataSet dataset = file->openDataSet("Hamiltonian/CustomLocalPlugin");
+        dataset.read(custom_plugin, dataset.getStrType());
+      }
+      catch(H5::Exception&){}
       delete file;
     }
     catch(...) {
@@ -322,7 +492,8 @@ void Hamiltonian<T,D>::generate_custom_local(){
 
     if(custom_required != 1) return;
 
-    // Generate the custom local energy from an external library inside /lib
+    // Generate the custom local energy from an external library inside /lib,
+    // or from the plugin given in the configuration file
     custom_local = fetch_type1();
     is_custom_local_set = true;
 
@@ -355,9 +526,20 @@ Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic> Hamiltonian<T,D>::fetch_type1(){
     }
 #pragma omp barrier
 
-    double V;
-    unsigned orb;
-    T V_converted;
+    local_potential_function plugin = nullptr;
+    if(!custom_plugin.empty())
+#pragma omp critical
+        plugin = load_local_potential(custom_plugin);
+
+    // The sites are sent to the potential in batches, so that a plugin can vectorize over them
+    const std::size_t batch = 4096;
+    std::vector<double> positions;
+    std::vector<unsigned> orbitals;
+    std::vector<std::size_t> indices;
+    std::vector<double> V(batch);
+    positions.reserve(batch*D);
+    orbitals.reserve(batch);
+    indices.reserve(batch);
 
     Eigen::Matrix<double,D,1> vec_real = Eigen::Matrix<double,D,1>::Zero(D);
 
@@ -368,33 +550,54 @@ Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic> Hamiltonian<T,D>::fetch_type1(){
     if(print_custom)
         potential_file = std::ofstream(filename);
 
+    auto flush = [&](){
+        const std::size_t n = indices.size();
+        if(plugin)
+            plugin(n, D, positions.data(), orbitals.data(), V.data());
+        else
+            for(std::size_t k = 0; k < n; k++)
+                V[k] = uncorrelated_wrapper(positions.data() + k*D, orbitals[k]);
+
+        for(std::size_t k = 0; k < n; k++){
+            T V_converted = T((V[k] - Eshift)/Escale); // type shenanigans
+
+            // Store that value of the potential in the KPM_Vector with ghosts
+            vec(indices[k]) = V_converted;
+
+            // write to a stream
+            if(print_custom){
+                for(unsigned j = 0; j < D; j++)
+                    potential_file << positions[k*D + j] << " ";
+                potential_file << orbitals[k] << " ";
+                potential_file << V_converted << "\n";
+            }
+        }
+        positions.clear();
+        orbitals.clear();
+        indices.clear();
+    };
+
     for(unsigned i=0; i<r.N*r.Orb; i++){
 
         coord_ld.set_coord(i);                          // Convert from index to local coordinates
+        r.convertCoordinates(coord_Ld, coord_ld);       // Local coordinates with ghosts
+        if(r.test_ghosts(coord_Ld) == 0)                // The padding does not belong to the sample
+            continue;
         r.convertCoordinates(coord_Lt, coord_ld);       // Convert from local to global coordinates, 
-        orb = coord_Lt.coord[D];
 
         for(unsigned j = 0; j < D; j++)
             vec_real(j) = coord_Lt.coord[j];            // Set first coordinates 
 
         vec_real = r.rLat*vec_real;                     // Convert to real space
-        V = uncorrelated_wrapper(vec_real.data(), orb); // and get the value of the potential
-
-        V_converted = T((V - Eshift)/Escale); // type shenanigans
-
-        // Convert to local coordinates with ghosts to get the index of the
-        // KPM_Vector in which to store that value of the potential
-        r.convertCoordinates(coord_Ld, coord_ld);
-        vec(coord_Ld.index) = V_converted;
+        for(unsigned j = 0; j < D; j++)
+            positions.push_back(vec_real(j));
+        orbitals.push_back(coord_Lt.coord[D]);
+        indices.push_back(coord_Ld.index);
 
-        // write to a stream
-        if(print_custom){
-            for(unsigned j = 0; j < D; j++)
-                potential_file << vec_real(j) << " ";
-            potential_file << orb << " ";
-            potential_file << V_converted << "\n";
-        }
+        if(indices.size() == batch)
+            flush();
     }
+    flush();
 
     if(print_custom)
         potential_file.close();
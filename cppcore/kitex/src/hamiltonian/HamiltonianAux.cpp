@@ -5,8 +5,37 @@
 /*                                                         */
 /***********************************************************/
 
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
 #include "hamiltonian/HamiltonianAux.hpp"
 
 double uncorrelated_wrapper(double *vec, unsigned orb){ 
     return 0; 
 };
+
+local_potential_function load_local_potential(const std::string & path){
+    // The library is never closed: the function is used until the end of the program.
+    // Loading the same library again only increases its reference count
+#ifdef _WIN32
+    HMODULE lib = LoadLibraryA(path.c_str());
+    void *fn = lib ? reinterpret_cast<void *>(GetProcAddress(lib, "kite_local_potential")) : nullptr;
+#else
+    void *lib = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    void *fn = lib ? dlsym(lib, "kite_local_potential") : nullptr;
+#endif
+    if(!lib){
+        std::cout << "Error: could not load the custom potential plugin " << path << ". Exiting program.\n";
+        exit(1);
+    }
+    if(!fn){
+        std::cout << "Error: " << path << " does not export kite_local_potential. Exiting program.\n";
+        exit(1);
+    }
+    return reinterpret_cast<local_potential_function>(fn);
+}
@@ -155,6 +155,8 @@ Defect_Operator<T,D>::Defect_Operator( Hamiltonian<T,D> & h1,  std::string & def
           phase2 =  - dif_R.transpose() * (matA * r.rOrb.col(Lda.coord[D])).matrix();
           phase3 =  - dif_R.transpose() * (matA * ra).matrix();	   
           new_hopping(ih, iv) = hopping.at(ih) * multEiphase(phase1 + phase2 + phase3);
+          if(r.field_profile)
+            new_hopping(ih, iv) = hopping.at(ih) * multEiphase(r.peierls_phase(Lda, Ldb));
         }
       hopping.at(ih) *= multEiphase(phase1 + phase2);
     }
@@ -193,7 +195,7 @@ void Defect_Operator<T,D>::generate_disorder()  {
   Coordinates<std::size_t,D + 1> latt(r.ld), LATT(r.Lt), Latt(r.Ld), Latt2(r.Ld), latStr(r.lStr), x(r.nd);
   // Distribute the local disorder
 
-  std::size_t ndefects= p * r.N , count = 0;
+  std::size_t ndefects= p * r.Nr , count = 0;
   if(ndefects < positions_fixed.size())
     ndefects = positions_fixed.size();
   
@@ -209,6 +211,8 @@ void Defect_Operator<T,D>::generate_disorder()  {
       
       latt.set_coord(pos);
       r.convertCoordinates(Latt,latt);
+      if(r.test_ghosts(Latt) == 0)                              // the site is in the padding
+        continue;
       r.convertCoordinates(latStr,latt);
       auto & st = position.at(latStr.index);
 
@@ -239,7 +243,7 @@ void Defect_Operator<T,D>::generate_disorder()  {
               */
 
               r.convertCoordinates(latStr, Latt);
-              if(latStr.index < istr)                           
+              if(r.tile_rank[latStr.index] < r.tile_rank[istr])
                 h.hV.add_conflict_with_defect(std::size_t(node_pos), latStr.index);
             }
           else
@@ -316,6 +320,8 @@ void Defect_Operator<T,D>::generate_disorder()  {
               border_element1.push_back( Latt.index );	    
               border_element2.push_back(Latt.index + Global.element2_diff[i]);
               border_hopping.push_back(Global.hopping[i]);
+              if(r.field_profile)
+                border_hopping.back() *= multEiphase(r.peierls_phase(Latt, Ldb.set_coord(std::ptrdiff_t(Latt.index + Global.element2_diff[i]))));
 		
             }
         }
@@ -357,9 +363,9 @@ void Defect_Operator<T,D>::generate_disorder()  {
           std::size_t node_pos =  *it + node_position.at(node);
           Latt.set_coord(node_pos);
           r.convertCoordinates(latStr, Latt ); // Get tile index
-          // Tests if the node is in a higher tile,
+          // Tests if the node is in a tile that is multiplied later
 	    
-          if(r.test_ghosts(Latt) == 1 && h.cross_mozaic[latStr.index] &&  latStr.index > istr )
+          if(r.test_ghosts(Latt) == 1 && h.cross_mozaic[latStr.index] &&  r.tile_rank[latStr.index] > r.tile_rank[istr] )
             {	    
               h.cross_mozaic[latStr.index] = false;
               h.cross_mozaic_indexes.push_back(latStr.index); // Add  because
@@ -37,8 +37,11 @@ Periodic_Operator<T,D>::Periodic_Operator (char * name, LatticeStructure<D> & rr
       for(std::size_t j = 0; j <  r.Orb; j++ )      
         distance(i,j) = dist(i,j);
     delete file;
+    test_bipartite();
+    find_sectors();
     Convert_Build(r);
   }
+  build_peierls();
   debug_message("Left Periodic_Operator constructor.\n");
 }
 
@@ -94,6 +97,152 @@ void Periodic_Operator<T,D>::Convert_Build (  LatticeStructure <D> & r )
   debug_message("Left Convert_Build.\n");
 }
 
+template <typename T, unsigned D>
+void Periodic_Operator<T,D>::build_peierls()
+{
+  /*
+    With a non-uniform field, the phase of each hopping depends on the row of the slow coordinate
+    where it starts. The phases of the rows of this sub-domain are computed once, by each thread
+    for its own rows, and are used by build_regular_phases instead of the ghost_pot product.
+    Rows without field get exactly a unit phase, and keep the real-valued fast path.
+  */
+  if(!r.field_profile)
+    return;
+  debug_message("Entered build_peierls\n");
+  
+  Coordinates<std::ptrdiff_t, D + 1> a(r.Ld), b(r.Ld);
+  peierls = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>::Ones(hopping.rows() * r.Orb, r.Ld[D - 1]);
+  
+  for(unsigned io = 0; io < r.Orb; io++)
+    for(unsigned ib = 0; ib < NHoppings(io); ib++)
+      for(std::size_t row = NGHOSTS; row < r.Ld[D - 1] - NGHOSTS; row++)
+        {
+          std::fill_n(a.coord, D, NGHOSTS);
+          a.coord[D - 1] = row;
+          a.coord[D] = io;
+          a.set_index(a.coord);
+          b.set_coord(a.index + distance(ib, io));
+          peierls(ib + io * hopping.rows(), row) = multEiphase(r.peierls_phase(a, b));
+        }
+  debug_message("Left build_peierls\n");
+}
+
+template <typename T, unsigned D>
+void Periodic_Operator<T,D>::test_bipartite()
+{
+  /*
+    Look for a splitting of the sites into two sublattices such that every hopping connects
+    different sublattices. The sublattice of orbital io in the unit cell R is
+      sublattice[io] + sum_d sublattice_parity[d] * R[d]  (mod 2)
+    so both orbital sublattices (honeycomb) and checkerboard patterns (square lattice) are found.
+    Along a periodic direction, the checkerboard is only consistent if the length is even.
+  */
+  debug_message("Entered test_bipartite\n");
+  unsigned l[D + 1];
+  std::fill_n(l, D, 3);
+  l[D]  = r.Orb;
+  Coordinates<std::ptrdiff_t, D + 1> b3(l);
+  
+  is_bipartite = false;
+  for(unsigned k = 0; k < (1u << D) && !is_bipartite; k++)
+    {
+      bool allowed = true;
+      for(unsigned d = 0; d < D; d++)
+        {
+          sublattice_parity[d] = (k >> d) & 1u;
+          if(sublattice_parity[d] && r.Bd[d] != 0 && r.Lt[d] % 2 != 0)
+            allowed = false;
+        }
+      if(!allowed)
+        continue;
+      
+      // Colour the orbitals, following the hoppings until no new orbital is reached
+      sublattice.assign(r.Orb, -1);
+      is_bipartite = true;
+      for(unsigned start = 0; start < r.Orb && is_bipartite; start++)
+        {
+          if(sublattice.at(start) != -1)
+            continue;
+          sublattice.at(start) = 0;
+          bool changed = true;
+          while(changed && is_bipartite)
+            {
+              changed = false;
+              for(unsigned io = 0; io < r.Orb; io++)
+                for(unsigned i = 0; i < NHoppings(io); i++)
+                  {
+                    if(hopping(i,io) == T(0))
+                      continue;
+                    b3.set_coord(dist(i,io));
+                    const unsigned jo = unsigned(b3.coord[D]);
+                    unsigned parity = 1;                          // the hopping must change the sublattice
+                    for(unsigned d = 0; d < D; d++)
+                      parity += sublattice_parity[d] * unsigned(std::abs(b3.coord[d] - 1));
+                    parity %= 2;
+                    
+                    int & si = sublattice.at(io), & sj = sublattice.at(jo);
+                    if(si == -1 && sj == -1)
+                      continue;
+                    if(sj == -1)
+                      { sj = (si + int(parity)) % 2; changed = true; }
+                    else if(si == -1)
+                      { si = (sj + int(parity)) % 2; changed = true; }
+                    else if((si + int(parity)) % 2 != sj)
+                      is_bipartite = false;
+                  }
+            }
+        }
+    }
+  debug_message("Left test_bipartite\n");
+}
+
+template <typename T, unsigned D>
+void Periodic_Operator<T,D>::find_sectors()
+{
+  /*
+    Split the orbitals into the connected components of the hopping graph. The sectors are
+    numbered by their lowest orbital, so orbital 0 is always in sector 0 and the orbitals
+    of each sector appear in increasing order.
+  */
+  debug_message("Entered find_sectors\n");
+  unsigned l[D + 1];
+  std::fill_n(l, D, 3);
+  l[D]  = r.Orb;
+  Coordinates<std::ptrdiff_t, D + 1> b3(l);
+
+  std::vector<unsigned> root(r.Orb);
+  for(unsigned io = 0; io < r.Orb; io++)
+    root.at(io) = io;
+  auto find = [&root](unsigned o) {
+    while(root.at(o) != o)
+      o = root.at(o) = root.at(root.at(o));
+    return o;
+  };
+  
+  for(unsigned io = 0; io < r.Orb; io++)
+    for(unsigned i = 0; i < NHoppings(io); i++)
+      {
+        if(hopping(i,io) == T(0))
+          continue;
+        b3.set_coord(dist(i,io));
+        unsigned a = find(io), b = find(unsigned(b3.coord[D]));
+        if(a != b)
+          root.at(std::max(a,b)) = std::min(a,b);
+      }
+
+  sector.assign(r.Orb, 0);
+  NSectors = 0;
+  std::vector<unsigned> label(r.Orb, r.Orb);
+  for(unsigned io = 0; io < r.Orb; io++)
+    {
+      unsigned a = find(io);
+      if(label.at(a) == r.Orb)
+        label.at(a) = NSectors++;
+      sector.at(io) = label.at(a);
+    }
+  debug_message("Left find_sectors\n");
+}
+
 template <typename T, unsigned D>
 void Periodic_Operator<T,D>::build_velocity(std::vector<unsigned> & components, unsigned n)
 {
@@ -0,0 +1,133 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+#include "Generic.hpp"
+#include "tools/ComplexTraits.hpp"
+#include "lattice/SparseStructure.hpp"
+#include "hamiltonian/HamiltonianSparse.hpp"
+
+template <typename T, unsigned D>
+Sparse_Operator<T,D>::Sparse_Operator(SparseStructure<T,D> & ss) : s(ss)
+{
+  /*
+    Copy the rows of the sites owned by this thread. The columns are renumbered locally:
+    the owned sites come first, in the order of the input, followed by the halo, the sites
+    of other threads reached by the hoppings that were cut by the partition.
+  */
+  debug_message("Entered Sparse_Operator constructor.\n");
+  thread_id = omp_get_thread_num();
+
+  for(std::size_t i = 0; i < s.Nt; i++)
+    if(s.owner[i] == thread_id)
+      site.push_back(i);
+  N = site.size();
+
+  std::vector<std::size_t> halo;
+  for(std::size_t i = 0; i < N; i++)
+    for(std::size_t k = s.row[site[i]]; k < s.row[site[i] + 1]; k++)
+      if(s.owner[s.column[k]] != thread_id)
+        halo.push_back(s.column[k]);
+  std::sort(halo.begin(), halo.end());
+  halo.erase(std::unique(halo.begin(), halo.end()), halo.end());
+  site.insert(site.end(), halo.begin(), halo.end());
+  Nd = site.size();
+
+  row.resize(N + 1);
+  row[0] = 0;
+  for(std::size_t i = 0; i < N; i++)
+    {
+      for(std::size_t k = s.row[site[i]]; k < s.row[site[i] + 1]; k++)
+        {
+          const std::size_t j = s.column[k];
+          if(s.owner[j] == thread_id)
+            column.push_back(s.local[j]);
+          else
+            column.push_back(N + (std::lower_bound(halo.begin(), halo.end(), j) - halo.begin()));
+          hopping.push_back(s.hopping[k]);
+        }
+      row[i + 1] = column.size();
+    }
+
+  position = Eigen::Matrix<double, D, Eigen::Dynamic>(D, Nd);
+  for(std::size_t i = 0; i < Nd; i++)
+    position.col(i) = s.position.col(site[i]);
+
+  // The sites in the halo of any thread get a slot in the exchange buffer
+#pragma omp critical
+  for(auto j : halo)
+    s.slot[j] = 0;
+#pragma omp barrier
+#pragma omp master
+  {
+    std::size_t count = 0;
+    for(std::size_t i = 0; i < s.Nt; i++)
+      if(s.slot[i] >= 0)
+        s.slot[i] = count++;
+    s.buffer.assign(count, T(0));
+  }
+#pragma omp barrier
+
+  for(std::size_t i = 0; i < N; i++)
+    if(s.slot[site[i]] >= 0)
+      {
+        border.push_back(i);
+        border_slot.push_back(s.slot[site[i]]);
+      }
+  for(auto j : halo)
+    halo_slot.push_back(s.slot[j]);
+
+  debug_message("Left Sparse_Operator constructor.\n");
+}
+
+template <typename T, unsigned D>
+void Sparse_Operator<T,D>::build_velocity(std::vector<unsigned> & components, unsigned n)
+{
+  /*
+    Same generalized velocities as Periodic_Operator::build_velocity, with the distance
+    between the sites of each element. Along the periodic directions of the box, the
+    closest image of the second site is used.
+  */
+  if(n == v.size())
+    v.push_back(std::vector<value_type>(hopping.size()));
+
+  std::vector<value_type> & v1 = v.at(n);
+  const Eigen::Matrix<double, D, D> inverse = s.rLat.inverse();
+  Eigen::Matrix<double, D, 1> dr_a, dr_R;
+
+  for(std::size_t i = 0; i < N; i++)
+    for(std::size_t k = row[i]; k < row[i + 1]; k++)
+      {
+        dr_a = inverse * (position.col(column[k]) - position.col(i));
+        for(unsigned d = 0; d < D; d++)
+          if(s.Bd[d] != 0)
+            dr_a(d) -= std::round(dr_a(d));
+        dr_R = s.rLat * dr_a;
+
+        v1.at(k) = value_type(1);
+        for(unsigned c = 0; c < components.size(); c++)
+          v1.at(k) *= value_type(dr_R(components.at(c)));
+      }
+}
+
+template struct Sparse_Operator<float,1u>;
+template struct Sparse_Operator<double,1u>;
+template struct Sparse_Operator<long double,1u>;
+template struct Sparse_Operator<std::complex<float>,1u>;
+template struct Sparse_Operator<std::complex<double>,1u>;
+template struct Sparse_Operator<std::complex<long double>,1u>;
+template struct Sparse_Operator<float,2u>;
+template struct Sparse_Operator<double,2u>;
+template struct Sparse_Operator<long double,2u>;
+template struct Sparse_Operator<std::complex<float>,2u>;
+template struct Sparse_Operator<std::complex<double>,2u>;
+template struct Sparse_Operator<std::complex<long double>,2u>;
+template struct Sparse_Operator<float,3u>;
+template struct Sparse_Operator<double,3u>;
+template struct Sparse_Operator<long double,3u>;
+template struct Sparse_Operator<std::complex<float>,3u>;
+template struct Sparse_Operator<std::complex<double>,3u>;
+template struct Sparse_Operator<std::complex<long double>,3u>;
@@ -27,11 +27,12 @@ void Vacancy_Operator<T,D>::generate_disorder()
   for(unsigned i = 0; i < r.NStr ; i++)
     position.at(i).clear();
   vacancies_with_defects.clear();
+  add_padding();
   // Distribute Vacancies
   
   for(unsigned k = 0; k < concentration.size(); k++)
     {
-      std::size_t vacancies_number  = static_cast<std::size_t>(concentration.at(k)) * r.N, count = 0;
+      std::size_t vacancies_number  = static_cast<std::size_t>(concentration.at(k)) * r.Nr, count = 0;
       // Test how many vacancies where in this subdomain
       if(vacancies_number < positions_fixed.at(k).size())
         vacancies_number =  positions_fixed.at(k).size();
@@ -65,6 +66,33 @@ void Vacancy_Operator<T,D>::generate_disorder()
     std::sort (position.at(i).begin(), position.at(i).end());
 }
 
+template <typename T,unsigned D>
+void Vacancy_Operator<T,D>::add_padding()
+{
+  /*
+    The sites that pad the sub-domain up to a multiple of TILE do not belong to the sample.
+    They are emptied together with the vacancies, but are not counted in SizetVacancies.
+    Being in the list, they are also never drawn as a random vacancy.
+  */
+  if(r.N == r.Nr)
+    return;
+  
+  Coordinates<std::size_t,D + 1> latt(r.ld), Latt(r.Ld), latStr(r.lStr);
+  for(std::size_t i = 0; i < r.Size; i++)
+    {
+      latt.set_coord(i);
+      bool padded = false;
+      for(unsigned d = 0; d < D; d++)
+        padded = padded || latt.coord[d] >= r.lr[d];
+      if(padded)
+        {
+          r.convertCoordinates(latStr,latt);
+          r.convertCoordinates(Latt,latt);
+          position.at(latStr.index).push_back(Latt.index);
+        }
+    }
+}
+
 template <typename T,unsigned D>
 void Vacancy_Operator<T,D>::add_model(double p, std::vector <int> & orb, std::vector<int> & postmp)
 {
@@ -38,6 +38,20 @@ LatticeStructure<D>::LatticeStructure(char *name )
       get_hdf5<int>(&MagneticField, file, (char *) "/Hamiltonian/MagneticFieldMul");
     }
     catch (H5::Exception&){}
+
+    // Optional non-uniform field: flux per unit cell (in flux quanta) of each row of the slow coordinate
+    if(D > 1)
+      try {
+        H5::Exception::dontPrint();
+        std::vector<double> flux(Lt[D - 1]);
+        get_hdf5<double>(flux.data(), file, (char *) "/Hamiltonian/MagneticFieldProfile");
+        vector_potential.assign(Lt[D - 1] + 1, 0.);
+        for(unsigned k = 0; k < Lt[D - 1]; k++)
+          vector_potential[k + 1] = vector_potential[k] + 2.0 * M_PI * flux[k];
+        field_profile = true;
+        MagneticField = 0;
+      }
+      catch (H5::Exception&){}
     file->close();
   }
 
@@ -48,22 +62,50 @@ LatticeStructure<D>::LatticeStructure(char *name )
   if(D==2) ghost_pot(0,1) = MagneticField * 2.0 / Lt[1] * M_PI;
   if(D==3) ghost_pot(0,1) = MagneticField * 2.0 / Lt[2] * M_PI;
 
+  // A field profile is not uniform, so its phases cannot be written with ghost_pot.
+  // They are computed bond by bond with peierls_phase instead. The hoppings across a
+  // periodic boundary of the slow coordinate see the gauge shifted by the total flux,
+  // which has to be an integer number of flux quanta. Open boundaries have no such hoppings
+  if(field_profile)
+    {
+      const double total = vector_potential.back() / (2.0 * M_PI);
+      if(Bd[D - 1] != 0 && std::abs(total - std::round(total)) > 1e-6)
+        {
+          std::cout << "The total flux of MagneticFieldProfile has to be an integer number of flux quanta "
+                    << "with periodic boundaries along the last lattice vector. Exiting.\n";
+          exit(1);
+        }
+      rOrbFrac = rLat.inverse() * rOrb;
+    }
 
-  test_divisibility();
+
+  test_domains();
     
   Nd = 1;
   N = 1;
+  Nr = 1;
   Nt = 1;
   NStr = 1;
   n_threads = 1;
+  nd[D] = 1;
+  thread_id = omp_get_thread_num();
     
+  Coordinates<unsigned, D + 1> dist(nd);
+  dist.set_coord(unsigned(thread_id));
+
+  // The sample is split as evenly as possible among the sub-domains, so their lengths
+  // differ at most by one. All of them are padded to the same length, a multiple of TILE.
+  // The padded sites do not belong to the sample and are kept at zero, just like vacancies.
   for(unsigned i = 0; i < D; i++)
     {
-      ld[i] = Lt[i]/nd[i];
+      ld[i] = TILE * ((domain_length(i, 0) + TILE - 1) / TILE);
+      lr[i] = domain_length(i, dist.coord[i]);
+      lo[i] = domain_start(i, dist.coord[i]);
       Ld[i] = ld[i] + 2*NGHOSTS;
       lStr[i] = ld[i] / TILE;
       Nd *= Ld[i];
       N  *= ld[i];
+      Nr *= lr[i];
       Nt *= Lt[i] ;
       NStr *= lStr[i] ;
       n_threads *= nd[i];
@@ -74,17 +116,14 @@ LatticeStructure<D>::LatticeStructure(char *name )
   Lt[D] = Orb;
   Ld[D] = Orb;
   ld[D] = Orb;
+  lr[D] = Orb;
+  lo[D] = 0;
   lStr[D] = Orb;
-  nd[D] = 1;
     
   Size = N * Orb;
   Sized = Nd * Orb;
   Sizet = Nt * Orb;
   SizetVacancies = 0;
-  thread_id = omp_get_thread_num();
-    
-  Coordinates<unsigned, D + 1> dist(nd);
-  dist.set_coord(unsigned(thread_id));
   
   // Test if subdomain is in the Global border and if it has open boundaries set to FALSE
   for(unsigned i = 0; i < D; i++)
@@ -92,7 +131,52 @@ LatticeStructure<D>::LatticeStructure(char *name )
       boundary[i][0] = (dist.coord[i] == 0         && Bd[i] == 0 ? false : true); 
       boundary[i][1] = (dist.coord[i] == nd[i] - 1 && Bd[i] == 0 ? false : true);	
     }
-    
+
+  build_tile_order();
+}
+
+template <unsigned D>
+void LatticeStructure<D>::build_tile_order() {
+  /*
+    Order in which KPM_MOTOR visits the tiles that belong to the sample. Row by row, the
+    neighbours of a tile along the slowest direction are a whole row (or plane) of tiles
+    away in memory. Along a Morton curve, consecutive tiles stay close in every direction,
+    which keeps the rows of the stencil in cache for wide domains.
+  */
+  Coordinates<std::size_t, D + 1> latStr(lStr);
+  unsigned nStr[D];
+  for(unsigned i = 0; i < D; i++)
+    nStr[i] = (lr[i] + TILE - 1) / TILE;
+
+  std::vector<std::pair<std::size_t, std::size_t>> order;
+  for(std::size_t istr = 0; istr < NStr; istr++)
+    {
+      latStr.set_coord(istr);
+      bool inside = true;
+      for(unsigned i = 0; i < D; i++)
+        inside = inside && latStr.coord[i] < nStr[i];
+      if(!inside)
+        continue;
+
+      std::size_t key = istr;
+#if TILE_ORDER == 1
+      // Interleave the bits of the tile coordinates
+      key = 0;
+      for(unsigned b = 0; b < 8*sizeof(std::size_t)/D; b++)
+        for(unsigned i = 0; i < D; i++)
+          key |= ((latStr.coord[i] >> b) & std::size_t(1)) << (b*D + i);
+#endif
+      order.push_back({key, istr});
+    }
+  std::sort(order.begin(), order.end());
+
+  tile_order.clear();
+  tile_rank.assign(NStr, NStr);
+  for(std::size_t it = 0; it < order.size(); it++)
+    {
+      tile_order.push_back(order[it].second);
+      tile_rank[order[it].second] = it;
+    }
 }
 
 template <unsigned D>
@@ -117,21 +201,43 @@ unsigned LatticeStructure<D>::get_BorderSize() {
 
 
 template <unsigned D>
-void LatticeStructure<D>::test_divisibility() {
-  debug_message("Entered LatticeStructure::test_divisibility.\n");
-  // Test if TILE x nd divides the length
+void LatticeStructure<D>::test_domains() {
+  debug_message("Entered LatticeStructure::test_domains.\n");
+  // Test if every sub-domain is long enough to fill the ghosts of its neighbours
 
   for(unsigned i = 0; i < D; i++){
-    if(Lt[i]%(nd[i] * TILE) != 0){
+    if(nd[i] == 0 || Lt[i] < nd[i] * NGHOSTS){
       std::cout << "The system size in direction " << i << " (" << Lt[i] <<  ") ";
-      std::cout << "must be a multiple of the number of divisions in that ";
-      std::cout << "direction (" << nd[i] << ") times TILE (" << TILE << "). ";
+      std::cout << "must be at least the number of divisions in that ";
+      std::cout << "direction (" << nd[i] << ") times NGHOSTS (" << NGHOSTS << "). ";
       std::cout << "Exiting.\n";
       exit(1);
     }
   } 
 
-  debug_message("Left LatticeStructure::test_divisibility.\n");
+  debug_message("Left LatticeStructure::test_domains.\n");
+}
+
+template <unsigned D>
+unsigned LatticeStructure<D>::domain_length(unsigned i, unsigned n) {
+  // Number of unit cells of the sample in the n-th sub-domain along direction i.
+  // The first Lt % nd sub-domains get one extra unit cell
+  return Lt[i] / nd[i] + (n < Lt[i] % nd[i] ? 1 : 0);
+}
+
+template <unsigned D>
+unsigned LatticeStructure<D>::domain_start(unsigned i, unsigned n) {
+  // Global coordinate of the first unit cell of the n-th sub-domain along direction i
+  return n * (Lt[i] / nd[i]) + std::min(n, Lt[i] % nd[i]);
+}
+
+template <unsigned D>
+unsigned LatticeStructure<D>::domain_coordinate(unsigned i, std::size_t coord) {
+  // Sub-domain along direction i to which the global coordinate belongs
+  const std::size_t q = Lt[i] / nd[i], rem = Lt[i] % nd[i];
+  if(coord < rem * (q + 1))
+    return unsigned(coord / (q + 1));
+  return unsigned(rem + (coord - rem * (q + 1)) / q);
 }
 
 template <unsigned D>
@@ -141,12 +247,11 @@ void  LatticeStructure<D>::convertCoordinates(Coordinates<T1, D + 1> & dest, Coo
   /*
    * Convert between the types basis defined in the LatticeStructure
    */
-  Coordinates<T1, D + 1> xd(T1(thread_id), nd);
   // Convert from Ld to Lt
   if( std::equal(std::begin(source.L), std::end(source.L), std::begin(Ld)) && std::equal(std::begin(dest.L), std::end(dest.L), std::begin(Lt)))
     {
       for(unsigned i = 0; i < D; i++)
-        dest.coord[i] =  (source.coord[i] + xd.coord[i] * ld[i] - NGHOSTS + Lt[i])%Lt[i] ;
+        dest.coord[i] =  (source.coord[i] + lo[i] - NGHOSTS + Lt[i])%Lt[i] ;
       dest.coord[D] = source.coord[D];
       dest.set_index(dest.coord);
     }
@@ -154,7 +259,7 @@ void  LatticeStructure<D>::convertCoordinates(Coordinates<T1, D + 1> & dest, Coo
   if( std::equal(std::begin(source.L), std::end(source.L), std::begin(ld)) && std::equal(std::begin(dest.L), std::end(dest.L), std::begin(Lt)))
     {
       for(unsigned i = 0; i < D; i++)
-        dest.coord[i] =  source.coord[i] + xd.coord[i] * ld[i];
+        dest.coord[i] =  source.coord[i] + lo[i];
       dest.coord[D] = source.coord[D];
       dest.set_index(dest.coord);
     }
@@ -173,7 +278,7 @@ void  LatticeStructure<D>::convertCoordinates(Coordinates<T1, D + 1> & dest, Coo
   if( std::equal(std::begin(source.L), std::end(source.L), std::begin(Lt)) && std::equal(std::begin(dest.L), std::end(dest.L), std::begin(ld)))
     {
       for(unsigned i = 0; i < D; i++)
-        dest.coord[i] =  source.coord[i] - xd.coord[i] * ld[i];
+        dest.coord[i] =  source.coord[i] - lo[i];
       dest.coord[D] = source.coord[D];
       dest.set_index(dest.coord);
     }
@@ -182,7 +287,7 @@ void  LatticeStructure<D>::convertCoordinates(Coordinates<T1, D + 1> & dest, Coo
   if( std::equal(std::begin(source.L), std::end(source.L), std::begin(Lt)) && std::equal(std::begin(dest.L), std::end(dest.L), std::begin(Ld)))
     {
       for(unsigned i = 0; i < D; i++)
-        dest.coord[i] =  source.coord[i] - xd.coord[i] * ld[i] + NGHOSTS;
+        dest.coord[i] =  source.coord[i] - lo[i] + NGHOSTS;
       dest.coord[D] = source.coord[D];
       dest.set_index(dest.coord);
     }
@@ -206,11 +311,11 @@ void  LatticeStructure<D>::convertCoordinates(Coordinates<T1, D + 1> & dest, Coo
       dest.set_index(dest.coord);
     }
 
-  // Convert from Ld to nd
+  // Convert from Lt to nd
   if( std::equal(std::begin(source.L), std::end(source.L), std::begin(Lt)) && std::equal(std::begin(dest.L), std::end(dest.L), std::begin(nd)))
     {
       for(unsigned i = 0; i < D; i++)
-        dest.coord[i] =  source.coord[i]/ld[i]; 
+        dest.coord[i] =  domain_coordinate(i, std::size_t(source.coord[i])); 
       dest.coord[D] = 0;
       dest.set_index(dest.coord);
     }
@@ -224,7 +329,7 @@ unsigned LatticeStructure<D>::domain_number (long index) {
   Coordinates<long, D + 1> n(nd);
   LATT.set_coord(index);
   for (unsigned i = 0; i < D; i++)
-    LATT.coord[i] /= ld[i];
+    LATT.coord[i] = domain_coordinate(i, std::size_t(LATT.coord[i]));
   LATT.coord[D] = 0;
   return unsigned(n.set_index(LATT.coord).index);
 }
@@ -248,14 +353,14 @@ void LatticeStructure<D>::print_coordinates(std::size_t pos1, std::size_t pos2)
 template <unsigned D>
 bool LatticeStructure<D>::test_ghosts(  Coordinates<std::size_t, D + 1> & Latt)
 {
-  // This function tests if the coordinates are in the ghosts
+  // This function tests if the coordinates are in the ghosts or in the padding
   // 0 is in the ghosts
   // 1 isn't in the ghosts
   
   bool teste = true;
   
   for(int j = 0; j < static_cast<int>(D); j++)
-    if(teste && (Latt.coord[j] < NGHOSTS || Latt.coord[j] >= std::ptrdiff_t(Ld[j] - NGHOSTS)) )
+    if(teste && (Latt.coord[j] < NGHOSTS || Latt.coord[j] >= std::ptrdiff_t(lr[j] + NGHOSTS)) )
       teste = false;                                        // node is in the ghosts!
     else  if(Latt.coord[j] < 0 || Latt.coord[j] > std::ptrdiff_t(Ld[j] - 1))
       {
@@ -265,6 +370,51 @@ bool LatticeStructure<D>::test_ghosts(  Coordinates<std::size_t, D + 1> & Latt)
   return teste;
 }
 
+template <unsigned D>
+double LatticeStructure<D>::gauge(double y)
+{
+  // Vector potential along the fast coordinate at the (fractional) row y of the slow coordinate.
+  // It is piecewise linear inside each row and gains the total flux at every period
+  const double L = Lt[D - 1];
+  const double q = std::floor(y / L);
+  const double y0 = y - q * L;
+  const unsigned k = std::min(unsigned(y0), Lt[D - 1] - 1);
+  return q * vector_potential.back() + vector_potential[k] + (y0 - k) * (vector_potential[k + 1] - vector_potential[k]);
+}
+
+template <unsigned D>
+double LatticeStructure<D>::mean_gauge(double y1, double y2)
+{
+  // Average of the gauge along the segment [y1, y2], integrated exactly row by row
+  if(std::abs(y2 - y1) < 1e-12)
+    return gauge(y1);
+  
+  const double a = std::min(y1, y2), b = std::max(y1, y2);
+  double integral = 0., y = a;
+  while(y < b)
+    {
+      const double next = std::min(b, std::floor(y) + 1.);
+      integral += 0.5 * (gauge(y) + gauge(next)) * (next - y);
+      y = next;
+    }
+  return integral / (b - a);
+}
+
+template <unsigned D>
+double LatticeStructure<D>::peierls_phase(Coordinates<std::ptrdiff_t, D + 1> & a, Coordinates<std::ptrdiff_t, D + 1> & b)
+{
+  // Phase of the hopping from site a to site b, both given in the sub-domain coordinates (with ghosts).
+  // The gauge only depends on the slow coordinate, so the phase is the line integral of the vector
+  // potential along the bond, taken in the frame where the orbitals are at the origin of their cells,
+  // which reduces to the Landau gauge of ghost_pot when the field is uniform
+  const double y1 = double(a.coord[D - 1]) + lo[D - 1] - NGHOSTS + rOrbFrac(D - 1, a.coord[D]);
+  const double y2 = double(b.coord[D - 1]) + lo[D - 1] - NGHOSTS + rOrbFrac(D - 1, b.coord[D]);
+  const double dx = double(b.coord[0] - a.coord[0]);
+  const double mean = mean_gauge(y1, y2);
+  
+  return dx * mean - rOrbFrac(0, b.coord[D]) * (gauge(y2) - mean) + rOrbFrac(0, a.coord[D]) * (gauge(y1) - mean);
+}
+
 template struct LatticeStructure<1u>;
 template struct LatticeStructure<2u>;
 template struct LatticeStructure<3u>;
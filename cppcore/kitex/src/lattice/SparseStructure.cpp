@@ -0,0 +1,144 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+#include "Generic.hpp"
+#include "tools/ComplexTraits.hpp"
+#include "tools/myHDF5.hpp"
+#include "lattice/SparseStructure.hpp"
+
+template <typename T, unsigned D>
+SparseStructure<T,D>::SparseStructure(char *name)
+{
+  debug_message("Entered SparseStructure constructor.\n");
+  auto *file = new H5::H5File(name, H5F_ACC_RDONLY);
+  unsigned Orb, nd[D];
+  std::size_t nnz;
+  get_hdf5<unsigned>(&Orb, file, (char *) "/NOrbitals");
+  get_hdf5<unsigned>(nd, file, (char *) "/Divisions");
+  get_hdf5<unsigned>(Bd, file, (char *) "/Boundaries");
+  get_hdf5<double>(rLat.data(), file, (char *) "/LattVectors");
+
+  Nt = Orb;
+  position = Eigen::Matrix<double, D, Eigen::Dynamic>::Zero(D, Nt);
+  get_hdf5<double>(position.data(), file, (char *) "/OrbPositions");
+
+  row.resize(Nt + 1);
+  get_hdf5<unsigned long>(row.data(), file, (char *) "/SparseHamiltonian/IndPtr");
+  nnz = row.back();
+  column.resize(nnz);
+  hopping.resize(nnz);
+  get_hdf5<unsigned>(column.data(), file, (char *) "/SparseHamiltonian/Indices");
+  get_hdf5<T>(hopping.data(), file, (char *) "/SparseHamiltonian/Data");
+  file->close();
+  delete file;
+
+  n_threads = 1;
+  for(unsigned i = 0; i < D; i++)
+    n_threads *= nd[i];
+
+  for(std::size_t i = 0; i < nnz; i++)
+    if(column[i] >= Nt)
+      {
+        std::cout << "The sparse Hamiltonian has a column index out of range. Exiting.\n";
+        exit(1);
+      }
+
+  partition();
+  debug_message("Left SparseStructure constructor.\n");
+}
+
+template <typename T, unsigned D>
+void SparseStructure<T,D>::partition()
+{
+  // Split the sites among the threads by recursive coordinate bisection: the sites of each
+  // part are cut in two along the direction where they are most spread, with the number of
+  // sites of each half proportional to the number of threads that will share it.
+  // The parts are compact, so few hoppings are cut and the halos are small.
+  std::vector<std::size_t> order(Nt);
+  for(std::size_t i = 0; i < Nt; i++)
+    order[i] = i;
+  owner.assign(Nt, 0);
+  bisect(order.data(), order.data() + Nt, 0, n_threads);
+
+  // The sites of each thread keep the order of the input, which usually has some locality
+  std::vector<std::size_t> count(n_threads, 0);
+  local.resize(Nt);
+  for(std::size_t i = 0; i < Nt; i++)
+    local[i] = count[owner[i]]++;
+  slot.assign(Nt, -1);
+
+  std::size_t cut = 0;
+  for(std::size_t i = 0; i < Nt; i++)
+    for(std::size_t k = row[i]; k < row[i + 1]; k++)
+      cut += (owner[column[k]] != owner[i]);
+
+  std::cout << "Sparse Hamiltonian with " << Nt << " sites and " << row.back() << " elements, "
+            << cut << " of them between different threads.\n";
+}
+
+template <typename T, unsigned D>
+void SparseStructure<T,D>::bisect(std::size_t *begin, std::size_t *end, unsigned first, unsigned parts)
+{
+  if(parts == 1)
+    {
+      for(std::size_t *i = begin; i != end; i++)
+        owner[*i] = first;
+      return;
+    }
+
+  // Direction along which the sites are most spread
+  Eigen::Matrix<double, D, 1> lo = Eigen::Matrix<double, D, 1>::Constant(std::numeric_limits<double>::max());
+  Eigen::Matrix<double, D, 1> hi = -lo;
+  for(std::size_t *i = begin; i != end; i++)
+    {
+      lo = lo.cwiseMin(position.col(*i));
+      hi = hi.cwiseMax(position.col(*i));
+    }
+  Eigen::Index axis = 0;
+  (hi - lo).maxCoeff(&axis);
+
+  const unsigned left = parts / 2;
+  std::size_t *middle = begin + (end - begin) * left / parts;
+  std::nth_element(begin, middle, end, [&](std::size_t a, std::size_t b) {
+    return position(axis, a) < position(axis, b);
+  });
+
+  bisect(begin, middle, first, left);
+  bisect(middle, end, first + left, parts - left);
+}
+
+template <typename T, unsigned D>
+void SparseStructure<T,D>::release()
+{
+  // Every thread has its own copy of its rows: free the input
+  std::vector<unsigned long>().swap(row);
+  std::vector<unsigned>().swap(column);
+  std::vector<T>().swap(hopping);
+  std::vector<unsigned>().swap(owner);
+  std::vector<std::size_t>().swap(local);
+  std::vector<std::ptrdiff_t>().swap(slot);
+  position.resize(D, 0);
+}
+
+template struct SparseStructure<float,1u>;
+template struct SparseStructure<double,1u>;
+template struct SparseStructure<long double,1u>;
+template struct SparseStructure<std::complex<float>,1u>;
+template struct SparseStructure<std::complex<double>,1u>;
+template struct SparseStructure<std::complex<long double>,1u>;
+template struct SparseStructure<float,2u>;
+template struct SparseStructure<double,2u>;
+template struct SparseStructure<long double,2u>;
+template struct SparseStructure<std::complex<float>,2u>;
+template struct SparseStructure<std::complex<double>,2u>;
+template struct SparseStructure<std::complex<long double>,2u>;
+template struct SparseStructure<float,3u>;
+template struct SparseStructure<double,3u>;
+template struct SparseStructure<long double,3u>;
+template struct SparseStructure<std::complex<float>,3u>;
+template struct SparseStructure<std::complex<double>,3u>;
+template struct SparseStructure<std::complex<long double>,3u>;
@@ -22,10 +22,23 @@ class Simulation;
 #include "tools/queue.hpp"
 #include "simulation/Simulation.hpp"
 #include "simulation/SimulationGlobal.hpp"
+#include "lattice/SparseStructure.hpp"
+#include "hamiltonian/HamiltonianSparse.hpp"
+#include "vector/KPM_SparseVector.hpp"
+#include "simulation/SimulationSparse.hpp"
 #include "tools/messages.hpp"
 
 typedef int indextype;
 
+template <typename T, unsigned D>
+void run_simulation(char *name, bool sparse){
+  // Hamiltonians given as a sparse matrix do not go through the lattice machinery
+  if(sparse)
+    GlobalSparseSimulation <T, D> h(name);
+  else
+    GlobalSimulation <T, D> h(name);
+}
+
 int main(int argc, char *argv[]){  
   //(void) argc;
     
@@ -49,7 +62,13 @@ int main(int argc, char *argv[]){
   get_hdf5(&is_complex, file, (char *) "/IS_COMPLEX");
   get_hdf5(&precision,  file, (char *) "/PRECISION");
   get_hdf5(&dim,        file, (char *) "/DIM");
-  
+
+  bool sparse = false;
+  try{
+    H5::Exception::dontPrint();
+    H5::Group group = file->openGroup("/SparseHamiltonian");
+    sparse = true;
+  } catch(H5::Exception&) {}
   
   file->close();
   
@@ -75,92 +94,92 @@ int main(int argc, char *argv[]){
   switch (index ) {
   case 0:
     {
-      class GlobalSimulation <float, 1u> h(argv[1]); // float real 1D
+      run_simulation <float, 1u> (argv[1], sparse); // float real 1D
       break;
     }
   case 1:
     {
-      class GlobalSimulation <float, 2u> h(argv[1]); // float real 2D
+      run_simulation <float, 2u> (argv[1], sparse); // float real 2D
       break;
     }
   case 2:
     {
-      class GlobalSimulation <float, 3u> h(argv[1]); // float real 3D
+      run_simulation <float, 3u> (argv[1], sparse); // float real 3D
       break;
     }
   case 3:
       {
-      class GlobalSimulation <double, 1u> h(argv[1]); // double real 1D
+      run_simulation <double, 1u> (argv[1], sparse); // double real 1D
       break;
       }
   case 4:
       {
-      class GlobalSimulation <double, 2u> h(argv[1]); //double real 2D. You get the picture.
+      run_simulation <double, 2u> (argv[1], sparse); //double real 2D. You get the picture.
       break;
       }
   case 5:
       {
-      class GlobalSimulation <double, 3u> h(argv[1]);
+      run_simulation <double, 3u> (argv[1], sparse);
       break;
       }
   case 6:
       {
-      class GlobalSimulation <long double, 1u> h(argv[1]);
+      run_simulation <long double, 1u> (argv[1], sparse);
       break;
       }
   case 7:
       {
-      class GlobalSimulation <long double, 2u> h(argv[1]);
+      run_simulation <long double, 2u> (argv[1], sparse);
       break;
       }
   case 8:
       {
-      class GlobalSimulation <long double, 3u> h(argv[1]);
+      run_simulation <long double, 3u> (argv[1], sparse);
       break;
       }
   case 9:
       {
-      class GlobalSimulation <std::complex<float>, 1u> h(argv[1]);
+      run_simulation <std::complex<float>, 1u> (argv[1], sparse);
       break;
       }
   case 10:
       {
-      class GlobalSimulation <std::complex<float>, 2u> h(argv[1]);
+      run_simulation <std::complex<float>, 2u> (argv[1], sparse);
       break;
       }
   case 11:
       {
-      class GlobalSimulation <std::complex<float>, 3u> h(argv[1]);
+      run_simulation <std::complex<float>, 3u> (argv[1], sparse);
       break;
       }
   case 12:
       {
-      class GlobalSimulation <std::complex<double>, 1u> h(argv[1]);
+      run_simulation <std::complex<double>, 1u> (argv[1], sparse);
       break;
       }
   case 13:
       {
-      class GlobalSimulation <std::complex<double>, 2u> h(argv[1]);
+      run_simulation <std::complex<double>, 2u> (argv[1], sparse);
       break;
       }
   case 14:
       {
-      class GlobalSimulation <std::complex<double>, 3u> h(argv[1]);
+      run_simulation <std::complex<double>, 3u> (argv[1], sparse);
       break;
       }
   case 15:
       {
-      class GlobalSimulation <std::complex<long double>, 1u> h(argv[1]);
+      run_simulation <std::complex<long double>, 1u> (argv[1], sparse);
       break;
       }
   case 16:
       {
-      class GlobalSimulation <std::complex<long double>, 2u> h(argv[1]);
+      run_simulation <std::complex<long double>, 2u> (argv[1], sparse);
       break;
       }
   case 17:
       {
-      class GlobalSimulation <std::complex<long double>, 3u> h(argv[1]);
+      run_simulation <std::complex<long double>, 3u> (argv[1], sparse);
       break;
       }
   default:
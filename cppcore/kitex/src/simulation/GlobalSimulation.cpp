@@ -50,10 +50,15 @@ GlobalSimulation<T,D>::GlobalSimulation( char *name ) : rglobal(name){
   {
     Simulation<T,D> simul(name, Global);
 
+    simul.calc_hartree(); // self-consistent local energies, used by all the calculations below
+    simul.calc_fused();  // sweeps shared by several of the calculations below
     simul.calc_conddc();
     simul.calc_condopt();
     simul.calc_condopt2();
     simul.calc_singleshot();
+    simul.calc_singleshot_optical();
+    simul.calc_bond_currents();
+    simul.calc_chern_marker();
     simul.calc_DOS();
     simul.calc_wavepacket();
     simul.calc_LDOS(); 
@@ -9,6 +9,7 @@
 
 #include "Generic.hpp"
 #include "tools/ComplexTraits.hpp"
+#include "tools/myHDF5.hpp"
 #include "simulation/Global.hpp"
 #include "tools/Random.hpp"
 #include "lattice/Coordinates.hpp"
@@ -89,6 +90,39 @@ std::vector<std::vector<unsigned>> Simulation<T,D>::process_string(std::string i
 }
 
 
+template <typename T,unsigned D>
+bool Simulation<T,D>::load_operators(const std::string & group, unsigned n_slots){
+  // Reads the on-site orbital operators group/Operator0, group/Operator1, ... of the first n_slots
+  // velocity slots into the Hamiltonian (see Hamiltonian::set_operator). The slots without
+  // a dataset keep their plain velocity. Returns true if any operator was found
+  h.clear_operators();
+#pragma omp critical
+{
+  auto *file = new H5::H5File(name, H5F_ACC_RDONLY);
+  for(unsigned n = 0; n < n_slots; n++)
+    {
+      std::string field = group + "/Operator" + std::to_string(n);
+      hsize_t dims[2] = {0, 0};
+      try{
+        H5::Exception::dontPrint();
+        H5::DataSet dataset = file->openDataSet(field);
+        H5::DataSpace dataspace = dataset.getSpace();
+        if(dataspace.getSimpleExtentNdims() == 2)
+          dataspace.getSimpleExtentDims(dims, NULL);
+      } catch(H5::Exception&) {continue;}
+
+      // The matrix is stored by rows. A matrix of the wrong size is refused by set_operator
+      Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> O = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(dims[1], dims[0]);
+      if(dims[0] == r.Orb && dims[1] == r.Orb)
+        get_hdf5<T>(O.data(), file, field);
+      h.set_operator(n, O.transpose());
+    }
+  file->close();
+  delete file;
+}
+  return h.operators_set;
+}
+
 template <typename T,unsigned D>
 double Simulation<T,D>::time_kpm(int N_average){
   debug_message("Entered time_kpm");
@@ -155,6 +189,25 @@ template std::vector<std::vector<unsigned>> Simulation<std::complex<float> ,2u>:
 template std::vector<std::vector<unsigned>> Simulation<std::complex<double> ,2u>::process_string(std::string);
 template std::vector<std::vector<unsigned>> Simulation<std::complex<long double> ,2u>::process_string(std::string);
 
+template bool Simulation<float ,1u>::load_operators(const std::string &, unsigned);
+template bool Simulation<double ,1u>::load_operators(const std::string &, unsigned);
+template bool Simulation<long double ,1u>::load_operators(const std::string &, unsigned);
+template bool Simulation<std::complex<float> ,1u>::load_operators(const std::string &, unsigned);
+template bool Simulation<std::complex<double> ,1u>::load_operators(const std::string &, unsigned);
+template bool Simulation<std::complex<long double> ,1u>::load_operators(const std::string &, unsigned);
+template bool Simulation<float ,3u>::load_operators(const std::string &, unsigned);
+template bool Simulation<double ,3u>::load_operators(const std::string &, unsigned);
+template bool Simulation<long double ,3u>::load_operators(const std::string &, unsigned);
+template bool Simulation<std::complex<float> ,3u>::load_operators(const std::string &, unsigned);
+template bool Simulation<std::complex<double> ,3u>::load_operators(const std::string &, unsigned);
+template bool Simulation<std::complex<long double> ,3u>::load_operators(const std::string &, unsigned);
+template bool Simulation<float ,2u>::load_operators(const std::string &, unsigned);
+template bool Simulation<double ,2u>::load_operators(const std::string &, unsigned);
+template bool Simulation<long double ,2u>::load_operators(const std::string &, unsigned);
+template bool Simulation<std::complex<float> ,2u>::load_operators(const std::string &, unsigned);
+template bool Simulation<std::complex<double> ,2u>::load_operators(const std::string &, unsigned);
+template bool Simulation<std::complex<long double> ,2u>::load_operators(const std::string &, unsigned);
+
 template double Simulation<float ,1u>::time_kpm(int);
 template double Simulation<double ,1u>::time_kpm(int);
 template double Simulation<long double ,1u>::time_kpm(int);
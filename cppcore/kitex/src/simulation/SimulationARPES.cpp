@@ -111,6 +111,13 @@ void Simulation<T,D>::ARPES(int NDisorder, int NMoments, Eigen::Array<double, Ei
         } 
     }
     store_ARPES(&gamma);
+#pragma omp master
+    {
+      H5::H5File * file = new H5::H5File(name, H5F_ACC_RDWR);
+      write_samples(file, "/Calculation/arpes/kMU", long(NDisorder));
+      delete file;
+    }
+#pragma omp barrier
 }
 
 template <typename T, unsigned DIM>
@@ -0,0 +1,321 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+
+#include "Generic.hpp"
+#include "tools/ComplexTraits.hpp"
+#include "tools/myHDF5.hpp"
+#include "simulation/Global.hpp"
+#include "tools/Random.hpp"
+#include "lattice/Coordinates.hpp"
+#include "lattice/LatticeStructure.hpp"
+template <typename T, unsigned D>
+class Hamiltonian;
+template <typename T, unsigned D>
+class KPM_Vector;
+#include "tools/queue.hpp"
+#include "simulation/Simulation.hpp"
+#include "hamiltonian/Hamiltonian.hpp"
+#include "vector/KPM_VectorBasis.hpp"
+#include "vector/KPM_Vector.hpp"
+
+// Chebyshev coefficients of the Green's function, defined in SimulationSingleShot.cpp
+std::complex<double> green(int n, int sigma, std::complex<double> energy);
+
+template <typename T, unsigned D>
+void Simulation<T,D>::calc_bond_currents() {
+  Eigen::Array<double, Eigen::Dynamic, 1> energies;
+  int NDisorder, NRandom, NMoments, direction;
+  double gamma;
+  std::string direction_string;
+  std::string group = "/Calculation/bond_currents/";
+
+    // Make sure that all the threads are ready before opening any files
+    // Some threads could still be inside the Simulation constructor
+    // This barrier is essential
+#pragma omp barrier
+  int calculate_bond_currents_local = false;
+#pragma omp master
+{
+  auto * file1 = new H5::H5File(name, H5F_ACC_RDONLY);
+  Global.calculate_bond_currents = false;
+  try{
+    debug_message("bond currents: checking if we need to calculate it.\n");
+    get_hdf5<int>(&direction, file1, (char *)   "/Calculation/bond_currents/Direction");
+    Global.calculate_bond_currents = true;
+
+  } catch(H5::Exception&) {debug_message("bond currents: no need to calculate it.\n");}
+  file1->close();
+  delete file1;
+
+}
+#pragma omp barrier
+#pragma omp critical
+  calculate_bond_currents_local = Global.calculate_bond_currents;
+#pragma omp barrier
+
+
+  if(calculate_bond_currents_local){
+#pragma omp master
+      {
+        std::cout << "Calculating the bond currents.\n";
+      }
+#pragma omp barrier
+#pragma omp critical
+{
+    auto * file = new H5::H5File(name, H5F_ACC_RDONLY);
+    get_hdf5<int>(&direction, file, (char *)   "/Calculation/bond_currents/Direction");
+    get_hdf5<int>(&NRandom, file, (char *)   "/Calculation/bond_currents/NumRandoms");
+    get_hdf5<int>(&NDisorder, file, (char *)   "/Calculation/bond_currents/NumDisorder");
+    get_hdf5<int>(&NMoments, file, (char *)   "/Calculation/bond_currents/NumMoments");
+    get_hdf5<double>(&gamma, file, (char *)   "/Calculation/bond_currents/Gamma");
+
+    if(direction == 0)
+      direction_string = "x,x";
+    else if(direction == 1)
+      direction_string = "y,y";
+    else if(direction == 2)
+      direction_string = "z,z";
+    else{
+      std::cout << "Invalid bond currents direction. Has to be x, y or z. Exiting.\n";
+      exit(1);
+    }
+
+    hsize_t dims_out[2];
+    auto * dataset     	= new H5::DataSet(file->openDataSet(group + "Energy"));
+    auto * dataspace 	= new H5::DataSpace(dataset->getSpace());
+    dataspace->getSimpleExtentDims(dims_out, nullptr);
+    delete dataspace;
+    delete dataset;
+    energies = Eigen::Array<double, -1, 1>::Zero(dims_out[0]*dims_out[1]);
+    get_hdf5<double>(energies.data(),  	  file, (char *)   "/Calculation/bond_currents/Energy");
+
+    file->close();
+  delete file;
+}
+
+  bond_currents(energies, gamma, NMoments, NDisorder, NRandom, direction_string);
+  }
+}
+
+template <typename T, unsigned D>
+void Simulation<T,D>::bond_currents(Eigen::Array<double, Eigen::Dynamic, 1> energies, double gamma, int NMoments,
+  int NDisorder, int NRandomV, std::string direction_string){
+  // Map of the linear response of the current through every bond of the periodic lattice to a uniform
+  // electric field along the given direction, with the Kubo-Greenwood formula
+  //
+  //   J_ij(E) ~ Tr[ J_ij A(E) v A(E) ],   J_ij = i (H_ij |i><j| - H_ji |j><i|)
+  //
+  // where A(E) = sum_n Im g_n(E) T_n is the same broadened delta function as in the single-shot
+  // conductivity. The trace is evaluated with the random vectors: with |psi> = A(E)|r> and
+  // |chi> = A(E) v|r>, the element <j|A v A|i> is estimated by (chi_j psi_i^* - psi_j chi_i^*)/2, so
+  // the bonds of the whole sample are obtained in a single pass over the hoppings per random vector
+  // (KPM_Vector::bond_currents). The Chebyshev recursions are shared by SSBATCH energies at a time.
+  // The map is normalized so that the average over the unit cells of the current density
+  //
+  //   j_i = 1/2 sum_j (r_j - r_i) J_ij
+  //
+  // is the single-shot dc conductivity. Only the hoppings of the periodic part of the Hamiltonian
+  // are mapped, not the ones added by the structural defects
+
+  debug_message("Entered bond_currents\n");
+  int NE = static_cast<int>(energies.rows());
+  int NPadded = (NMoments + MEMORY - 1)/MEMORY*MEMORY;
+
+  // Largest number of hoppings of an orbital. The orbitals with fewer hoppings are padded with zeros
+  std::size_t NBonds = 0;
+  for(unsigned io = 0; io < r.Orb; io++)
+    NBonds = std::max<std::size_t>(NBonds, h.hr.NHoppings(io));
+
+  std::vector<std::vector<unsigned>> indices = process_string(direction_string);
+
+  // initialize the kpm vectors necessary for this calculation
+  KPM_Vector<T,D> kpm0(1, *this);       // random vector
+  KPM_Vector<T,D> kpm1(MEMORY, *this);  // Chebyshev recursions of v|r> and |r>
+
+  // For each energy of a batch, the columns of 'left' and 'right' are A(E) v|r> and A(E)|r>
+  Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> left, right, coefs;
+  Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> currents;
+  currents = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(r.Orb*NBonds*r.Nr, NE);
+  long average = 0;
+
+  for(int disorder = 0; disorder < NDisorder; disorder++){
+    h.generate_disorder();
+    h.build_velocity(indices.at(0),0u);
+
+    for(int randV = 0; randV < NRandomV; randV++){
+      h.generate_twists(); // Generates Random or fixed boundaries
+      kpm0.initiate_vector();
+      kpm1.initiate_phases();
+      kpm0.Exchange_Boundaries();
+
+      for(int e0 = 0; e0 < NE; e0 += SSBATCH){
+        int NB = std::min(SSBATCH, NE - e0);
+
+        // Expansion coefficients of A(E). The rows beyond NMoments are zero
+        coefs = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(NPadded, NB);
+        for(int k = 0; k < NB; k++){
+          std::complex<double> energy(energies(e0 + k), gamma);
+          for(int n = 0; n < NMoments; n++)
+            coefs(n, k) = T(static_cast<value_type>(green(n, 1, energy).imag()/(1.0 + int(n==0))));
+        }
+
+        // MEMORY Chebyshev vectors at a time. Their ghosts are exchanged, and so are the ones of
+        // the combinations
+        left  = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(r.Sized, NB);
+        right = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(r.Sized, NB);
+        kpm1.set_index(0);
+        kpm0.Velocity(&kpm1, indices, 0);
+        for(int n = 0; n < NPadded; n += MEMORY){
+          for(int i = n; i < n + MEMORY; i++)
+            kpm1.cheb_iteration(i);
+          left.noalias() += kpm1.v*coefs.middleRows(n, MEMORY);
+        }
+
+        kpm1.set_index(0);
+        kpm1.v.col(0) = kpm0.v.col(0);
+        for(int m = 0; m < NPadded; m += MEMORY){
+          for(int i = m; i < m + MEMORY; i++)
+            kpm1.cheb_iteration(i);
+          right.noalias() += kpm1.v*coefs.middleRows(m, MEMORY);
+        }
+
+        for(int k = 0; k < NB; k++)
+          kpm1.bond_currents(right.col(k).data(), left.col(k).data(), NBonds, currents.col(e0 + k).data());
+      }
+      average++;
+    }
+  }
+
+  // Average over the samples and normalization of the single-shot conductivity
+  double unit_cell_area = fabs(r.rLat.determinant());
+  double factor = 2.0*double(r.Orb)*double(r.Nt)/unit_cell_area/double(average);
+
+  // Global position of the unit cells of this sub-domain
+  std::vector<std::size_t> cells(r.Nr);
+  for(std::size_t l = 0; l < r.Nr; l++){
+    std::size_t rest = l, stride = 1;
+    cells.at(l) = 0;
+    for(unsigned d = 0; d < D; d++){
+      cells.at(l) += (r.lo[d] + rest % r.lr[d])*stride;
+      rest /= r.lr[d];
+      stride *= r.Lt[d];
+    }
+  }
+
+#pragma omp master
+  {
+    Global.bond_currents = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(r.Orb*NBonds*r.Nt, NE);
+  }
+#pragma omp barrier
+#pragma omp critical
+  {
+    for(std::size_t b = 0; b < r.Orb*NBonds; b++)
+      for(std::size_t l = 0; l < r.Nr; l++)
+        Global.bond_currents.row(b*r.Nt + cells.at(l)) = factor*currents.row(b*r.Nr + l);
+  }
+#pragma omp barrier
+
+#pragma omp master
+  {
+    // The bonds of each orbital: orbital at the other end, unit cell and bond vector
+    Eigen::Array<int, Eigen::Dynamic, Eigen::Dynamic> bond_orbitals, bond_cells;
+    Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> bond_vectors;
+    bond_orbitals = Eigen::Array<int, Eigen::Dynamic, Eigen::Dynamic>::Constant(1, r.Orb*NBonds, -1);
+    bond_cells    = Eigen::Array<int, Eigen::Dynamic, Eigen::Dynamic>::Zero(D, r.Orb*NBonds);
+    bond_vectors  = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(D, r.Orb*NBonds);
+
+    Coordinates<std::ptrdiff_t, D + 1> Lda(r.Ld), Ldb(r.Ld);
+    Eigen::Map<Eigen::Matrix<std::ptrdiff_t,D, 1>> va(Lda.coord), vb(Ldb.coord);
+    for(unsigned io = 0; io < r.Orb; io++)
+      {
+        std::ptrdiff_t ip = io*Lda.basis[D];
+        for(unsigned i = 0; i < D; i++)
+          ip += r.Ld[i]/2 * Lda.basis[i];  // Choose a point in the middle of the domain
+        Lda.set_coord(ip);
+
+        for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+          {
+            std::size_t b = io*NBonds + ib;
+            Ldb.set_coord(ip + h.hr.distance(ib,io));
+            bond_orbitals(0, b) = int(Ldb.coord[D]);
+            bond_cells.col(b) = (vb - va).template cast<int>();
+            bond_vectors.col(b) = r.rLat * (vb - va).template cast<double>() + r.rOrb.col(Ldb.coord[D]) - r.rOrb.col(io);
+          }
+      }
+
+    // Current density of each orbital, ordered as [energy][direction][orbital][site]
+    Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> density;
+    density = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(D*r.Orb*r.Nt, NE);
+    for(unsigned d = 0; d < D; d++)
+      for(unsigned io = 0; io < r.Orb; io++)
+        for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+          density.middleRows((d*r.Orb + io)*r.Nt, r.Nt) +=
+            0.5*bond_vectors(d, io*NBonds + ib)*Global.bond_currents.middleRows((io*NBonds + ib)*r.Nt, r.Nt);
+
+    // The coordinates of the sample are the fastest dimensions, as in the global index of KITEx
+    std::vector<hsize_t> dims_currents = {hsize_t(NE), hsize_t(r.Orb), hsize_t(NBonds)};
+    std::vector<hsize_t> dims_density  = {hsize_t(NE), hsize_t(D), hsize_t(r.Orb)};
+    for(unsigned d = D; d-- > 0; )
+      {
+        dims_currents.push_back(r.Lt[d]);
+        dims_density.push_back(r.Lt[d]);
+      }
+
+    auto * file = new H5::H5File(name, H5F_ACC_RDWR);
+    write_map(Global.bond_currents.data(), dims_currents, file, "/Calculation/bond_currents/Currents");
+    write_map(density.data(), dims_density, file, "/Calculation/bond_currents/Density");
+    write_hdf5(bond_orbitals, file, "/Calculation/bond_currents/BondOrbitals");
+    write_hdf5(bond_cells, file, "/Calculation/bond_currents/BondCells");
+    write_hdf5(bond_vectors, file, "/Calculation/bond_currents/BondVectors");
+    file->close();
+    delete file;
+
+    // The map may be large, so it is not kept after being written
+    Global.bond_currents.resize(0, 0);
+    debug_message("Left bond_currents");
+  }
+#pragma omp barrier
+}
+
+template void Simulation<float,1u>::calc_bond_currents();
+template void Simulation<double,1u>::calc_bond_currents();
+template void Simulation<long double,1u>::calc_bond_currents();
+template void Simulation<std::complex<float>,1u>::calc_bond_currents();
+template void Simulation<std::complex<double>,1u>::calc_bond_currents();
+template void Simulation<std::complex<long double>,1u>::calc_bond_currents();
+template void Simulation<float,2u>::calc_bond_currents();
+template void Simulation<double,2u>::calc_bond_currents();
+template void Simulation<long double,2u>::calc_bond_currents();
+template void Simulation<std::complex<float>,2u>::calc_bond_currents();
+template void Simulation<std::complex<double>,2u>::calc_bond_currents();
+template void Simulation<std::complex<long double>,2u>::calc_bond_currents();
+template void Simulation<float,3u>::calc_bond_currents();
+template void Simulation<double,3u>::calc_bond_currents();
+template void Simulation<long double,3u>::calc_bond_currents();
+template void Simulation<std::complex<float>,3u>::calc_bond_currents();
+template void Simulation<std::complex<double>,3u>::calc_bond_currents();
+template void Simulation<std::complex<long double>,3u>::calc_bond_currents();
+
+template void Simulation<float,1u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<double,1u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<long double,1u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<std::complex<float>,1u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<std::complex<double>,1u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<std::complex<long double>,1u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<float,2u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<double,2u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<long double,2u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<std::complex<float>,2u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<std::complex<double>,2u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<std::complex<long double>,2u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<float,3u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<double,3u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<long double,3u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<std::complex<float>,3u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<std::complex<double>,3u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
+template void Simulation<std::complex<long double>,3u>::bond_currents(Eigen::Array<double, -1, 1>, double, int, int, int, std::string);
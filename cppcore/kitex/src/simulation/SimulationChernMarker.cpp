@@ -0,0 +1,361 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+
+#include "Generic.hpp"
+#include "tools/ComplexTraits.hpp"
+#include "tools/myHDF5.hpp"
+#include "simulation/Global.hpp"
+#include "tools/Random.hpp"
+#include "lattice/Coordinates.hpp"
+#include "lattice/LatticeStructure.hpp"
+template <typename T, unsigned D>
+class Hamiltonian;
+template <typename T, unsigned D>
+class KPM_Vector;
+#include "tools/queue.hpp"
+#include "simulation/Simulation.hpp"
+#include "hamiltonian/Hamiltonian.hpp"
+#include "vector/KPM_VectorBasis.hpp"
+#include "vector/KPM_Vector.hpp"
+
+template <typename T, unsigned D>
+void Simulation<T,D>::calc_chern_marker() {
+  Eigen::Array<double, Eigen::Dynamic, 1> energies;
+  Eigen::Array<unsigned long, Eigen::Dynamic, 1> orbitals, positions;
+  Eigen::Array<int, Eigen::Dynamic, Eigen::Dynamic> regions;
+  int NDisorder, NRandom = 0, NMoments;
+
+    // Make sure that all the threads are ready before opening any files
+    // Some threads could still be inside the Simulation constructor
+    // This barrier is essential
+#pragma omp barrier
+  int calculate_chern_marker_local = false;
+#pragma omp master
+{
+  auto * file1 = new H5::H5File(name, H5F_ACC_RDONLY);
+  Global.calculate_chern_marker = false;
+  try{
+    debug_message("chern marker: checking if we need to calculate it.\n");
+    get_hdf5<int>(&NMoments, file1, (char *)   "/Calculation/chern_marker/NumMoments");
+    Global.calculate_chern_marker = true;
+
+  } catch(H5::Exception&) {debug_message("chern marker: no need to calculate it.\n");}
+  file1->close();
+  delete file1;
+
+}
+#pragma omp barrier
+#pragma omp critical
+  calculate_chern_marker_local = Global.calculate_chern_marker;
+#pragma omp barrier
+
+
+  if(calculate_chern_marker_local){
+#pragma omp master
+      {
+        std::cout << "Calculating the local Chern marker.\n";
+        if(D != 2){
+          std::cout << "The local Chern marker is only defined for two-dimensional lattices. Exiting.\n";
+          exit(1);
+        }
+      }
+#pragma omp barrier
+#pragma omp critical
+{
+    auto * file = new H5::H5File(name, H5F_ACC_RDONLY);
+    H5::Exception::dontPrint();
+    get_hdf5<int>(&NMoments, file, (char *)   "/Calculation/chern_marker/NumMoments");
+    get_hdf5<int>(&NDisorder, file, (char *)   "/Calculation/chern_marker/NumDisorder");
+
+    hsize_t dims_out[2];
+    auto * dataset     	= new H5::DataSet(file->openDataSet("/Calculation/chern_marker/Energy"));
+    auto * dataspace 	= new H5::DataSpace(dataset->getSpace());
+    dataspace->getSimpleExtentDims(dims_out, nullptr);
+    delete dataspace;
+    delete dataset;
+    energies = Eigen::Array<double, -1, 1>::Zero(dims_out[0]*dims_out[1]);
+    get_hdf5<double>(energies.data(),  	  file, (char *)   "/Calculation/chern_marker/Energy");
+
+    // Single sites, with the same convention as the LDoS
+    try{
+      dataset   = new H5::DataSet(file->openDataSet("/Calculation/chern_marker/Orbitals"));
+      dataspace = new H5::DataSpace(dataset->getSpace());
+      dataspace->getSimpleExtentDims(dims_out, nullptr);
+      delete dataspace;
+      delete dataset;
+      orbitals  = Eigen::Array<unsigned long, -1, 1>::Zero(dims_out[0]);
+      positions = Eigen::Array<unsigned long, -1, 1>::Zero(dims_out[0]);
+      get_hdf5<unsigned long>(orbitals.data(), file, (char *) "/Calculation/chern_marker/Orbitals");
+      get_hdf5<unsigned long>(positions.data(), file, (char *) "/Calculation/chern_marker/FixPosition");
+    } catch(H5::Exception&) {}
+
+    // Rectangular regions of unit cells: first corner and number of cells along each direction
+    try{
+      dataset   = new H5::DataSet(file->openDataSet("/Calculation/chern_marker/RegionStart"));
+      dataspace = new H5::DataSpace(dataset->getSpace());
+      dataspace->getSimpleExtentDims(dims_out, nullptr);
+      delete dataspace;
+      delete dataset;
+      regions = Eigen::Array<int, -1, -1>::Zero(2*D, dims_out[0]);
+      Eigen::Array<int, -1, -1> start(D, dims_out[0]), size(D, dims_out[0]);
+      get_hdf5<int>(start.data(), file, (char *) "/Calculation/chern_marker/RegionStart");
+      get_hdf5<int>(size.data(), file, (char *) "/Calculation/chern_marker/RegionSize");
+      get_hdf5<int>(&NRandom, file, (char *) "/Calculation/chern_marker/NumRandoms");
+      regions.topRows(D) = start;
+      regions.bottomRows(D) = size;
+    } catch(H5::Exception&) {}
+
+    file->close();
+  delete file;
+}
+#pragma omp barrier
+
+    Eigen::Array<unsigned long, Eigen::Dynamic, 1> sites = positions + orbitals*r.Nt;
+    chern_marker(energies, NMoments, NDisorder, NRandom, sites, regions);
+  }
+}
+
+template <typename T, unsigned D>
+void Simulation<T,D>::chern_marker(Eigen::Array<double, Eigen::Dynamic, 1> energies, int NMoments, int NDisorder,
+  int NRandomV, Eigen::Array<unsigned long, Eigen::Dynamic, 1> sites, Eigen::Array<int, Eigen::Dynamic, Eigen::Dynamic> regions){
+  // Local Chern marker of Bianco and Resta
+  //
+  //   C(r) = -(4 pi/A_c) Im <r| P x Q y P |r>,   P = theta(E_F - H),   Q = 1 - P
+  //
+  // where A_c is the area of the unit cell. P is expanded in Chebyshev polynomials with the Jackson kernel,
+  // and with |a> = P|r> the matrix element is
+  //
+  //   <r| P x Q y P |r> = <a|x y|a> - <x a| P |y a>
+  //
+  // so each site costs two expansions. The Fermi energies share the first one, SSBATCH at a time. The
+  // positions are measured from the site with the minimum image convention, which requires the sample to
+  // be much larger than the localization length of P. The sum of the marker over the orbitals of a unit
+  // cell is the Chern number deep inside an insulator.
+  //
+  // The average of the marker over a rectangular region of unit cells is evaluated stochastically with
+  // random vectors restricted to that region, whose covariance is the identity inside the region. Since
+  // P Q = 0, the trace over the region does not depend on the origin of the positions.
+
+  debug_message("Entered chern_marker\n");
+  int NE = static_cast<int>(energies.rows());
+  int NPadded = (NMoments + MEMORY - 1)/MEMORY*MEMORY;
+  auto NSites = static_cast<int>(sites.rows());
+  auto NRegions = static_cast<int>(regions.cols());
+
+  // Chebyshev coefficients of the step function with the Jackson kernel. The rows beyond NMoments are zero
+  Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> coefs;
+  coefs = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(NPadded, NE);
+  for(int k = 0; k < NE; k++){
+    double phi = std::acos(std::max(-1.0, std::min(1.0, energies(k))));
+    for(int n = 0; n < NMoments; n++){
+      double arg = M_PI/(NMoments + 1.0);
+      double kernel = ((NMoments - n + 1)*cos(n*arg) + sin(n*arg)/tan(arg))/(NMoments + 1.0);
+      double step = (n == 0) ? (M_PI - phi)/M_PI : -2.0*sin(n*phi)/(n*M_PI);
+      coefs(n, k) = T(static_cast<value_type>(kernel*step));
+    }
+  }
+
+  // Unit cell and orbital of the sites of this domain, without the ghosts
+  std::vector<std::size_t> site_index;
+  std::vector<unsigned> site_orbital;
+  std::vector<Eigen::Matrix<double, D, 1>> site_cell;
+  Coordinates<std::size_t, D + 1> x(r.Ld), z(r.Lt);
+  for(std::size_t i = 0; i < r.Sized; i++){
+    x.set_coord(i);
+    bool real_site = true;
+    for(unsigned d = 0; d < D; d++)
+      real_site = real_site && x.coord[d] >= NGHOSTS && x.coord[d] < NGHOSTS + r.lr[d];
+    if(!real_site)
+      continue;
+    r.convertCoordinates(z, x);
+    Eigen::Matrix<double, D, 1> cell;
+    for(unsigned d = 0; d < D; d++)
+      cell(d) = double(z.coord[d]);
+    site_index.push_back(i);
+    site_orbital.push_back(unsigned(z.coord[D]));
+    site_cell.push_back(cell);
+  }
+
+  // Positions x and y measured from 'origin', in the unit cell 'center', with the minimum image
+  // convention. They vanish on the ghosts
+  Eigen::Array<T, Eigen::Dynamic, 1> X, Y;
+  X = Eigen::Array<T, Eigen::Dynamic, 1>::Zero(r.Sized);
+  Y = Eigen::Array<T, Eigen::Dynamic, 1>::Zero(r.Sized);
+  auto build_positions = [&](const Eigen::Matrix<double, D, 1> & center, const Eigen::Matrix<double, D, 1> & origin){
+    for(std::size_t s = 0; s < site_index.size(); s++){
+      Eigen::Matrix<double, D, 1> dn = site_cell.at(s) - center;
+      for(unsigned d = 0; d < D; d++)
+        dn(d) -= double(r.Lt[d])*std::round(dn(d)/double(r.Lt[d]));
+      Eigen::Matrix<double, D, 1> R = r.rLat*dn + r.rOrb.col(site_orbital.at(s)) - origin;
+      X(site_index.at(s)) = T(static_cast<value_type>(R(0)));
+      Y(site_index.at(s)) = T(static_cast<value_type>(R(D - 1)));
+    }
+  };
+
+  KPM_Vector<T,D> kpm0(1, *this);       // starting vector
+  KPM_Vector<T,D> kpm1(MEMORY, *this);  // Chebyshev recursions
+
+  // Contribution of this domain to Im <r|P x Q y P|r> for every Fermi energy, with |r> in kpm0
+  Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> proj;
+  Eigen::Matrix<T, Eigen::Dynamic, 1> ax, py;
+  auto marker = [&](){
+    Eigen::Array<double, Eigen::Dynamic, 1> im = Eigen::Array<double, Eigen::Dynamic, 1>::Zero(NE);
+    for(int e0 = 0; e0 < NE; e0 += SSBATCH){
+      int NB = std::min(SSBATCH, NE - e0);
+
+      // P|r> for a batch of Fermi energies
+      proj = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(r.Sized, NB);
+      kpm1.set_index(0);
+      kpm1.v.col(0) = kpm0.v.col(0);
+      for(int n = 0; n < NPadded; n += MEMORY){
+        for(int i = n; i < n + MEMORY; i++)
+          kpm1.cheb_iteration(i);
+        proj.noalias() += kpm1.v*coefs.block(n, e0, MEMORY, NB);
+      }
+
+      for(int k = 0; k < NB; k++){
+        ax = (X*proj.col(k).array()).matrix();
+        kpm1.set_index(0);
+        kpm1.v.col(0) = (Y*proj.col(k).array()).matrix();
+        kpm1.Exchange_Boundaries();
+        T value = ax.dot(kpm1.v.col(0));
+
+        py = Eigen::Matrix<T, Eigen::Dynamic, 1>::Zero(r.Sized);
+        for(int n = 0; n < NPadded; n += MEMORY){
+          for(int i = n; i < n + MEMORY; i++)
+            kpm1.cheb_iteration(i);
+          py.noalias() += kpm1.v*coefs.block(n, e0 + k, MEMORY, 1);
+        }
+        value -= ax.dot(py);
+        im(e0 + k) = double(std::imag(value));
+      }
+    }
+    return im;
+  };
+
+  Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> site_marker, region_marker;
+  site_marker   = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(NE, NSites);
+  region_marker = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(NE, NRegions);
+
+  for(int disorder = 0; disorder < NDisorder; disorder++){
+    h.generate_disorder();
+    h.generate_twists(); // Generates Random or fixed boundaries
+    kpm1.initiate_phases();
+
+    for(int s = 0; s < NSites; s++){
+      std::size_t pos = sites(s);
+      Eigen::Matrix<double, D, 1> center;
+      for(unsigned d = 0; d < D; d++){
+        center(d) = double(pos % r.Lt[d]);
+        pos /= r.Lt[d];
+      }
+      build_positions(center, r.rOrb.col(pos));
+
+      kpm0.build_site(sites(s));
+      kpm0.Exchange_Boundaries();
+      site_marker.col(s) += marker();
+    }
+
+    for(int g = 0; g < NRegions; g++){
+      Eigen::Matrix<double, D, 1> center;
+      for(unsigned d = 0; d < D; d++)
+        center(d) = regions(d, g) + 0.5*(regions(D + d, g) - 1);
+      build_positions(center, Eigen::Matrix<double, D, 1>::Zero());
+
+      for(int randV = 0; randV < NRandomV; randV++){
+        kpm0.v.setZero();
+        for(std::size_t s = 0; s < site_index.size(); s++){
+          bool inside = true;
+          for(unsigned d = 0; d < D; d++)
+            inside = inside && site_cell.at(s)(d) >= regions(d, g) && site_cell.at(s)(d) < regions(d, g) + regions(D + d, g);
+          if(inside)
+            kpm0.v(site_index.at(s), 0) = rnd.init();
+        }
+        for(unsigned i = 0; i < r.NStr; i++)
+          for(auto & vacancy : h.hV.position.at(i))
+            kpm0.v(vacancy, 0) = 0.;
+        kpm0.set_index(0);
+        kpm0.Exchange_Boundaries();
+        region_marker.col(g) += marker();
+      }
+    }
+  }
+
+  double unit_cell_area = fabs(r.rLat.determinant());
+  site_marker *= -4.0*M_PI/unit_cell_area/double(NDisorder);
+  for(int g = 0; g < NRegions; g++)
+    region_marker.col(g) *= -4.0*M_PI/unit_cell_area/double(NDisorder*NRandomV)/double(regions.col(g).bottomRows(D).prod());
+
+  // Sum of the contributions of all the domains
+#pragma omp master
+  {
+    Global.chern_marker = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(NE, NSites + NRegions);
+  }
+#pragma omp barrier
+#pragma omp critical
+  {
+    Global.chern_marker.leftCols(NSites) += site_marker;
+    Global.chern_marker.rightCols(NRegions) += region_marker;
+  }
+#pragma omp barrier
+
+#pragma omp master
+  {
+    auto * file = new H5::H5File(name, H5F_ACC_RDWR);
+    if(NSites > 0){
+      write_hdf5(Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>(Global.chern_marker.leftCols(NSites)), file, "/Calculation/chern_marker/Marker");
+      write_samples(file, "/Calculation/chern_marker/Marker", long(NDisorder));
+    }
+    if(NRegions > 0){
+      write_hdf5(Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>(Global.chern_marker.rightCols(NRegions)), file, "/Calculation/chern_marker/RegionMarker");
+      write_samples(file, "/Calculation/chern_marker/RegionMarker", long(NRandomV)*NDisorder);
+    }
+    file->close();
+    delete file;
+    debug_message("Left chern_marker");
+  }
+#pragma omp barrier
+}
+
+template void Simulation<float,1u>::calc_chern_marker();
+template void Simulation<double,1u>::calc_chern_marker();
+template void Simulation<long double,1u>::calc_chern_marker();
+template void Simulation<std::complex<float>,1u>::calc_chern_marker();
+template void Simulation<std::complex<double>,1u>::calc_chern_marker();
+template void Simulation<std::complex<long double>,1u>::calc_chern_marker();
+template void Simulation<float,2u>::calc_chern_marker();
+template void Simulation<double,2u>::calc_chern_marker();
+template void Simulation<long double,2u>::calc_chern_marker();
+template void Simulation<std::complex<float>,2u>::calc_chern_marker();
+template void Simulation<std::complex<double>,2u>::calc_chern_marker();
+template void Simulation<std::complex<long double>,2u>::calc_chern_marker();
+template void Simulation<float,3u>::calc_chern_marker();
+template void Simulation<double,3u>::calc_chern_marker();
+template void Simulation<long double,3u>::calc_chern_marker();
+template void Simulation<std::complex<float>,3u>::calc_chern_marker();
+template void Simulation<std::complex<double>,3u>::calc_chern_marker();
+template void Simulation<std::complex<long double>,3u>::calc_chern_marker();
+
+template void Simulation<float,1u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<double,1u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<long double,1u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<std::complex<float>,1u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<std::complex<double>,1u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<std::complex<long double>,1u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<float,2u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<double,2u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<long double,2u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<std::complex<float>,2u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<std::complex<double>,2u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<std::complex<long double>,2u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<float,3u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<double,3u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<long double,3u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<std::complex<float>,3u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<std::complex<double>,3u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
+template void Simulation<std::complex<long double>,3u>::chern_marker(Eigen::Array<double, -1, 1>, int, int, int, Eigen::Array<unsigned long, -1, 1>, Eigen::Array<int, -1, -1>);
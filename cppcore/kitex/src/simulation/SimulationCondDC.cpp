@@ -82,7 +82,12 @@ template <typename T,unsigned D>
 void Simulation<T,D>::CondDC(int NMoments, int NRandom, int NDisorder, int direction){
   std::string dir(num2str2(direction));
   std::string dirc = dir.substr(0,1)+","+dir.substr(1,2);
-  Gamma2D(NRandom, NDisorder, {NMoments,NMoments}, process_string(dirc), "/Calculation/conductivity_dc/Gamma"+dir);
+  // Orbital operators turn the currents into {O, v}/2, such as the spin current with O = sigma_z
+  if(!is_fused("/Calculation/conductivity_dc/Gamma"+dir)){
+    load_operators("/Calculation/conductivity_dc", 2);
+    Gamma2D(NRandom, NDisorder, {NMoments,NMoments}, process_string(dirc), "/Calculation/conductivity_dc/Gamma"+dir);
+    h.clear_operators();
+  }
 }
 
 
@@ -85,8 +85,10 @@ template <typename T,unsigned D>
 void Simulation<T,D>::CondOpt(int NMoments, int NRandom, int NDisorder, int direction){
   std::string dir(num2str2(direction));
   std::string dirc = dir.substr(0,1)+","+dir.substr(1,2);
-  Gamma1D(NRandom, NDisorder, NMoments, process_string(dir), "/Calculation/conductivity_optical/Lambda"+dir);
-  Gamma2D(NRandom, NDisorder, {NMoments,NMoments}, process_string(dirc), "/Calculation/conductivity_optical/Gamma"+dir);
+  if(!is_fused("/Calculation/conductivity_optical/Lambda"+dir))
+    Gamma1D(NRandom, NDisorder, NMoments, process_string(dir), "/Calculation/conductivity_optical/Lambda"+dir);
+  if(!is_fused("/Calculation/conductivity_optical/Gamma"+dir))
+    Gamma2D(NRandom, NDisorder, {NMoments,NMoments}, process_string(dirc), "/Calculation/conductivity_optical/Gamma"+dir);
 }
 
 
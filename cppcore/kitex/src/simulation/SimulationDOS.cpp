@@ -121,7 +121,12 @@ template <typename T,unsigned D>
 void Simulation<T,D>::DOS(int NMoments, int NRandom, int NDisorder){
   debug_message("Entered Simulation::DOS\n");
   std::vector<std::vector<unsigned>> indices = process_string("");
-  Gamma1D(NRandom, NDisorder, NMoments, indices, "/Calculation/dos/MU");
+  // An orbital operator O gives the projected density of states Tr[O delta(E - H)]
+  if(!is_fused("/Calculation/dos/MU")){
+    load_operators("/Calculation/dos", 1);
+    Gamma1D(NRandom, NDisorder, NMoments, indices, "/Calculation/dos/MU");
+    h.clear_operators();
+  }
   debug_message("Left Simulation::DOS\n");
 }
 
@@ -0,0 +1,116 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+
+
+#include "Generic.hpp"
+#include "tools/ComplexTraits.hpp"
+#include "tools/myHDF5.hpp"
+#include "simulation/Global.hpp"
+#include "tools/Random.hpp"
+#include "lattice/Coordinates.hpp"
+#include "lattice/LatticeStructure.hpp"
+template <typename T, unsigned D>
+class Hamiltonian;
+template <typename T, unsigned D>
+class KPM_Vector;
+#include "tools/queue.hpp"
+#include "simulation/Simulation.hpp"
+#include "hamiltonian/Hamiltonian.hpp"
+#include "vector/KPM_VectorBasis.hpp"
+#include "vector/KPM_Vector.hpp"
+
+template <typename T,unsigned D>
+void Simulation<T,D>::calc_fused(){
+    debug_message("Entered Simulation::calc_fused\n");
+    // Looks at the DOS, DC and optical conductivity requested in the configuration file and runs
+    // the Chebyshev sweeps they have in common only once. The datasets produced here are listed
+    // in fused, and the calc_* functions skip them. The outputs keep their usual format:
+    //  - The DC and optical conductivities along the same direction use the same Gamma matrix.
+    //    The larger one is calculated and the other one is its leading block.
+    //  - The DOS and the Lambda moments of the optical conductivity are obtained from one sweep
+    //    T_n|r>, with a left vector for each of them (see Gamma1DFused). With the same random
+    //    vectors, they are the same numbers as the ones of separate sweeps.
+    // Only calculations with the same NumRandoms and NumDisorder share their sweeps. The orbital
+    // operator of the DOS is the first slot of the shared sweep.
+
+#pragma omp barrier
+
+  // NumMoments, NumRandoms, NumDisorder, Direction of each calculation (NumMoments = 0 if absent)
+  int dos[4] = {0, 0, 0, 0}, dc[4] = {0, 0, 0, 0}, opt[4] = {0, 0, 0, 0};
+#pragma omp critical
+{
+    auto *file = new H5::H5File(name, H5F_ACC_RDONLY);
+    auto read = [&](std::string group, int *params, bool direction){
+      std::string fields[4] = {group + "/NumMoments", group + "/NumRandoms", group + "/NumDisorder", group + "/Direction"};
+      try{
+        H5::Exception::dontPrint();
+        for(int i = direction ? 3 : 2; i >= 0; i--)
+          get_hdf5<int>(params + i, file, fields[i]);
+      } catch(H5::Exception&) {params[0] = 0;}
+    };
+    read("/Calculation/dos", dos, false);
+    read("/Calculation/conductivity_dc", dc, true);
+    read("/Calculation/conductivity_optical", opt, true);
+    file->close();
+    delete file;
+}
+#pragma omp barrier
+
+  // The DC conductivity of other operators than the velocities has its own Gamma matrix
+  const bool dc_operators = dc[0] > 0 && load_operators("/Calculation/conductivity_dc", 2);
+  h.clear_operators();
+
+  if(dc[0] > 0 && opt[0] > 0 && !dc_operators && dc[1] == opt[1] && dc[2] == opt[2] && dc[3] == opt[3]){
+    std::string dir(num2str2(opt[3]));
+    std::string dirc = dir.substr(0,1)+","+dir.substr(1,2);
+    std::string name_dc  = "/Calculation/conductivity_dc/Gamma"+dir;
+    std::string name_opt = "/Calculation/conductivity_optical/Gamma"+dir;
+    const bool dc_larger = dc[0] >= opt[0];
+    const int NMoments = std::max(dc[0], opt[0]), NBlock = std::min(dc[0], opt[0]);
+#pragma omp master
+    std::cout << "Calculating the Gamma matrix shared by the DC and optical conductivities.\n";
+
+    Gamma2D(opt[1], opt[2], {NMoments, NMoments}, process_string(dirc), dc_larger ? name_dc : name_opt);
+#pragma omp master
+    {
+      // Global.general_gamma still holds the matrix that has just been stored
+      Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> block = Global.general_gamma.topLeftCorner(NBlock, NBlock);
+      H5::H5File * file = new H5::H5File(name, H5F_ACC_RDWR);
+      write_hdf5(block, file, dc_larger ? name_opt : name_dc);
+      write_samples(file, dc_larger ? name_opt : name_dc, long(opt[1])*opt[2]);
+      delete file;
+    }
+#pragma omp barrier
+    fused.push_back(name_dc);
+    fused.push_back(name_opt);
+  }
+
+  if(dos[0] > 0 && opt[0] > 0 && dos[1] == opt[1] && dos[2] == opt[2]){
+    std::string dir(num2str2(opt[3]));
+    std::string name_dos = "/Calculation/dos/MU";
+    std::string name_lambda = "/Calculation/conductivity_optical/Lambda"+dir;
+#pragma omp master
+    std::cout << "Calculating the DOS and the optical conductivity Lambda in one sweep.\n";
+
+    load_operators("/Calculation/dos", 1);
+    Gamma1DFused(opt[1], opt[2], {dos[0], opt[0]}, {{}, process_string(dir).at(0)}, {name_dos, name_lambda});
+    h.clear_operators();
+    fused.push_back(name_dos);
+    fused.push_back(name_lambda);
+  }
+  debug_message("Left Simulation::calc_fused\n");
+}
+
+template <typename T,unsigned D>
+bool Simulation<T,D>::is_fused(const std::string & name_dataset){
+  return std::find(fused.begin(), fused.end(), name_dataset) != fused.end();
+}
+
+#define instantiate(type, dim)  template void Simulation<type,dim>::calc_fused(); \
+  template bool Simulation<type,dim>::is_fused(const std::string &);
+#include "tools/instantiate.hpp"
@@ -81,7 +81,7 @@ void Simulation<T,D>::Gaussian_Wave_Packet(){
   T one  = CT.assign_value(double(1),  double(0));
   std::vector<double> times;
   
-  Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic> avg_x, avg_y, avg_z, avg_ident;
+  Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic> avg_x, avg_y, avg_z, avg_ident, avg_current;
   Eigen::Matrix<T, 2, 2> ident, spin_x, spin_y, spin_z;
 
   Eigen::Map<Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic>> vket (sum_ket.v.data(), r.Sized/2, 2);
@@ -98,6 +98,14 @@ void Simulation<T,D>::Gaussian_Wave_Packet(){
   Eigen::Matrix <double ,1, 2> vb;
   Eigen::Matrix <T,Eigen::Dynamic, Eigen::Dynamic>        spinor;
 
+  // Drive H(t) = H_0 + f(t) V, with f sampled at the two Gauss points of each sub-step and at the time points
+  int NumSubsteps = 1;
+  bool driven = false;
+  Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> drive;
+  Eigen::Array<double, Eigen::Dynamic, 1> drive_points;
+  Eigen::Matrix<double, D, 1> vector_potential = Eigen::Matrix<double, D, 1>::Zero();
+  Eigen::Array<double, Eigen::Dynamic, 1> onsite_drive = Eigen::Array<double, Eigen::Dynamic, 1>::Zero(r.Orb);
+
   ident <<  one, zero,
     zero, one;
   
@@ -132,6 +140,18 @@ void Simulation<T,D>::Gaussian_Wave_Packet(){
     get_hdf5     <double>(vb.data(),   file, (char *) "/Calculation/gaussian_wave_packet/mean_value");
     get_hdf5 <double>(k_vector.data(), file, (char *) "/Calculation/gaussian_wave_packet/k_vector");
 
+    try{
+      H5::Exception::dontPrint();
+      get_hdf5<int>(&NumSubsteps, file, (char *) "/Calculation/gaussian_wave_packet/NumSubsteps");
+      drive = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(2, std::max(NumPoints - 1, 0)*NumSubsteps);
+      get_hdf5<double>(drive.data(), file, (char *) "/Calculation/gaussian_wave_packet/Drive");
+      drive_points = Eigen::Array<double, Eigen::Dynamic, 1>::Zero(NumPoints);
+      get_hdf5<double>(drive_points.data(), file, (char *) "/Calculation/gaussian_wave_packet/DrivePoints");
+      get_hdf5<double>(vector_potential.data(), file, (char *) "/Calculation/gaussian_wave_packet/VectorPotential");
+      get_hdf5<double>(onsite_drive.data(), file, (char *) "/Calculation/gaussian_wave_packet/OnsiteDrive");
+      driven = true;
+    } catch(H5::Exception&) {}
+
     file->close();  delete file;
   }
 #pragma omp barrier
@@ -140,6 +160,14 @@ void Simulation<T,D>::Gaussian_Wave_Packet(){
   avg_z       = Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic>::Zero(NumPoints,1);
   avg_ident   = Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic>::Zero(NumPoints,1);
   avg_results = Eigen::Array<T, Eigen::Dynamic,Eigen::Dynamic>::Zero(2*D, NumPoints);
+  avg_current = Eigen::Array<T, Eigen::Dynamic,Eigen::Dynamic>::Zero(D, NumPoints);
+
+  if(driven && !is_tt<std::complex, T>::value && vector_potential.norm() > 0)
+    {
+#pragma omp master
+      std::cout << "A vector potential requires a complex Hamiltonian. Exiting.\n";
+      exit(1);
+    }
     
 #pragma omp master
   {
@@ -148,41 +176,124 @@ void Simulation<T,D>::Gaussian_Wave_Packet(){
     Global.avg_z       = Eigen::Matrix<T,Eigen::Dynamic,1>::Zero(NumPoints,1);
     Global.avg_ident   = Eigen::Matrix<T,Eigen::Dynamic,1>::Zero(NumPoints,1);
     Global.avg_results = Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic>::Zero(2*D,NumPoints);
+    Global.avg_current = Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic>::Zero(D,NumPoints);
   }
     
     
+  // The velocity along each direction is kept in the slot of the same number, for the current
+  std::vector<std::vector<unsigned>> indices(D);
+  for(unsigned d = 0; d < D; d++)
+    {
+      indices.at(d) = {d};
+      h.build_velocity(indices.at(d), d);
+    }
+
+  // Chebyshev coefficients of exp(-i tau H): of a whole time step, or of each of the two exponentials of a
+  // sub-step of the driven propagation
   NumMoments = (NumMoments/2)*2;
-  Eigen::Matrix<T,Eigen::Dynamic,1> m(NumMoments);
-  for(unsigned n = 0; n < unsigned(NumMoments); n++)
-    #if USE_BOOST
-    m(n) = value_type((n == 0 ? 1 : 2 )*boost::math::cyl_bessel_j(n, timestep )) * T(pow(-II,n));
-    #else
-    m(n) = value_type((n == 0 ? 1 : 2 )*std::cyl_bessel_j(n, timestep )) * T(pow(-II,n));
-    #endif
+  auto bessel = [&](double tau){
+    Eigen::Matrix<T,Eigen::Dynamic,1> m(NumMoments);
+    for(unsigned n = 0; n < unsigned(NumMoments); n++)
+      #if USE_BOOST
+      m(n) = value_type((n == 0 ? 1 : 2 )*boost::math::cyl_bessel_j(n, tau )) * T(pow(-II,n));
+      #else
+      m(n) = value_type((n == 0 ? 1 : 2 )*std::cyl_bessel_j(n, tau )) * T(pow(-II,n));
+      #endif
+    return m;
+  };
+  Eigen::Matrix<T,Eigen::Dynamic,1> m = bessel(timestep), m_half = bessel(0.5*timestep/NumSubsteps);
+
+  // sum_ket -> exp(-i tau H) sum_ket
+  auto evolve = [&](const Eigen::Matrix<T,Eigen::Dynamic,1> & coefs){
+    phi.v.setZero();
+    phi.set_index(0);
+    phi.v.col(0) = sum_ket.v.col(0);
+    phi.Exchange_Boundaries();
+    phi.cheb_iteration(1); // multiply by H
+    sum_ket.v.col(0) = phi.v * coefs.segment(0, 2);
+    for(unsigned n = 2; n < unsigned(NumMoments); n += 2)
+      {
+        phi.cheb_iteration(n);
+        phi.cheb_iteration(n + 1);
+        sum_ket.v.col(0) += phi.v * coefs.segment(n,2);
+      }
+  };
+
+  /*
+    Driven propagation with the fourth order commutator-free exponential integrator
+      U(t + dt, t) = exp(-i dt (a1 H1 + a2 H2)) exp(-i dt (a2 H1 + a1 H2)),
+    with H1 and H2 at the Gauss points of the sub-step and a1,2 = (3 -+ 2 sqrt(3))/12. As a1 + a2 = 1/2, each
+    factor is exp(-i dt/2 H_eff) with H_eff = w1 H1 + w2 H2, w1 + w2 = 1, expanded with the Bessel coefficients
+    of the static propagation. H_eff is set in place, without rebuilding the lattice: the vector potential
+    f(t) A multiplies each periodic hopping by exp(-i f(t) A.(r_j - r_i)), which is the minimal coupling
+    k -> k - A for a unit charge, and the on-site drive f(t) U_o is added to the local energy of each orbital.
+    The hoppings of the structural defects are not driven.
+  */
+  const double a1 = (3.0 - 2.0*sqrt(3.0))/12.0, a2 = (3.0 + 2.0*sqrt(3.0))/12.0;
+  Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> hopping0 = h.hr.hopping;
+  std::vector<value_type> U_Orbital0 = h.U_Orbital;
+  std::vector<int> address0 = h.Anderson_orb_address;
+  std::vector<double> onsite_applied(r.Orb, 0.0);   // shift of the Anderson energies of each orbital
+
+  auto set_drive = [&](double w1, double w2, double f1, double f2){
+    for(unsigned io = 0; io < r.Orb; io++)
+      {
+        for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+          {
+            double Ad = 0;
+            for(unsigned d = 0; d < D; d++)
+              Ad += vector_potential(d)*double(std::real(h.hr.v.at(d)(ib, io)));
+            h.hr.hopping(ib, io) = hopping0(ib, io)*(value_type(w1)*CT.multEiphase(-f1*Ad) + value_type(w2)*CT.multEiphase(-f2*Ad));
+          }
+        if(onsite_drive(io) == 0)
+          continue;
+        double U = (w1*f1 + w2*f2)*onsite_drive(io);
+        if(address0.at(io) < 0)
+          {
+            h.Anderson_orb_address.at(io) = -1;
+            h.U_Orbital.at(io) = U_Orbital0.at(io) + value_type(U);
+          }
+        else
+          {
+            for(std::size_t i = 0; i < r.Nd; i++)
+              h.U_Anderson.at(address0.at(io)*r.Nd + i) += value_type(U - onsite_applied.at(io));
+            onsite_applied.at(io) = U;
+          }
+      }
+  };
+
+  auto restore_drive = [&](){
+    for(unsigned io = 0; io < r.Orb; io++)
+      if(address0.at(io) >= 0 && onsite_applied.at(io) != 0)
+        for(std::size_t i = 0; i < r.Nd; i++)
+          h.U_Anderson.at(address0.at(io)*r.Nd + i) -= value_type(onsite_applied.at(io));
+    std::fill(onsite_applied.begin(), onsite_applied.end(), 0.0);
+    h.hr.hopping = hopping0;
+    h.U_Orbital = U_Orbital0;
+    h.Anderson_orb_address = address0;
+  };
+
   for(int id = 0; id < NumDisorder; id++)
     {
       sum_ket.set_index(0);
       sum_ket.v.setZero();
       sum_ket.build_wave_packet(k_vector, spinor, width, vb);
       h.generate_disorder();	
+      std::fill(onsite_applied.begin(), onsite_applied.end(), 0.0);
       sum_ket.empty_ghosts(0);
       for(unsigned t = 0; t < unsigned(NumPoints); t++)
         {
-          if(t > 0)
-            {
-              phi.v.setZero();
-              phi.set_index(0);
-              phi.v.col(0) = sum_ket.v.col(0);
-              phi.Exchange_Boundaries();
-              phi.cheb_iteration(1); // multiply by H
-              sum_ket.v.col(0) = phi.v * m.segment(0, 2);
-              for(unsigned n = 2; n < unsigned(NumMoments); n += 2)
-                {
-                  phi.cheb_iteration(n);
-                  phi.cheb_iteration(n + 1);
-                  sum_ket.v.col(0) += phi.v * m.segment(n,2);
-                }
-            }
+          if(t > 0 && !driven)
+            evolve(m);
+          if(t > 0 && driven)
+            for(int s = 0; s < NumSubsteps; s++)
+              {
+                const std::size_t k = (t - 1)*NumSubsteps + s;
+                set_drive(2*a2, 2*a1, drive(0, k), drive(1, k));
+                evolve(m_half);
+                set_drive(2*a1, 2*a2, drive(0, k), drive(1, k));
+                evolve(m_half);
+              }
           sum_ket.empty_ghosts(0);
           
           // In the multiplication of a matrix the number of columns of the first should be equal to
@@ -207,7 +318,21 @@ void Simulation<T,D>::Gaussian_Wave_Packet(){
           avg_z(t) += (x2(0,0) - avg_z(t) ) /T(id + 1);
           phi.measure_wave_packet(sum_ket.v.data(), sum_ket.v.data(), results.data());
           avg_results.col(t) += (results - avg_results.col(t) ) /T(id + 1); 
+
+          // Current i<psi|[H, x]|psi>, with the vector potential of this time
+          if(driven)
+            set_drive(1.0, 0.0, drive_points(t), 0.0);
+          for(unsigned d = 0; d < D; d++)
+            {
+              sum_ket.Exchange_Boundaries();
+              phi.set_index(0);
+              sum_ket.Velocity(&phi, indices, int(d));
+              sum_ket.empty_ghosts(0);
+              T current = II*(sum_ket.v.adjoint() * phi.v.col(0))(0,0);
+              avg_current(d, t) += (current - avg_current(d, t))/T(id + 1);
+            }
         }
+      restore_drive();
 	
     }
 
@@ -218,6 +343,7 @@ void Simulation<T,D>::Gaussian_Wave_Packet(){
     Global.avg_z += avg_z;
     Global.avg_ident += avg_ident;
     Global.avg_results += avg_results;
+    Global.avg_current += avg_current;
   }
 #pragma omp barrier
 
@@ -251,6 +377,15 @@ void Simulation<T,D>::Gaussian_Wave_Packet(){
 			  
         write_hdf5(avg_z, file, name);
       }
+
+    for(unsigned i = 0; i < D; i++)
+      {
+        std::string orient = "xyz";
+        char name[200];
+        avg_z.col(0) = Global.avg_current.row(i);
+        sprintf(name,"/Calculation/gaussian_wave_packet/Current%c", orient.at(i));
+        write_hdf5(avg_z, file, name);
+      }
       
     file->close();      
     delete file;
@@ -0,0 +1,471 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+
+#include "Generic.hpp"
+#include "tools/ComplexTraits.hpp"
+#include "tools/myHDF5.hpp"
+#include "simulation/Global.hpp"
+#include "tools/Random.hpp"
+#include "lattice/Coordinates.hpp"
+#include "lattice/LatticeStructure.hpp"
+template <typename T, unsigned D>
+class Hamiltonian;
+template <typename T, unsigned D>
+class KPM_Vector;
+#include "tools/queue.hpp"
+#include "simulation/Simulation.hpp"
+#include "hamiltonian/Hamiltonian.hpp"
+#include "vector/KPM_VectorBasis.hpp"
+#include "vector/KPM_Vector.hpp"
+#include <array>
+#include <deque>
+
+template <typename T, unsigned D>
+void Simulation<T,D>::calc_hartree() {
+  int NMoments, NRandom = 0, Probing = 0, NIterations, History;
+  double fermi_energy, temperature, tolerance, mixing, energy_scale;
+  Eigen::Array<double, Eigen::Dynamic, 1> reference, initial, kernel_values;
+  Eigen::Array<int, Eigen::Dynamic, Eigen::Dynamic> kernel_sites;
+
+    // Make sure that all the threads are ready before opening any files
+    // Some threads could still be inside the Simulation constructor
+    // This barrier is essential
+#pragma omp barrier
+  int calculate_hartree_local = false;
+#pragma omp master
+{
+  auto * file1 = new H5::H5File(name, H5F_ACC_RDONLY);
+  Global.calculate_hartree = false;
+  try{
+    debug_message("hartree: checking if we need to calculate it.\n");
+    get_hdf5<int>(&NMoments, file1, (char *)   "/Calculation/hartree/NumMoments");
+    Global.calculate_hartree = true;
+
+  } catch(H5::Exception&) {debug_message("hartree: no need to calculate it.\n");}
+  file1->close();
+  delete file1;
+
+}
+#pragma omp barrier
+#pragma omp critical
+  calculate_hartree_local = Global.calculate_hartree;
+#pragma omp barrier
+
+
+  if(calculate_hartree_local){
+#pragma omp master
+      {
+        std::cout << "Calculating the self-consistent Hartree potential.\n";
+      }
+#pragma omp barrier
+#pragma omp critical
+{
+    auto * file = new H5::H5File(name, H5F_ACC_RDONLY);
+    H5::Exception::dontPrint();
+    get_hdf5<double>(&energy_scale, file, (char *) "/EnergyScale");
+    get_hdf5<int>(&NMoments, file, (char *)   "/Calculation/hartree/NumMoments");
+    get_hdf5<int>(&NRandom, file, (char *)   "/Calculation/hartree/NumRandoms");
+    get_hdf5<int>(&Probing, file, (char *)   "/Calculation/hartree/ProbingDistance");
+    get_hdf5<int>(&NIterations, file, (char *)   "/Calculation/hartree/MaxIterations");
+    get_hdf5<int>(&History, file, (char *)   "/Calculation/hartree/History");
+    get_hdf5<double>(&fermi_energy, file, (char *)   "/Calculation/hartree/FermiEnergy");
+    get_hdf5<double>(&temperature, file, (char *)   "/Calculation/hartree/Temperature");
+    get_hdf5<double>(&tolerance, file, (char *)   "/Calculation/hartree/Tolerance");
+    get_hdf5<double>(&mixing, file, (char *)   "/Calculation/hartree/Mixing");
+
+    // Interaction kernel: orbital of the site, orbital of the source, distance between their unit cells and value
+    hsize_t dims_out[2];
+    auto * dataset     	= new H5::DataSet(file->openDataSet("/Calculation/hartree/KernelValues"));
+    auto * dataspace 	= new H5::DataSpace(dataset->getSpace());
+    dataspace->getSimpleExtentDims(dims_out, nullptr);
+    delete dataspace;
+    delete dataset;
+    kernel_values = Eigen::Array<double, -1, 1>::Zero(dims_out[0]);
+    kernel_sites  = Eigen::Array<int, -1, -1>::Zero(D + 2, dims_out[0]);
+    get_hdf5<double>(kernel_values.data(), file, (char *) "/Calculation/hartree/KernelValues");
+    get_hdf5<int>(kernel_sites.data(), file, (char *) "/Calculation/hartree/KernelSites");
+
+    // Density of each orbital that does not create a potential. Without it, the average density of the
+    // first iteration is used
+    try{
+      reference = Eigen::Array<double, -1, 1>::Zero(r.Orb);
+      get_hdf5<double>(reference.data(), file, (char *) "/Calculation/hartree/Reference");
+    } catch(H5::Exception&) {reference.resize(0);}
+
+    // Potential of a previous run, in the layout of the output
+    try{
+      initial = Eigen::Array<double, -1, 1>::Zero(r.Nt*r.Orb);
+      get_hdf5<double>(initial.data(), file, (char *) "/Calculation/hartree/InitialPotential");
+      initial /= energy_scale;
+    } catch(H5::Exception&) {initial.resize(0);}
+
+    file->close();
+  delete file;
+}
+#pragma omp barrier
+
+    if(NRandom <= 0 && Probing <= 0){
+#pragma omp master
+      std::cout << "The Hartree potential needs either random vectors or a probing distance. Exiting.\n";
+      exit(1);
+    }
+
+    hartree(fermi_energy, temperature, NMoments, NRandom, Probing, NIterations, tolerance, mixing, History,
+            reference, initial, kernel_sites, kernel_values, energy_scale);
+  }
+}
+
+template <typename T, unsigned D>
+void Simulation<T,D>::hartree(double fermi_energy, double temperature, int NMoments, int NRandomV, int Probing,
+  int NIterations, double tolerance, double mixing, int History, Eigen::Array<double, Eigen::Dynamic, 1> reference,
+  Eigen::Array<double, Eigen::Dynamic, 1> initial, Eigen::Array<int, Eigen::Dynamic, Eigen::Dynamic> kernel_sites,
+  Eigen::Array<double, Eigen::Dynamic, 1> kernel_values, double energy_scale){
+  // Self-consistent Hartree potential
+  //
+  //   V_i = sum_j K_ij (n_j - n0_j),   n_j = <j| f(H + V) |j>
+  //
+  // where f is the Fermi function and n0 the reference density of each orbital. The local densities of all the
+  // sites are estimated at once from the Chebyshev expansion of f, applied either to random vectors,
+  //
+  //   n_j = E[ conj(xi_j) (f xi)_j ],
+  //
+  // or to probing vectors, which are one on the sites of an orbital whose unit cells have the same coordinates
+  // modulo the probing distance. Probing is exact when the elements of f(H) between such sites vanish, which is
+  // a good approximation in insulators and at finite temperature. The random vectors are the same at every
+  // iteration, so that the map V -> K (n[V] - n0) is deterministic and its fixed point is well defined.
+  //
+  // The fixed point is found with Anderson mixing of the potential. With the residuals F = K (n[V] - n0) - V
+  // and the differences dV, dF between consecutive iterations of the last History iterations,
+  //
+  //   V' = V + mixing F - sum_k g_k (dV_k + mixing dF_k),   g = argmin |F - sum_k g_k dF_k|,
+  //
+  // which reduces to linear mixing for History = 0. The converged potential is added to the local energies of
+  // the Hamiltonian, so the calculations that follow use it. With Anderson disorder, it is converged for the
+  // current realization and shared by all the realizations of the later calculations.
+
+  debug_message("Entered hartree\n");
+  int NPadded = (NMoments + MEMORY - 1)/MEMORY*MEMORY;
+  std::size_t NGlobal = r.Nt*r.Orb;
+
+  // Chebyshev coefficients of the Fermi function with the Jackson kernel. They are projected numerically
+  // at finite temperature. The rows beyond NMoments are zero
+  Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> coefs;
+  coefs = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(NPadded, 1);
+  double phi = std::acos(std::max(-1.0, std::min(1.0, fermi_energy)));
+  int NQuadrature = 4*NMoments;
+  for(int n = 0; n < NMoments; n++){
+    double arg = M_PI/(NMoments + 1.0);
+    double kernel = ((NMoments - n + 1)*cos(n*arg) + sin(n*arg)/tan(arg))/(NMoments + 1.0);
+    double fermi = (n == 0) ? (M_PI - phi)/M_PI : -2.0*sin(n*phi)/(n*M_PI);
+    if(temperature > 0){
+      fermi = 0;
+      for(int k = 0; k < NQuadrature; k++){
+        double theta = M_PI*(k + 0.5)/NQuadrature;
+        fermi += cos(n*theta)/(1.0 + exp((cos(theta) - fermi_energy)/temperature));
+      }
+      fermi *= (n == 0 ? 1.0 : 2.0)/NQuadrature;
+    }
+    coefs(n, 0) = T(static_cast<value_type>(kernel*fermi));
+  }
+
+  // Sites of this domain, without the ghosts and the vacancies
+  std::vector<bool> vacancy(r.Sized, false);
+  for(unsigned i = 0; i < r.NStr; i++)
+    for(auto & v : h.hV.position.at(i))
+      vacancy.at(v) = true;
+
+  std::vector<std::size_t> site_index, site_global;
+  std::vector<unsigned> site_orbital;
+  std::vector<std::array<std::size_t, D>> site_cell;
+  Coordinates<std::size_t, D + 1> x(r.Ld), z(r.Lt);
+  for(std::size_t i = 0; i < r.Sized; i++){
+    x.set_coord(i);
+    bool real_site = !vacancy.at(i);
+    for(unsigned d = 0; d < D; d++)
+      real_site = real_site && x.coord[d] >= NGHOSTS && x.coord[d] < NGHOSTS + r.lr[d];
+    if(!real_site)
+      continue;
+    r.convertCoordinates(z, x);
+    std::array<std::size_t, D> cell;
+    for(unsigned d = 0; d < D; d++)
+      cell[d] = z.coord[d];
+    site_index.push_back(i);
+    site_global.push_back(z.index);
+    site_orbital.push_back(unsigned(z.coord[D]));
+    site_cell.push_back(cell);
+  }
+  std::size_t NSites = site_index.size();
+
+  // Sources of the potential of each site, as global indices. Open boundaries cut the kernel
+  std::vector<std::size_t> source_start(NSites + 1, 0), source_index;
+  std::vector<double> source_value;
+  for(std::size_t s = 0; s < NSites; s++){
+    for(long k = 0; k < kernel_values.rows(); k++){
+      if(kernel_sites(0, k) != int(site_orbital.at(s)))
+        continue;
+      std::size_t index = std::size_t(kernel_sites(1, k))*r.Nt, stride = 1;
+      bool inside = true;
+      for(unsigned d = 0; d < D; d++){
+        long c = long(site_cell.at(s)[d]) + kernel_sites(2 + d, k);
+        if(r.Bd[d] == 0 && (c < 0 || c >= long(r.Lt[d])))
+          inside = false;
+        c = ((c % long(r.Lt[d])) + long(r.Lt[d])) % long(r.Lt[d]);
+        index += std::size_t(c)*stride;
+        stride *= r.Lt[d];
+      }
+      if(inside){
+        source_index.push_back(index);
+        source_value.push_back(kernel_values(k));
+      }
+    }
+    source_start.at(s + 1) = source_index.size();
+  }
+
+  // External local energy, to which the Hartree potential is added
+  Eigen::Array<T, Eigen::Dynamic, 1> external;
+  external = Eigen::Array<T, Eigen::Dynamic, 1>::Zero(r.Sized);
+  if(h.is_custom_local_set)
+    external = h.custom_local.col(0);
+  h.custom_local = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(r.Sized, 1);
+  h.is_custom_local_set = true;
+  h.is_chiral = false;
+
+  auto set_potential = [&](const Eigen::Array<double, Eigen::Dynamic, 1> & V){
+    h.custom_local.col(0) = external;
+    for(std::size_t s = 0; s < NSites; s++)
+      h.custom_local(site_index.at(s), 0) += T(static_cast<value_type>(V(s)));
+  };
+
+  // Sum or maximum over the domains
+  auto reduce = [&](const Eigen::Array<double, Eigen::Dynamic, 1> & local, bool maximum){
+    Eigen::Array<double, Eigen::Dynamic, 1> total;
+#pragma omp master
+    Global.hartree_sums = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(local.rows(), 1);
+#pragma omp barrier
+#pragma omp critical
+    {
+      if(maximum)
+        Global.hartree_sums.col(0) = Global.hartree_sums.col(0).max(local);
+      else
+        Global.hartree_sums.col(0) += local;
+    }
+#pragma omp barrier
+    total = Global.hartree_sums.col(0);
+#pragma omp barrier
+    return total;
+  };
+
+  KPM_Vector<T,D> kpm0(1, *this);       // starting vector
+  KPM_Vector<T,D> kpm1(MEMORY, *this);  // Chebyshev recursions
+  Eigen::Matrix<T, Eigen::Dynamic, 1> fermi_vector;
+
+  h.generate_disorder();
+  h.generate_twists(); // Generates Random or fixed boundaries
+  kpm1.initiate_phases();
+
+  // f(H) applied to the vector in kpm0
+  auto apply_fermi = [&](){
+    kpm0.set_index(0);
+    kpm0.Exchange_Boundaries();
+    fermi_vector = Eigen::Matrix<T, Eigen::Dynamic, 1>::Zero(r.Sized);
+    kpm1.set_index(0);
+    kpm1.v.col(0) = kpm0.v.col(0);
+    for(int n = 0; n < NPadded; n += MEMORY){
+      for(int i = n; i < n + MEMORY; i++)
+        kpm1.cheb_iteration(i);
+      fermi_vector.noalias() += kpm1.v*coefs.block(n, 0, MEMORY, 1);
+    }
+  };
+
+  // Local densities of this domain. The random vectors are replayed at every iteration
+  auto random_state = rnd;
+  auto density = [&](){
+    Eigen::Array<double, Eigen::Dynamic, 1> n = Eigen::Array<double, Eigen::Dynamic, 1>::Zero(NSites);
+    if(NRandomV > 0){
+      rnd = random_state;
+      for(int randV = 0; randV < NRandomV; randV++){
+        kpm0.v.setZero();
+        for(std::size_t s = 0; s < NSites; s++)
+          kpm0.v(site_index.at(s), 0) = rnd.init();
+        apply_fermi();
+        for(std::size_t s = 0; s < NSites; s++)
+          n(s) += double(std::real(myconj(kpm0.v(site_index.at(s), 0))*fermi_vector(site_index.at(s))));
+      }
+      n /= double(NRandomV);
+    } else {
+      std::size_t NColors = 1;
+      for(unsigned d = 0; d < D; d++)
+        NColors *= std::size_t(Probing);
+      for(std::size_t color = 0; color < NColors*r.Orb; color++){
+        std::vector<bool> member(NSites, false);
+        for(std::size_t s = 0; s < NSites; s++){
+          std::size_t c = color;
+          bool same = site_orbital.at(s) == c/NColors;
+          c %= NColors;
+          for(unsigned d = 0; d < D; d++){
+            same = same && site_cell.at(s)[d] % std::size_t(Probing) == c % std::size_t(Probing);
+            c /= std::size_t(Probing);
+          }
+          member.at(s) = same;
+        }
+        kpm0.v.setZero();
+        for(std::size_t s = 0; s < NSites; s++)
+          if(member.at(s))
+            kpm0.v(site_index.at(s), 0) = T(1);
+        apply_fermi();
+        for(std::size_t s = 0; s < NSites; s++)
+          if(member.at(s))
+            n(s) = double(std::real(fermi_vector(site_index.at(s))));
+      }
+    }
+    return n;
+  };
+
+  // Potential generated by the densities of all the domains, which are gathered with a flag for the real sites
+  bool reference_set = reference.rows() == long(r.Orb);
+  auto potential = [&](const Eigen::Array<double, Eigen::Dynamic, 1> & n){
+#pragma omp master
+    Global.hartree = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(NGlobal, 2);
+#pragma omp barrier
+#pragma omp critical
+    for(std::size_t s = 0; s < NSites; s++){
+      Global.hartree(site_global.at(s), 0) = n(s);
+      Global.hartree(site_global.at(s), 1) = 1.;
+    }
+#pragma omp barrier
+    if(!reference_set){
+      reference = Eigen::Array<double, Eigen::Dynamic, 1>::Zero(r.Orb);
+      for(unsigned o = 0; o < r.Orb; o++)
+        reference(o) = Global.hartree.col(0).segment(o*r.Nt, r.Nt).sum()/
+          std::max(1.0, Global.hartree.col(1).segment(o*r.Nt, r.Nt).sum());
+      reference_set = true;
+    }
+    Eigen::Array<double, Eigen::Dynamic, 1> V = Eigen::Array<double, Eigen::Dynamic, 1>::Zero(NSites);
+    for(std::size_t s = 0; s < NSites; s++)
+      for(std::size_t k = source_start.at(s); k < source_start.at(s + 1); k++){
+        std::size_t j = source_index.at(k);
+        V(s) += source_value.at(k)*Global.hartree(j, 1)*(Global.hartree(j, 0) - reference(j/r.Nt));
+      }
+#pragma omp barrier
+    return V;
+  };
+
+  // Anderson mixing
+  Eigen::Array<double, Eigen::Dynamic, 1> V = Eigen::Array<double, Eigen::Dynamic, 1>::Zero(NSites), n, F;
+  if(initial.rows() == long(NGlobal))
+    for(std::size_t s = 0; s < NSites; s++)
+      V(s) = initial(site_global.at(s));
+  std::deque<Eigen::Array<double, Eigen::Dynamic, 1>> dV, dF;
+  Eigen::Array<double, Eigen::Dynamic, 1> V_old, F_old;
+  std::vector<double> residuals;
+  bool converged = false;
+
+  for(int iteration = 0; iteration < NIterations && !converged; iteration++){
+    set_potential(V);
+    n = density();
+    F = potential(n) - V;
+
+    Eigen::Array<double, Eigen::Dynamic, 1> local_max(1);
+    local_max(0) = NSites > 0 ? F.abs().maxCoeff() : 0.;
+    double residual = reduce(local_max, true)(0);
+    residuals.push_back(residual*energy_scale);
+#pragma omp master
+    std::cout << "Hartree iteration " << iteration << ": maximum change of the potential "
+              << residual*energy_scale << "\n";
+    if(residual < tolerance){
+      converged = true;
+      break;
+    }
+
+    if(iteration > 0 && History > 0){
+      dV.push_back(V - V_old);
+      dF.push_back(F - F_old);
+      if(int(dV.size()) > History){
+        dV.pop_front();
+        dF.pop_front();
+      }
+    }
+    V_old = V;
+    F_old = F;
+
+    int NHistory = int(dF.size());
+    Eigen::Array<double, Eigen::Dynamic, 1> products = Eigen::Array<double, Eigen::Dynamic, 1>::Zero(NHistory*(NHistory + 1));
+    for(int a = 0; a < NHistory; a++){
+      products(NHistory*NHistory + a) = (dF.at(a)*F).sum();
+      for(int b = 0; b < NHistory; b++)
+        products(a*NHistory + b) = (dF.at(a)*dF.at(b)).sum();
+    }
+    products = reduce(products, false);
+
+    V += mixing*F;
+    if(NHistory > 0){
+      Eigen::MatrixXd A = Eigen::Map<Eigen::MatrixXd>(products.data(), NHistory, NHistory);
+      Eigen::VectorXd b = products.tail(NHistory).matrix();
+      Eigen::VectorXd g = A.completeOrthogonalDecomposition().solve(b);
+      for(int a = 0; a < NHistory; a++)
+        V -= g(a)*(dV.at(a) + mixing*dF.at(a));
+    }
+  }
+  set_potential(V);
+
+#pragma omp master
+  {
+    if(converged)
+      std::cout << "The Hartree potential converged after " << residuals.size() << " iterations.\n";
+    else
+      std::cout << "The Hartree potential did not converge after " << NIterations << " iterations.\n";
+  }
+
+  // Potential in eV and densities of the last iteration, with the index of the unit cell running fastest
+#pragma omp master
+  Global.hartree = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(NGlobal, 2);
+#pragma omp barrier
+#pragma omp critical
+  for(std::size_t s = 0; s < NSites; s++){
+    Global.hartree(site_global.at(s), 0) = V(s)*energy_scale;
+    Global.hartree(site_global.at(s), 1) = n(s);
+  }
+#pragma omp barrier
+
+#pragma omp master
+  {
+    auto * file = new H5::H5File(name, H5F_ACC_RDWR);
+    Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> output;
+    output = Global.hartree.col(0);
+    output.resize(r.Nt, r.Orb);
+    write_hdf5(output, file, "/Calculation/hartree/Potential");
+    output = Global.hartree.col(1);
+    output.resize(r.Nt, r.Orb);
+    write_hdf5(output, file, "/Calculation/hartree/Density");
+    Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> history = Eigen::Map<Eigen::Array<double, -1, -1>>(residuals.data(), residuals.size(), 1);
+    write_hdf5(history, file, "/Calculation/hartree/Residuals");
+    file->close();
+    delete file;
+    debug_message("Left hartree");
+  }
+#pragma omp barrier
+}
+
+template void Simulation<float,1u>::calc_hartree();
+template void Simulation<double,1u>::calc_hartree();
+template void Simulation<long double,1u>::calc_hartree();
+template void Simulation<std::complex<float>,1u>::calc_hartree();
+template void Simulation<std::complex<double>,1u>::calc_hartree();
+template void Simulation<std::complex<long double>,1u>::calc_hartree();
+template void Simulation<float,2u>::calc_hartree();
+template void Simulation<double,2u>::calc_hartree();
+template void Simulation<long double,2u>::calc_hartree();
+template void Simulation<std::complex<float>,2u>::calc_hartree();
+template void Simulation<std::complex<double>,2u>::calc_hartree();
+template void Simulation<std::complex<long double>,2u>::calc_hartree();
+template void Simulation<float,3u>::calc_hartree();
+template void Simulation<double,3u>::calc_hartree();
+template void Simulation<long double,3u>::calc_hartree();
+template void Simulation<std::complex<float>,3u>::calc_hartree();
+template void Simulation<std::complex<double>,3u>::calc_hartree();
+template void Simulation<std::complex<long double>,3u>::calc_hartree();
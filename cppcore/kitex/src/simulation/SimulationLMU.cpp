@@ -103,9 +103,112 @@ void Simulation<T,D>::LMU(int NDisorder, int NMoments, Eigen::Array<unsigned lon
       } 
     }
     store_LMU(&gamma);
+#pragma omp master
+    {
+      H5::H5File * file = new H5::H5File(name, H5F_ACC_RDWR);
+      write_samples(file, "/Calculation/ldos/lMU", long(NDisorder));
+      delete file;
+    }
+#pragma omp barrier
     debug_message("Left Simulation::MU\n");
 }
 
+template <typename T,unsigned D>
+void Simulation<T,D>::LDOS_Recursion(int NDisorder, int NSteps, Eigen::Array<unsigned long, Eigen::Dynamic, 1> positions){
+    /*
+      Haydock recursion. Starting from the site |u_0>, the Lanczos vectors
+        b_{n+1}|u_{n+1}> = H|u_n> - a_n|u_n> - b_n|u_{n-1}>
+      tridiagonalise H, and the local Green function is the continued fraction
+        G(z) = b_0^2/(z - a_0 - b_1^2/(z - a_1 - b_2^2/(...)))
+      with b_0 the norm of the site vector. KITE-tools evaluates it at
+      any complex energy, closing the fraction with a terminator. A coefficient b_n = 0
+      means that the recursion closed exactly, and the following ones are left at zero.
+      The coefficients of each disorder realization are stored separately.
+    */
+    debug_message("Entered Simulation::LDOS_Recursion\n");
+
+    typedef typename extract_value_type<T>::value_type value_type;
+    auto NPositions = static_cast<int>(positions.size());
+    const value_type tolerance = value_type(100)*std::numeric_limits<value_type>::epsilon();
+
+    KPM_Vector<T,D> kpm0(1, *this); // previous Lanczos vector |u_{n-1}>
+    KPM_Vector<T,D> kpm1(2, *this); // |u_n> and H|u_n>
+
+    // One column per position and disorder realization
+    Eigen::Array<value_type, Eigen::Dynamic, Eigen::Dynamic> a = Eigen::Array<value_type, Eigen::Dynamic, Eigen::Dynamic>::Zero(NSteps, NPositions*NDisorder);
+    Eigen::Array<value_type, Eigen::Dynamic, Eigen::Dynamic> b = Eigen::Array<value_type, Eigen::Dynamic, Eigen::Dynamic>::Zero(NSteps + 1, NPositions*NDisorder);
+
+    // Scalar product of two columns of kpm1 without the ghosts, summed over all the threads
+    Coordinates<std::size_t, D + 1> x(r.Ld);
+    auto dot = [&](unsigned i, unsigned j){
+      T sum = 0;
+      for(std::size_t ii = 0; ii < r.Sized ; ii += r.Ld[0])
+        {
+          x.set_coord(ii + NGHOSTS);
+          if(r.test_ghosts(x))
+            sum += (kpm1.v.block(ii + NGHOSTS, i, r.lr[0], 1).adjoint() * kpm1.v.block(ii + NGHOSTS, j, r.lr[0], 1))(0,0);
+        }
+#pragma omp master
+      Global.smaller_gamma = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(1, 1);
+#pragma omp barrier
+#pragma omp critical
+      Global.smaller_gamma(0,0) += sum;
+#pragma omp barrier
+      sum = Global.smaller_gamma(0,0);
+#pragma omp barrier
+      return sum;
+    };
+
+    for(int disorder = 0; disorder < NDisorder; disorder++){
+      h.generate_disorder();
+      h.generate_twists();      // Generates Random or fixed boundaries
+      kpm1.initiate_phases();   //Initiates the Hopping Phases in KPM1
+      
+      for(int pos_index = 0; pos_index < NPositions; pos_index++){
+        const long col = disorder*NPositions + pos_index;
+        kpm1.build_site(positions(pos_index));
+        kpm1.set_index(0);
+        kpm1.Exchange_Boundaries();
+        kpm0.v.setZero();
+
+        value_type bn = std::sqrt(std::real(dot(0, 0)));
+        b(0, col) = bn;
+        if(bn < tolerance)
+          continue;
+        kpm1.v.col(0) /= bn;
+        
+        for(int n = 0; n < NSteps; n++)
+          {
+            const unsigned un = kpm1.get_index();
+            kpm1.template Multiply<0>();             // H|u_n> in the other column
+            const unsigned hn = kpm1.get_index();
+            
+            const value_type an = std::real(dot(un, hn));
+            kpm1.v.col(hn) -= an*kpm1.v.col(un) + (n > 0 ? bn : value_type(0))*kpm0.v.col(0);
+            kpm0.v.col(0) = kpm1.v.col(un);
+            bn = std::sqrt(std::real(dot(hn, hn)));
+            
+            a(n, col) = an;
+            if(bn < tolerance)
+              break;
+            b(n + 1, col) = bn;
+            kpm1.v.col(hn) /= bn;
+          }
+      }
+    }
+
+#pragma omp master
+    {
+      H5::H5File * file = new H5::H5File(name, H5F_ACC_RDWR);
+      write_hdf5(a, file, "/Calculation/ldos/RecursionA");
+      write_hdf5(b, file, "/Calculation/ldos/RecursionB");
+      file->close();
+      delete file;
+    }
+#pragma omp barrier
+    debug_message("Left Simulation::LDOS_Recursion\n");
+}
+
 template <typename T,unsigned D>
 void Simulation<T,D>::calc_LDOS(){
   debug_message("Entered Simulation::calc_LDOS\n");
@@ -136,6 +239,7 @@ void Simulation<T,D>::calc_LDOS(){
   // Now calculate it
   unsigned ldos_NumMoments;
   unsigned ldos_NumDisorder;
+  int ldos_Recursion = 0;
   Eigen::Array<unsigned long, Eigen::Dynamic, 1> ldos_Orbitals;
   Eigen::Array<unsigned long, Eigen::Dynamic, 1> ldos_Positions;
   
@@ -166,6 +270,10 @@ void Simulation<T,D>::calc_LDOS(){
       get_hdf5<unsigned>(&ldos_NumDisorder, file, (char *) "/Calculation/ldos/NumDisorder");
       get_hdf5<unsigned long>(ldos_Orbitals.data(), file, (char *) "/Calculation/ldos/Orbitals");
       get_hdf5<unsigned long>(ldos_Positions.data(), file, (char *) "/Calculation/ldos/FixPosition");
+      try{
+        H5::Exception::dontPrint();
+        get_hdf5<int>(&ldos_Recursion, file, (char *) "/Calculation/ldos/Recursion");
+      } catch(H5::Exception&) {}
       file->close();  
       delete file;
     }
@@ -177,7 +285,13 @@ void Simulation<T,D>::calc_LDOS(){
     } else if(D==3){
       total_positions = ldos_Positions + ldos_Orbitals*r.Lt[0]*r.Lt[1]*r.Lt[2];
     };
-    LMU(ldos_NumDisorder, ldos_NumMoments, total_positions);
+#pragma omp master
+    if(ldos_Recursion)
+      std::cout << "Using the recursion method.\n";
+    if(ldos_Recursion)
+      LDOS_Recursion(ldos_NumDisorder, ldos_NumMoments, total_positions);
+    else
+      LMU(ldos_NumDisorder, ldos_NumMoments, total_positions);
   }
   debug_message("Left Simulation::calc_LDOS\n");
 }
@@ -221,6 +335,25 @@ template void Simulation<std::complex<float> ,3u>::LMU(int, int, Eigen::Array<un
 template void Simulation<std::complex<double> ,3u>::LMU(int, int, Eigen::Array<unsigned long, -1, 1>);
 template void Simulation<std::complex<long double> ,3u>::LMU(int, int, Eigen::Array<unsigned long, -1, 1>);
 
+template void Simulation<float ,1u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<double ,1u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<long double ,1u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<std::complex<float> ,1u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<std::complex<double> ,1u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<std::complex<long double> ,1u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<float ,2u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<double ,2u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<long double ,2u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<std::complex<float> ,2u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<std::complex<double> ,2u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<std::complex<long double> ,2u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<float ,3u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<double ,3u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<long double ,3u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<std::complex<float> ,3u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<std::complex<double> ,3u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+template void Simulation<std::complex<long double> ,3u>::LDOS_Recursion(int, int, Eigen::Array<unsigned long, -1, 1>);
+
 template void Simulation<float ,1u>::calc_LDOS();
 template void Simulation<double ,1u>::calc_LDOS();
 template void Simulation<long double ,1u>::calc_LDOS();
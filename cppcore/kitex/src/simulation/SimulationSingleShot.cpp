@@ -29,6 +29,78 @@ std::complex<double> green(int n, int sigma, std::complex<double> energy){
   return 2.0*sigma/sq*i*exp(-sigma*n*1.0*acos(energy)*i);
 }
 
+std::complex<double> dgreen(int n, int sigma, std::complex<double> energy){
+  const std::complex<double> i(0.0,1.0); 
+  std::complex<double> den = 1.0 - energy*energy;
+  std::complex<double> sq = sqrt(den);
+  return -2.0*sigma/den*i*exp(-sigma*n*1.0*acos(energy)*i)*(1.0*n*sigma*i + energy/sq);
+}
+
+Eigen::Array<double, Eigen::Dynamic, 1> fermi_weights(const Eigen::Array<double, Eigen::Dynamic, 1> & grid, double mu, double temperature){
+  // Trapezoidal weights of the integral of f(E, mu)*g(E) over a uniform grid of energies. At zero
+  // temperature the integral stops at mu, with g interpolated linearly inside the last interval
+  int NE = static_cast<int>(grid.rows());
+  double dE = grid(1) - grid(0);
+  Eigen::Array<double, Eigen::Dynamic, 1> weights = Eigen::Array<double, Eigen::Dynamic, 1>::Zero(NE);
+
+  if(temperature > 0){
+    for(int k = 0; k < NE; k++)
+      weights(k) = dE*((k == 0 || k == NE - 1)? 0.5 : 1.0)/(1.0 + exp((grid(k) - mu)/temperature));
+    return weights;
+  }
+  
+  for(int k = 0; k < NE - 1; k++){
+    double s = std::min(mu - grid(k), dE);
+    if(s <= 0)
+      break;
+    weights(k)     += s - s*s/(2.0*dE);
+    weights(k + 1) += s*s/(2.0*dE);
+  }
+  return weights;
+}
+
+void frequency_window(double mu, double omega, double temperature, double eta, int NPoints,
+                      std::vector<double> & grid, std::vector<double> & weights){
+  // Energies and weights of the integral int dE [f(E,mu) - f(E+omega,mu)]/omega g(E), which is g(mu)
+  // at zero temperature and frequency. At zero temperature only the window [mu - omega, mu] contributes.
+  // By default, the spacing of the energies is a quarter of the broadening
+  grid.clear();
+  weights.clear();
+  double emin = mu - omega, emax = mu;
+  if(temperature > 0){
+    emin -= 20.0*temperature;
+    emax += 20.0*temperature;
+  }
+  
+  if(emax <= emin){
+    grid.push_back(mu);
+    weights.push_back(1.0);
+  } else {
+    int NE = NPoints;
+    if(NE <= 0)
+      NE = static_cast<int>(ceil(4.0*(emax - emin)/eta)) + 1;
+    NE = std::max(NE, 2);
+    double dE = (emax - emin)/(NE - 1);
+    
+    for(int k = 0; k < NE; k++){
+      double energy = emin + k*dE;
+      double weight = dE*((k == 0 || k == NE - 1)? 0.5 : 1.0);
+      if(temperature > 0){
+        double f0 = 1.0/(1.0 + exp((energy - mu)/temperature));
+        double f1 = 1.0/(1.0 + exp((energy + omega - mu)/temperature));
+        weight *= (omega > 0)? (f0 - f1)/omega : f0*(1.0 - f0)/temperature;
+      } else
+        weight /= omega;
+      
+      // both energies have to be inside the spectrum
+      if(energy > -0.99 && energy + omega < 0.99){
+        grid.push_back(energy);
+        weights.push_back(weight);
+      }
+    }
+  }
+}
+
 template <typename T, unsigned D>
 void Simulation<T,D>::calc_singleshot() {
   Eigen::Array<double, Eigen::Dynamic, 1> energies;
@@ -36,6 +108,9 @@ void Simulation<T,D>::calc_singleshot() {
   Eigen::Array<int, Eigen::Dynamic, 1> preserve_disorders;
   Eigen::Array<int, Eigen::Dynamic, 1> moments;
   int NDisorder, NRandom, direction;
+  int NPoints = 0;
+  double temperature = 0;
+  double min_energy = -1.0;
   std::string direction_string;
 
     // Make sure that all the threads are ready before opening any files
@@ -82,10 +157,32 @@ void Simulation<T,D>::calc_singleshot() {
       direction_string = "y,y";
     else if(direction == 2)
       direction_string = "z,z";
+    else if(direction == 3)
+      direction_string = "x,y";
+    else if(direction == 4)
+      direction_string = "x,z";
+    else if(direction == 5)
+      direction_string = "y,x";
+    else if(direction == 6)
+      direction_string = "y,z";
+    else if(direction == 7)
+      direction_string = "z,x";
+    else if(direction == 8)
+      direction_string = "z,y";
     else{
-      std::cout << "Invalid singleshot direction. Has to be xx, yy or zz. Exiting.\n";
+      std::cout << "Invalid singleshot direction. Has to be xx, yy, zz, xy, xz, yx, yz, zx or zy. Exiting.\n";
       exit(1);
     }
+
+    // The temperature and the number of integration points are only used by the Hall conductivity,
+    // and may be missing from older configuration files
+    try{
+      get_hdf5<double>(&temperature, file, (char *)   "/Calculation/singleshot_conductivity_dc/Temperature");
+      get_hdf5<int>(&NPoints, file, (char *)   "/Calculation/singleshot_conductivity_dc/NumPoints");
+    } catch(H5::Exception&) {debug_message("singleshot dc: using the default temperature and number of points.\n");}
+    try{
+      get_hdf5<double>(&min_energy, file, (char *)   "/Calculation/singleshot_conductivity_dc/MinEnergy");
+    } catch(H5::Exception&) {debug_message("singleshot dc: integrating from the bottom of the spectrum.\n");}
        
     // We also need to determine the number of energies that we need to calculate
     auto * dataset_energy     	= new H5::DataSet(file->openDataSet("/Calculation/singleshot_conductivity_dc/Energy"));
@@ -128,7 +225,11 @@ void Simulation<T,D>::calc_singleshot() {
   delete file;
 }
 
-  singleshot(energies, gammas, preserve_disorders, moments, NDisorder, NRandom, direction_string);
+  if(direction < 3)
+    singleshot(energies, gammas, preserve_disorders, moments, NDisorder, NRandom, direction_string);
+  else
+    singleshot_hall(energies, gammas, preserve_disorders, moments, NDisorder, NRandom, direction_string,
+                    temperature, NPoints, min_energy);
   }
 }
 
@@ -423,6 +524,556 @@ void Simulation<T,D>::singleshot(Eigen::Array<double, Eigen::Dynamic, 1> energie
 #pragma omp barrier
 }
 
+template <typename T, unsigned D>
+void Simulation<T,D>::singleshot_hall(Eigen::Array<double, Eigen::Dynamic, 1> energies,
+  Eigen::Array<double, Eigen::Dynamic, 1> gammas,
+  Eigen::Array<int, Eigen::Dynamic, 1> preserve_disorders,
+  Eigen::Array<int, Eigen::Dynamic, 1> moments,
+  int NDisorder, int NRandomV, std::string direction_string, double temperature, int NPoints, double min_energy){
+  // Calculate the transverse dc conductivity for a set of Fermi energies with the Kubo-Bastin formula
+  //
+  // KITE-tools obtains it from the full Gamma matrix, Gamma_nm = <r| v^a T_n v^b T_m |r>, as
+  //
+  //   sigma(mu) = int dE f(E,mu) 2Im sum_nm dg_n(E) Gamma_nm d_m(E)
+  //
+  // where dg_n are the coefficients of the derivative of the Green's function and d_m the ones of the
+  // delta function. Here the sums over n and m are done on the vectors instead, for each energy E_k
+  // of an integration grid shared by all the Fermi energies. With the operators G' = sum_n dg_n T_n
+  // and P = sum_m d_m T_m, the integrand is
+  //
+  //   2Im <r| v^a G' v^b P |r> = Im <r| v^a G' v^b P |r> - Im <r| v^a P v^b G'^* |r>
+  //
+  // The second form is the one of the hermitian Gamma matrix stored by KITEx, and its statistical
+  // error is much smaller. Both Chebyshev recursions, of v^a|r> and of |r>, are expanded with the
+  // coefficients of SSBATCH energies at a time. For NE grid energies that is 2*N*NE/SSBATCH
+  // multiplications by H. The default spacing of the grid is eta/4, and eta has to scale as 1/N,
+  // so the cost is O(N^2/SSBATCH), like the O(N^2/MEMORY) of the Gamma matrix; what is saved is
+  // storing the N x N matrix, not the quadratic cost.
+  // Fermi energies with the same broadening and number of moments are integrated on the same grid.
+
+  typedef typename extract_value_type<T>::value_type value_type;
+  debug_message("Entered singleshot_hall\n");
+    
+  std::string name_dataset = "/Calculation/singleshot_conductivity_dc/SingleShot";
+  int N_energies = static_cast<int>(energies.rows());
+  double EnergyScale;
+
+#pragma omp critical
+{
+  auto * fetchfile         = new H5::H5File(name, H5F_ACC_RDONLY);
+  get_hdf5<double>(&EnergyScale,  fetchfile, (char *)   "/EnergyScale");
+  fetchfile->close();
+  delete fetchfile;
+}
+#pragma omp barrier
+  double EScale = EnergyScale;
+
+  // Same normalization as the DC conductivity of KITE-tools, in units of e^2/h
+  double unit_cell_area = fabs(r.rLat.determinant());
+  unsigned int number_of_orbitals = r.Orb;
+  unsigned int spin_degeneracy = 1;
+  double factor = 2.0*M_PI*spin_degeneracy*number_of_orbitals/unit_cell_area;
+
+  std::vector<std::vector<unsigned>> indices = process_string(direction_string);
+
+  // Group the Fermi energies that share the broadening and the number of moments
+  std::vector<int> group(N_energies, -1), group_first;
+  for(int job = 0; job < N_energies; job++){
+    for(std::size_t g = 0; g < group_first.size(); g++)
+      if(gammas(group_first.at(g)) == gammas(job) && moments(group_first.at(g)) == moments(job)){
+        group.at(job) = static_cast<int>(g);
+        break;
+      }
+    if(group.at(job) < 0){
+      group.at(job) = static_cast<int>(group_first.size());
+      group_first.push_back(job);
+    }
+  }
+  int N_groups = static_cast<int>(group_first.size());
+
+  // The integration grids go from min_energy, by default the bottom of the rescaled spectrum, up to the
+  // highest occupied energy. By default, their spacing is a quarter of the broadening
+  std::vector<Eigen::Array<double, Eigen::Dynamic, 1>> grids(N_groups);
+  std::vector<Eigen::Array<double, Eigen::Dynamic, 1>> weights(N_energies);
+  for(int g = 0; g < N_groups; g++){
+    double eta = gammas(group_first.at(g));
+    double mu_max = min_energy;
+    for(int job = 0; job < N_energies; job++)
+      if(group.at(job) == g)
+        mu_max = std::max(mu_max, energies(job));
+    
+    double max_energy = std::max(std::min(1.0, mu_max + 30.0*temperature), min_energy + eta);
+    int NE = NPoints;
+    if(NE <= 0)
+      NE = static_cast<int>(ceil(4.0*(max_energy - min_energy)/eta)) + 1;
+    NE = std::max(NE, 3);
+    grids.at(g) = Eigen::Array<double, Eigen::Dynamic, 1>::LinSpaced(NE, min_energy, max_energy);
+    
+    for(int job = 0; job < N_energies; job++)
+      if(group.at(job) == g)
+        weights.at(job) = fermi_weights(grids.at(g), energies(job), temperature);
+  }
+  
+#pragma omp master
+  {
+    for(int g = 0; g < N_groups; g++)
+      std::cout << "Hall conductivity: broadening " << gammas(group_first.at(g))*EScale << ", "
+                << moments(group_first.at(g)) << " moments, " << grids.at(g).rows() << " integration points.\n";
+  }
+#pragma omp barrier
+
+  // initialize the kpm vectors necessary for this calculation
+  KPM_Vector<T,D> kpm0(1, *this);       // random vector
+  KPM_Vector<T,D> kpm1(MEMORY, *this);  // Chebyshev recursions of v^a|r> and |r>
+  KPM_Vector<T,D> kpm2(1, *this);       // vectors to be multiplied by v^b
+  KPM_Vector<T,D> kpm3(1, *this);       // v^b times kpm2
+
+  // For each energy of a batch, the columns of 'left' and 'right' are G'^*, Re and Im parts,
+  // and P applied to v^a|r> and to |r> respectively
+  Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> left, right, coefs;
+  std::vector<Eigen::Array<T, Eigen::Dynamic, 1>> integrand(N_groups);
+  for(int g = 0; g < N_groups; g++)
+    integrand.at(g) = Eigen::Array<T, Eigen::Dynamic, 1>::Zero(grids.at(g).rows());
+  std::vector<long> average(N_groups, 0);
+
+  // v^b applied to a column of 'right'
+  auto velocity = [&](int col){
+    kpm2.set_index(0);
+    kpm2.v.col(0) = right.col(col);
+    kpm2.Exchange_Boundaries();
+    kpm3.set_index(0);
+    kpm2.Velocity(&kpm3, indices, 1);
+    kpm3.empty_ghosts(0);
+  };
+
+  for(int disorder = 0; disorder < NDisorder; disorder++){
+    h.generate_disorder();
+    h.build_velocity(indices.at(0),0u);
+    h.build_velocity(indices.at(1),1u);
+
+    for(int g = 0; g < N_groups; g++){
+      bool new_disorder = false;
+      for(int job = 0; job < N_energies; job++)
+        if(group.at(job) == g && preserve_disorders(job) == 0)
+          new_disorder = true;
+      
+      if(new_disorder){
+        h.generate_disorder();
+        h.build_velocity(indices.at(0),0u);
+        h.build_velocity(indices.at(1),1u);
+      }
+
+      const Eigen::Array<double, Eigen::Dynamic, 1> & grid = grids.at(g);
+      int NE = static_cast<int>(grid.rows());
+      double eta = gammas(group_first.at(g));
+      int NMoments = moments(group_first.at(g));
+      int NPadded = (NMoments + MEMORY - 1)/MEMORY*MEMORY;
+
+      for(int randV = 0; randV < NRandomV; randV++){
+        h.generate_twists(); // Generates Random or fixed boundaries
+        kpm0.initiate_vector();
+        kpm1.initiate_phases();
+        kpm2.initiate_phases();
+        kpm3.initiate_phases();
+        kpm0.Exchange_Boundaries();
+
+        for(int e0 = 0; e0 < NE; e0 += SSBATCH){
+          int NB = std::min(SSBATCH, NE - e0);
+
+          // Expansion coefficients of this batch of energies. The rows beyond NMoments are zero
+          coefs = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(NPadded, 3*NB);
+          for(int k = 0; k < NB; k++){
+            std::complex<double> energy(grid(e0 + k), eta);
+            for(int n = 0; n < NMoments; n++){
+              std::complex<double> dg = std::conj(dgreen(n, 1, energy))/(1.0 + int(n==0));
+              coefs(n, 3*k)     = T(static_cast<value_type>(dg.real()));
+              coefs(n, 3*k + 1) = T(static_cast<value_type>(dg.imag()));
+              coefs(n, 3*k + 2) = T(static_cast<value_type>(-green(n, 1, energy).imag()/M_PI/(1.0 + int(n==0))));
+            }
+          }
+
+          // MEMORY Chebyshev vectors at a time
+          left  = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(r.Sized, 3*NB);
+          right = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(r.Sized, 3*NB);
+          kpm1.set_index(0);
+          kpm0.Velocity(&kpm1, indices, 0);
+          for(int n = 0; n < NPadded; n += MEMORY){
+            for(int i = n; i < n + MEMORY; i++)
+              kpm1.cheb_iteration(i);
+            left.noalias() += kpm1.v*coefs.middleRows(n, MEMORY);
+          }
+
+          kpm1.set_index(0);
+          kpm1.v.col(0) = kpm0.v.col(0);
+          for(int m = 0; m < NPadded; m += MEMORY){
+            for(int i = m; i < m + MEMORY; i++)
+              kpm1.cheb_iteration(i);
+            right.noalias() += kpm1.v*coefs.middleRows(m, MEMORY);
+          }
+
+          // v^a is anti-hermitian, so <r|v^a = -(v^a|r>)^dagger
+          for(int k = 0; k < NB; k++){
+            velocity(3*k + 2);
+            T re1 = left.col(3*k).dot(kpm3.v.col(0));
+            T im1 = left.col(3*k + 1).dot(kpm3.v.col(0));
+            velocity(3*k);
+            T re2 = left.col(3*k + 2).dot(kpm3.v.col(0));
+            velocity(3*k + 1);
+            T im2 = left.col(3*k + 2).dot(kpm3.v.col(0));
+
+            T value = T(std::real(im1) - std::imag(re1) + std::imag(re2) + std::real(im2));
+            integrand.at(g)(e0 + k) += (value - integrand.at(g)(e0 + k))/value_type(average.at(g) + 1);
+          }
+        }
+        average.at(g)++;
+      }
+    }
+  }
+
+  // integrate over the energies of the grid for each Fermi energy
+  Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> cond_array;
+  cond_array = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(1, N_energies);
+  for(int job = 0; job < N_energies; job++){
+    const Eigen::Array<T, Eigen::Dynamic, 1> & integ = integrand.at(group.at(job));
+    for(int k = 0; k < integ.rows(); k++)
+      cond_array(job) += integ(k)*T(static_cast<value_type>(weights.at(job)(k)));
+  }
+  
+#pragma omp master
+  { 
+    Global.singleshot_cond = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> :: Zero(1, N_energies);
+  }
+#pragma omp barrier
+#pragma omp critical
+  {
+    Global.singleshot_cond += cond_array;			
+  }
+#pragma omp barrier
+  
+#pragma omp master
+  {
+    Global.singleshot_cond *= static_cast<T>(factor);
+      
+    // Same layout as the longitudinal conductivity
+    Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> store_data;
+    store_data = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(4, energies.rows());
+    for(int ener = 0; ener < N_energies; ener++)
+      {
+        store_data(0, ener) = energies(ener)*EScale;
+        store_data(1, ener) = gammas(ener)*EScale;
+        store_data(2, ener) = preserve_disorders(ener);
+        store_data(3, ener) = Global.singleshot_cond.real()(ener);
+      }
+    
+    auto * file = new H5::H5File(name, H5F_ACC_RDWR);
+    write_hdf5(store_data, file, name_dataset);
+    delete file;
+    
+    // make sure the global matrix is zeroed
+    Global.singleshot_cond.setZero();
+    debug_message("Left singleshot_hall");
+  }
+#pragma omp barrier
+}
+
+template <typename T, unsigned D>
+void Simulation<T,D>::calc_singleshot_optical() {
+  Eigen::Array<double, Eigen::Dynamic, 1> energies;
+  Eigen::Array<double, Eigen::Dynamic, 1> frequencies;
+  Eigen::Array<double, Eigen::Dynamic, 1> gammas;
+  Eigen::Array<int, Eigen::Dynamic, 1> moments;
+  int NDisorder, NRandom, direction, NPoints;
+  double temperature;
+  std::string direction_string;
+  std::string group = "/Calculation/singleshot_conductivity_optical/";
+
+    // Make sure that all the threads are ready before opening any files
+    // Some threads could still be inside the Simulation constructor
+    // This barrier is essential
+#pragma omp barrier
+  int calculate_singleshot_local = false;
+#pragma omp master
+{
+  auto * file1 = new H5::H5File(name, H5F_ACC_RDONLY);
+  Global.calculate_singleshot_optical = false;
+  try{
+    debug_message("single_shot optical checking if we need to calculate it.\n");
+    get_hdf5<int>(&direction, file1, (char *)   "/Calculation/singleshot_conductivity_optical/Direction");
+    Global.calculate_singleshot_optical = true;
+    
+  } catch(H5::Exception&) {debug_message("singleshot optical: no need to calculate it.\n");}
+  file1->close();
+  delete file1;
+  
+}
+#pragma omp barrier
+#pragma omp critical
+  calculate_singleshot_local = Global.calculate_singleshot_optical;
+#pragma omp barrier
+
+
+  if(calculate_singleshot_local){
+#pragma omp master
+      {
+        std::cout << "Calculating SingleShot optical conductivity.\n";
+      }
+#pragma omp barrier
+#pragma omp critical
+{
+    auto * file = new H5::H5File(name, H5F_ACC_RDONLY);
+    get_hdf5<int>(&direction, file, (char *)   "/Calculation/singleshot_conductivity_optical/Direction");
+    get_hdf5<int>(&NRandom, file, (char *)   "/Calculation/singleshot_conductivity_optical/NumRandoms");
+    get_hdf5<int>(&NDisorder, file, (char *)   "/Calculation/singleshot_conductivity_optical/NumDisorder");
+    get_hdf5<int>(&NPoints, file, (char *)   "/Calculation/singleshot_conductivity_optical/NumPoints");
+    get_hdf5<double>(&temperature, file, (char *)   "/Calculation/singleshot_conductivity_optical/Temperature");
+       
+    if(direction == 0)
+      direction_string = "x,x";
+    else if(direction == 1)
+      direction_string = "y,y";
+    else if(direction == 2)
+      direction_string = "z,z";
+    else{
+      std::cout << "Invalid singleshot optical direction. Has to be xx, yy or zz. Exiting.\n";
+      exit(1);
+    }
+
+    // The Fermi energies, frequencies, broadenings and numbers of moments all have one element per point
+    hsize_t dims_out[2];
+    auto * dataset     	= new H5::DataSet(file->openDataSet(group + "Energy"));
+    auto * dataspace 	= new H5::DataSpace(dataset->getSpace());
+    dataspace->getSimpleExtentDims(dims_out, nullptr);
+    delete dataspace;
+    delete dataset;
+    int N_points = static_cast<int>(dims_out[0]*dims_out[1]);
+    
+    energies    = Eigen::Array<double, -1, 1>::Zero(N_points);
+    frequencies = Eigen::Array<double, -1, 1>::Zero(N_points);
+    gammas      = Eigen::Array<double, -1, 1>::Zero(N_points);
+    moments     = Eigen::Array<int, -1, 1>::Zero(N_points);
+    get_hdf5<double>(energies.data(),  	  file, (char *)   "/Calculation/singleshot_conductivity_optical/Energy");
+    get_hdf5<double>(frequencies.data(),  file, (char *)   "/Calculation/singleshot_conductivity_optical/Frequency");
+    get_hdf5<double>(gammas.data(),  	  file, (char *)   "/Calculation/singleshot_conductivity_optical/Gamma");
+    get_hdf5<int>(moments.data(),  	      file, (char *)   "/Calculation/singleshot_conductivity_optical/NumMoments");
+
+    file->close();
+  delete file;
+}
+
+  singleshot_optical(energies, frequencies, gammas, moments, NDisorder, NRandom, direction_string, temperature, NPoints);
+  }
+}
+
+template <typename T, unsigned D>
+void Simulation<T,D>::singleshot_optical(Eigen::Array<double, Eigen::Dynamic, 1> energies,
+  Eigen::Array<double, Eigen::Dynamic, 1> frequencies,
+  Eigen::Array<double, Eigen::Dynamic, 1> gammas,
+  Eigen::Array<int, Eigen::Dynamic, 1> moments,
+  int NDisorder, int NRandomV, std::string direction_string, double temperature, int NPoints){
+  // Calculate the real part of the longitudinal optical conductivity for a set of Fermi energies
+  // and frequencies with the Kubo-Greenwood formula
+  //
+  //   Re sigma(mu, w) ~ 1/w int dE [f(E,mu) - f(E+w,mu)] Tr[v A(E) v A(E+w)]
+  //
+  // where A(E) = sum_n Im g_n(E) T_n is the same broadened delta function as in the dc single-shot
+  // conductivity, which is recovered at w = 0. At zero temperature only the energies between mu - w
+  // and mu contribute. The Chebyshev recursions of v|r> and of |r> are expanded with the coefficients
+  // of A(E) and A(E+w) of SSBATCH energies at a time, so the cost is linear in the number of moments.
+  // The points with the same broadening and number of moments share these recursions, whatever their
+  // Fermi energy and frequency. The trace is evaluated in its symmetric form
+  // (<r|v A(E) v A(E+w)|r> + <r|v A(E+w) v A(E)|r>)/2
+
+  typedef typename extract_value_type<T>::value_type value_type;
+  debug_message("Entered singleshot_optical\n");
+    
+  std::string name_dataset = "/Calculation/singleshot_conductivity_optical/SingleShot";
+  int N_jobs = static_cast<int>(energies.rows());
+  double EnergyScale;
+
+#pragma omp critical
+{
+  auto * fetchfile         = new H5::H5File(name, H5F_ACC_RDONLY);
+  get_hdf5<double>(&EnergyScale,  fetchfile, (char *)   "/EnergyScale");
+  fetchfile->close();
+  delete fetchfile;
+}
+#pragma omp barrier
+  double EScale = EnergyScale;
+
+  // Same normalization as the dc single-shot conductivity
+  double unit_cell_area = fabs(r.rLat.determinant());
+  unsigned int number_of_orbitals = r.Orb;
+  unsigned int spin_degeneracy = 1;
+  double factor = -2.0*spin_degeneracy*number_of_orbitals/unit_cell_area;
+
+  std::vector<std::vector<unsigned>> indices = process_string(direction_string);
+
+  // Group the points that share the broadening and the number of moments, and list the
+  // energies E of the integrals of all of them
+  std::vector<int> group_first;
+  std::vector<std::vector<int>> point_job;
+  std::vector<std::vector<double>> point_energy, point_weight;
+  std::vector<double> grid, weights;
+  for(int job = 0; job < N_jobs; job++){
+    std::size_t g = 0;
+    while(g < group_first.size() &&
+          !(gammas(group_first.at(g)) == gammas(job) && moments(group_first.at(g)) == moments(job)))
+      g++;
+    if(g == group_first.size()){
+      group_first.push_back(job);
+      point_job.emplace_back();
+      point_energy.emplace_back();
+      point_weight.emplace_back();
+    }
+    
+    frequency_window(energies(job), frequencies(job), temperature, gammas(job), NPoints, grid, weights);
+    for(std::size_t k = 0; k < grid.size(); k++){
+      point_job.at(g).push_back(job);
+      point_energy.at(g).push_back(grid.at(k));
+      point_weight.at(g).push_back(weights.at(k));
+    }
+  }
+  int N_groups = static_cast<int>(group_first.size());
+
+#pragma omp master
+  {
+    for(int g = 0; g < N_groups; g++)
+      std::cout << "Optical conductivity: broadening " << gammas(group_first.at(g))*EScale << ", "
+                << moments(group_first.at(g)) << " moments, " << point_job.at(g).size() << " integration points.\n";
+  }
+#pragma omp barrier
+
+  // initialize the kpm vectors necessary for this calculation
+  KPM_Vector<T,D> kpm0(1, *this);       // random vector
+  KPM_Vector<T,D> kpm1(MEMORY, *this);  // Chebyshev recursions of v|r> and |r>
+  KPM_Vector<T,D> kpm2(1, *this);       // vectors to be multiplied by v
+  KPM_Vector<T,D> kpm3(1, *this);       // v times kpm2
+
+  // For each point of a batch, the columns of 'left' and 'right' are A(E) and A(E+w) applied to
+  // v|r> and to |r> respectively
+  Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> left, right, coefs;
+  Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> cond_array, sample;
+  cond_array = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(1, N_jobs);
+  sample     = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(1, N_jobs);
+  long average = 0;
+
+  // v applied to a column of 'left'
+  auto velocity = [&](int col){
+    kpm2.set_index(0);
+    kpm2.v.col(0) = left.col(col);
+    kpm2.Exchange_Boundaries();
+    kpm3.set_index(0);
+    kpm2.Velocity(&kpm3, indices, 1);
+    kpm3.empty_ghosts(0);
+  };
+
+  for(int disorder = 0; disorder < NDisorder; disorder++){
+    h.generate_disorder();
+    h.build_velocity(indices.at(0),0u);
+    h.build_velocity(indices.at(1),1u);
+
+    for(int randV = 0; randV < NRandomV; randV++){
+      h.generate_twists(); // Generates Random or fixed boundaries
+      kpm0.initiate_vector();
+      kpm1.initiate_phases();
+      kpm2.initiate_phases();
+      kpm3.initiate_phases();
+      kpm0.Exchange_Boundaries();
+      sample.setZero();
+
+      for(int g = 0; g < N_groups; g++){
+        double eta = gammas(group_first.at(g));
+        int NMoments = moments(group_first.at(g));
+        int NPadded = (NMoments + MEMORY - 1)/MEMORY*MEMORY;
+        int NE = static_cast<int>(point_job.at(g).size());
+
+        for(int e0 = 0; e0 < NE; e0 += SSBATCH){
+          int NB = std::min(SSBATCH, NE - e0);
+
+          // Expansion coefficients of A(E) and A(E+w). The rows beyond NMoments are zero
+          coefs = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(NPadded, 2*NB);
+          for(int k = 0; k < NB; k++){
+            int job = point_job.at(g).at(e0 + k);
+            std::complex<double> energy0(point_energy.at(g).at(e0 + k), eta);
+            std::complex<double> energy1(point_energy.at(g).at(e0 + k) + frequencies(job), eta);
+            for(int n = 0; n < NMoments; n++){
+              coefs(n, 2*k)     = T(static_cast<value_type>(green(n, 1, energy0).imag()/(1.0 + int(n==0))));
+              coefs(n, 2*k + 1) = T(static_cast<value_type>(green(n, 1, energy1).imag()/(1.0 + int(n==0))));
+            }
+          }
+
+          // MEMORY Chebyshev vectors at a time
+          left  = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(r.Sized, 2*NB);
+          right = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>::Zero(r.Sized, 2*NB);
+          kpm1.set_index(0);
+          kpm0.Velocity(&kpm1, indices, 0);
+          for(int n = 0; n < NPadded; n += MEMORY){
+            for(int i = n; i < n + MEMORY; i++)
+              kpm1.cheb_iteration(i);
+            left.noalias() += kpm1.v*coefs.middleRows(n, MEMORY);
+          }
+
+          kpm1.set_index(0);
+          kpm1.v.col(0) = kpm0.v.col(0);
+          for(int m = 0; m < NPadded; m += MEMORY){
+            for(int i = m; i < m + MEMORY; i++)
+              kpm1.cheb_iteration(i);
+            right.noalias() += kpm1.v*coefs.middleRows(m, MEMORY);
+          }
+
+          for(int k = 0; k < NB; k++){
+            velocity(2*k);
+            T prod = kpm3.v.col(0).dot(right.col(2*k + 1));
+            velocity(2*k + 1);
+            prod += kpm3.v.col(0).dot(right.col(2*k));
+            
+            int job = point_job.at(g).at(e0 + k);
+            sample(job) += T(static_cast<value_type>(point_weight.at(g).at(e0 + k)/2.0)*std::real(prod));
+          }
+        }
+      }
+      cond_array += (sample - cond_array)/value_type(average + 1);
+      average++;
+    }
+  }
+  
+#pragma omp master
+  { 
+    Global.singleshot_cond = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> :: Zero(1, N_jobs);
+  }
+#pragma omp barrier
+#pragma omp critical
+  {
+    Global.singleshot_cond += cond_array;			
+  }
+#pragma omp barrier
+  
+#pragma omp master
+  {
+    Global.singleshot_cond *= static_cast<T>(factor);
+      
+    // Create array to store the data
+    Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> store_data;
+    store_data = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>::Zero(4, N_jobs);
+    for(int job = 0; job < N_jobs; job++)
+      {
+        store_data(0, job) = energies(job)*EScale;
+        store_data(1, job) = frequencies(job)*EScale;
+        store_data(2, job) = gammas(job)*EScale;
+        store_data(3, job) = Global.singleshot_cond.real()(job);
+      }
+    
+    auto * file = new H5::H5File(name, H5F_ACC_RDWR);
+    write_hdf5(store_data, file, name_dataset);
+    delete file;
+    
+    // make sure the global matrix is zeroed
+    Global.singleshot_cond.setZero();
+    debug_message("Left singleshot_optical");
+  }
+#pragma omp barrier
+}
+
 template void Simulation<float,1u>::calc_singleshot();
 template void Simulation<double,1u>::calc_singleshot();
 template void Simulation<long double,1u>::calc_singleshot();
@@ -461,6 +1112,63 @@ template void Simulation<std::complex<float>,3u>::singleshot(Eigen::Array<double
 template void Simulation<std::complex<double>,3u>::singleshot(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string);
 template void Simulation<std::complex<long double>,3u>::singleshot(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string);
 
+template void Simulation<float,1u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<double,1u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<long double,1u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<std::complex<float>,1u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<std::complex<double>,1u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<std::complex<long double>,1u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<float,2u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<double,2u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<long double,2u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<std::complex<float>,2u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<std::complex<double>,2u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<std::complex<long double>,2u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<float,3u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<double,3u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<long double,3u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<std::complex<float>,3u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<std::complex<double>,3u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+template void Simulation<std::complex<long double>,3u>::singleshot_hall(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int, double);
+
+template void Simulation<float,1u>::calc_singleshot_optical();
+template void Simulation<double,1u>::calc_singleshot_optical();
+template void Simulation<long double,1u>::calc_singleshot_optical();
+template void Simulation<std::complex<float>,1u>::calc_singleshot_optical();
+template void Simulation<std::complex<double>,1u>::calc_singleshot_optical();
+template void Simulation<std::complex<long double>,1u>::calc_singleshot_optical();
+template void Simulation<float,2u>::calc_singleshot_optical();
+template void Simulation<double,2u>::calc_singleshot_optical();
+template void Simulation<long double,2u>::calc_singleshot_optical();
+template void Simulation<std::complex<float>,2u>::calc_singleshot_optical();
+template void Simulation<std::complex<double>,2u>::calc_singleshot_optical();
+template void Simulation<std::complex<long double>,2u>::calc_singleshot_optical();
+template void Simulation<float,3u>::calc_singleshot_optical();
+template void Simulation<double,3u>::calc_singleshot_optical();
+template void Simulation<long double,3u>::calc_singleshot_optical();
+template void Simulation<std::complex<float>,3u>::calc_singleshot_optical();
+template void Simulation<std::complex<double>,3u>::calc_singleshot_optical();
+template void Simulation<std::complex<long double>,3u>::calc_singleshot_optical();
+
+template void Simulation<float,1u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<double,1u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<long double,1u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<std::complex<float>,1u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<std::complex<double>,1u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<std::complex<long double>,1u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<float,2u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<double,2u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<long double,2u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<std::complex<float>,2u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<std::complex<double>,2u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<std::complex<long double>,2u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<float,3u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<double,3u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<long double,3u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<std::complex<float>,3u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<std::complex<double>,3u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+template void Simulation<std::complex<long double>,3u>::singleshot_optical(Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<double, -1, 1>, Eigen::Array<int, -1, 1>, int, int, std::string, double, int);
+
 /*
 #define instantiate(type, dim)               template class Simulation<type,dim>;
 #include "tools/instantiate.hpp"
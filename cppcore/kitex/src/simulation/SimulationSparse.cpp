@@ -0,0 +1,354 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+#include "Generic.hpp"
+#include "tools/ComplexTraits.hpp"
+#include "tools/myHDF5.hpp"
+#include "simulation/Global.hpp"
+#include "tools/Random.hpp"
+#include "tools/queue.hpp"
+#include "lattice/SparseStructure.hpp"
+#include "hamiltonian/HamiltonianSparse.hpp"
+#include "vector/KPM_SparseVector.hpp"
+#include "simulation/SimulationSparse.hpp"
+
+template <typename T,unsigned D>
+GlobalSparseSimulation<T,D>::GlobalSparseSimulation(char *name) : sglobal(name) {
+  debug_message("Entered GlobalSparseSimulation\n");
+
+  omp_set_num_threads(sglobal.n_threads);
+#pragma omp parallel default(shared)
+  {
+    SparseSimulation<T,D> simul(name, Global, sglobal);
+
+    simul.calc_conddc();
+    simul.calc_condopt();
+    simul.calc_DOS();
+    simul.calc_unsupported();
+  }
+  debug_message("Left GlobalSparseSimulation\n");
+}
+
+template <typename T,unsigned D>
+SparseSimulation<T,D>::SparseSimulation(char *filename, GLOBAL_VARIABLES <T> & Global1, SparseStructure<T,D> & s) :
+  Global(Global1), name(filename), h(s) {
+  // All the threads have copied their rows: the input is no longer needed
+#pragma omp barrier
+#pragma omp master
+  s.release();
+#pragma omp barrier
+}
+
+template <typename T,unsigned D>
+bool SparseSimulation<T,D>::requested(std::string calculation){
+  // Make sure that all the threads are ready before opening any files
+#pragma omp barrier
+  bool local_requested = false;
+#pragma omp master
+  {
+    auto *file = new H5::H5File(name, H5F_ACC_RDONLY);
+    Global.calculate_dos = false;
+    try{
+      H5::Exception::dontPrint();
+      int dummy_variable;
+      std::string field = "/Calculation/" + calculation + "/NumMoments";
+      get_hdf5<int>(&dummy_variable, file, field);
+      Global.calculate_dos = true;
+    } catch(H5::Exception&) {}
+    file->close();
+    delete file;
+  }
+#pragma omp barrier
+  local_requested = Global.calculate_dos;
+#pragma omp barrier
+  return local_requested;
+}
+
+template <typename T,unsigned D>
+std::vector<std::vector<unsigned>> SparseSimulation<T,D>::process_string(std::string indices_string){
+  // Same format as Simulation::process_string: "xy,z" gives {{0,1},{2}}
+  std::vector<std::vector<unsigned>> indices;
+  std::vector<unsigned> temp;
+  for(char c : indices_string + ",")
+    {
+      if(c == ',')
+        {
+          indices.push_back(temp);
+          temp.clear();
+        }
+      else if(c >= 'x' && c <= 'z' && unsigned(c - 'x') < D)
+        temp.push_back(unsigned(c - 'x'));
+      else
+        {
+          std::cout << "Please enter a valid expression.\n";
+          exit(1);
+        }
+    }
+  return indices;
+}
+
+template <typename T,unsigned D>
+void SparseSimulation<T,D>::calc_DOS(){
+  if(!requested("dos"))
+    return;
+  int NMoments, NRandom, NDisorder;
+#pragma omp master
+  std::cout << "Calculating DOS.\n";
+#pragma omp critical
+  {
+    auto *file = new H5::H5File(name, H5F_ACC_RDONLY);
+    get_hdf5<int>(&NMoments,  file, (char *) "/Calculation/dos/NumMoments");
+    get_hdf5<int>(&NDisorder, file, (char *) "/Calculation/dos/NumDisorder");
+    get_hdf5<int>(&NRandom,   file, (char *) "/Calculation/dos/NumRandoms");
+    file->close();
+    delete file;
+  }
+  // There is no disorder to generate: every realization only adds random vectors
+  Gamma1D(NRandom*NDisorder, NMoments, process_string(""), "/Calculation/dos/MU");
+}
+
+template <typename T,unsigned D>
+void SparseSimulation<T,D>::calc_conddc(){
+  if(!requested("conductivity_dc"))
+    return;
+  int NMoments, NRandom, NDisorder, direction;
+#pragma omp master
+  std::cout << "Calculating CondDC.\n";
+#pragma omp critical
+  {
+    auto *file = new H5::H5File(name, H5F_ACC_RDONLY);
+    get_hdf5<int>(&direction, file, (char *) "/Calculation/conductivity_dc/Direction");
+    get_hdf5<int>(&NMoments,  file, (char *) "/Calculation/conductivity_dc/NumMoments");
+    get_hdf5<int>(&NRandom,   file, (char *) "/Calculation/conductivity_dc/NumRandoms");
+    get_hdf5<int>(&NDisorder, file, (char *) "/Calculation/conductivity_dc/NumDisorder");
+    file->close();
+    delete file;
+  }
+  std::string dir(num2str2(direction));
+  std::string dirc = dir.substr(0,1)+","+dir.substr(1,2);
+  Gamma2D(NRandom*NDisorder, NMoments, process_string(dirc), "/Calculation/conductivity_dc/Gamma"+dir);
+}
+
+template <typename T,unsigned D>
+void SparseSimulation<T,D>::calc_condopt(){
+  if(!requested("conductivity_optical"))
+    return;
+  int NMoments, NRandom, NDisorder, direction;
+#pragma omp master
+  std::cout << "Calculating the optical conductivity.\n";
+#pragma omp critical
+  {
+    auto *file = new H5::H5File(name, H5F_ACC_RDONLY);
+    get_hdf5<int>(&direction, file, (char *) "/Calculation/conductivity_optical/Direction");
+    get_hdf5<int>(&NMoments,  file, (char *) "/Calculation/conductivity_optical/NumMoments");
+    get_hdf5<int>(&NRandom,   file, (char *) "/Calculation/conductivity_optical/NumRandoms");
+    get_hdf5<int>(&NDisorder, file, (char *) "/Calculation/conductivity_optical/NumDisorder");
+    file->close();
+    delete file;
+  }
+  std::string dir(num2str2(direction));
+  std::string dirc = dir.substr(0,1)+","+dir.substr(1,2);
+  Gamma1D(NRandom*NDisorder, NMoments, process_string(dir), "/Calculation/conductivity_optical/Lambda"+dir);
+  Gamma2D(NRandom*NDisorder, NMoments, process_string(dirc), "/Calculation/conductivity_optical/Gamma"+dir);
+}
+
+template <typename T,unsigned D>
+void SparseSimulation<T,D>::calc_unsupported(){
+  for(std::string calculation : {"ldos", "arpes", "gaussian_wave_packet", "singleshot_conductivity_dc",
+                                 "singleshot_conductivity_optical", "conductivity_optical_nonlinear",
+                                 "bond_currents", "chern_marker", "hartree"})
+    if(requested(calculation))
+      {
+#pragma omp master
+        std::cout << "The calculation " << calculation << " is not available for sparse Hamiltonians. Skipping.\n";
+      }
+}
+
+template <typename T,unsigned D>
+void SparseSimulation<T,D>::Gamma1D(int NRandomV, int N_moments, std::vector<std::vector<unsigned>> indices,
+                                    std::string name_dataset){
+  // Same moments as Simulation::Gamma1D: <r| v^a T_n(H) v^b |r>
+  int num_velocities = 0;
+  for(auto & indice : indices)
+    num_velocities += static_cast<int>(indice.size());
+  int factor = 1 - (num_velocities % 2)*2;
+
+  for(unsigned it = 0; it < indices.size(); it++)
+    h.build_velocity(indices.at(it), it);
+
+  KPM_SparseVector<T,D> kpm0(1, *this);
+  KPM_SparseVector<T,D> kpm1(2, *this);
+
+  Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> gamma = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic >::Zero(1, N_moments + N_moments % 2);
+  Eigen::Matrix<T, 1, 2> tmp;
+
+  for(int randV = 0; randV < NRandomV; randV++)
+    {
+      kpm0.initiate_vector();
+      kpm1.set_index(0);
+      kpm1.v.col(0) = kpm0.v.col(0);
+      if(indices.size() != 0)
+        kpm0.Velocity(&kpm1, indices, 0);
+      kpm0.v.col(0) *= T(factor);
+
+      for(int m = 0; m < N_moments; m += 2)
+        {
+          kpm1.cheb_iteration(m);
+          kpm1.cheb_iteration(m + 1);
+          tmp = kpm0.v.col(0).head(h.N).adjoint() * kpm1.v.topRows(h.N);
+          gamma.matrix().block(0, m, 1, 2) += (tmp - gamma.matrix().block(0, m, 1, 2))/value_type(randV + 1);
+        }
+    }
+
+  gamma.conservativeResize(1, N_moments);
+  store_gamma(&gamma, N_moments, indices, name_dataset);
+#pragma omp master
+  {
+    H5::H5File * file = new H5::H5File(name, H5F_ACC_RDWR);
+    write_samples(file, name_dataset, long(NRandomV));
+    delete file;
+  }
+#pragma omp barrier
+}
+
+template <typename T,unsigned D>
+void SparseSimulation<T,D>::Gamma2D(int NRandomV, int N_moments, std::vector<std::vector<unsigned>> indices,
+                                    std::string name_dataset){
+  // Same moments as Simulation::Gamma2D: G_nm = <r| v^a T_n(H) v^b T_m(H) |r>,
+  // MEMORY moments at a time on each side. The moments are padded to a multiple of MEMORY and the
+  // extra ones are dropped before storing
+  Eigen::Matrix<T, MEMORY, MEMORY> tmp;
+  int NPadded = (N_moments + MEMORY - 1)/MEMORY*MEMORY;
+
+  for(unsigned it = 0; it < indices.size(); it++)
+    h.build_velocity(indices.at(it), it);
+
+  KPM_SparseVector<T,D> kpm0(1, *this);      // initial random vector
+  KPM_SparseVector<T,D> kpm1(2, *this);      // left vector that will be Chebyshev-iterated on
+  KPM_SparseVector<T,D> kpm2(MEMORY, *this); // right vector that will be Chebyshev-iterated on
+  KPM_SparseVector<T,D> kpm3(MEMORY, *this); // kpm1 multiplied by the velocity
+
+  Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> gamma = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic >::Zero(NPadded, NPadded);
+
+  for(int randV = 0; randV < NRandomV; randV++)
+    {
+      kpm0.initiate_vector();
+      kpm1.set_index(0);
+      kpm0.Velocity(&kpm1, indices, 0);
+
+      for(int n = 0; n < NPadded; n += MEMORY)
+        {
+          for(int i = n; i < n + MEMORY; i++)
+            {
+              kpm1.cheb_iteration(i);
+              kpm3.set_index(i%MEMORY);
+              kpm1.Velocity(&kpm3, indices, 1);
+            }
+
+          kpm2.set_index(0);
+          kpm2.v.col(0) = kpm0.v.col(0);
+          for(int m = 0; m < NPadded; m += MEMORY)
+            {
+              for(int i = m; i < m + MEMORY; i++)
+                kpm2.cheb_iteration(i);
+
+              tmp = kpm3.v.topRows(h.N).adjoint() * kpm2.v.topRows(h.N);
+              gamma.block(n, m, MEMORY, MEMORY) += (tmp.array() - gamma.block(n, m, MEMORY, MEMORY))/value_type(randV + 1);
+            }
+        }
+    }
+
+  int num_velocities = 0;
+  for(auto & indice : indices)
+    num_velocities += static_cast<int>(indice.size());
+  // Column-major, so the N_moments x N_moments block is G_nm at (m*N_moments + n) as before
+  Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> cropped = gamma.topLeftCorner(N_moments, N_moments)*T(1 - (num_velocities % 2)*2);
+  store_gamma(&cropped, N_moments, indices, name_dataset);
+#pragma omp master
+  {
+    H5::H5File * file = new H5::H5File(name, H5F_ACC_RDWR);
+    write_samples(file, name_dataset, long(NRandomV));
+    delete file;
+  }
+#pragma omp barrier
+}
+
+template <typename T,unsigned D>
+void SparseSimulation<T,D>::store_gamma(Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> *gamma, int N_moments,
+                                        std::vector<std::vector<unsigned>> indices, std::string name_dataset){
+  // Sum the contributions of all the threads, as in Simulation::store_gamma
+  int num_velocities = 0;
+  for(auto & indice : indices)
+    num_velocities += static_cast<int>(indice.size());
+  int factor = 1 - (num_velocities % 2)*2;
+
+  if(indices.size() == 2)
+    {
+      Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic> general_gamma = Eigen::Map<Eigen::Array<T,Eigen::Dynamic,Eigen::Dynamic>>(gamma->data(), N_moments, N_moments);
+#pragma omp master
+      Global.general_gamma = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic > :: Zero(N_moments, N_moments);
+#pragma omp barrier
+#pragma omp critical
+      Global.general_gamma.matrix() += (general_gamma.matrix() + T(factor)*general_gamma.matrix().adjoint())/value_type(2);
+#pragma omp barrier
+    }
+  else
+    {
+#pragma omp master
+      Global.general_gamma = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic > :: Zero(1, N_moments);
+#pragma omp barrier
+#pragma omp critical
+      Global.general_gamma += *gamma;
+#pragma omp barrier
+    }
+
+#pragma omp master
+  {
+    H5::H5File * file = new H5::H5File(name, H5F_ACC_RDWR);
+    write_hdf5(Global.general_gamma, file, name_dataset);
+    delete file;
+  }
+#pragma omp barrier
+}
+
+template class SparseSimulation<float ,1u>;
+template class SparseSimulation<double ,1u>;
+template class SparseSimulation<long double ,1u>;
+template class SparseSimulation<std::complex<float> ,1u>;
+template class SparseSimulation<std::complex<double> ,1u>;
+template class SparseSimulation<std::complex<long double> ,1u>;
+template class SparseSimulation<float ,2u>;
+template class SparseSimulation<double ,2u>;
+template class SparseSimulation<long double ,2u>;
+template class SparseSimulation<std::complex<float> ,2u>;
+template class SparseSimulation<std::complex<double> ,2u>;
+template class SparseSimulation<std::complex<long double> ,2u>;
+template class SparseSimulation<float ,3u>;
+template class SparseSimulation<double ,3u>;
+template class SparseSimulation<long double ,3u>;
+template class SparseSimulation<std::complex<float> ,3u>;
+template class SparseSimulation<std::complex<double> ,3u>;
+template class SparseSimulation<std::complex<long double> ,3u>;
+
+template class GlobalSparseSimulation<float ,1u>;
+template class GlobalSparseSimulation<double ,1u>;
+template class GlobalSparseSimulation<long double ,1u>;
+template class GlobalSparseSimulation<std::complex<float> ,1u>;
+template class GlobalSparseSimulation<std::complex<double> ,1u>;
+template class GlobalSparseSimulation<std::complex<long double> ,1u>;
+template class GlobalSparseSimulation<float ,2u>;
+template class GlobalSparseSimulation<double ,2u>;
+template class GlobalSparseSimulation<long double ,2u>;
+template class GlobalSparseSimulation<std::complex<float> ,2u>;
+template class GlobalSparseSimulation<std::complex<double> ,2u>;
+template class GlobalSparseSimulation<std::complex<long double> ,2u>;
+template class GlobalSparseSimulation<float ,3u>;
+template class GlobalSparseSimulation<double ,3u>;
+template class GlobalSparseSimulation<long double ,3u>;
+template class GlobalSparseSimulation<std::complex<float> ,3u>;
+template class GlobalSparseSimulation<std::complex<double> ,3u>;
+template class GlobalSparseSimulation<std::complex<long double> ,3u>;
@@ -28,59 +28,150 @@ template <typename T,unsigned D>
 
 void Simulation<T,D>::Gamma1D(int NRandomV, int NDisorder, int N_moments,
     std::vector<std::vector<unsigned>> indices, std::string name_dataset){
+  // A sweep with a single consumer (see Gamma1DFused), so that the moments are the same numbers
+  // whether they are calculated alone or together with others
+  std::vector<unsigned> components;
+  if(!indices.empty())
+    components = indices.at(0);
+  Gamma1DFused(NRandomV, NDisorder, {N_moments}, {components}, {name_dataset});
+}
 
-  int num_velocities = 0;
-  for(auto & indice : indices)
-    num_velocities += static_cast<int>(indice.size());
-  int factor = 1 - (num_velocities % 2)*2;
-    
-  // Initialize the KPM vectors that will be needed to run the 1D Gamma matrix
-  KPM_Vector<T,D> kpm0(1, *this);
-  KPM_Vector<T,D> kpm1(2, *this);
-		
-  // Make sure the local gamma matrix is zeroed
-  Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> gamma = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic >::Zero(1, N_moments);
-  Eigen::Matrix<T, 1, 2> tmp =  Eigen::Matrix < T, 1, 2> ::Zero();		
+
+template <typename T,unsigned D>
+void Simulation<T,D>::Gamma1DFused(int NRandomV, int NDisorder, std::vector<int> N_moments,
+    std::vector<std::vector<unsigned>> indices, std::vector<std::string> names_dataset){
+  // One Chebyshev sweep T_n|r> shared by several one-dimensional moments Tr[v_c T_n], where v_c
+  // is the generalized velocity with the components indices[c] (none for the DOS). A velocity
+  // with k components is (anti-)Hermitian, v_c^dagger = (-1)^k v_c, so the moments are
+  // <v_c r|T_n|r>, using the same random vector for all of them. The slot c can also hold an
+  // orbital operator (see Hamiltonian::set_operator), which keeps this symmetry.
+  // Every consumer only uses its own dot products, so its moments do not depend on the others.
+  const std::size_t n_consumers = names_dataset.size();
+  const int N_max = *std::max_element(N_moments.begin(), N_moments.end());
+
+  // Without velocity and operator, the moments follow from T_2n = 2 T_n T_n - T_0 and
+  // T_2n-1 = 2 T_n T_n-1 - T_1: <r|T_2n|r> and <r|T_2n-1|r> are the norm of T_n|r> and its overlap
+  // with T_n-1|r>, so only half of the iterations are needed. This holds for any Hermitian H and any vector.
+  // With chiral symmetry the trace of every odd Chebyshev polynomial vanishes, so the odd moments
+  // are set to zero. This holds on average over random vectors, not for the test vectors chosen with SEED
+  std::vector<bool> doubling(n_consumers);
+  std::vector<int> column(n_consumers, -1);
+  int N_sweep = 0, N_doubling = 0, num_columns = 0;
+  for(std::size_t c = 0; c < n_consumers; c++)
+    {
+      doubling.at(c) = indices.at(c).empty() && !h.has_operator(static_cast<unsigned>(c));
+      if(doubling.at(c))
+        N_doubling = std::max(N_doubling, N_moments.at(c)/2 + 1);
+      else
+        column.at(c) = num_columns++;
+      N_sweep = std::max(N_sweep, doubling.at(c) ? N_moments.at(c)/2 + 1 : N_moments.at(c));
+    }
+  char *env = getenv("SEED");
+  std::string seed(env != NULL ? env : "");
+  const bool chiral = N_doubling > 0 && h.is_chiral && seed != "ones" && seed != "deterministic";
+  
+  // Iterate only the first copy of each decoupled sector (see Hamiltonian::build_sectors),
+  // unless the orbital operators could mix them
+  h.use_sectors = h.reduced_sectors && !h.operators_set;
+#pragma omp master
+  {
+    if(h.use_sectors)
+      std::cout << "The Hamiltonian has identical decoupled sectors: iterating only one copy of each.\n";
+    if(chiral)
+      std::cout << "The Hamiltonian has chiral symmetry: computing only the even moments.\n";
+  }
+
+  KPM_Vector<T,D> kpm1(2, *this);                                    // Chebyshev-iterated vector
+  KPM_Vector<T,D> kpmv(std::max(num_columns, 1), *this);             // v_c |r> for each consumer
+
+  Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> gamma = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic >::Zero(n_consumers, N_max);
+  Coordinates<std::size_t, D + 1> x(r.Ld);
 
   long average = 0;
   for(int disorder = 0; disorder < NDisorder; disorder++){
     h.generate_disorder();
-    
     for(unsigned it = 0; it < indices.size(); it++)
       h.build_velocity(indices.at(it), it);
-    
+
     for(int randV = 0; randV < NRandomV; randV++)
       {
-	/* Note: Still need to include in Gamma2D and Gamma3D */
-	h.generate_twists(); // Generates Random or fixed boundaries	
-	kpm0.initiate_vector();   // original random vector
-	kpm1.initiate_phases();   //Initiates the Hopping Phases in KPM1
-	
-	kpm1.set_index(0);
-	kpm1.v.col(0) = kpm0.v.col(0);
+	h.generate_twists(); // Generates Random or fixed boundaries
+	kpm1.initiate_vector();
+	kpm1.initiate_phases();
+	kpmv.initiate_phases();
+	// The velocities and the first iteration read the ghosts of the random vector
 	kpm1.Exchange_Boundaries();
-	
-	if(indices.size() != 0)
-	  kpm0.Velocity(&kpm1, indices, 0);
-	
-	kpm0.v.col(0) = factor*kpm0.v.col(0); // This factor is due to the fact that this Velocity operator is not self-adjoint
-	kpm0.empty_ghosts(0);
-
-	for(int m = 0; m < N_moments; m += 2)
+
+	for(std::size_t c = 0; c < n_consumers; c++)
+	  if(!doubling.at(c))
+	    {
+	      kpmv.set_index(column.at(c));
+	      kpm1.Velocity(&kpmv, indices, static_cast<int>(c));
+	      kpmv.empty_ghosts(column.at(c));
+	    }
+
+	T mu0 = 0, mu1 = 0;
+	for(int n = 0; n < N_sweep; n++)
 	  {
-	    kpm1.cheb_iteration(m);
-	    kpm1.cheb_iteration(m+1);
-	    tmp.setZero();
-	    for(std::size_t ii = 0; ii < r.Sized ; ii += r.Ld[0])
-	      tmp += kpm0.v.block(ii,0, r.Ld[0], 1).adjoint() * kpm1.v.block(ii, 0, r.Ld[0], 2);
+	    kpm1.cheb_iteration(n);
+	    const unsigned idx = kpm1.get_index();
 	    
-	    gamma.matrix().block(0,m,1,2) += (tmp - gamma.matrix().block(0,m,1,2))/value_type(average + 1);
+	    if(n < N_doubling)
+	      {
+		// Norm of T_n and overlap with T_n-1, without the ghosts: the rows starting in the ghosts
+		// are skipped, and the padding and the ghosts along the rows are zero or excluded by lr
+		T norm = 0, overlap = 0;
+		for(std::size_t ii = 0; ii < r.Sized ; ii += r.Ld[0])
+		  {
+		    x.set_coord(ii + NGHOSTS);
+		    if(r.test_ghosts(x))
+		      {
+			norm += kpm1.v.col(idx).segment(ii + NGHOSTS, r.lr[0]).squaredNorm();
+			if(n > 0 && !chiral)
+			  overlap += kpm1.v.col(idx).segment(ii + NGHOSTS, r.lr[0]).dot(kpm1.v.col(1 - idx).segment(ii + NGHOSTS, r.lr[0]));
+		      }
+		  }
+		if(n == 0)
+		  mu0 = norm;
+		if(n == 1)
+		  mu1 = overlap;
+		for(std::size_t c = 0; c < n_consumers; c++)
+		  if(doubling.at(c))
+		    {
+		      if(2*n < N_moments.at(c))
+			gamma(c,2*n) += (value_type(2)*norm - mu0 - gamma(c,2*n))/value_type(average + 1);
+		      if(n > 0 && 2*n - 1 < N_moments.at(c))
+			gamma(c,2*n - 1) += ((chiral? T(0) : value_type(2)*overlap - mu1) - gamma(c,2*n - 1))/value_type(average + 1);
+		    }
+	      }
+
+	    // The ghosts of kpmv are empty
+	    for(std::size_t c = 0; c < n_consumers; c++)
+	      if(!doubling.at(c) && n < N_moments.at(c))
+		{
+		  T tmp = 0;
+		  for(std::size_t ii = 0; ii < r.Sized ; ii += r.Ld[0])
+		    tmp += kpmv.v.col(column.at(c)).segment(ii, r.Ld[0]).dot(kpm1.v.col(idx).segment(ii, r.Ld[0]));
+		  gamma(c,n) += (tmp - gamma(c,n))/value_type(average + 1);
+		}
 	  }
 	average++;
       }
-  } 
-  
-  store_gamma1D(&gamma, name_dataset);
+  }
+
+  h.use_sectors = false;
+  for(std::size_t c = 0; c < n_consumers; c++)
+    {
+      Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> gamma_c = gamma.block(c, 0, 1, N_moments.at(c));
+      store_gamma1D(&gamma_c, names_dataset.at(c));
+#pragma omp master
+      {
+	H5::H5File * file = new H5::H5File(name, H5F_ACC_RDWR);
+	write_samples(file, names_dataset.at(c), long(NRandomV)*NDisorder);
+	delete file;
+      }
+#pragma omp barrier
+    }
 }
 
 
@@ -132,6 +223,25 @@ template void Simulation<std::complex<float>,3u>::Gamma1D(int, int, int, std::ve
 template void Simulation<std::complex<double>,3u>::Gamma1D(int, int, int, std::vector<std::vector<unsigned>>, std::string);
 template void Simulation<std::complex<long double>,3u>::Gamma1D(int, int, int, std::vector<std::vector<unsigned>>, std::string);
 
+template void Simulation<float,1u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<double,1u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<long double,1u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<std::complex<float>,1u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<std::complex<double>,1u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<std::complex<long double>,1u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<float,2u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<double,2u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<long double,2u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<std::complex<float>,2u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<std::complex<double>,2u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<std::complex<long double>,2u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<float,3u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<double,3u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<long double,3u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<std::complex<float>,3u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<std::complex<double>,3u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+template void Simulation<std::complex<long double>,3u>::Gamma1DFused(int, int, std::vector<int>, std::vector<std::vector<unsigned>>, std::vector<std::string>);
+
 template void Simulation<float,1u>::store_gamma1D(Eigen::Array<float, -1, -1>* , std::string);
 template void Simulation<double,1u>::store_gamma1D(Eigen::Array<double, -1, -1>* , std::string);
 template void Simulation<long double,1u>::store_gamma1D(Eigen::Array<long double, -1, -1>* , std::string);
@@ -155,4 +265,4 @@ template void Simulation<std::complex<long double>,3u>::store_gamma1D(Eigen::Arr
 #define instantiate(type, dim)  template void Simulation<type,dim>::Gamma1D(int, int, int, std::vector<std::vector<unsigned>>, std::string); \
   template void Simulation<type,dim>::store_gamma1D(Eigen::Array<type, Eigen::Dynamic, Eigen::Dynamic>* , std::string);
 #include "tools/instantiate.hpp"
-*/
\ No newline at end of file
+*/
@@ -55,6 +55,13 @@ void Simulation<T,D>::Gamma2D(int NRandomV, int NDisorder, std::vector<int> N_mo
     num_velocities += static_cast<int>(indice.size());
   int factor = 1 - (num_velocities % 2)*2;
 
+  // Iterate only the first copy of each decoupled sector (see Hamiltonian::build_sectors),
+  // unless the orbital operators could mix them
+  h.use_sectors = h.reduced_sectors && !h.operators_set;
+#pragma omp master
+  if(h.use_sectors)
+    std::cout << "The Hamiltonian has identical decoupled sectors: iterating only one copy of each.\n";
+  
   //  --------- INITIALIZATIONS --------------
     
   KPM_Vector<T,D> kpm0(1, *this);      // initial random vector
@@ -144,7 +151,15 @@ void Simulation<T,D>::Gamma2D(int NRandomV, int NDisorder, std::vector<int> N_mo
   } 
   gamma = gamma*factor;
   
+  h.use_sectors = false;
   store_gamma(&gamma, N_moments, indices, name_dataset);
+#pragma omp master
+  {
+    H5::H5File * file = new H5::H5File(name, H5F_ACC_RDWR);
+    write_samples(file, name_dataset, long(NRandomV)*NDisorder);
+    delete file;
+  }
+#pragma omp barrier
 }
 
 
@@ -72,6 +72,13 @@ void Simulation<T,D>::Gamma3D(int NRandomV, int NDisorder, std::vector<int> N_mo
     
   typedef typename extract_value_type<T>::value_type value_type;
     
+  // Iterate only the first copy of each decoupled sector (see Hamiltonian::build_sectors),
+  // unless the orbital operators could mix them
+  h.use_sectors = h.reduced_sectors && !h.operators_set;
+#pragma omp master
+  if(h.use_sectors)
+    std::cout << "The Hamiltonian has identical decoupled sectors: iterating only one copy of each.\n";
+  
   //  --------- INITIALIZATIONS --------------
     
   KPM_Vector<T,D> kpm0(1, *this);           // initial random vector
@@ -179,10 +186,14 @@ void Simulation<T,D>::Gamma3D(int NRandomV, int NDisorder, std::vector<int> N_mo
           average++;
         }
     } 
+  h.use_sectors = false;
 #pragma omp master
   {
     store_gamma3D(&Global.general_gamma, N_moments, indices, name_dataset);
-    
+
+    H5::H5File * file = new H5::H5File(name, H5F_ACC_RDWR);
+    write_samples(file, name_dataset, long(NRandomV)*NDisorder);
+    delete file;
   }
 #pragma omp barrier
 }
@@ -118,6 +118,59 @@ write_hdf5(const Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic > & mu, H5::H5Fi
 }
 
 
+void write_samples(H5::H5File * file, const std::string name, long samples)
+{
+  // Number of random vectors (times disorder realizations) averaged in the moments of the dataset,
+  // and the SEED they were generated with, so that independent runs can be merged afterwards
+  char *env = getenv("SEED");
+  std::string seed(env != NULL ? env : "random");
+
+  H5::DataSet dataset = file->openDataSet(name);
+  H5::DataSpace scalar(H5S_SCALAR);
+  H5::StrType string_type(H5::PredType::C_S1, std::max<size_t>(1, seed.size()));
+  try {
+    H5::Exception::dontPrint();
+    dataset.removeAttr("NumSamples");
+    dataset.removeAttr("Seed");
+  }
+  catch (H5::Exception&) {}
+
+  dataset.createAttribute("NumSamples", H5::PredType::NATIVE_LONG, scalar).write(H5::PredType::NATIVE_LONG, &samples);
+  dataset.createAttribute("Seed", string_type, scalar).write(string_type, seed);
+}
+
+
+void write_map(const double * data, const std::vector<hsize_t> & dims, H5::H5File * file, const std::string name)
+{
+  // Maps over the lattice are stored chunked and compressed. The coordinates of the sample are the
+  // last dimensions, and each chunk holds at most 2^20 elements of a single slice of them
+  const hsize_t max_chunk = 1 << 20;
+  std::vector<hsize_t> chunk_dims(dims.size(), 1);
+  hsize_t size = 1;
+  for(std::size_t i = dims.size(); i-- > 0; )
+    {
+      chunk_dims[i] = std::max<hsize_t>(1, std::min(dims[i], max_chunk / size));
+      size *= chunk_dims[i];
+    }
+  
+  H5::DataSet dataset;
+  H5::DataSpace dataspace = H5::DataSpace(int(dims.size()), dims.data());
+  H5::DSetCreatPropList plist;
+  plist.setChunk(int(dims.size()), chunk_dims.data());
+  if(H5Zfilter_avail(H5Z_FILTER_DEFLATE))
+    plist.setDeflate(6);
+  
+  try {
+    H5::Exception::dontPrint();
+    dataset = file->createDataSet(name, H5::PredType::NATIVE_DOUBLE, dataspace, plist);
+  }
+  catch (H5::FileIException&) {
+    dataset = file->openDataSet(name);
+  }
+  
+  dataset.write(data, H5::PredType::NATIVE_DOUBLE);
+}
+
 #define instantiateTYPE(type)              template void get_hdf5<type>(type *, H5::H5File *, char * ); \
   template void get_hdf5<type>(type *, H5::H5File*, std::string &);	\
   template void write_hdf5(const Eigen::Array<type, Eigen::Dynamic, Eigen::Dynamic > & , H5::H5File * , const std::string );
@@ -0,0 +1,157 @@
+/***********************************************************/
+/*                                                         */
+/*   Copyright (C) 2018-2022, M. Andelkovic, L. Covaci,    */
+/*  A. Ferreira, S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                         */
+/***********************************************************/
+
+#include "Generic.hpp"
+#include "simulation/Global.hpp"
+#include "tools/ComplexTraits.hpp"
+#include "tools/Random.hpp"
+#include "lattice/SparseStructure.hpp"
+#include "hamiltonian/HamiltonianSparse.hpp"
+#include "vector/KPM_SparseVector.hpp"
+#include "simulation/SimulationSparse.hpp"
+
+template <typename T, unsigned D>
+KPM_SparseVector<T,D>::KPM_SparseVector(int mem, SparseSimulation<T,D> & sim) : memory(mem), simul(sim), h(sim.h)
+{
+  index = 0;
+  v = Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic>::Zero(h.Nd, memory);
+}
+
+template <typename T, unsigned D>
+void KPM_SparseVector<T,D>::set_index(int i) {
+  index = i;
+}
+
+template <typename T, unsigned D>
+void KPM_SparseVector<T,D>::inc_index() {
+  index = (index + 1) % memory;
+}
+
+template <typename T, unsigned D>
+void KPM_SparseVector<T,D>::dec_index() {
+  index = (index + memory - 1) % memory;
+}
+
+template <typename T, unsigned D>
+unsigned KPM_SparseVector<T,D>::get_index() {
+  return index;
+}
+
+template <typename T, unsigned D>
+void KPM_SparseVector<T,D>::initiate_vector() {
+  index = 0;
+
+  // Same test vectors as KPM_Vector::initiate_vector
+  char *env = getenv("SEED");
+  std::string seed(env != NULL ? env : "");
+  const value_type norm = static_cast<value_type>(sqrt(value_type(h.s.Nt)));
+
+  v.col(index).setZero();
+  if(seed == "deterministic")
+    {
+      if(h.N > 0 && h.site[0] == 0)
+        v(0, index) = 1;
+    }
+  else if(seed == "ones")
+    v.col(index).head(h.N).setConstant(value_type(1)/norm);
+  else
+    for(std::size_t i = 0; i < h.N; i++)
+      v(i, index) = simul.rnd.init()/norm;
+
+  Exchange_Boundaries();
+}
+
+template <typename T, unsigned D>
+template <unsigned MULT, bool VELOCITY>
+void KPM_SparseVector<T,D>::KPM_MOTOR(KPM_SparseVector<T,D> * kpm_final, unsigned axis)
+{
+  T * phi0 = kpm_final->v.col(kpm_final->index).data();
+  const T * phiM1 = v.col((memory - 1 + index) % memory).data();
+  const T * phiM2 = v.col((memory - 2 + index) % memory).data();
+
+  for(std::size_t i = 0; i < h.N; i++)
+    {
+      T sum = 0;
+      for(std::size_t k = h.row[i]; k < h.row[i + 1]; k++)
+        if(VELOCITY)
+          sum += h.v[axis][k] * h.hopping[k] * phiM1[h.column[k]];
+        else
+          sum += h.hopping[k] * phiM1[h.column[k]];
+
+      if(MULT == 1)
+        phi0[i] = value_type(2) * sum - phiM2[i];
+      else
+        phi0[i] = sum;
+    }
+
+  kpm_final->Exchange_Boundaries();
+}
+
+template <typename T, unsigned D>
+template <unsigned MULT>
+void KPM_SparseVector<T,D>::Multiply() {
+  inc_index();
+  KPM_MOTOR<MULT, false>(this, 0);
+}
+
+template <typename T, unsigned D>
+void KPM_SparseVector<T,D>::Velocity(KPM_SparseVector<T,D> * kpm_final, std::vector<std::vector<unsigned>> & indices, int pos)
+{
+  if(indices.at(pos).size() == 0)
+    return;
+  inc_index();
+  KPM_MOTOR<0u, true>(kpm_final, static_cast<unsigned>(pos));
+  dec_index();
+}
+
+template <typename T, unsigned D>
+void KPM_SparseVector<T,D>::cheb_iteration(unsigned n)
+{
+  switch(n)
+    {
+    case 0:
+      break;
+    case 1:
+      Multiply<0>();
+      break;
+    default:
+      Multiply<1>();
+    }
+}
+
+template <typename T, unsigned D>
+void KPM_SparseVector<T,D>::Exchange_Boundaries()
+{
+  // The owned sites in the halos of other threads are copied to the shared buffer,
+  // and the halo of this thread is read from it
+  T * phi = v.col(index).data();
+  for(std::size_t b = 0; b < h.border.size(); b++)
+    h.s.buffer[h.border_slot[b]] = phi[h.border[b]];
+#pragma omp barrier
+  for(std::size_t k = 0; k < h.halo_slot.size(); k++)
+    phi[h.N + k] = h.s.buffer[h.halo_slot[k]];
+#pragma omp barrier
+}
+
+template class KPM_SparseVector<float,1u>;
+template class KPM_SparseVector<double,1u>;
+template class KPM_SparseVector<long double,1u>;
+template class KPM_SparseVector<std::complex<float>,1u>;
+template class KPM_SparseVector<std::complex<double>,1u>;
+template class KPM_SparseVector<std::complex<long double>,1u>;
+template class KPM_SparseVector<float,2u>;
+template class KPM_SparseVector<double,2u>;
+template class KPM_SparseVector<long double,2u>;
+template class KPM_SparseVector<std::complex<float>,2u>;
+template class KPM_SparseVector<std::complex<double>,2u>;
+template class KPM_SparseVector<std::complex<long double>,2u>;
+template class KPM_SparseVector<float,3u>;
+template class KPM_SparseVector<double,3u>;
+template class KPM_SparseVector<long double,3u>;
+template class KPM_SparseVector<std::complex<float>,3u>;
+template class KPM_SparseVector<std::complex<double>,3u>;
+template class KPM_SparseVector<std::complex<long double>,3u>;
@@ -93,6 +93,14 @@ void KPM_Vector<T,D>::measure_wave_packet(T * bra, T * ket, T * results){
   (void) results;
 }
 
+template <typename T, unsigned D>
+void KPM_Vector<T,D>::bond_currents(const T * psi, const T * chi, std::size_t NBonds, double * map){
+  (void) psi;
+  (void) chi;
+  (void) NBonds;
+  (void) map;
+}
+
 template <typename T, unsigned D>
 void KPM_Vector<T,D>::Exchange_Boundaries(){}
 
@@ -39,12 +39,19 @@ KPM_Vector<T,2u>::KPM_Vector(int mem, Simulation<T,2> & sim) :
     Coordinates <std::size_t, 3>     z(r.Ld);
     Coordinates <int, 3> x(r.nd), dist(r.nd);
     
+    // With TILE_ORDER == 1 the phases of every row of tiles are kept (see build_phase_rows)
+    const std::size_t num_rows = (TILE_ORDER == 1 ? (r.lr[1] + TILE - 1) / TILE : 1);
+    phase_rows = new T**[r.Orb];
     mult_t1_ghost_cor = new T**[r.Orb];
     for(unsigned io = 0; io < r.Orb; io++)
       {
+	phase_rows[io] = new T*[h.hr.NHoppings(io)];
 	mult_t1_ghost_cor[io] = new T*[h.hr.NHoppings(io)];
 	for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
-	  mult_t1_ghost_cor[io][ib] = new T[TILE];
+	  {
+	    phase_rows[io][ib] = new T[num_rows * TILE];
+	    mult_t1_ghost_cor[io][ib] = phase_rows[io][ib];
+	  }
       }
     
     for(unsigned d = 0; d < 2; d++)
@@ -68,10 +75,10 @@ KPM_Vector<T,2u>::KPM_Vector(int mem, Simulation<T,2> & sim) :
 	d = 0;
 	// Position of initial corner to copy the source
 	MemIndBeg[d][0][io] = z.set({std::size_t(NGHOSTS),               std::size_t(NGHOSTS), io}).index;   
-	MemIndBeg[d][1][io] = z.set({std::size_t(r.Ld[0] - 2 * NGHOSTS), std::size_t(NGHOSTS), io}).index;   
+	MemIndBeg[d][1][io] = z.set({std::size_t(r.lr[0]),               std::size_t(NGHOSTS), io}).index;   
 	// Position of initial corner to copy to the destiny 
 	MemIndEnd[d][0][io] = z.set({std::size_t(0),                     std::size_t(NGHOSTS), io}).index;   
-	MemIndEnd[d][1][io] = z.set({std::size_t(r.Ld[0] - NGHOSTS),     std::size_t(NGHOSTS), io}).index;   
+	MemIndEnd[d][1][io] = z.set({std::size_t(r.lr[0] + NGHOSTS),     std::size_t(NGHOSTS), io}).index;   
 	
 	d = 1;
 	// Bottom edge 
@@ -83,12 +90,12 @@ KPM_Vector<T,2u>::KPM_Vector(int mem, Simulation<T,2> & sim) :
 	    MemIndEnd[1][0][io] = z.set({std::size_t(0), std::size_t(0),                   io}).index;
 	  } 
 	// Top Edge 
-	MemIndBeg[d][1][io] = z.set({std::size_t(NGHOSTS), std::size_t(r.Ld[1] - 2*NGHOSTS), io}).index;
-	MemIndEnd[d][1][io] = z.set({std::size_t(NGHOSTS), std::size_t(r.Ld[1] - NGHOSTS),   io}).index;
+	MemIndBeg[d][1][io] = z.set({std::size_t(NGHOSTS), std::size_t(r.lr[1]),             io}).index;
+	MemIndEnd[d][1][io] = z.set({std::size_t(NGHOSTS), std::size_t(r.lr[1] + NGHOSTS),   io}).index;
 	if(r.boundary[1][1] == 1 && r.boundary[0][0] == 1) // Add the Left bottom Corner
 	  {
-	    MemIndBeg[1][1][io] = z.set({std::size_t(0), std::size_t(r.Ld[1] - 2*NGHOSTS), io}).index;
-	    MemIndEnd[1][1][io] = z.set({std::size_t(0), std::size_t(r.Ld[1] - NGHOSTS),   io}).index;
+	    MemIndBeg[1][1][io] = z.set({std::size_t(0), std::size_t(r.lr[1]),             io}).index;
+	    MemIndEnd[1][1][io] = z.set({std::size_t(0), std::size_t(r.lr[1] + NGHOSTS),   io}).index;
 	  }
       }
     
@@ -103,7 +110,10 @@ KPM_Vector<T,2u>::KPM_Vector(int mem, Simulation<T,2> & sim) :
     // JPPP Calcular os vectores das fases devido às condicoes fronteira
     for(unsigned i = 0; i < D; i ++)
       for(unsigned j = 0; j < 3; j ++)
-	Fact_Bnd[i][j] = new T[r.Ld[i]];
+	{
+	  Fact_Bnd[i][j] = new T[r.Ld[i]];
+	  Twist_Tile[i][j] = new bool[r.lStr[i]];
+	}
     
     initiate_vector();
   }
@@ -119,10 +129,16 @@ KPM_Vector <T, 2>::~KPM_Vector(void){
   for(unsigned io = 0; io < r.Orb;io++)
     {	
       for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
-        delete mult_t1_ghost_cor[io][ib];
-      delete mult_t1_ghost_cor[io];
+        delete [] phase_rows[io][ib];
+      delete [] phase_rows[io];
+      delete [] mult_t1_ghost_cor[io];
     }
-  delete mult_t1_ghost_cor;
+  delete [] phase_rows;
+  delete [] mult_t1_ghost_cor;
+
+  for(unsigned d = 0; d < D; d++)
+    for(unsigned j = 0; j < 3; j++)
+      delete [] Twist_Tile[d][j];
 }
 
 template <typename T>
@@ -156,8 +172,8 @@ void KPM_Vector <T, 2>::initiate_vector() {
   } else if(seed == "ones"){
       Coordinates<std::size_t, 3> x(r.Ld);
       for(std::size_t io = 0; io < r.Orb; io++)
-        for(std::size_t i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1++)
-          for(std::size_t i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0++)
+        for(std::size_t i1 = NGHOSTS; i1 < NGHOSTS + r.lr[1]; i1++)
+          for(std::size_t i0 = NGHOSTS; i0 < NGHOSTS + r.lr[0]; i0++)
             v(x.set({i0,i1,io}).index, index) = 1.0/static_cast<value_type>(sqrt(value_type(r.Sizet - r.SizetVacancies)));
 
 
@@ -166,8 +182,8 @@ void KPM_Vector <T, 2>::initiate_vector() {
       // The RNG is called inside the Random.cpp file, and there the code checks for a SEED again
       Coordinates<std::size_t, 3> x(r.Ld);
       for(std::size_t io = 0; io < r.Orb; io++)
-        for(std::size_t i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1++)
-          for(std::size_t i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0++)
+        for(std::size_t i1 = NGHOSTS; i1 < NGHOSTS + r.lr[1]; i1++)
+          for(std::size_t i0 = NGHOSTS; i0 < NGHOSTS + r.lr[0]; i0++)
             v(x.set({i0,i1,io}).index, index) = simul.rnd.init()/static_cast<value_type>(sqrt(value_type(r.Sizet - r.SizetVacancies)));
   }
 
@@ -180,6 +196,12 @@ void KPM_Vector <T, 2>::initiate_vector() {
       for(unsigned j = 0; j < vv.size(); j++)
         v(vv.at(j), index ) = 0. ;
     }
+
+  // Only the first copy of each decoupled sector is iterated (see Hamiltonian::build_sectors)
+  if(h.use_sectors && seed != "deterministic")
+    for(unsigned io = 0; io < r.Orb; io++)
+      v.col(index).segment(io * r.Nd, r.Nd) *= h.sector_weight.at(io);
+
   initiate_phases();
 }
 
@@ -207,6 +229,17 @@ void KPM_Vector <T, 2>::initiate_phases() {
       }
   }
 
+  // Flag the tiles in which a boundary twist phase is applied. Everywhere else the hoppings
+  // are multiplied without the Fact_Bnd factors (see mult_regular_hoppings)
+  for(unsigned d = 0; d < D; d++)
+    for(unsigned j = 0; j < 3; j++)
+      {
+        std::fill_n(Twist_Tile[d][j], r.lStr[d], false);
+        for(unsigned i = NGHOSTS; i < r.Ld[d] - NGHOSTS; i++)
+          if(Fact_Bnd[d][j][i] != ComplexTraits<T>::assign_value(1.0,0.0))
+            Twist_Tile[d][j][(i - NGHOSTS) / TILE] = true;
+      }
+
   // Testing initiate phases
   unsigned i=2;
 	x.set({0, i, 0});
@@ -247,8 +280,8 @@ void KPM_Vector <T, 2>::build_site(unsigned long pos){
 {
     total_coords.set_coord(pos);
     for(unsigned d = 0; d < 2; d++){
-        T_thread[d] = total_coords.coord[d]/r.ld[d];
-        x_thread[d] = total_coords.coord[d]%r.ld[d];
+        T_thread[d] = r.domain_coordinate(d, total_coords.coord[d]);
+        x_thread[d] = total_coords.coord[d] - r.domain_start(d, unsigned(T_thread[d]));
     }
     T_thread[2] = 0;
     x_thread[2] = total_coords.coord[2];
@@ -297,8 +330,8 @@ void KPM_Vector <T, 2>::build_planewave(Eigen::Matrix<double,Eigen::Dynamic,1> &
         exp_R(io) = static_cast<T>(weight(io)*exp(assign_value(0, 2.0*M_PI*orb_a_coords.col(io).transpose()*k))/static_cast<T>(sqrt(r.Nt)));
 
     // Calculate the exponential related to each unit cell
-    for(std::size_t i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1++)
-      for(std::size_t i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0++)
+    for(std::size_t i1 = NGHOSTS; i1 < NGHOSTS + r.lr[1]; i1++)
+      for(std::size_t i0 = NGHOSTS; i0 < NGHOSTS + r.lr[0]; i0++)
         {
           local_coords.set({i0,i1,std::size_t(0)});
           r.convertCoordinates(global_coords, local_coords);          // Converts the coordinates within a thread to global coordinates
@@ -345,8 +378,8 @@ void KPM_Vector <T, 2>::build_wave_packet(Eigen::Matrix<double,Eigen::Dynamic,Ei
   for(int ik = 0; ik < psi0.cols(); ik++)
     phase(0,ik)  = std::real(simul.Global.mu(ik, 0)) ;
 #pragma omp barrier
-  for(std::size_t i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1++)
-    for(std::size_t i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0++)
+  for(std::size_t i1 = NGHOSTS; i1 < NGHOSTS + r.lr[1]; i1++)
+    for(std::size_t i0 = NGHOSTS; i0 < NGHOSTS + r.lr[0]; i0++)
       {
         x.set({i0,i1,std::size_t(0)});
         r.convertCoordinates(z,x);
@@ -383,8 +416,8 @@ void KPM_Vector <T, 2>::build_wave_packet(Eigen::Matrix<double,Eigen::Dynamic,Ei
   value_type soma2 = sqrt(std::real(soma));
     
   for(std::size_t io = 0; io < r.Orb; io++)
-    for(std::size_t i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1++)
-      for(std::size_t i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0++)
+    for(std::size_t i1 = NGHOSTS; i1 < NGHOSTS + r.lr[1]; i1++)
+      for(std::size_t i0 = NGHOSTS; i0 < NGHOSTS + r.lr[0]; i0++)
         {
           x.set({i0,i1,io});
           v(x.index, 0) /= soma2;
@@ -420,6 +453,13 @@ void KPM_Vector <T, 2>::build_regular_phases(int i1, unsigned axis)
           if (VELOCITY)  tt  *=  h.hr.v.at(axis)(ib,io);
           for(std::size_t j = j0; j < j1; j += std )
             {
+              if(r.field_profile)
+                {
+                  local1.set_coord(j);
+                  mult_t1_ghost_cor[io][ib][count] = tt * h.hr.peierls(ib + io * h.hr.hopping.rows(), local1.coord[1]);
+                  count++;
+                  continue;
+                }
               r.convertCoordinates(global, local1.set_coord(j));
               value_type phase = vee(0)*global.coord[1]*r.ghost_pot(0,1);
               mult_t1_ghost_cor[io][ib][count] =  tt * multEiphase(phase);
@@ -429,6 +469,44 @@ void KPM_Vector <T, 2>::build_regular_phases(int i1, unsigned axis)
     }
 }
 
+template <typename T>
+template < unsigned MULT,bool VELOCITY> 
+void KPM_Vector <T, 2>::build_phase_rows(unsigned axis)
+{
+  /*
+    Along a Morton curve consecutive tiles alternate between rows, and rebuilding the phases
+    at every change costs more than the multiplication itself. With TILE_ORDER == 1 the phases
+    of all the rows are built once per multiplication, as many as in the row-major order
+  */
+#if TILE_ORDER == 1
+  const std::size_t num_rows = (r.lr[1] + TILE - 1) / TILE;
+  for(std::size_t row = 0; row < num_rows; row++)
+    {
+      for(unsigned io = 0; io < r.Orb; io++)
+        for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+          mult_t1_ghost_cor[io][ib] = phase_rows[io][ib] + row * TILE;
+      build_regular_phases<MULT,VELOCITY>(static_cast<int>(row * TILE + NGHOSTS), axis);
+    }
+#else
+  (void) axis;
+#endif
+}
+
+template <typename T>
+template < unsigned MULT,bool VELOCITY> 
+void KPM_Vector <T, 2>::select_phase_row(std::size_t row, unsigned axis)
+{
+  // Phases of the row of tiles that starts at i1 = row * TILE + NGHOSTS
+#if TILE_ORDER == 1
+  (void) axis;
+  for(unsigned io = 0; io < r.Orb; io++)
+    for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+      mult_t1_ghost_cor[io][ib] = phase_rows[io][ib] + row * TILE;
+#else
+  build_regular_phases<MULT,VELOCITY>(static_cast<int>(row * TILE + NGHOSTS), axis);
+#endif
+}
+
 template <typename T>
 template < unsigned MULT> 
 void KPM_Vector <T, 2>::initiate_stride(std::size_t & istr)
@@ -498,6 +576,24 @@ void inline KPM_Vector <T, 2>::mult_regular_hoppings(const  std::size_t & j0, co
       
       count = 0;
       y = 0;
+      
+      // Tiles away from the twisted boundaries: no Fact_Bnd factors, and a real hopping
+      // multiplies the real and imaginary parts of the vector separately
+      if(!Twist_Tile[0][hop[0]][(rr[0] - NGHOSTS) / TILE] && !Twist_Tile[1][hop[1]][(rr[1] - NGHOSTS) / TILE]) {
+        for(std::size_t j = j0; j < j1; j += std ) {
+          const T t1 = mult_t1_ghost_cor[io][ib][count++];
+          if(std::imag(t1) == 0) {
+            const value_type t1r = std::real(t1);
+            for(std::size_t i = j; i < j + TILE ; i++)
+              phi0[i] += t1r * phiM1[i + d1];
+          }
+          else
+            for(std::size_t i = j; i < j + TILE ; i++)
+              phi0[i] += t1 * phiM1[i + d1];
+        };
+        continue;
+      }
+      
       for(std::size_t j = j0; j < j1; j += std ) {
 	const T t1 = mult_t1_ghost_cor[io][ib][count++] * Fact_Bnd[1][hop[1]][rr[1]+y];
 	x = 0;
@@ -524,35 +620,43 @@ void KPM_Vector <T, 2>::KPM_MOTOR(KPM_Vector<T,2> *kpm_final, unsigned axis)
   for(auto istr = h.cross_mozaic_indexes.begin(); istr != h.cross_mozaic_indexes.end() ; istr++)
     initiate_stride<MULT>(*istr);
     
-  for( i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1 += TILE  ){
-      build_regular_phases<MULT,VELOCITY>(static_cast<int>(i1), axis);
-		
-      for( i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0 += TILE ){
-		    
-          std::size_t istr = (i1 - NGHOSTS) / TILE * r.lStr[0] + (i0 - NGHOSTS) / TILE;
-          if(h.cross_mozaic.at(istr))
-            initiate_stride<MULT>(istr);
-          // These four lines pertrain only to the magnetic field
-          for(std::size_t io = 0; io < r.Orb; io++)
-            {
-              const std::size_t ip = io * x.basis[2];
-              const std::size_t j0 = ip + i0 + i1 * std;
+  // The tiles are visited in the order of r.tile_order. The phases only depend on the
+  // row of tiles, so they are selected when it changes
+  build_phase_rows<MULT,VELOCITY>(axis);
+  std::size_t row = 0;
+  for(auto it = r.tile_order.begin(); it != r.tile_order.end(); it++){
+      std::size_t istr = *it;
+      i0 = (istr % r.lStr[0]) * TILE + NGHOSTS;
+      i1 = (istr / r.lStr[0]) * TILE + NGHOSTS;
+      if(it == r.tile_order.begin() || i1 != row)
+        {
+          row = i1;
+          select_phase_row<MULT,VELOCITY>(istr / r.lStr[0], axis);
+        }
+      if(h.cross_mozaic.at(istr))
+        initiate_stride<MULT>(istr);
+      // These four lines pertrain only to the magnetic field
+      for(std::size_t io = 0; io < r.Orb; io++)
+        {
+          if(h.use_sectors && h.sector_weight[io] == value_type(0))
+            continue;
+          const std::size_t ip = io * x.basis[2];
+          const std::size_t j0 = ip + i0 + i1 * std;
 		
-              // Local Energy
-              if(!VELOCITY) mult_local_disorder<MULT>(j0, io);
+          // Local Energy
+          if(!VELOCITY) mult_local_disorder<MULT>(j0, io);
 		
-              // Hoppings
-              mult_regular_hoppings(j0, io);
-            }
+          // Hoppings
+          mult_regular_hoppings(j0, io);
+        }
 
-          KPM_VectorBasis<T,2u>::template multiply_defect<MULT, VELOCITY>(istr, phi0, phiM1, axis);
+      KPM_VectorBasis<T,2u>::template multiply_defect<MULT, VELOCITY>(istr, phi0, phiM1, axis);
 	  	    
-          // Empty the vacancies in the tile
-          auto & hV = h.hV.position.at(istr);
-          for(auto k = hV.begin(); k != hV.end(); k++)
-            phi0[*k] = 0.;
+      // Empty the vacancies in the tile
+      auto & hV = h.hV.position.at(istr);
+      for(auto k = hV.begin(); k != hV.end(); k++)
+        phi0[*k] = 0.;
 
-        }
     }
 
   for(auto vc =  h.hV.vacancies_with_defects.begin(); vc != h.hV.vacancies_with_defects.end(); vc++)
@@ -573,6 +677,61 @@ void KPM_Vector <T, 2>::KPM_MOTOR(KPM_Vector<T,2> *kpm_final, unsigned axis)
 
 
 }
+template <typename T>
+void KPM_Vector <T, 2>::bond_currents(const T * psi, const T * chi, std::size_t NBonds, double * map)
+{
+  /*
+    Adds -Re[ H_ij (chi_j psi_i^* - psi_j chi_i^*) ] to the map for every hopping j = i + d of the
+    periodic part of the Hamiltonian, with the same phases as KPM_MOTOR. psi and chi must have their
+    ghosts exchanged. The map is ordered as [orbital][hopping][site] and only holds the sites of the
+    sample that belong to this sub-domain
+  */
+  std::size_t i0, i1, rr[2], hop[2];
+  std::size_t row = 0;
+  build_phase_rows<0u,false>(0);
+  for(auto it = r.tile_order.begin(); it != r.tile_order.end(); it++){
+      std::size_t istr = *it;
+      i0 = (istr % r.lStr[0]) * TILE + NGHOSTS;
+      i1 = (istr / r.lStr[0]) * TILE + NGHOSTS;
+      if(it == r.tile_order.begin() || i1 != row)
+        {
+          row = i1;
+          select_phase_row<0u,false>(istr / r.lStr[0], 0);
+        }
+      // The padding of the last tiles is not part of the sample
+      const std::size_t nx = std::min<std::size_t>(TILE, NGHOSTS + r.lr[0] - i0);
+      const std::size_t ny = std::min<std::size_t>(TILE, NGHOSTS + r.lr[1] - i1);
+
+      for(std::size_t io = 0; io < r.Orb; io++)
+        {
+          const std::size_t j0 = io * x.basis[2] + i0 + i1 * std;
+          rr[0] = i0;
+          rr[1] = i1;
+          for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+            {
+              const std::ptrdiff_t d1 = h.hr.distance(ib, io);
+              const std::size_t i_f = j0 + d1;
+              hop[0] = (i_f % r.Ld[0] ) - rr[0] + 1;
+              hop[1] = (i_f % (r.Ld[0] * r.Ld[1]))/(r.Ld[0]) - rr[1] + 1;
+              double * m = map + (io * NBonds + ib) * r.Nr;
+              
+              for(std::size_t y = 0; y < ny; y++)
+                {
+                  const T t1 = mult_t1_ghost_cor[io][ib][y] * Fact_Bnd[1][hop[1]][rr[1] + y];
+                  for(std::size_t x0 = 0; x0 < nx; x0++)
+                    {
+                      const std::size_t i = j0 + y * std + x0;
+                      T psi_i = psi[i], chi_i = chi[i];
+                      const T hij = t1 * Fact_Bnd[0][hop[0]][rr[0] + x0];
+                      m[(i1 + y - NGHOSTS) * r.lr[0] + i0 + x0 - NGHOSTS] -=
+                        double(std::real(hij * (chi[i + d1] * myconj(psi_i) - psi[i + d1] * myconj(chi_i))));
+                    }
+                }
+            }
+        }
+    }
+}
+
 template <typename T>
 void KPM_Vector <T, 2>::measure_wave_packet(T * bra, T * ket, T * results)  
 {
@@ -587,7 +746,7 @@ void KPM_Vector <T, 2>::measure_wave_packet(T * bra, T * ket, T * results)
       auto deltax = static_cast<value_type>(r.rOrb(0,io));
       auto deltay = static_cast<value_type>(r.rOrb(1,io));
 	
-      for(unsigned i1 = 0; i1 < r.ld[1]; i1++)
+      for(unsigned i1 = 0; i1 < r.lr[1]; i1++)
         {
           std::size_t ind = ad.set({std::size_t(NGHOSTS),std::size_t(i1 + NGHOSTS), std::size_t(io)}).index;
           auto z1 = static_cast<value_type>(at.coord[1] + i1);
@@ -599,7 +758,7 @@ void KPM_Vector <T, 2>::measure_wave_packet(T * bra, T * ket, T * results)
           T yl1 = assign_value(0., 0.);
           T yl2 = assign_value(0., 0.);
 	    
-          for(unsigned i0 = 0; i0 < r.ld[0]; i0++)
+          for(unsigned i0 = 0; i0 < r.lr[0]; i0++)
             {
               std::size_t j0 = ind + i0;
               auto x = static_cast<value_type>(x0 + i0 * r.rLat(0,0));
@@ -698,8 +857,8 @@ void KPM_Vector <T, 2>::test_boundaries_system() {
   Coordinates<std::size_t, 3> x(r.Ld);
     
   for(std::size_t  io = 0; io < (std::size_t) r.Ld[2]; io++)
-    for(std::size_t i1 = NGHOSTS; i1 < (std::size_t) r.Ld[1] - NGHOSTS ; i1++)
-      for(std::size_t i0 = NGHOSTS; i0 < (std::size_t) r.Ld[0] - NGHOSTS ; i0++)
+    for(std::size_t i1 = NGHOSTS; i1 < NGHOSTS + (std::size_t) r.lr[1] ; i1++)
+      for(std::size_t i0 = NGHOSTS; i0 < NGHOSTS + (std::size_t) r.lr[0] ; i0++)
         {
           r.convertCoordinates(z, x.set({i0,i1,io}) );
           v(x.set({i0,i1,io}).index, 0) = aux_wr(z.index);
@@ -744,7 +903,8 @@ void KPM_Vector <T, 2>::empty_ghosts(int mem_index) {
   
   
   // There are four sides, so set the ghosts in each side to zero individually.
-  // Remember that the size of the ghost boundaries depends on NGHOSTS.
+  // Remember that the size of the ghost boundaries depends on NGHOSTS. The padding
+  // of the sub-domain lies before the ghosts of the upper sides and is emptied with them.
     
   for(long  io = 0; io < (long) r.Ld[2]; io++)
     for(long i0 = 0; i0 < (long) r.Ld[0]; i0++)
@@ -753,8 +913,8 @@ void KPM_Vector <T, 2>::empty_ghosts(int mem_index) {
 
   for(long  io = 0; io < (long) r.Ld[2]; io++)
     for(long i0 = 0; i0 < (long) r.Ld[0]; i0++)
-      for(int d = 0; d < NGHOSTS; d++)
-        v(x.set({i0, (long) (r.Ld[1] - 1 - d),io}).index, mem_index) *= 0;
+      for(long d = NGHOSTS + r.lr[1]; d < (long) r.Ld[1]; d++)
+        v(x.set({i0, d,io}).index, mem_index) *= 0;
   
   for(long  io = 0; io < (long) r.Ld[2]; io++)
     for(long i1 = 0; i1 < (long) r.Ld[1]; i1++)
@@ -763,8 +923,8 @@ void KPM_Vector <T, 2>::empty_ghosts(int mem_index) {
 
   for(long  io = 0; io < (long) r.Ld[2]; io++)
     for(long i1 = 0; i1 < (long) r.Ld[1]; i1++)
-      for(int d = 0; d < NGHOSTS; d++)
-        v(x.set({(long) (r.Ld[0] - 1 - d),i1,io}).index, mem_index) *= 0;
+      for(long d = NGHOSTS + r.lr[0]; d < (long) r.Ld[0]; d++)
+        v(x.set({d,i1,io}).index, mem_index) *= 0;
 
 }
 
@@ -42,13 +42,20 @@ KPM_Vector<T,3u>::KPM_Vector(int mem, Simulation<T,3u> & sim) :
 
     std::size_t max_0, max_1;
     
+    // With TILE_ORDER == 1 the phases of every plane of tiles are kept (see build_phase_rows)
+    const std::size_t num_planes = (TILE_ORDER == 1 ? (r.lr[2] + TILE - 1) / TILE : 1);
+    phase_rows = new T**[r.Orb];
     mult_t1_ghost_cor = new   T**[r.Orb];
     
     for(unsigned io = 0; io < r.Orb; io++)
       {
+        phase_rows[io] = new T*[h.hr.NHoppings(io)];
         mult_t1_ghost_cor[io] = new T*[h.hr.NHoppings(io)];
         for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
-          mult_t1_ghost_cor[io][ib] = new T[TILE];
+          {
+            phase_rows[io][ib] = new T[num_planes * TILE];
+            mult_t1_ghost_cor[io][ib] = phase_rows[io][ib];
+          }
       }
 
     for(unsigned d = 0; d < D; d++)
@@ -73,10 +80,10 @@ KPM_Vector<T,3u>::KPM_Vector(int mem, Simulation<T,3u> & sim) :
         // Position of initial corner to copy to the destiny
         // From
         MemIndBeg[0][0][io] = z.set({ng,ng, ng, io}).index;   
-        MemIndBeg[0][1][io] = z.set({r.Ld[0] - 2 * ng , ng, ng, io}).index;   
+        MemIndBeg[0][1][io] = z.set({r.lr[0], ng, ng, io}).index;   
         // To
         MemIndEnd[0][0][io] = z.set({zero, ng, ng, io}).index;   
-        MemIndEnd[0][1][io] = z.set({r.Ld[0] - ng, ng, ng, io}).index;
+        MemIndEnd[0][1][io] = z.set({r.lr[0] + ng, ng, ng, io}).index;
       }
 
     //   Set boundaries in y direction
@@ -95,10 +102,10 @@ KPM_Vector<T,3u>::KPM_Vector(int mem, Simulation<T,3u> & sim) :
         std::size_t minx = (r.boundary[0][0] == true ? zero : NGHOSTS);
         // X is periodic in left direction         
         MemIndBeg[1][0][io] = z.set({minx, ng, ng, io}).index;   
-        MemIndBeg[1][1][io] = z.set({minx, r.Ld[1] - 2*ng, ng, io}).index;   
+        MemIndBeg[1][1][io] = z.set({minx, r.lr[1], ng, io}).index;   
         // Position of initial corner to copy to the destiny 
         MemIndEnd[1][0][io] = z.set({minx, zero, ng, io}).index;   
-        MemIndEnd[1][1][io] = z.set({minx, r.Ld[1] - ng, ng, io}).index;
+        MemIndEnd[1][1][io] = z.set({minx, r.lr[1] + ng, ng, io}).index;
       }    
 
     //   Set boundaries in z direction
@@ -119,10 +126,10 @@ KPM_Vector<T,3u>::KPM_Vector(int mem, Simulation<T,3u> & sim) :
         std::size_t miny = (r.boundary[1][0] == true ? zero : NGHOSTS);
         
         MemIndBeg[2][0][io] = z.set({minx, miny, ng, io}).index;
-        MemIndBeg[2][1][io] = z.set({minx, miny, r.Ld[2] - 2*ng, io}).index;   
+        MemIndBeg[2][1][io] = z.set({minx, miny, r.lr[2], io}).index;   
         // Position of initial corner to copy to the destiny 
         MemIndEnd[2][0][io] = z.set({minx, miny, zero, io}).index;   
-        MemIndEnd[2][1][io] = z.set({minx, miny, r.Ld[2] - ng, io}).index;                
+        MemIndEnd[2][1][io] = z.set({minx, miny, r.lr[2] + ng, io}).index;                
       }    
 
     for(unsigned d = 0 ; d < D; d++)
@@ -136,7 +143,10 @@ KPM_Vector<T,3u>::KPM_Vector(int mem, Simulation<T,3u> & sim) :
     // JPPP Calcular os vectores das fases devido às condicoes fronteira
     for(unsigned i = 0; i < D; i ++)
       for(unsigned j = 0; j < 3; j ++)
-	Fact_Bnd[i][j] = new T[r.Ld[i]];
+	{
+	  Fact_Bnd[i][j] = new T[r.Ld[i]];
+	  Twist_Tile[i][j] = new bool[r.lStr[i]];
+	}
     
     initiate_vector();
   }
@@ -148,10 +158,12 @@ KPM_Vector <T, 3u>::~KPM_Vector(void) {
   for(unsigned io = 0; io < r.Orb;io++)
     {
       for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
-        delete mult_t1_ghost_cor[io][ib];
-      delete mult_t1_ghost_cor[io];
+        delete [] phase_rows[io][ib];
+      delete [] phase_rows[io];
+      delete [] mult_t1_ghost_cor[io];
     }  
-  delete mult_t1_ghost_cor;
+  delete [] phase_rows;
+  delete [] mult_t1_ghost_cor;
   
   for(unsigned d = 0; d < D; d++)
     for(unsigned b = 0; b < 2; b++)
@@ -159,6 +171,10 @@ KPM_Vector <T, 3u>::~KPM_Vector(void) {
         delete MemIndBeg[d][b];
         delete MemIndEnd[d][b];
       }  
+
+  for(unsigned d = 0; d < D; d++)
+    for(unsigned j = 0; j < 3; j++)
+      delete [] Twist_Tile[d][j];
 }
 
 
@@ -177,18 +193,18 @@ void KPM_Vector <T, 3u>::initiate_vector(){
   if(seed=="ones"){
       Coordinates<std::size_t, 4> x(r.Ld);
       for(std::size_t io = 0; io < r.Orb; io++)
-        for(std::size_t i2 = NGHOSTS; i2 < r.Ld[2] - NGHOSTS; i2++)
-          for(std::size_t i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1++)
-            for(std::size_t i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0++)
+        for(std::size_t i2 = NGHOSTS; i2 < NGHOSTS + r.lr[2]; i2++)
+          for(std::size_t i1 = NGHOSTS; i1 < NGHOSTS + r.lr[1]; i1++)
+            for(std::size_t i0 = NGHOSTS; i0 < NGHOSTS + r.lr[0]; i0++)
               v(x.set({i0,i1,i2,io}).index, index) = 1.0/static_cast<value_type>(sqrt(value_type(r.Sizet - r.SizetVacancies)));
 
   // Proceed normally
   } else {
       Coordinates<std::size_t, 4> x(r.Ld);
       for(std::size_t io = 0; io < r.Orb; io++)
-        for(std::size_t i2 = NGHOSTS; i2 < r.Ld[2] - NGHOSTS; i2++)
-          for(std::size_t i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1++)
-            for(std::size_t i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0++)
+        for(std::size_t i2 = NGHOSTS; i2 < NGHOSTS + r.lr[2]; i2++)
+          for(std::size_t i1 = NGHOSTS; i1 < NGHOSTS + r.lr[1]; i1++)
+            for(std::size_t i0 = NGHOSTS; i0 < NGHOSTS + r.lr[0]; i0++)
               v(x.set({i0,i1,i2,io}).index, index) = simul.rnd.init()/static_cast<value_type>(sqrt(value_type(r.Sizet - r.SizetVacancies)));
   }
   
@@ -199,6 +215,11 @@ void KPM_Vector <T, 3u>::initiate_vector(){
         v(vv.at(j), index ) = 0. ;
   }
 
+  // Only the first copy of each decoupled sector is iterated (see Hamiltonian::build_sectors)
+  if(h.use_sectors && seed != "deterministic")
+    for(unsigned io = 0; io < r.Orb; io++)
+      v.col(index).segment(io * r.Nd, r.Nd) *= h.sector_weight.at(io);
+
   // Initiate the phases for the twisted boundary conditions
   initiate_phases();
 }
@@ -234,6 +255,17 @@ void KPM_Vector <T, 3>::initiate_phases() {
 	Fact_Bnd[2][0][x.coord[2]] = exp(ComplexTraits<T>::assign_value(0.0,h.BoundTwist[2] * int((int(r.Lt[2] - z.coord[2]))/r.Lt[2])));
       }
   }
+
+  // Flag the tiles in which a boundary twist phase is applied. Everywhere else the hoppings
+  // are multiplied without the Fact_Bnd factors (see mult_regular_hoppings)
+  for(unsigned d = 0; d < D; d++)
+    for(unsigned j = 0; j < 3; j++)
+      {
+        std::fill_n(Twist_Tile[d][j], r.lStr[d], false);
+        for(unsigned i = NGHOSTS; i < r.Ld[d] - NGHOSTS; i++)
+          if(Fact_Bnd[d][j][i] != ComplexTraits<T>::assign_value(1.0,0.0))
+            Twist_Tile[d][j][(i - NGHOSTS) / TILE] = true;
+      }
 }
 
 template <typename T>
@@ -292,9 +324,9 @@ void KPM_Vector <T, 3>::build_wave_packet(Eigen::Matrix<double,Eigen::Dynamic,Ei
   for(int ik = 0; ik < psi0.cols(); ik++)
     phase(0,ik)  = std::real(simul.Global.mu(ik, 0)) ;
 #pragma omp barrier
-  for(std::size_t i2 = NGHOSTS; i2 < r.Ld[2] - NGHOSTS; i2++)
-    for(std::size_t i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1++)
-      for(std::size_t i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0++)
+  for(std::size_t i2 = NGHOSTS; i2 < NGHOSTS + r.lr[2]; i2++)
+    for(std::size_t i1 = NGHOSTS; i1 < NGHOSTS + r.lr[1]; i1++)
+      for(std::size_t i0 = NGHOSTS; i0 < NGHOSTS + r.lr[0]; i0++)
         {
           x.set({i0,i1,std::size_t(0)});
           r.convertCoordinates(z,x);
@@ -332,9 +364,9 @@ void KPM_Vector <T, 3>::build_wave_packet(Eigen::Matrix<double,Eigen::Dynamic,Ei
   value_type soma2 = sqrt(std::real(soma));
   
   for(std::size_t io = 0; io < r.Orb; io++)
-    for(std::size_t i2 = NGHOSTS; i2 < r.Ld[2] - NGHOSTS; i2++)
-      for(std::size_t i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1++)
-        for(std::size_t i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0++)
+    for(std::size_t i2 = NGHOSTS; i2 < NGHOSTS + r.lr[2]; i2++)
+      for(std::size_t i1 = NGHOSTS; i1 < NGHOSTS + r.lr[1]; i1++)
+        for(std::size_t i0 = NGHOSTS; i0 < NGHOSTS + r.lr[0]; i0++)
           {
             x.set({i0,i1,i2,io});
             v(x.index, 0) /= soma2;
@@ -356,8 +388,8 @@ void KPM_Vector <T, 3>::test_boundaries_system() {
   
   for(std::size_t  io = 0; io < (std::size_t) r.Ld[3]; io++)
     for(std::size_t i2 = 0; i2 < (std::size_t) r.Ld[2] ; i2++)
-      for(std::size_t i1 = NGHOSTS; i1 < (std::size_t) r.Ld[1] - NGHOSTS ; i1++)
-        for(std::size_t i0 = NGHOSTS; i0 < (std::size_t) r.Ld[0] - NGHOSTS ; i0++)
+      for(std::size_t i1 = NGHOSTS; i1 < NGHOSTS + (std::size_t) r.lr[1] ; i1++)
+        for(std::size_t i0 = NGHOSTS; i0 < NGHOSTS + (std::size_t) r.lr[0] ; i0++)
           {
             r.convertCoordinates(z, x.set({i0,i1,i2,io}) );
             v(x.set({i0,i1,io}).index, 0) = aux_wr(z.index);
@@ -407,43 +439,114 @@ void KPM_Vector <T, 3>::empty_ghosts(int mem_index) {
   const long NGHL = NGHOSTS;
   
   // There are four sides, so set the ghosts in each side to zero individually.
-  // Remember that the size of the ghost boundaries depends on NGHOSTS.
+  // Remember that the size of the ghost boundaries depends on NGHOSTS. The padding
+  // of the sub-domain lies before the ghosts of the upper sides and is emptied with them.
 
   // perpendicular to x axis
   
   for(long  io = 0; io < static_cast<long>(r.Ld[3]); io++)
     for(long i2 = 0; i2 < static_cast<long>(r.Ld[2]); i2++)
       for(long i1 = 0; i1 <  static_cast<long>(r.Ld[1]); i1++)
-        for(long i0 = 0; i0 < NGHL; i0++)
-          {
+        {
+          for(long i0 = 0; i0 < NGHL; i0++)
             v(x.set({i0,i1,i2,io}).index, mem_index) *= 0;
-            v(x.set({static_cast<long>(r.Ld[0]) - 1 - i0, i1, i2, io}).index, mem_index) *= 0;
-          }
+          for(long i0 = NGHL + r.lr[0]; i0 < static_cast<long>(r.Ld[0]); i0++)
+            v(x.set({i0,i1,i2,io}).index, mem_index) *= 0;
+        }
 
   // perpendicular to y axis
   
   for(long  io = 0; io < static_cast<long>(r.Ld[3]); io++)
     for(long i2 = 0; i2 < static_cast<long>(r.Ld[2]); i2++)
-      for(long i1 = 0; i1 < NGHL; i1++)
-        for(long i0 = 0; i0 < static_cast<long>(r.Ld[0]); i0++)
-          {
+      {
+        for(long i1 = 0; i1 < NGHL; i1++)
+          for(long i0 = 0; i0 < static_cast<long>(r.Ld[0]); i0++)
             v(x.set({i0,i1,i2,io}).index, mem_index) *= 0;
-            v(x.set({i0,static_cast<long>(r.Ld[1]) - 1 -  i1, i2, io}).index, mem_index) *= 0;
-          }
+        for(long i1 = NGHL + r.lr[1]; i1 < static_cast<long>(r.Ld[1]); i1++)
+          for(long i0 = 0; i0 < static_cast<long>(r.Ld[0]); i0++)
+            v(x.set({i0,i1,i2,io}).index, mem_index) *= 0;
+      }
   
-  // perpendicular to y axis
+  // perpendicular to z axis
   
   for(long  io = 0; io < static_cast<long>(r.Ld[3]); io++)
-    for(long i2 = 0; i2 < NGHL; i2++)
-      for(long i1 = 0; i1 < static_cast<long>(r.Ld[1]); i1++)
-        for(long i0 = 0; i0 <  static_cast<long>(r.Ld[0]); i0++)
-          {
+    {
+      for(long i2 = 0; i2 < NGHL; i2++)
+        for(long i1 = 0; i1 < static_cast<long>(r.Ld[1]); i1++)
+          for(long i0 = 0; i0 <  static_cast<long>(r.Ld[0]); i0++)
             v(x.set({i0,i1,i2,io}).index, mem_index) *= 0;
-            v(x.set({i0,i1,static_cast<long>(r.Ld[2]) - 1 - i2, io}).index, mem_index) *= 0;
-          }
+      for(long i2 = NGHL + r.lr[2]; i2 < static_cast<long>(r.Ld[2]); i2++)
+        for(long i1 = 0; i1 < static_cast<long>(r.Ld[1]); i1++)
+          for(long i0 = 0; i0 <  static_cast<long>(r.Ld[0]); i0++)
+            v(x.set({i0,i1,i2,io}).index, mem_index) *= 0;
+    }
 }
 
 
+template <typename T>
+void KPM_Vector <T, 3>::bond_currents(const T * psi, const T * chi, std::size_t NBonds, double * map)
+{
+  /*
+    Adds -Re[ H_ij (chi_j psi_i^* - psi_j chi_i^*) ] to the map for every hopping j = i + d of the
+    periodic part of the Hamiltonian, with the same phases as KPM_MOTOR. psi and chi must have their
+    ghosts exchanged. The map is ordered as [orbital][hopping][site] and only holds the sites of the
+    sample that belong to this sub-domain
+  */
+  std::size_t i0, i1, i2, rr[3], hop[3];
+  Coordinates<std::size_t, D + 1> x(r.Ld);
+  std::size_t plane = 0;
+  build_phase_rows<0u,false>(0);
+  for(auto it = r.tile_order.begin(); it != r.tile_order.end(); it++){
+      std::size_t istr = *it;
+      i0 = (istr % r.lStr[0]) * TILE + NGHOSTS;
+      i1 = (istr / r.lStr[0] % r.lStr[1]) * TILE + NGHOSTS;
+      i2 = (istr / r.lStr[0] / r.lStr[1]) * TILE + NGHOSTS;
+      if(it == r.tile_order.begin() || i2 != plane)
+        {
+          plane = i2;
+          select_phase_row<0u,false>(istr / r.lStr[0] / r.lStr[1], 0);
+        }
+      // The padding of the last tiles is not part of the sample
+      const std::size_t nx = std::min<std::size_t>(TILE, NGHOSTS + r.lr[0] - i0);
+      const std::size_t ny = std::min<std::size_t>(TILE, NGHOSTS + r.lr[1] - i1);
+      const std::size_t nz = std::min<std::size_t>(TILE, NGHOSTS + r.lr[2] - i2);
+
+      for(std::size_t io = 0; io < r.Orb; io++)
+        {
+          const std::size_t j0 = io * x.basis[3] + i0 + i1 * tile[1] + i2 * tile[2];
+          rr[0] = i0;
+          rr[1] = i1;
+          rr[2] = i2;
+          for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+            {
+              const std::ptrdiff_t d1 = h.hr.distance(ib, io);
+              const std::size_t i_f = j0 + d1;
+              hop[0] = (i_f % r.Ld[0] ) - rr[0] + 1;
+              hop[1] = (i_f % (r.Ld[0] * r.Ld[1]) )/(r.Ld[0]) - rr[1] + 1;
+              hop[2] = (i_f % (r.Ld[0] * r.Ld[1] * r.Ld[2]) )/(r.Ld[0]*r.Ld[1]) - rr[2] + 1;
+              double * m = map + (io * NBonds + ib) * r.Nr;
+
+              for(std::size_t z = 0; z < nz; z++)
+                {
+                  const T t2 = mult_t1_ghost_cor[io][ib][z] * Fact_Bnd[2][hop[2]][rr[2] + z];
+                  for(std::size_t y = 0; y < ny; y++)
+                    {
+                      const T t1 = t2 * Fact_Bnd[1][hop[1]][rr[1] + y];
+                      for(std::size_t x0 = 0; x0 < nx; x0++)
+                        {
+                          const std::size_t i = j0 + z * tile[2] + y * tile[1] + x0;
+                          T psi_i = psi[i], chi_i = chi[i];
+                          const T hij = t1 * Fact_Bnd[0][hop[0]][rr[0] + x0];
+                          m[((i2 + z - NGHOSTS) * r.lr[1] + i1 + y - NGHOSTS) * r.lr[0] + i0 + x0 - NGHOSTS] -=
+                            double(std::real(hij * (chi[i + d1] * myconj(psi_i) - psi[i + d1] * myconj(chi_i))));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
 template <typename T>
 void KPM_Vector <T, 3>::measure_wave_packet(T * bra, T * ket, T * results)  
 {
@@ -460,8 +563,8 @@ void KPM_Vector <T, 3>::measure_wave_packet(T * bra, T * ket, T * results)
       auto deltay = static_cast<value_type>(r.rOrb(1,io));
       auto deltaz = static_cast<value_type>(r.rOrb(2,io));
       
-      for(unsigned i2 = 0; i2 < r.ld[2]; i2++)
-        for(unsigned i1 = 0; i1 < r.ld[1]; i1++)
+      for(unsigned i2 = 0; i2 < r.lr[2]; i2++)
+        for(unsigned i1 = 0; i1 < r.lr[1]; i1++)
           {
             std::size_t ind = ad.set({std::size_t(NGHOSTS),std::size_t(NGHOSTS + i1), std::size_t(i2 + NGHOSTS), std::size_t(io)}).index;
             auto z0 = static_cast<value_type>(at.coord[0] +  0);
@@ -480,7 +583,7 @@ void KPM_Vector <T, 3>::measure_wave_packet(T * bra, T * ket, T * results)
             T zl1 = assign_value(0., 0.);
             T zl2 = assign_value(0., 0.);
 	    
-            for(unsigned i0 = 0; i0 < r.ld[0]; i0++)
+            for(unsigned i0 = 0; i0 < r.lr[0]; i0++)
               {
                 std::size_t j0 = ind + i0;
                 auto x = static_cast<value_type>(xt + i0 * r.rLat(0,0));
@@ -629,6 +732,27 @@ void inline KPM_Vector <T, 3>::mult_regular_hoppings(const  std::size_t & ind_i,
       count = 0;
       z = 0;
 
+      // Tiles away from the twisted boundaries: no Fact_Bnd factors, and a real hopping
+      // multiplies the real and imaginary parts of the vector separately
+      if(!Twist_Tile[0][hop[0]][(rr[0] - NGHOSTS) / TILE] && !Twist_Tile[1][hop[1]][(rr[1] - NGHOSTS) / TILE] &&
+         !Twist_Tile[2][hop[2]][(rr[2] - NGHOSTS) / TILE]) {
+        for( std::size_t j2 = ind_i; j2 < ind_f; j2 += tile[2] ) {
+          const T t1 = mult_t1_ghost_cor[io][ib][count++];
+          const std::size_t std = tile[1], j2M = j2 + std * TILE;
+          if(std::imag(t1) == 0) {
+            const value_type t1r = std::real(t1);
+            for(std::size_t j1 = j2; j1 < j2M; j1 += std )
+              for(std::size_t j0 = j1; j0 < j1 + TILE ; j0++)
+                phi0[j0] += t1r * phiM1[j0 + d1];
+          }
+          else
+            for(std::size_t j1 = j2; j1 < j2M; j1 += std )
+              for(std::size_t j0 = j1; j0 < j1 + TILE ; j0++)
+                phi0[j0] += t1 * phiM1[j0 + d1];
+        };
+        continue;
+      }
+
       // Iterate over the slowest coordinate (z)
       for( std::size_t j2 = ind_i; j2 < ind_f; j2 += tile[2] ) {
           const T t1 = mult_t1_ghost_cor[io][ib][count++] * Fact_Bnd[2][hop[2]][rr[2]+z];
@@ -685,6 +809,41 @@ void inline KPM_Vector <T, 3>::mult_local_disorder(const  std::size_t & ind_i, c
 }
 
 
+template <typename T>
+template < unsigned MULT,bool VELOCITY> 
+void KPM_Vector <T, 3>::build_phase_rows(unsigned axis)
+{
+  // Same as in 2D, for the planes of tiles: with TILE_ORDER == 1 the phases of all of them
+  // are built once per multiplication, instead of at every change of plane
+#if TILE_ORDER == 1
+  const std::size_t num_planes = (r.lr[2] + TILE - 1) / TILE;
+  for(std::size_t plane = 0; plane < num_planes; plane++)
+    {
+      for(unsigned io = 0; io < r.Orb; io++)
+        for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+          mult_t1_ghost_cor[io][ib] = phase_rows[io][ib] + plane * TILE;
+      build_regular_phases<MULT,VELOCITY>(static_cast<int>(plane * TILE + NGHOSTS), axis);
+    }
+#else
+  (void) axis;
+#endif
+}
+
+template <typename T>
+template < unsigned MULT,bool VELOCITY> 
+void KPM_Vector <T, 3>::select_phase_row(std::size_t plane, unsigned axis)
+{
+  // Phases of the plane of tiles that starts at i2 = plane * TILE + NGHOSTS
+#if TILE_ORDER == 1
+  (void) axis;
+  for(unsigned io = 0; io < r.Orb; io++)
+    for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+      mult_t1_ghost_cor[io][ib] = phase_rows[io][ib] + plane * TILE;
+#else
+  build_regular_phases<MULT,VELOCITY>(static_cast<int>(plane * TILE + NGHOSTS), axis);
+#endif
+}
+
 template <typename T>
 template < unsigned MULT> 
 void KPM_Vector <T, 3u>::initiate_stride(std::size_t & istr)
@@ -734,6 +893,13 @@ void KPM_Vector <T, 3>::build_regular_phases(int i2min, unsigned axis) {
           if (VELOCITY)
             tt  *=  h.hr.v.at(axis)(ib,io);
           
+          if(r.field_profile)
+            {
+              for(std::size_t i2 = 0; i2 < TILE; i2++ )
+                mult_t1_ghost_cor[io][ib][i2] = tt * h.hr.peierls(ib + io * h.hr.hopping.rows(), i2min + i2);
+              continue;
+            }
+          
           for(std::size_t i2 = 0; i2 < TILE; i2++ )
             {
               auto phase = static_cast<value_type>(vee(0) * (global.coord[2] + int(i2)) * r.ghost_pot(0,D - 2));
@@ -758,36 +924,44 @@ void KPM_Vector <T, 3>::KPM_MOTOR(KPM_Vector<T,3> *kpm_final, unsigned axis)
   for(auto istr = h.cross_mozaic_indexes.begin(); istr != h.cross_mozaic_indexes.end() ; istr++)
     initiate_stride<MULT>(*istr);
   
-  // Iterate over tiles first
-  for( i2 = NGHOSTS; i2 < r.Ld[2] - NGHOSTS; i2 += TILE  ){
-      build_regular_phases<MULT,VELOCITY>(static_cast<int>(i2), axis);
-      for( i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1 += TILE  )
-        for( i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0 += TILE ){
-            
-            std::size_t istr = ((i2 - NGHOSTS) / TILE * r.lStr[1] + (i1 - NGHOSTS) / TILE) * r.lStr[0] + (i0 - NGHOSTS) / TILE;
-            if(h.cross_mozaic.at(istr))
-              initiate_stride<MULT>(istr);
-
-            // Iterate over the orbitals
-            for(std::size_t io = 0; io < r.Orb; io++){
-                const std::size_t ip = io * x.basis[3];
-                const std::size_t j0 = ip + i0 + i1 * tile[1] + i2 * tile[2];
+  // Iterate over tiles first, in the order of r.tile_order. The phases only depend on the
+  // plane of tiles, so they are selected when it changes
+  build_phase_rows<MULT,VELOCITY>(axis);
+  std::size_t plane = 0;
+  for(auto it = r.tile_order.begin(); it != r.tile_order.end(); it++){
+      std::size_t istr = *it;
+      i0 = (istr % r.lStr[0]) * TILE + NGHOSTS;
+      i1 = (istr / r.lStr[0] % r.lStr[1]) * TILE + NGHOSTS;
+      i2 = (istr / r.lStr[0] / r.lStr[1]) * TILE + NGHOSTS;
+      if(it == r.tile_order.begin() || i2 != plane)
+        {
+          plane = i2;
+          select_phase_row<MULT,VELOCITY>(istr / r.lStr[0] / r.lStr[1], axis);
+        }
+      if(h.cross_mozaic.at(istr))
+        initiate_stride<MULT>(istr);
+
+      // Iterate over the orbitals
+      for(std::size_t io = 0; io < r.Orb; io++){
+          if(h.use_sectors && h.sector_weight[io] == value_type(0))
+            continue;
+          const std::size_t ip = io * x.basis[3];
+          const std::size_t j0 = ip + i0 + i1 * tile[1] + i2 * tile[2];
 		
-                // Local Energy
-                if(!VELOCITY) mult_local_disorder<MULT>(j0, io);
+          // Local Energy
+          if(!VELOCITY) mult_local_disorder<MULT>(j0, io);
 		
-                // Hoppings
-                mult_regular_hoppings(j0, io);
-             }
-            
-            KPM_VectorBasis<T,3u>::template multiply_defect<MULT, VELOCITY>(istr, phi0, phiM1, axis);
-            
-            // Empty the vacancies in the tile
-            auto & hV = h.hV.position.at(istr);
-            for(auto k = hV.begin(); k != hV.end(); k++)
-              phi0[*k] = 0.;
+          // Hoppings
+          mult_regular_hoppings(j0, io);
+       }
+      
+      KPM_VectorBasis<T,3u>::template multiply_defect<MULT, VELOCITY>(istr, phi0, phiM1, axis);
+      
+      // Empty the vacancies in the tile
+      auto & hV = h.hV.position.at(istr);
+      for(auto k = hV.begin(); k != hV.end(); k++)
+        phi0[*k] = 0.;
 
-        }
     }
 
   for(auto vc =  h.hV.vacancies_with_defects.begin(); vc != h.hV.vacancies_with_defects.end(); vc++)
@@ -828,8 +1002,8 @@ void KPM_Vector <T, 3>::build_site(unsigned long pos){
     total_coords.set_coord(pos);
     for(unsigned d = 0; d < D; d++)
       {
-	T_thread[d] = total_coords.coord[d]/r.ld[d];
-	x_thread[d] = total_coords.coord[d]%r.ld[d];
+	T_thread[d] = r.domain_coordinate(d, total_coords.coord[d]);
+	x_thread[d] = total_coords.coord[d] - r.domain_start(d, unsigned(T_thread[d]));
       }
     T_thread[D] = 0;
     x_thread[D] = total_coords.coord[D];
@@ -882,9 +1056,9 @@ void KPM_Vector <T, 3>::build_planewave(Eigen::Matrix<double,Eigen::Dynamic,1> &
 
 
     // Calculate the exponential related to each unit cell
-    for(std::size_t i2 = NGHOSTS; i2 < r.Ld[2] - NGHOSTS; i2++)
-      for(std::size_t i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1++)
-        for(std::size_t i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0++)
+    for(std::size_t i2 = NGHOSTS; i2 < NGHOSTS + r.lr[2]; i2++)
+      for(std::size_t i1 = NGHOSTS; i1 < NGHOSTS + r.lr[1]; i1++)
+        for(std::size_t i0 = NGHOSTS; i0 < NGHOSTS + r.lr[0]; i0++)
           {
             local_coords.set({i0,i1,i2, std::size_t(0)});
             r.convertCoordinates(global_coords, local_coords);          // Converts the coordinates within a thread to global coordinates
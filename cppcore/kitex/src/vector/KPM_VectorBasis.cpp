@@ -77,17 +77,50 @@ void KPM_VectorBasis<T,D>::Velocity(KPM_Vector<T,D> * kpm_final,  std::vector<st
   // kpm_final shoud be different from this instance
   // 
   auto* child = static_cast<KPM_Vector<T,D>*>(this);
+  const unsigned slot = static_cast<unsigned>(pos);
+  T * phi_final = kpm_final->v.col(kpm_final->get_index()).data();
   switch(indices.at(pos).size())
     {
     case 0:
+      // Only the on-site operator, if there is one
+      if(!h.has_operator(slot))
+        return;
+      h.apply_operator(slot, v.col(index).data(), phi_final);
       break;
     default:
       {
+        if(!h.has_operator(slot))
+          {
+            child->inc_index(); 
+            child->template KPM_MOTOR<0u, true>(kpm_final, slot);
+            child->dec_index();
+            break;
+          }
+        
+        // Anti-commutator (O v + v O)/2 with the on-site operator O. The velocity is applied to
+        // O|phi> by putting it in place of |phi>, with its ghosts exchanged again because O
+        // mixes the orbitals of the vacancies of the neighbouring domains
+        Eigen::Matrix<T, Eigen::Dynamic, 1> phi = v.col(index), vO;
+        h.apply_operator(slot, phi.data(), v.col(index).data());
+        child->Exchange_Boundaries();
         child->inc_index(); 
-        child->template KPM_MOTOR<0u, true>(kpm_final, static_cast<unsigned>(pos));
+        child->template KPM_MOTOR<0u, true>(kpm_final, slot);
         child->dec_index();
+        vO = kpm_final->v.col(kpm_final->get_index());
+        
+        v.col(index) = phi;
+        child->inc_index(); 
+        child->template KPM_MOTOR<0u, true>(kpm_final, slot);
+        child->dec_index();
+        phi = kpm_final->v.col(kpm_final->get_index());
+        h.apply_operator(slot, phi.data(), phi_final);
+        kpm_final->v.col(kpm_final->get_index()) = (kpm_final->v.col(kpm_final->get_index()) + vO)/value_type(2);
       }
     }
+  
+  // KPM_MOTOR only fills the bulk of the domain. The ghosts of the result are read when it is
+  // iterated or multiplied by another velocity
+  kpm_final->Exchange_Boundaries();
 }
 
 template<typename T, unsigned D>
@@ -0,0 +1,33 @@
+#include <cstddef>
+
+// Custom local potential loaded by KITEx at runtime, without recompiling KITEx:
+// g++ -Wall -O3 -fPIC -shared -o libpotential.so plugin.cpp
+// and use kite.Configuration(..., custom_local_plugin="./libpotential.so")
+
+extern "C" void kite_local_potential(std::size_t n, unsigned dim, const double *positions,
+                                     const unsigned *orbitals, double *V){
+    // positions holds dim coordinates per site: positions[i*dim] = x, positions[i*dim + 1] = y, ...
+    // KITEx calls this function from every thread, with batches of the sites of its domain
+    const double Lx = 512, Ly = 512;
+
+    for(std::size_t i = 0; i < n; i++){
+        const double x = positions[i*dim];
+        const double y = positions[i*dim + 1];
+        const unsigned orb = orbitals[i];
+
+        // Same potential as hamaux.cpp
+        double dx = x - Lx/2;
+        double dy = y - Ly/2;
+        double r2 = dx*dx + dy*dy;
+
+        V[i] = 0;
+        if(r2 < 10000 and orb == 0)
+            V[i] = -1.1;
+
+        if(100 < x and x < 200 and 300 < y and y < 400)
+            V[i] = 0.6;
+
+        if(orb == 1 and x > 500)
+            V[i] = 1.0;
+    }
+}
@@ -22,13 +22,18 @@ class Calculation:
         self._conductivity_optical_nonlinear = []
         self._gaussian_wave_packet = []
         self._singleshot_conductivity_dc = []
+        self._singleshot_conductivity_optical = []
+        self._bond_currents = []
+        self._local_chern_marker = []
+        self._hartree_potential = []
 
         self._avail_dir_full = {'xx': 0, 'yy': 1, 'zz': 2, 'xy': 3, 'xz': 4, 'yx': 5, 'yz': 6, 'zx': 7, 'zy': 8}
         self._avail_dir_nonl = {'xxx': 0, 'xxy': 1, 'xxz': 2, 'xyx': 3, 'xyy': 4, 'xyz': 5, 'xzx': 6, 'xzy': 7,
                                 'xzz': 8, 'yxx': 9, 'yxy': 10, 'yxz': 11, 'yyx': 12, 'yyy': 13, 'yyz': 14, 'yzx': 15,
                                 'yzy': 16, 'yzz': 17, 'zxx': 18, 'zxy': 19, 'zxz': 20, 'zyx': 21, 'zyy': 22, 'zyz': 23,
                                 'zzx': 24, 'zzy': 25, 'zzz': 26}
-        self._avail_dir_sngl = {'xx': 0, 'yy': 1, 'zz': 2}
+        self._avail_dir_sngl = {'xx': 0, 'yy': 1, 'zz': 2, 'xy': 3, 'xz': 4, 'yx': 5, 'yz': 6, 'zx': 7, 'zy': 8}
+        self._avail_dir_bond = {'x': 0, 'y': 1, 'z': 2}
     @property
     def get_dos(self):
         """Returns the requested DOS functions."""
@@ -70,7 +75,27 @@ class Calculation:
         """Returns the requested singleshot DC conductivity functions."""
         return self._singleshot_conductivity_dc
 
-    def dos(self, num_points, num_moments, num_random, num_disorder=1):
+    @property
+    def get_singleshot_conductivity_optical(self):
+        """Returns the requested singleshot optical conductivity functions."""
+        return self._singleshot_conductivity_optical
+
+    @property
+    def get_bond_currents(self):
+        """Returns the requested bond current maps."""
+        return self._bond_currents
+
+    @property
+    def get_local_chern_marker(self):
+        """Returns the requested local Chern markers."""
+        return self._local_chern_marker
+
+    @property
+    def get_hartree_potential(self):
+        """Returns the requested self-consistent Hartree potential."""
+        return self._hartree_potential
+
+    def dos(self, num_points, num_moments, num_random, num_disorder=1, operator=None):
         """Calculate the density of states as a function of energy
 
         Parameters
@@ -83,12 +108,16 @@ class Calculation:
             Number of random vectors to use for the stochastic evaluation of trace.
         num_disorder : int
             Number of different disorder realisations.
+        operator : np.ndarray, optional
+            Hermitian matrix O acting on the orbitals of each unit cell, in the order of the orbitals in the
+            configuration file. The projected density of states Tr[O delta(E-H)] is calculated instead, for instance
+            the spin polarization with O = sigma_z, or the weight of some orbitals with a projector.
         """
 
         self._dos.append({'num_points': num_points, 'num_moments': num_moments, 'num_random': num_random,
-                          'num_disorder': num_disorder})
+                          'num_disorder': num_disorder, 'operator': operator})
 
-    def ldos(self, energy, num_moments, position, sublattice, num_disorder=1):
+    def ldos(self, energy, num_moments, position, sublattice, num_disorder=1, method='chebyshev'):
         """Calculate the local density of states as a function of energy
 
         Parameters
@@ -96,18 +125,24 @@ class Calculation:
         energy : list or np.array
             List of energy points at which the LDOS will be calculated.
         num_moments : int
-            Number of polynomials in the Chebyshev expansion.
+            Number of polynomials in the Chebyshev expansion, or number of levels of the recursion.
         num_disorder : int
             Number of different disorder realisations.
         position : list
             Relative index of the unit cell where the LDOS will be calculated.
         sublattice : str or list
             Name of the sublattice at which the LDOS will be calculated.
+        method : str
+            'chebyshev' for the Chebyshev moments, or 'recursion' for the continued fraction
+            of the Haydock (Lanczos) recursion.
         """
 
+        if method not in ('chebyshev', 'recursion'):
+            raise SystemExit('The LDOS method should be either \'chebyshev\' or \'recursion\'.')
+
         self._ldos.append({'energy': energy, 'num_moments': num_moments,
                            'position': np.reshape(np.array(position).flatten(), (-1, np.shape(position)[-1])),
-                           'sublattice': sublattice, 'num_disorder': num_disorder})
+                           'sublattice': sublattice, 'num_disorder': num_disorder, 'method': method})
 
     def arpes(self, k_vector, weight, num_moments, num_disorder=1):
         """Calculate the spectral contribution for given k-points and weights.
@@ -152,15 +187,28 @@ class Calculation:
             Optional parameters, forward probing point, defined with x, y coordinate were the wavepacket will be checked
             at different timesteps.
 
+            Optional parameters of a time-dependent Hamiltonian H(t) = H_0 + f(t) V, with the time in the units of the
+            timestep: drive, a function f(t) that accepts an array of times; vector_potential, the vector potential
+            per unit of f(t), which enters the Peierls phases of the hoppings; onsite_drive, the on-site energy per
+            unit of f(t) of each orbital, in the order of the orbitals in the configuration file; num_substeps, the
+            number of steps of the propagator in each timestep (default 1).
         """
         probing_point = kwargs.get('probing_point', 0)
+        drive = kwargs.get('drive', None)
+        if drive is not None and not callable(drive):
+            raise SystemExit('The drive of the wave packet should be a function of time!')
+        if drive is None and any(kwargs.get(key) is not None for key in ('vector_potential', 'onsite_drive')):
+            raise SystemExit('The vector potential and the on-site drive of the wave packet need a drive function!')
 
         self._gaussian_wave_packet.append(
             {'num_points': num_points, 'num_moments': num_moments,
              'timestep': timestep, 'num_disorder': num_disorder, 'spinor': spinor, 'width': width, 'k_vector': k_vector,
-             'mean_value': mean_value, 'probing_point': probing_point})
+             'mean_value': mean_value, 'probing_point': probing_point, 'drive': drive,
+             'vector_potential': kwargs.get('vector_potential', None), 'onsite_drive': kwargs.get('onsite_drive', None),
+             'num_substeps': kwargs.get('num_substeps', 1)})
 
-    def conductivity_dc(self, direction, num_points, num_moments, num_random, num_disorder=1, temperature=0):
+    def conductivity_dc(self, direction, num_points, num_moments, num_random, num_disorder=1, temperature=0,
+                        operators=None):
         """Calculate the DC conductivity for a given direction
 
         Parameters
@@ -176,18 +224,24 @@ class Calculation:
             Number of random vectors to use for the stochastic evaluation of trace.
         num_disorder : int
             Number of different disorder realisations.
-        temperature : float
-            Value of the temperature at which we calculate the response.
+        temperature : float or list of floats
+            Value of the temperature at which we calculate the response. When a list is given, KITE-tools
+            computes the conductivity for all the temperatures in a single pass.
+        operators : tuple, optional
+            Pair of Hermitian matrices (O_1, O_2) acting on the orbitals of each unit cell, either of which can be
+            None. The current along the first (second) direction is replaced by the anti-commutator {O_1, v}/2
+            ({O_2, v}/2), for instance the spin current with O_1 = sigma_z for the spin Hall conductivity.
         """
         if direction not in self._avail_dir_full:
             print('The desired direction is not available. Choose from a following set: \n',
                   self._avail_dir_full.keys())
             raise SystemExit('Invalid direction!')
-        else:
-            self._conductivity_dc.append(
-                {'direction': self._avail_dir_full[direction], 'num_points': num_points, 'num_moments': num_moments,
-                 'num_random': num_random, 'num_disorder': num_disorder,
-                 'temperature': temperature})
+        if operators is not None and len(operators) != 2:
+            raise SystemExit('The operators of the DC conductivity must be a pair (O_1, O_2)!')
+        self._conductivity_dc.append(
+            {'direction': self._avail_dir_full[direction], 'num_points': num_points, 'num_moments': num_moments,
+             'num_random': num_random, 'num_disorder': num_disorder,
+             'temperature': temperature, 'operators': operators})
 
     def conductivity_optical(self, direction, num_points, num_moments, num_random, num_disorder=1, temperature=0):
         """Calculate optical conductivity for a given direction
@@ -254,7 +308,7 @@ class Calculation:
                  'temperature': temperature, 'special': special})
 
     def singleshot_conductivity_dc(self, energy, direction, eta, num_moments, num_random, num_disorder=1,
-                                   preserve_disorder=False):
+                                   preserve_disorder=False, temperature=0, num_points=None, min_energy=None):
         """Calculate the DC conductivity using KITEx for a fiven direction and energy
 
         Parameters
@@ -263,7 +317,7 @@ class Calculation:
             Array or a single value of energies at which singleshot_conductivity_dc will be calculated.
         direction : string
             direction in xyz coordinates along which the conductivity is calculated.
-            Supports 'xx', 'yy', 'zz'.
+            Supports 'xx', 'yy', 'zz' and, for the Hall conductivity, 'xy', 'xz', 'yx', 'yz', 'zx', 'zy'.
         eta : Float
             Parameter that affects the broadening of the kernel function.
         num_moments : int
@@ -274,6 +328,14 @@ class Calculation:
             Number of different disorder realisations.
         preserve_disorder : bool
             If True, preverse the disorder configuration for calculations with different random vectors. Default False.
+        temperature : float
+            Temperature of the Fermi-Dirac distribution, only used by the Hall conductivity.
+        num_points : int
+            Number of energies of the grid on which the Hall conductivity is integrated over the Fermi sea. By
+            default, the spacing of the grid is a quarter of eta.
+        min_energy : float
+            Lower limit of the integral of the Hall conductivity over the Fermi sea, in eV. By default, the bottom
+            of the rescaled spectrum, energy_shift - energy_scale.
         """
 
         if direction not in self._avail_dir_sngl:
@@ -286,4 +348,169 @@ class Calculation:
                  'direction': self._avail_dir_sngl[direction],
                  'eta': np.atleast_1d(eta), 'num_moments': np.atleast_1d(num_moments),
                  'num_random': num_random, 'num_disorder': num_disorder,
-                 'preserve_disorder': np.atleast_1d(preserve_disorder)})
\ No newline at end of file
+                 'preserve_disorder': np.atleast_1d(preserve_disorder),
+                 'temperature': temperature, 'num_points': num_points, 'min_energy': min_energy})
+
+    def singleshot_conductivity_optical(self, energy, frequency, direction, eta, num_moments, num_random,
+                                        num_disorder=1, temperature=0, num_points=None):
+        """Calculate the real part of the optical conductivity using KITEx for a given direction, Fermi energy and
+        frequency
+
+        Parameters
+        ----------
+        energy : ndarray or float
+            Array or a single value of Fermi energies.
+        frequency : ndarray or float
+            Array or a single value of frequencies, with the same length as energy or a single value.
+        direction : string
+            direction in xyz coordinates along which the conductivity is calculated.
+            Supports 'xx', 'yy', 'zz'.
+        eta : ndarray or float
+            Broadening of the delta functions.
+        num_moments : ndarray or int
+            Number of polynomials in the Chebyshev expansion.
+        num_random : int
+            Number of random vectors to use for the stochastic evaluation of trace.
+        num_disorder : int
+            Number of different disorder realisations.
+        temperature : float
+            Temperature of the Fermi-Dirac distribution.
+        num_points : int
+            Number of energies on which the Kubo-Greenwood formula is integrated for each frequency. By default, the
+            spacing of the energies is a quarter of eta.
+        """
+
+        if direction not in self._avail_dir_full or self._avail_dir_full[direction] > 2:
+            print('The desired direction is not available. Choose from a following set: \n', ['xx', 'yy', 'zz'])
+            raise SystemExit('Invalid direction!')
+        else:
+            self._singleshot_conductivity_optical.append(
+                {'energy': np.atleast_1d(energy), 'frequency': np.atleast_1d(frequency),
+                 'direction': self._avail_dir_full[direction],
+                 'eta': np.atleast_1d(eta), 'num_moments': np.atleast_1d(num_moments),
+                 'num_random': num_random, 'num_disorder': num_disorder,
+                 'temperature': temperature, 'num_points': num_points})
+
+    def bond_currents(self, energy, direction, eta, num_moments, num_random, num_disorder=1):
+        """Calculate the map of the currents through the bonds of the lattice, in response to an electric field
+        along a given direction, using KITEx
+
+        Parameters
+        ----------
+        energy : ndarray or float
+            Array or a single value of Fermi energies.
+        direction : string
+            Direction of the electric field. Supports 'x', 'y' and 'z'.
+        eta : float
+            Broadening of the delta functions.
+        num_moments : int
+            Number of polynomials in the Chebyshev expansion.
+        num_random : int
+            Number of random vectors to use for the stochastic evaluation of trace.
+        num_disorder : int
+            Number of different disorder realisations.
+        """
+
+        if direction not in self._avail_dir_bond:
+            print('The desired direction is not available. Choose from a following set: \n',
+                  self._avail_dir_bond.keys())
+            raise SystemExit('Invalid direction!')
+        else:
+            self._bond_currents.append(
+                {'energy': np.atleast_1d(energy), 'direction': self._avail_dir_bond[direction],
+                 'eta': eta, 'num_moments': num_moments,
+                 'num_random': num_random, 'num_disorder': num_disorder})
+
+    def local_chern_marker(self, energy, num_moments, position=None, sublattice=None, region=None, num_random=1,
+                           num_disorder=1):
+        """Calculate the local Chern marker of a two-dimensional insulator at given sites, or its average over
+        rectangular regions of the sample, using KITEx
+
+        Parameters
+        ----------
+        energy : ndarray or float
+            Array or a single value of Fermi energies, inside the gap.
+        num_moments : int
+            Number of polynomials in the Chebyshev expansion of the projector onto the occupied states.
+        position : list, optional
+            Relative index of the unit cells of the sites, as in the LDOS.
+        sublattice : str or list, optional
+            Name of the sublattice of the sites, as in the LDOS.
+        region : list, optional
+            List of rectangular regions, each given by the relative index of its first unit cell and its number of
+            unit cells along each direction, [[i0, j0], [ni, nj]].
+        num_random : int
+            Number of random vectors used for the average over each region.
+        num_disorder : int
+            Number of different disorder realisations.
+        """
+
+        if position is None and region is None:
+            raise SystemExit('The local Chern marker needs either the positions of the sites or the regions!')
+        if (position is None) != (sublattice is None):
+            raise SystemExit('The sites of the local Chern marker are given by both a position and a sublattice!')
+
+        if position is not None:
+            position = np.reshape(np.array(position).flatten(), (-1, np.shape(position)[-1]))
+        if region is not None:
+            region = np.reshape(np.array(region, dtype=int), (-1, 2, np.shape(region)[-1]))
+        self._local_chern_marker.append(
+            {'energy': np.atleast_1d(energy), 'num_moments': num_moments, 'position': position,
+             'sublattice': sublattice, 'region': region, 'num_random': num_random, 'num_disorder': num_disorder})
+
+    def hartree_potential(self, fermi_energy, num_moments, onsite=0, kernel=None, cutoff=0, temperature=0,
+                          num_random=None, probing_distance=None, reference=None, mixing=0.3, history=5,
+                          tolerance=1e-3, max_iterations=50, initial_potential=None):
+        """Solve for a self-consistent Hartree potential before the other calculations, using KITEx
+
+        The local densities n_j of all the sites are obtained from a Chebyshev expansion of the Fermi function,
+        and the potential V_i = sum_j K_ij (n_j - n0_j) is added to the onsite energies until it stops changing.
+        The converged potential is used by all the other calculations of the same configuration file.
+
+        Parameters
+        ----------
+        fermi_energy : float
+            Chemical potential.
+        num_moments : int
+            Number of polynomials in the Chebyshev expansion of the Fermi function.
+        onsite : float
+            Interaction between orbitals at the same position, including the interaction of an orbital with itself.
+        kernel : callable, optional
+            Interaction between orbitals at a distance 0 < r <= cutoff, as a function of r.
+        cutoff : float
+            Range of the kernel, in the units of the lattice vectors.
+        temperature : float
+            Temperature of the Fermi function.
+        num_random : int, optional
+            Number of random vectors used to estimate the local densities.
+        probing_distance : int, optional
+            Estimate the local densities with probing vectors instead, on the unit cells whose relative indices are
+            equal modulo probing_distance. It should be larger than the decay length of the density matrix and
+            divide the number of unit cells along each periodic direction.
+        reference : ndarray or float, optional
+            Density of each orbital that does not create a potential, such as the neutral filling. By default, the
+            average density of each orbital in the first iteration.
+        mixing : float
+            Fraction of the new potential mixed into the old one at each iteration.
+        history : int
+            Number of previous iterations used by the Anderson mixing. Zero gives linear mixing.
+        tolerance : float
+            Largest change of the potential at any site for which the loop has converged.
+        max_iterations : int
+            Maximum number of iterations.
+        initial_potential : ndarray, optional
+            Starting potential, for instance the Potential of a previous output, with one row per orbital and one
+            column per unit cell.
+        """
+
+        if (num_random is None) == (probing_distance is None):
+            raise SystemExit('The Hartree potential needs either a number of random vectors or a probing distance!')
+        if kernel is not None and not callable(kernel):
+            raise SystemExit('The kernel of the Hartree potential should be a function of the distance!')
+
+        self._hartree_potential.append(
+            {'fermi_energy': fermi_energy, 'num_moments': num_moments, 'onsite': onsite, 'kernel': kernel,
+             'cutoff': cutoff, 'temperature': temperature, 'num_random': num_random or 0,
+             'probing_distance': probing_distance or 0, 'reference': reference, 'mixing': mixing,
+             'history': history, 'tolerance': tolerance, 'max_iterations': max_iterations,
+             'initial_potential': initial_potential})
@@ -14,7 +14,7 @@ class Configuration:
 
     def __init__(self, divisions=(1, 1, 1), length=(1, 1, 1), boundaries=('open', 'open', 'open'),
                  is_complex=False, precision=1, spectrum_range=None, angles=(0, 0, 0), custom_local=False,
-                 custom_local_print=False):
+                 custom_local_print=False, custom_local_plugin=None):
         r"""Define basic parameters used in the calculation
 
        Parameters
@@ -38,6 +38,13 @@ class Configuration:
             Energy scale which defines the scaling factor of all the energy related parameters. The scaling is done
             automatically in the background after this definition. If the term is not specified, a rough estimate of the
             bounds is found.
+       custom_local : bool
+            Boolean that reflects whether the calculation should use the user-defined local potential.
+       custom_local_print : bool
+            Boolean that reflects whether KITEx should output the values of the local potential.
+       custom_local_plugin : Optional[str]
+            Path to a shared library exporting kite_local_potential, loaded by KITEx at runtime. Setting it implies
+            custom_local=True.
        """
 
         if spectrum_range:
@@ -62,6 +69,9 @@ class Configuration:
         self._Twists = np.array(angles, dtype=np.float64)
         self._custom_local = custom_local
         self._print_custom_local = custom_local_print
+        self._custom_local_plugin = custom_local_plugin
+        if custom_local_plugin is not None:
+            self._custom_local = True
 
         self._length = length
         self._htype = np.float32
@@ -159,6 +169,11 @@ class Configuration:
         """Return print custom potential flag"""
         return self._print_custom_local
 
+    @property
+    def custom_pot_plugin(self):  # -> potential
+        """Return the path of the custom potential plugin"""
+        return self._custom_local_plugin
+
 
 def estimate_bounds(lattice, disorder=None, disorder_structural=None):
     model = make_pybinding_model(lattice, disorder, disorder_structural)
@@ -8,6 +8,7 @@ class Modification:
     def __init__(self, **kwargs):
         self._magnetic_field = kwargs.get('magnetic_field', None)
         self._flux = kwargs.get('flux', None)
+        self._field_profile = kwargs.get('field_profile', None)
 
     @property
     def magnetic_field(self):  # magnetic_field:
@@ -18,3 +19,8 @@ class Modification:
     def flux(self):  # flux:
         """Returns the number of multiples of flux quantum."""
         return self._flux
+
+    @property
+    def field_profile(self):  # field_profile:
+        """Returns the magnetic field profile along the last lattice vector: an array or a function of the row index."""
+        return self._field_profile
@@ -4,13 +4,115 @@ import numpy as np
 import h5py as hp
 import pybinding as pb
 import pybinding
-from scipy.sparse import coo_matrix
+from scipy.sparse import coo_matrix, csr_matrix, identity
 
 import kite
 from typing import Optional
 from .modification import Modification
 from .utils.model import estimate_bounds
-__all__ = ['config_system']
+__all__ = ['config_system', 'config_sparse_system']
+
+
+def _operators(calculation):
+    """Return the orbital operators of all the requested functions."""
+    operators = [single['operator'] for single in calculation.get_dos]
+    for single in calculation.get_conductivity_dc:
+        operators += list(single['operators'] or [])
+    return operators
+
+
+def _write_operators(group, operators, num_orbitals, config):
+    """Write the orbital operator of each velocity slot as Operator0, Operator1, ... Slots with None keep the plain
+    velocity."""
+    for n, operator in enumerate(operators):
+        if operator is None:
+            continue
+        operator = np.atleast_2d(np.asarray(operator))
+        if operator.shape != (num_orbitals, num_orbitals):
+            raise SystemExit('The orbital operators must be {0}x{0} matrices, one row and column per orbital!'
+                             .format(num_orbitals))
+        if not np.allclose(operator, operator.conj().T):
+            raise SystemExit('The orbital operators must be Hermitian!')
+        group.create_dataset('Operator{}'.format(n), data=operator.astype(config.type))
+
+
+def _site_indices(position, sublattice, lattice, orbitals_before, config, space_size, name):
+    """Return the orbital and the index of the unit cell of the probed sites, given by the relative index of their
+    unit cell and the name of their sublattice."""
+    len_pos = np.array(position).shape[0]
+
+    if isinstance(sublattice, list):
+        len_sub = len(sublattice)
+    else:
+        len_sub = 1
+        sublattice = [sublattice]
+
+    if len_pos != len_sub and (len_pos != 1 and len_sub != 1):
+        raise SystemExit('Number of sublattices and number of positions should either have the same '
+                         'length or should be specified as a single value! Choose them accordingly.')
+
+    # get the names and sublattices from the lattice
+    names, sublattices_all = zip(*lattice.sublattices.items())
+
+    # convert relative index and sublattice to orbital number
+    orbitals = []
+    system_l = config._length
+    Lx = system_l[0]
+    Ly = 1
+    Lz = 1
+
+    if len(system_l) == 2:
+        Ly = system_l[1]
+    elif len(system_l) == 3:
+        Ly = system_l[1]
+        Lz = system_l[2]
+
+    for item in position:
+        if item.shape[0] != space_size:
+            raise SystemExit('The probing position for the ' + name + ' should be selected with the '
+                             'relative index of length {}'.format(space_size))
+
+    # Check if pos cell is valid
+    if space_size == 1:
+        if not np.all(0 <= np.squeeze(np.asarray(item))[0] < Lx for item in position):
+            raise SystemExit('The probing position for the ' + name + ' should be selected within the relative '
+                             'coordinates [[0, {}],[0, {}],[0, {}]] with the relative index '
+                             'of length {}'.format(Lx - 1, Ly - 1, Lz - 1, space_size))
+    if space_size == 2:
+        if not np.all(np.all(0 <= np.squeeze(np.asarray(item))[0] < Lx)
+                      and np.all(0 <= np.squeeze(np.asarray(item))[1] < Ly) for item in position):
+            raise SystemExit('The probing position for the ' + name + ' should be selected within the relative '
+                             'coordinates [[0, {}],[0, {}],[0, {}]] with the relative index '
+                             'of length {}'.format(Lx - 1, Ly - 1, Lz - 1, space_size))
+
+    if space_size == 3:
+        if not np.all(0 <= np.squeeze(np.asarray(item))[0] < Lx and 0 <= np.squeeze(np.asarray(item))[1] < Ly
+                   and 0 <= np.squeeze(np.asarray(item))[2] < Lz for item in position):
+            raise SystemExit('The probing position for the ' + name + ' should be selected within the relative '
+                             'coordinates [[0, {}],[0, {}],[0, {}]] with the relative index '
+                             'of length {}'.format(Lx - 1, Ly - 1, Lz - 1, space_size))
+
+    # fixed_positions_index = [i, j, k] x [1, Lx, Lx*Ly]
+    fixed_positions = np.asarray(np.dot(position, np.array([1, Lx, Lx * Ly], dtype=np.int32)[0:space_size]),
+                                 dtype=np.int32).reshape(-1)
+    for sub in sublattice:
+
+        if sub not in names:
+            raise SystemExit('Desired sublattice for ' + name + ' calculation doesn\'t exist in the chosen lattice! ')
+
+        indx = names.index(sub)
+        lattice_sub = sublattices_all[indx]
+        sub_id = lattice_sub.alias_id
+        it = np.nditer(lattice_sub.energy, flags=['multi_index'])
+
+        # orbit_idx = [i, j, k] x [1, Lx, Lx*Ly] + orbital * Lx*Ly*Lz
+        while not it.finished:
+            orbit = int(orbitals_before[sub_id] + it.multi_index[0])
+            orbitals.append(orbit)
+            it.iternext()
+    if len_sub != len_pos:
+        return np.tile(np.asarray(orbitals), len_pos).reshape(-1), np.repeat(np.asarray(fixed_positions), len_sub)
+    return np.asarray(orbitals), np.asarray(fixed_positions)
 
 
 def config_system(lattice: pybinding.Lattice, config: kite.Configuration, calculation: kite.Calculation,
@@ -61,7 +163,7 @@ def config_system(lattice: pybinding.Lattice, config: kite.Configuration, calcul
         modification = Modification(magnetic_field=False)
 
     # check if magnetic field is On
-    if (modification.magnetic_field or modification.flux) and complx == 0:
+    if (modification.magnetic_field or modification.flux or modification.field_profile is not None) and complx == 0:
         print('Magnetic field is added but is_complex identifier is 0. Automatically turning is_complex to 1!')
         config._is_complex = 1
         config.set_type()
@@ -76,6 +178,12 @@ def config_system(lattice: pybinding.Lattice, config: kite.Configuration, calcul
         config._is_complex = 1
         config.set_type()
 
+    if complx == 0 and any(np.iscomplexobj(o) and np.linalg.norm(np.imag(o)) > 0 for o in _operators(calculation)):
+        print('Complex orbital operators are added but is_complex identifier is 0. Automatically turning is_complex '
+              'to 1!')
+        config._is_complex = 1
+        config.set_type()
+
 
     # hamiltonian is complex 1 or real 0
     complx = int(config.comp)
@@ -264,9 +372,10 @@ def config_system(lattice: pybinding.Lattice, config: kite.Configuration, calcul
     print('\nChosen number of decomposition parts is:', domain_dec[0:space_size], '.'
                                                                                   '\nINFO: this product will correspond to the total number of threads. '
                                                                                   '\nYou should choose at most the number of processor cores you have.'
-                                                                                  '\nWARNING: System size need\'s to be an integer multiple of \n'
+                                                                                  '\nINFO: the system is split as evenly as possible among the parts, which are padded '
+                                                                                  '\ninternally to a multiple of TILE. Sizes that are integer multiples of \n'
                                                                                   '[TILE * ', domain_dec, '] '
-                                                                                                          '\nwhere TILE is selected when compiling the C++ code. \n')
+                                                                                                          '\nneed no padding, where TILE is selected when compiling the C++ code. \n')
 
     f.create_dataset('Divisions', data=domain_dec[0:space_size], dtype='u4')
     # space dimension of the lattice 1D, 2D, 3D
@@ -291,6 +400,9 @@ def config_system(lattice: pybinding.Lattice, config: kite.Configuration, calcul
     grp.create_dataset('CustomLocalEnergy', data=localEn, dtype=int)
     # custom pot
     grp.create_dataset('PrintCustomLocalEnergy', data=printlocalEn, dtype=int)
+    if config.custom_pot_plugin is not None:
+        # shared library with the custom pot, loaded by KITEx
+        grp.create_dataset('CustomLocalPlugin', data=str(config.custom_pot_plugin))
 
     if complx:
         # hoppings
@@ -333,6 +445,46 @@ def config_system(lattice: pybinding.Lattice, config: kite.Configuration, calcul
         grp.create_dataset('MagneticFieldMul', data=int(multiply_bmin), dtype='u4')
         print('\n##############################################################################\n')
 
+    # non-uniform magnetic field, changing along the last lattice vector
+    if modification.field_profile is not None:
+        if modification.magnetic_field or modification.flux:
+            raise SystemExit('A magnetic field profile cannot be combined with a uniform magnetic field.')
+        if space_size < 2:
+            raise SystemExit('A magnetic field profile needs at least two dimensions.')
+        print('\n##############################################################################\n')
+        print('MAGNETIC FIELD PROFILE:\n')
+
+        hbar = 6.58211899 * 10 ** -16  #: [eV*s]
+        phi0 = 2 * np.pi * hbar  #: [V*s] flux quantum
+        slow = space_size - 1
+        vector1_3d = np.zeros(3)
+        vector1_3d[:len(vectors[0, :])] = vectors[0, :]
+        vector2_3d = np.zeros(3)
+        vector2_3d[:len(vectors[slow, :])] = vectors[slow, :]
+        unit_cell_area = np.linalg.norm(np.cross(vector1_3d, vector2_3d)) * 1e-18
+
+        profile = modification.field_profile
+        if callable(profile):
+            profile = [profile(row) for row in range(leng[slow])]
+        profile = np.asarray(profile, dtype=float)
+        if profile.shape != (leng[slow],):
+            raise SystemExit('The magnetic field profile needs one value for each of the {} unit cells along the '
+                             'last lattice vector.'.format(leng[slow]))
+
+        # flux quanta through the unit cells of each row; with periodic boundaries along the last lattice vector
+        # the total flux has to be an integer
+        flux_profile = profile * unit_cell_area / phi0
+        total_flux = np.sum(flux_profile)
+        if bound[slow] != 0 and abs(np.round(total_flux) - total_flux) > 1e-12:
+            flux_profile += (np.round(total_flux) - total_flux) / leng[slow]
+            print('The total flux was shifted from {:.4f} to {:d} flux quanta, changing the field by {:.4f} T in '
+                  'every row.'.format(total_flux, int(np.round(total_flux)),
+                                      (np.round(total_flux) - total_flux) / leng[slow] * phi0 / unit_cell_area))
+        print('Field ranges from {:.2f} T to {:.2f} T'.format(np.min(flux_profile) * phi0 / unit_cell_area,
+                                                               np.max(flux_profile) * phi0 / unit_cell_area))
+        grp.create_dataset('MagneticFieldProfile', data=flux_profile, dtype=np.float64)
+        print('\n##############################################################################\n')
+
     grp_dis = grp.create_group('Disorder')
 
     if disorder:
@@ -518,6 +670,7 @@ def config_system(lattice: pybinding.Lattice, config: kite.Configuration, calcul
         grpc_p.create_dataset('NumRandoms', data=random, dtype=np.int32)
         grpc_p.create_dataset('NumPoints', data=point, dtype=np.int32)
         grpc_p.create_dataset('NumDisorder', data=dis, dtype=np.int32)
+        _write_operators(grpc_p, [calculation.get_dos[0]['operator']], np.sum(num_orbitals), config)
 
     if calculation.get_ldos:
         grpc_p = grpc.create_group('ldos')
@@ -533,92 +686,18 @@ def config_system(lattice: pybinding.Lattice, config: kite.Configuration, calcul
             raise SystemExit('Only a single function request of each type is currently allowed. Please use another '
                              'configuration file for the same functionality.')
 
-        #position = np.squeeze(position)
-        len_pos = np.array(position).shape[0]
-
-        if isinstance(sublattice, list):
-            len_sub = len(sublattice)
-        else:
-            len_sub = 1
-            sublattice = [sublattice]
-
-        if len_pos != len_sub and (len_pos != 1 and len_sub != 1):
-            raise SystemExit('Number of sublattices and number of positions should either have the same '
-                             'length or should be specified as a single value! Choose them accordingly.')
-
-        # get the names and sublattices from the lattice
-        names, sublattices_all = zip(*lattice.sublattices.items())
-
-        # convert relative index and sublattice to orbital number
-        orbitals = []
-        system_l = config._length
-        Lx = system_l[0]
-        Ly = 1
-        Lz = 1
-
-        if len(system_l) == 2:
-            Ly = system_l[1]
-        elif len(system_l) == 3:
-            Ly = system_l[1]
-            Lz = system_l[2]
-
-        for item in position:
-            if item.shape[0] != space_size:
-                raise SystemExit('The probing position for the LDOS should be selected with the '
-                                 'relative index of length {}'.format(space_size))
-
-        # Check if pos cell is valid
-        if space_size == 1:
-            if not np.all(0 <= np.squeeze(np.asarray(item))[0] < Lx for item in position):
-                raise SystemExit('The probing position for the LDOS should be selected within the relative '
-                                 'coordinates [[0, {}],[0, {}],[0, {}]] with the relative index '
-                                 'of length {}'.format(Lx - 1, Ly - 1, Lz - 1, space_size))
-        if space_size == 2:
-            if not np.all(np.all(0 <= np.squeeze(np.asarray(item))[0] < Lx)
-                          and np.all(0 <= np.squeeze(np.asarray(item))[1] < Ly) for item in position):
-                raise SystemExit('The probing position for the LDOS should be selected within the relative '
-                                 'coordinates [[0, {}],[0, {}],[0, {}]] with the relative index '
-                                 'of length {}'.format(Lx - 1, Ly - 1, Lz - 1, space_size))
-
-        if space_size == 3:
-            if not np.all(0 <= np.squeeze(np.asarray(item))[0] < Lx and 0 <= np.squeeze(np.asarray(item))[1] < Ly
-                       and 0 <= np.squeeze(np.asarray(item))[2] < Lz for item in position):
-                raise SystemExit('The probing position for the LDOS should be selected within the relative '
-                                 'coordinates [[0, {}],[0, {}],[0, {}]] with the relative index '
-                                 'of length {}'.format(Lx - 1, Ly - 1, Lz - 1, space_size))
-
-        # fixed_positions_index = [i, j, k] x [1, Lx, Lx*Ly]
-        fixed_positions = np.asarray(np.dot(position, np.array([1, Lx, Lx * Ly], dtype=np.int32)[0:space_size]),
-                                     dtype=np.int32).reshape(-1)
-        # num_positions_ldos = fixed_positions.shape[0]
-        for sub in sublattice:
-
-            if sub not in names:
-                raise SystemExit('Desired sublattice for LDOS calculation doesn\'t exist in the chosen lattice! ')
-
-            indx = names.index(sub)
-            lattice_sub = sublattices_all[indx]
-            sub_id = lattice_sub.alias_id
-            it = np.nditer(lattice_sub.energy, flags=['multi_index'])
-
-            # orbit_idx = [i, j, k] x [1, Lx, Lx*Ly] + orbital * Lx*Ly*Lz
-            while not it.finished:
-                orbit = int(orbitals_before[sub_id] + it.multi_index[0])
-                orbitals.append(orbit)
-                it.iternext()
-        # num_orbitals = np.asarray(orbitals).shape[0]
+        orbitals, fixed_positions = _site_indices(position, sublattice, lattice, orbitals_before, config,
+                                                  space_size, 'LDOS')
         if len(calculation.get_ldos) > 1:
             raise SystemExit('Only a single function request of each type is currently allowed. Please use another '
                              'configuration file for the same functionality.')
         grpc_p.create_dataset('NumMoments', data=moments, dtype=np.int32)
         grpc_p.create_dataset('Energy', data=(np.asarray(energy) - config.energy_shift) / config.energy_scale, dtype=np.float32)
-        if len_sub != len_pos:
-            grpc_p.create_dataset('Orbitals', data=np.tile(np.asarray(orbitals),len_pos).reshape(-1), dtype=np.int32)
-            grpc_p.create_dataset('FixPosition', data=np.repeat(np.asarray(fixed_positions),len_sub), dtype=np.int32)
-        else:
-            grpc_p.create_dataset('Orbitals', data=np.asarray(orbitals), dtype=np.int32)
-            grpc_p.create_dataset('FixPosition', data=np.asarray(fixed_positions), dtype=np.int32)
+        grpc_p.create_dataset('Orbitals', data=orbitals, dtype=np.int32)
+        grpc_p.create_dataset('FixPosition', data=fixed_positions, dtype=np.int32)
         grpc_p.create_dataset('NumDisorder', data=dis, dtype=np.int32)
+        if single_ldos['method'] == 'recursion':
+            grpc_p.create_dataset('Recursion', data=1, dtype=np.int32)
 
     if calculation.get_arpes:
         grpc_p = grpc.create_group('arpes')
@@ -671,6 +750,32 @@ def config_system(lattice: pybinding.Lattice, config: kite.Configuration, calcul
         grpc_p.create_dataset('k_vector', data=np.reshape(np.array(k_vector).flatten(), (-1, space_size)), dtype=np.float64)
         grpc_p.create_dataset('timestep', data=timestep, dtype=np.float32)
 
+        single_gauss_wavepacket = calculation.get_gaussian_wave_packet[0]
+        if single_gauss_wavepacket['drive'] is not None:
+            # f(t) at the two Gauss points of each sub-step of the propagator, and at the time points
+            drive = single_gauss_wavepacket['drive']
+            num_substeps = int(single_gauss_wavepacket['num_substeps'])
+            step = float(np.ravel(timestep)[0]) / num_substeps
+            num_steps = (int(np.ravel(num_points)[0]) - 1) * num_substeps
+            starts = np.arange(num_steps) * step
+            gauss = np.stack([starts + (0.5 - np.sqrt(3) / 6) * step, starts + (0.5 + np.sqrt(3) / 6) * step], axis=1)
+            vector_potential = single_gauss_wavepacket['vector_potential']
+            onsite_drive = single_gauss_wavepacket['onsite_drive']
+            if vector_potential is None:
+                vector_potential = np.zeros(space_size)
+            if onsite_drive is None:
+                onsite_drive = np.zeros(np.sum(num_orbitals))
+            if np.size(vector_potential) != space_size or np.size(onsite_drive) != np.sum(num_orbitals):
+                raise SystemExit('The vector potential of the wave packet needs one component per dimension, and the '
+                                 'on-site drive one energy per orbital!')
+            grpc_p.create_dataset('NumSubsteps', data=num_substeps, dtype=np.int32)
+            grpc_p.create_dataset('Drive', data=np.reshape(np.asarray(drive(gauss.ravel()), dtype=np.float64),
+                                                           (num_steps, 2)))
+            grpc_p.create_dataset('DrivePoints', data=np.asarray(drive(np.arange(np.ravel(num_points)[0]) *
+                                                                       float(np.ravel(timestep)[0])), dtype=np.float64))
+            grpc_p.create_dataset('VectorPotential', data=np.ravel(vector_potential), dtype=np.float64)
+            grpc_p.create_dataset('OnsiteDrive', data=np.ravel(onsite_drive) / config.energy_scale, dtype=np.float64)
+
     if calculation.get_conductivity_dc:
         grpc_p = grpc.create_group('conductivity_dc')
 
@@ -690,8 +795,11 @@ def config_system(lattice: pybinding.Lattice, config: kite.Configuration, calcul
         grpc_p.create_dataset('NumRandoms', data=np.asarray(random), dtype=np.int32)
         grpc_p.create_dataset('NumPoints', data=np.asarray(point), dtype=np.int32)
         grpc_p.create_dataset('NumDisorder', data=np.asarray(dis), dtype=np.int32)
-        grpc_p.create_dataset('Temperature', data=np.asarray(temp) / config.energy_scale, dtype=np.float64)
+        grpc_p.create_dataset('Temperature', data=np.asarray(temp, dtype=np.float64).reshape(-1) / config.energy_scale,
+                              dtype=np.float64)
         grpc_p.create_dataset('Direction', data=np.asarray(direction), dtype=np.int32)
+        _write_operators(grpc_p, calculation.get_conductivity_dc[0]['operators'] or [], np.sum(num_orbitals),
+                         config)
 
     if calculation.get_conductivity_optical:
         grpc_p = grpc.create_group('conductivity_optical')
@@ -743,6 +851,7 @@ def config_system(lattice: pybinding.Lattice, config: kite.Configuration, calcul
         grpc_p = grpc.create_group('singleshot_conductivity_dc')
 
         moments, random, dis, energies, eta, direction, preserve_disorder = [], [], [], [], [], [], []
+        temp, point, min_energy = [], [], []
 
         for single_singlshot_cond in calculation.get_singleshot_conductivity_dc:
 
@@ -786,6 +895,15 @@ def config_system(lattice: pybinding.Lattice, config: kite.Configuration, calcul
             dis.append(single_singlshot_cond['num_disorder'])
             direction.append(single_singlshot_cond['direction'])
             preserve_disorder.append(preserve_disorder_)
+            temp.append(single_singlshot_cond['temperature'])
+            point.append(single_singlshot_cond['num_points'] or 0)
+            if single_singlshot_cond['min_energy'] is None:
+                min_energy.append(-1.0)
+            else:
+                min_energy.append((single_singlshot_cond['min_energy'] - config.energy_shift) / config.energy_scale)
+                if not -1 <= min_energy[-1] < 1:
+                    raise SystemExit('The lower limit of the Hall conductivity integral has to be inside the spectrum '
+                                     'range!')
 
         if len(calculation.get_singleshot_conductivity_dc) > 1:
             raise SystemExit('Only a single function request of each type is currently allowed. Please use another '
@@ -798,6 +916,266 @@ def config_system(lattice: pybinding.Lattice, config: kite.Configuration, calcul
         grpc_p.create_dataset('Gamma', data=np.asarray(eta) / config.energy_scale, dtype=np.float64)
         grpc_p.create_dataset('Direction', data=np.asarray(direction), dtype=np.int32)
         grpc_p.create_dataset('PreserveDisorder', data=np.asarray(preserve_disorder).astype(int), dtype=np.int32)
+        grpc_p.create_dataset('Temperature', data=np.asarray(temp) / config.energy_scale, dtype=np.float64)
+        grpc_p.create_dataset('NumPoints', data=np.asarray(point), dtype=np.int32)
+        grpc_p.create_dataset('MinEnergy', data=np.asarray(min_energy), dtype=np.float64)
+
+    if calculation.get_singleshot_conductivity_optical:
+        if len(calculation.get_singleshot_conductivity_optical) > 1:
+            raise SystemExit('Only a single function request of each type is currently allowed. Please use another '
+                             'configuration file for the same functionality.')
+        grpc_p = grpc.create_group('singleshot_conductivity_optical')
+
+        single_singlshot_opt = calculation.get_singleshot_conductivity_optical[0]
+        arrays = [single_singlshot_opt[key] for key in ('energy', 'frequency', 'eta', 'num_moments')]
+        max_length = max(array.size for array in arrays)
+        if any(array.size not in (1, max_length) for array in arrays):
+            raise SystemExit('Number of moments, eta, energy and frequency should either have the same length or '
+                             'specified as a single value! Choose them accordingly.')
+        energy_, frequency_, eta_, moments_ = [np.resize(array, max_length) for array in arrays]
+
+        grpc_p.create_dataset('NumMoments', data=np.atleast_2d(moments_), dtype=np.int32)
+        grpc_p.create_dataset('NumRandoms', data=[single_singlshot_opt['num_random']], dtype=np.int32)
+        grpc_p.create_dataset('NumDisorder', data=[single_singlshot_opt['num_disorder']], dtype=np.int32)
+        grpc_p.create_dataset('NumPoints', data=[single_singlshot_opt['num_points'] or 0], dtype=np.int32)
+        grpc_p.create_dataset('Energy', data=np.atleast_2d(energy_ - config.energy_shift) / config.energy_scale,
+                              dtype=np.float64)
+        grpc_p.create_dataset('Frequency', data=np.atleast_2d(frequency_) / config.energy_scale, dtype=np.float64)
+        grpc_p.create_dataset('Gamma', data=np.atleast_2d(eta_) / config.energy_scale, dtype=np.float64)
+        grpc_p.create_dataset('Temperature', data=[single_singlshot_opt['temperature'] / config.energy_scale],
+                              dtype=np.float64)
+        grpc_p.create_dataset('Direction', data=[single_singlshot_opt['direction']], dtype=np.int32)
+
+    if calculation.get_bond_currents:
+        if len(calculation.get_bond_currents) > 1:
+            raise SystemExit('Only a single function request of each type is currently allowed. Please use another '
+                             'configuration file for the same functionality.')
+        grpc_p = grpc.create_group('bond_currents')
+
+        single_bond_currents = calculation.get_bond_currents[0]
+        grpc_p.create_dataset('NumMoments', data=[single_bond_currents['num_moments']], dtype=np.int32)
+        grpc_p.create_dataset('NumRandoms', data=[single_bond_currents['num_random']], dtype=np.int32)
+        grpc_p.create_dataset('NumDisorder', data=[single_bond_currents['num_disorder']], dtype=np.int32)
+        grpc_p.create_dataset('Energy', data=np.atleast_2d(single_bond_currents['energy'] - config.energy_shift) /
+                              config.energy_scale, dtype=np.float64)
+        grpc_p.create_dataset('Gamma', data=[single_bond_currents['eta'] / config.energy_scale], dtype=np.float64)
+        grpc_p.create_dataset('Direction', data=[single_bond_currents['direction']], dtype=np.int32)
+
+    if calculation.get_local_chern_marker:
+        if len(calculation.get_local_chern_marker) > 1:
+            raise SystemExit('Only a single function request of each type is currently allowed. Please use another '
+                             'configuration file for the same functionality.')
+        if space_size != 2:
+            raise SystemExit('The local Chern marker is only available for two-dimensional lattices!')
+        grpc_p = grpc.create_group('chern_marker')
+
+        single_marker = calculation.get_local_chern_marker[0]
+        grpc_p.create_dataset('NumMoments', data=[single_marker['num_moments']], dtype=np.int32)
+        grpc_p.create_dataset('NumDisorder', data=[single_marker['num_disorder']], dtype=np.int32)
+        grpc_p.create_dataset('Energy', data=np.atleast_2d(single_marker['energy'] - config.energy_shift) /
+                              config.energy_scale, dtype=np.float64)
+        if single_marker['position'] is not None:
+            orbitals, fixed_positions = _site_indices(single_marker['position'], single_marker['sublattice'], lattice,
+                                                      orbitals_before, config, space_size, 'local Chern marker')
+            grpc_p.create_dataset('Orbitals', data=orbitals, dtype=np.int32)
+            grpc_p.create_dataset('FixPosition', data=fixed_positions, dtype=np.int32)
+        if single_marker['region'] is not None:
+            start, size = single_marker['region'][:, 0, :], single_marker['region'][:, 1, :]
+            if np.any(start < 0) or np.any(size < 1) or np.any(start + size > np.asarray(config._length)):
+                raise SystemExit('The regions of the local Chern marker should be inside the sample, with at least '
+                                 'one unit cell along each direction!')
+            grpc_p.create_dataset('RegionStart', data=start, dtype=np.int32)
+            grpc_p.create_dataset('RegionSize', data=size, dtype=np.int32)
+            grpc_p.create_dataset('NumRandoms', data=[single_marker['num_random']], dtype=np.int32)
+
+    if calculation.get_hartree_potential:
+        if len(calculation.get_hartree_potential) > 1:
+            raise SystemExit('Only a single function request of each type is currently allowed. Please use another '
+                             'configuration file for the same functionality.')
+        grpc_p = grpc.create_group('hartree')
+
+        single_hartree = calculation.get_hartree_potential[0]
+        num_orb = position.shape[0]
+        num_cells = int(np.prod(config._length))
+        if single_hartree['probing_distance'] and any(
+                b and length % single_hartree['probing_distance'] for b, length in zip(bound, leng)):
+            raise SystemExit('The probing distance should divide the number of unit cells along the periodic '
+                             'directions!')
+
+        # Interaction between every pair of orbitals inside the cutoff, as orbital of the site, orbital of the
+        # source, relative index of the unit cell of the source and value
+        cutoff = single_hartree['cutoff'] if single_hartree['kernel'] is not None else 0
+        reach = cutoff + np.max(np.linalg.norm(position[:, None, :] - position[None, :, :], axis=2))
+        span = np.ceil(reach * np.linalg.norm(np.linalg.inv(vectors), axis=0)).astype(int)
+        offsets = np.stack(np.meshgrid(*[np.arange(-n, n + 1) for n in span], indexing='ij'), -1).reshape(-1, space_size)
+        sites, values = [], []
+        for orb_i in range(num_orb):
+            for orb_j in range(num_orb):
+                distances = np.linalg.norm(offsets @ vectors + position[orb_j] - position[orb_i], axis=1)
+                for offset, dist in zip(offsets, distances):
+                    if dist < 1e-8:
+                        value = single_hartree['onsite']
+                    elif dist <= cutoff:
+                        value = single_hartree['kernel'](dist)
+                    else:
+                        continue
+                    if value != 0:
+                        sites.append([orb_i, orb_j] + list(offset))
+                        values.append(value)
+        if not sites:
+            raise SystemExit('The interaction of the Hartree potential is zero!')
+
+        grpc_p.create_dataset('NumMoments', data=[single_hartree['num_moments']], dtype=np.int32)
+        grpc_p.create_dataset('NumRandoms', data=[single_hartree['num_random']], dtype=np.int32)
+        grpc_p.create_dataset('ProbingDistance', data=[single_hartree['probing_distance']], dtype=np.int32)
+        grpc_p.create_dataset('MaxIterations', data=[single_hartree['max_iterations']], dtype=np.int32)
+        grpc_p.create_dataset('History', data=[single_hartree['history']], dtype=np.int32)
+        grpc_p.create_dataset('FermiEnergy', data=[(single_hartree['fermi_energy'] - config.energy_shift) /
+                                                   config.energy_scale], dtype=np.float64)
+        grpc_p.create_dataset('Temperature', data=[single_hartree['temperature'] / config.energy_scale],
+                              dtype=np.float64)
+        grpc_p.create_dataset('Tolerance', data=[single_hartree['tolerance'] / config.energy_scale], dtype=np.float64)
+        grpc_p.create_dataset('Mixing', data=[single_hartree['mixing']], dtype=np.float64)
+        grpc_p.create_dataset('KernelSites', data=np.asarray(sites), dtype=np.int32)
+        grpc_p.create_dataset('KernelValues', data=np.asarray(values, dtype=np.float64) / config.energy_scale,
+                              dtype=np.float64)
+        if single_hartree['reference'] is not None:
+            reference = np.broadcast_to(np.asarray(single_hartree['reference'], dtype=np.float64), (num_orb,))
+            grpc_p.create_dataset('Reference', data=reference, dtype=np.float64)
+        if single_hartree['initial_potential'] is not None:
+            initial = np.asarray(single_hartree['initial_potential'], dtype=np.float64)
+            if initial.size != num_orb * num_cells:
+                raise SystemExit('The initial Hartree potential should have one row per orbital and one column per '
+                                 'unit cell!')
+            grpc_p.create_dataset('InitialPotential', data=initial.reshape(num_orb, num_cells), dtype=np.float64)
+
+    print('\n##############################################################################\n')
+    print('OUTPUT:\n')
+    print('\nExporting of KITE configuration to {} finished.\n'.format(filename))
+    print('\n##############################################################################\n')
+    f.close()
+
+
+def config_sparse_system(hamiltonian, positions, config: kite.Configuration, calculation: kite.Calculation,
+                         vectors=None, filename='kite_config.h5'):
+    """Export a Hamiltonian given as a sparse matrix to the *.h5 file
+
+    For samples that are not built from a periodic lattice (quasicrystals, amorphous or relaxed structures), the
+    Hamiltonian is stored in CSR format together with the position of each site. KITEx splits the sites among the
+    threads by recursive bisection of their positions, so the number of threads is the product of the divisions
+    of the configuration. Only the density of states and the DC and optical conductivities are available.
+
+    Parameters
+    ----------
+    hamiltonian
+        Square scipy sparse matrix, with the onsite energies on the diagonal.
+    positions
+        Array of shape (num_sites, dim) with the position of each site, used for the velocity operators.
+    config
+        Configuration object. The length is ignored, the boundaries refer to the box given by the vectors and
+        the product of the divisions is the number of threads.
+    calculation : Calculation
+        Calculation object that defines the requested functions for the calculation.
+    vectors
+        Array of shape (dim, dim) with the vectors of the box, used for the periodic boundaries and the
+        normalization of the conductivities. If None, the bounding box of the sites is used.
+    filename : str
+        Name of the exported file.
+    """
+
+    hamiltonian = csr_matrix(hamiltonian)
+    hamiltonian.sort_indices()
+    positions = np.atleast_2d(np.asarray(positions, dtype=np.float64))
+    num_sites, space_size = positions.shape
+    if hamiltonian.shape != (num_sites, num_sites):
+        raise SystemExit('The Hamiltonian should be a square matrix with one row per position!')
+    if space_size < 1 or space_size > 3:
+        raise SystemExit('The positions should have 1, 2 or 3 components!')
+
+    if (calculation.get_ldos or calculation.get_arpes or calculation.get_gaussian_wave_packet or
+            calculation.get_singleshot_conductivity_dc or calculation.get_singleshot_conductivity_optical or
+            calculation.get_conductivity_optical_nonlinear or calculation.get_bond_currents or
+            calculation.get_local_chern_marker or calculation.get_hartree_potential):
+        raise SystemExit('Only the DOS and the DC and optical conductivities are available for sparse Hamiltonians!')
+    if any(o is not None for o in _operators(calculation)):
+        raise SystemExit('Orbital operators are not available for sparse Hamiltonians!')
+
+    if np.iscomplexobj(hamiltonian.data) and np.linalg.norm(hamiltonian.data.imag) > 0 and config.comp == 0:
+        print('Complex hoppings are added but is_complex identifier is 0. Automatically turning is_complex to 1!')
+        config._is_complex = 1
+        config.set_type()
+
+    print('\n##############################################################################\n')
+    print('SCALING:\n')
+    if not config.energy_scale:
+        # Gershgorin circles give a safe bound of the spectrum
+        radius = np.asarray(abs(hamiltonian).sum(axis=1)).flatten() - np.abs(hamiltonian.diagonal())
+        e_min = np.min(hamiltonian.diagonal().real - radius)
+        e_max = np.max(hamiltonian.diagonal().real + radius)
+        print('\nAutomatic scaling is being done. Bounds of the spectrum from the Gershgorin circles: ')
+        print('({:.2f}, {:.2f} eV)\n'.format(e_min, e_max))
+        config._energy_scale = (e_max - e_min) / (2 * 0.9)
+        config._energy_shift = (e_max + e_min) / 2
+    else:
+        print('\nManual scaling is chosen. \n')
+
+    if vectors is None:
+        extent = np.max(positions, axis=0) - np.min(positions, axis=0)
+        vectors = np.diag(np.where(extent > 0, extent, 1.))
+    vectors = np.asarray(vectors, dtype=np.float64).reshape(space_size, space_size)
+
+    bound, twists = config.bound
+    bound, twists = bound[0:space_size], twists[0:space_size]
+    if np.any(bound == 2) or np.any(twists != 0):
+        raise SystemExit('Twisted boundaries are not available for sparse Hamiltonians!')
+    num_threads = int(np.prod(config.div))
+
+    matrix = (hamiltonian - config.energy_shift * identity(num_sites, format='csr')) / config.energy_scale
+    matrix = csr_matrix(matrix)
+    matrix.sort_indices()
+
+    f = hp.File(filename, 'w')
+    f.create_dataset('IS_COMPLEX', data=int(config.comp), dtype='u4')
+    f.create_dataset('PRECISION', data=config.prec, dtype='u4')
+    # the whole sample is a single cell with one orbital per site
+    f.create_dataset('L', data=np.ones(space_size), dtype='u4')
+    f.create_dataset('Boundaries', data=bound, dtype='u4')
+    f.create_dataset('BoundaryTwists', data=twists, dtype=float)
+    f.create_dataset('Divisions', data=[num_threads] + [1] * (space_size - 1), dtype='u4')
+    f.create_dataset('DIM', data=space_size, dtype='u4')
+    f.create_dataset('LattVectors', data=vectors, dtype=np.float64)
+    f.create_dataset('OrbPositions', data=positions, dtype=np.float64)
+    f.create_dataset('NOrbitals', data=num_sites, dtype='u4')
+    f.create_dataset('EnergyScale', data=config.energy_scale, dtype=np.float64)
+    f.create_dataset('EnergyShift', data=config.energy_shift, dtype=np.float64)
+
+    grp = f.create_group('SparseHamiltonian')
+    grp.create_dataset('IndPtr', data=matrix.indptr, dtype='u8')
+    grp.create_dataset('Indices', data=matrix.indices, dtype='u4')
+    if config.comp:
+        grp.create_dataset('Data', data=matrix.data.astype(config.type))
+    else:
+        grp.create_dataset('Data', data=matrix.data.real.astype(config.type))
+
+    grpc = f.create_group('Calculation')
+    requests = [('dos', calculation.get_dos), ('conductivity_dc', calculation.get_conductivity_dc),
+                ('conductivity_optical', calculation.get_conductivity_optical)]
+    for name, functions in requests:
+        if not functions:
+            continue
+        if len(functions) > 1:
+            raise SystemExit('Only a single function request of each type is currently allowed. Please use another '
+                             'configuration file for the same functionality.')
+        function = functions[0]
+        grpc_p = grpc.create_group(name)
+        grpc_p.create_dataset('NumMoments', data=[function['num_moments']], dtype=np.int32)
+        grpc_p.create_dataset('NumRandoms', data=[function['num_random']], dtype=np.int32)
+        grpc_p.create_dataset('NumPoints', data=[function['num_points']], dtype=np.int32)
+        grpc_p.create_dataset('NumDisorder', data=[function['num_disorder']], dtype=np.int32)
+        if name != 'dos':
+            grpc_p.create_dataset('Temperature', data=np.asarray([function['temperature']], dtype=np.float64)
+                                  / config.energy_scale, dtype=np.float64)
+            grpc_p.create_dataset('Direction', data=[function['direction']], dtype=np.int32)
 
     print('\n##############################################################################\n')
     print('OUTPUT:\n')
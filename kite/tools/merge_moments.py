@@ -0,0 +1,121 @@
+"""Merge the Chebyshev moments of independent KITEx runs
+
+    Every KITEx run stores its moments averaged over its own random vectors and disorder realizations, and records
+    the number of samples in the attribute NumSamples of each dataset. This script combines several such files,
+    weighting the moments by their number of samples, into a file that KITE-tools processes as usual:
+
+        python merge_moments.py merged.h5 run0.h5 run1.h5 run2.h5
+"""
+
+import shutil
+import sys
+import h5py as hp
+import numpy as np
+
+__all__ = ['merge_moments']
+
+# Haydock coefficients are stored per disorder realization, so they are concatenated instead of averaged
+_concatenated = ('RecursionA', 'RecursionB')
+
+
+def _datasets(group, prefix=''):
+    """Return the paths of all the datasets inside the group."""
+    paths = []
+    for key, item in group.items():
+        if isinstance(item, hp.Group):
+            paths += _datasets(item, prefix + key + '/')
+        else:
+            paths.append(prefix + key)
+    return paths
+
+
+def merge_moments(output, inputs, allow_same_seed=False):
+    """Combine the moments of several KITEx output files into a new file.
+
+    Parameters
+    ----------
+    output : str
+        Name of the merged file.
+    inputs : list(str)
+        KITEx output files generated from the same configuration, possibly with different numbers of random vectors
+        or disorder realizations.
+    allow_same_seed : bool
+        Merge runs that were made with the same fixed SEED, which therefore contain the same samples.
+    """
+    if len(inputs) < 2:
+        raise SystemExit('At least two files are needed for a merge.')
+
+    files = [hp.File(name, 'r') for name in inputs]
+    try:
+        reference = files[0]
+        paths = [path for path in _datasets(reference) if not path.startswith('Results/')]
+        for name, f in zip(inputs[1:], files[1:]):
+            other = [path for path in _datasets(f) if not path.startswith('Results/')]
+            if sorted(other) != sorted(paths):
+                raise SystemExit('{0} and {1} do not contain the same datasets.'.format(inputs[0], name))
+
+        merged = {}
+        groups = set()
+        for path in paths:
+            dset = reference[path]
+            leaf = path.split('/')[-1]
+            if 'NumSamples' in dset.attrs:
+                samples = [int(f[path].attrs['NumSamples']) for f in files]
+                seeds = [f[path].attrs['Seed'] for f in files]
+                seeds = [s.decode() if isinstance(s, bytes) else str(s) for s in seeds]
+                fixed = [s for s in seeds if s != 'random']
+                if len(fixed) != len(set(fixed)) and not allow_same_seed:
+                    raise SystemExit('Several runs of {0} used the same SEED, so they contain the same samples.'
+                                     .format(path))
+                moments = sum(n * np.asarray(f[path][()]) for n, f in zip(samples, files)) / sum(samples)
+                merged[path] = (moments.astype(dset.dtype), sum(samples), ','.join(seeds))
+                groups.add(path.rsplit('/', 1)[0])
+            elif path.startswith('Calculation/') and leaf in _concatenated:
+                merged[path] = (np.concatenate([np.asarray(f[path][()]) for f in files], axis=0), None, None)
+                groups.add(path.rsplit('/', 1)[0])
+            elif leaf in ('NumRandoms', 'NumDisorder') and path.startswith('Calculation/'):
+                continue
+            else:
+                for name, f in zip(inputs[1:], files[1:]):
+                    if not np.array_equal(np.asarray(f[path][()]), np.asarray(dset[()])):
+                        raise SystemExit('{0} differs between {1} and {2}. Only runs of the same configuration can '
+                                         'be merged.'.format(path, inputs[0], name))
+
+        # The samples of every run are counted in NumDisorder, which is what KITE-tools uses for the LDoS
+        counts = {}
+        for group in groups:
+            randoms = [int(np.ravel(f[group + '/NumRandoms'][()])[0]) if group + '/NumRandoms' in f else 1
+                       for f in files]
+            disorder = [int(np.ravel(f[group + '/NumDisorder'][()])[0]) for f in files]
+            if len(set(randoms)) == 1:
+                counts[group] = (randoms[0], sum(disorder))
+            else:
+                counts[group] = (1, sum(r * d for r, d in zip(randoms, disorder)))
+    finally:
+        for f in files:
+            f.close()
+
+    shutil.copyfile(inputs[0], output)
+    with hp.File(output, 'r+') as f:
+        if 'Results' in f:
+            del f['Results']
+        for path, (data, samples, seeds) in merged.items():
+            dtype = f[path].dtype
+            del f[path]
+            f.create_dataset(path, data=data, dtype=dtype)
+            if samples is not None:
+                f[path].attrs['NumSamples'] = np.int64(samples)
+                f[path].attrs['Seed'] = np.bytes_(seeds)
+        for group, (randoms, disorder) in counts.items():
+            if group + '/NumRandoms' in f:
+                f[group + '/NumRandoms'][...] = randoms
+            f[group + '/NumDisorder'][...] = disorder
+
+    print('Merged {0} files into {1}'.format(len(inputs), output))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 4:
+        print('Usage: python merge_moments.py merged.h5 run0.h5 run1.h5 [...]')
+        sys.exit(1)
+    merge_moments(sys.argv[1], sys.argv[2:])
@@ -155,3 +155,36 @@ def hexagonal(a: float = 1., t: complex = 1., t_nn: complex = 0, onsite: Tuple[f
         ([1, 1], 'B', 'B', 't_nn')
     )
     return lat
+
+
+def square_spin(a: float = 1., t: float = 1., onsite: float = 0.) -> pb.Lattice:
+    """Make a square lattice with two decoupled spin copies
+
+    Parameters
+    ----------
+    a : float
+        The unit vector length of the square lattice [nm].
+    t : float
+        The hopping strength between the nearest neighbours [eV].
+    onsite : float
+        The onsite energy for the orbitals [eV].
+
+    Returns
+    ------
+    pb.Lattice
+        The lattice object containing the square lattice, with the sublattices 'up' and 'down' on the same site
+    """
+
+    a1, a2 = a * np.array([1, 0]), a * np.array([0, 1])
+    lat = pb.Lattice(a1=a1, a2=a2)
+    lat.add_sublattices(
+        ('up', a * np.array([0, 0]), onsite),
+        ('down', a * np.array([0, 0]), onsite)
+    )
+    lat.add_hoppings(
+        ([1, 0], 'up', 'up', t),
+        ([0, 1], 'up', 'up', t),
+        ([1, 0], 'down', 'down', t),
+        ([0, 1], 'down', 'down', t)
+    )
+    return lat
@@ -4,6 +4,7 @@ import numpy as np
 import kite
 import os
 import h5py
+import scipy.sparse
 from .lattices import hexagonal, read_text_and_matrices, square
 
 
@@ -281,4 +282,129 @@ def test_dc(params, baseline, tmp_path):
     kite.execute.kitetools("{0} --CondDC -N {1}".format(config_system['filename'], str((tmp_path / "cond_dc.dat"))))
     results.append(np.loadtxt(str((tmp_path / "cond_dc.dat"))))
     expected = baseline(results)
-    assert pytest.fuzzy_equal(results, expected, rtol=1e-6, atol=1e-10)
\ No newline at end of file
+    assert pytest.fuzzy_equal(results, expected, rtol=1e-6, atol=1e-10)
+
+def test_divisions(tmp_path):
+    # The velocity only fills the bulk of every sub-domain: the ghosts of the result have to be exchanged before
+    # it is iterated, and the ghosts of the vector it is applied to as well. With the deterministic vectors of
+    # SEED=ones, the moments of a single domain and of 2x2 sub-domains are the same up to the rounding errors
+    results = []
+    for divisions in ([1, 1], [2, 2]):
+        configuration = kite.Configuration(divisions=divisions, length=[32, 32], boundaries=["periodic", "periodic"],
+                                           is_complex=False, precision=1, spectrum_range=[-3.1, 3.1])
+        calculation = kite.Calculation(configuration)
+        calculation.conductivity_dc(num_points=1000, num_moments=32, num_random=1, direction='xx', temperature=0.01)
+        calculation.conductivity_optical(num_points=256, num_moments=32, num_random=1, direction='yy')
+        filename = str(tmp_path / "divisions-{}.h5".format(divisions[0]))
+        kite.config_system(hexagonal(t=-1), configuration, calculation, filename=filename)
+        os.environ["SEED"] = "ones"
+        kite.execute.kitex(filename)
+        with h5py.File(filename, 'r') as hdf5_file:
+            results.append([np.array(hdf5_file[name][:]) for name in (
+                "/Calculation/conductivity_dc/Gammaxx", "/Calculation/conductivity_optical/Gammayy",
+                "/Calculation/conductivity_optical/Lambdayy")])
+    for single, divided in zip(*results):
+        assert pytest.fuzzy_equal(divided, single, rtol=1e-10, atol=1e-10)
+
+
+def test_sparse_padding(tmp_path):
+    # The sparse Gamma2D runs MEMORY moments at a time: a number of moments that is not a multiple of it is padded,
+    # and the stored matrix is the corner of the one of a larger, aligned, number of moments
+    size = 12
+    x, y = np.meshgrid(np.arange(size), np.arange(size), indexing='ij')
+    positions = np.column_stack([x.ravel(), y.ravel()]).astype(float)
+    distance = np.abs(positions[:, None, :] - positions[None, :, :]).sum(axis=2)
+    hamiltonian = scipy.sparse.csr_matrix(-1.0 * (distance == 1))
+    results = {}
+    for num_moments in (40, 48):
+        configuration = kite.Configuration(divisions=[2, 1], length=[size, size], boundaries=["open", "open"],
+                                           is_complex=False, precision=1, spectrum_range=[-4.1, 4.1])
+        calculation = kite.Calculation(configuration)
+        calculation.conductivity_dc(num_points=100, num_moments=num_moments, num_random=1, direction='xx',
+                                    temperature=0.01)
+        filename = str(tmp_path / "sparse-{}.h5".format(num_moments))
+        kite.config_sparse_system(hamiltonian, positions, configuration, calculation, filename=filename)
+        os.environ["SEED"] = "ones"
+        kite.execute.kitex(filename)
+        with h5py.File(filename, 'r') as hdf5_file:
+            results[num_moments] = np.array(hdf5_file["/Calculation/conductivity_dc/Gammaxx"][:])
+    assert results[40].shape == (40, 40)
+    assert np.abs(results[48]).max() > 0
+    assert pytest.fuzzy_equal(results[40], results[48][:40, :40], rtol=1e-10, atol=1e-12)
+
+
+def test_fused(tmp_path):
+    # KITEx runs the Chebyshev sweeps shared by the DOS and the optical conductivity, and by the DC and optical
+    # conductivities along the same direction, only once. Every random vector is drawn in the same order as in the
+    # separate runs, so the moments are the same numbers. A single domain keeps the order of the sums fixed
+    def run(name, dos=False, dc=0, optical=0):
+        configuration = kite.Configuration(divisions=[1, 1], length=[32, 32], boundaries=["periodic", "periodic"],
+                                           is_complex=False, precision=1, spectrum_range=[-3.1, 3.1])
+        calculation = kite.Calculation(configuration)
+        if dos:
+            calculation.dos(num_points=1000, num_moments=64, num_random=2, num_disorder=1)
+        if dc:
+            calculation.conductivity_dc(num_points=1000, num_moments=dc, num_random=2, direction='yy',
+                                        temperature=0.01)
+        if optical:
+            calculation.conductivity_optical(num_points=256, num_moments=optical, num_random=2, direction='yy')
+        filename = str(tmp_path / "fused-{}.h5".format(name))
+        kite.config_system(hexagonal(t=-1), configuration, calculation, filename=filename)
+        os.environ["SEED"] = "3"
+        kite.execute.kitex(filename)
+        with h5py.File(filename, 'r') as hdf5_file:
+            return {key: np.array(hdf5_file["/Calculation/" + key][:]) for key in (
+                "dos/MU", "conductivity_dc/Gammayy", "conductivity_optical/Gammayy",
+                "conductivity_optical/Lambdayy") if "/Calculation/" + key in hdf5_file}
+
+    fused, dos, optical = run("dos-optical", dos=True, optical=32), run("dos", dos=True), run("optical", optical=32)
+    assert np.array_equal(fused["dos/MU"], dos["dos/MU"])
+    assert np.array_equal(fused["conductivity_optical/Lambdayy"], optical["conductivity_optical/Lambdayy"])
+    assert np.array_equal(fused["conductivity_optical/Gammayy"], optical["conductivity_optical/Gammayy"])
+
+    fused, dc = run("dc-optical", dc=48, optical=32), run("dc", dc=48)
+    assert np.array_equal(fused["conductivity_dc/Gammayy"], dc["conductivity_dc/Gammayy"])
+    assert np.array_equal(fused["conductivity_optical/Gammayy"], dc["conductivity_dc/Gammayy"][:32, :32])
+
+
+def test_singleshot_hall(tmp_path):
+    # In the gap of the Haldane model the Hall conductivity is quantized, sigma_xy = 1 in units of e^2/h. The
+    # single-shot calculation is the contraction of the Gamma matrix of conductivity_dc with the coefficients of
+    # the Kubo-Bastin formula, integrated over the same grid, and with the same random vector it gives the same value
+    length, num_moments, eta, scale = 64, 256, 0.1, 3.5
+    energies = np.array([0.0, -1.0])
+    files = {}
+    for name in ("singleshot", "gamma"):
+        configuration = kite.Configuration(divisions=[1, 1], length=[length, length],
+                                           boundaries=["periodic", "periodic"], is_complex=True, precision=1,
+                                           spectrum_range=[-scale, scale])
+        calculation = kite.Calculation(configuration)
+        if name == "singleshot":
+            calculation.singleshot_conductivity_dc(energy=energies, direction='xy', eta=eta, num_moments=num_moments,
+                                                   num_random=1)
+        else:
+            calculation.conductivity_dc(num_points=100, num_moments=num_moments, num_random=1, direction='xy',
+                                        temperature=0.01)
+        files[name] = str(tmp_path / "hall-{}.h5".format(name))
+        kite.config_system(hexagonal(t=-1, t_nn=-0.1j), configuration, calculation, filename=files[name])
+        os.environ["SEED"] = "3"
+        kite.execute.kitex(files[name])
+    with h5py.File(files["singleshot"], 'r') as hdf5_file:
+        sigma = np.array(hdf5_file["/Calculation/singleshot_conductivity_dc/SingleShot"][:])[:, 3]
+    with h5py.File(files["gamma"], 'r') as hdf5_file:
+        gamma = np.array(hdf5_file["/Calculation/conductivity_dc/Gammaxy"][:])
+    assert sigma[0] == pytest.approx(1.0, abs=0.02)
+
+    # Coefficients of the Green's function and of its derivative, and the zero-temperature weights of KITEx
+    n = np.arange(num_moments)
+    half = 1 / (1 + (n == 0))
+    factor = 2 * np.pi * 2 / (np.sqrt(3) / 2)
+    for mu, value in zip(energies / scale, sigma):
+        z = np.linspace(-1, mu, int(np.ceil(4 * (mu + 1) / (eta / scale))) + 1)[:, None] + 1j * eta / scale
+        sq = np.sqrt(1 - z * z)
+        delta = -(2j / sq * np.exp(-1j * n * np.arccos(z))).imag / np.pi * half
+        dgreen = -2j / (1 - z * z) * np.exp(-1j * n * np.arccos(z)) * (1j * n + z / sq) * half
+        weights = np.full(z.shape[0], z[1, 0].real - z[0, 0].real)
+        weights[[0, -1]] /= 2
+        integrand = 2 * np.einsum('en,nm,em->e', delta, gamma, dgreen).imag
+        assert factor * np.sum(weights * integrand) == pytest.approx(value, rel=1e-6)
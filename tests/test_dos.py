@@ -4,7 +4,7 @@ import numpy as np
 import kite
 import h5py
 import os
-from .lattices import square, cube, hexagonal
+from .lattices import square, cube, hexagonal, square_spin
 
 
 settings = {
@@ -184,3 +184,83 @@ def test_mag(params, baseline, tmp_path):
     results.append(np.loadtxt(str(tmp_path / "dos.dat")))
     expected = baseline(results)
     assert pytest.fuzzy_equal(results, expected, rtol=1e-6, atol=1e-10)
+
+
+def dos_moments(lattice, tmp_path, filename, disorder=(), length=(128, 128), num_moments=64, num_random=4,
+                random_seed="3"):
+    """Compute the DOS moments of a lattice with Uniform onsite disorder. Every element of disorder is a pair
+    (list of sublattices, width); the sublattices of one pair share the same random value in each unit cell."""
+    configuration = kite.Configuration(divisions=[2, 2], length=list(length), boundaries=["periodic", "periodic"],
+                                       is_complex=False, precision=1, spectrum_range=[-6, 6])
+    calculation = kite.Calculation(configuration)
+    calculation.dos(num_points=1000, num_moments=num_moments, num_random=num_random, num_disorder=1)
+    filename = str((tmp_path / filename).with_suffix(".h5"))
+    kwargs = {}
+    if len(disorder) > 0:
+        kwargs['disorder'] = kite.Disorder(lattice)
+        for sublattices, width in disorder:
+            kwargs['disorder'].add_disorder(sublattices, 'Uniform', 0., width)
+    kite.config_system(lattice, configuration, calculation, filename=filename, **kwargs)
+    os.environ["SEED"] = random_seed
+    kite.execute.kitex(filename)
+    with h5py.File(filename, 'r') as hdf5_file:
+        return np.array(hdf5_file["/Calculation/dos/MU"][:]).real.reshape(-1)
+
+
+def test_dos_sectors(tmp_path):
+    # Without disorder KITEx iterates only one of the spin copies, and the trace is the one of the single copy
+    mu_spin = dos_moments(square_spin(), tmp_path, "dos-spin", random_seed="ones")
+    mu_single = dos_moments(square(), tmp_path, "dos-single", random_seed="ones")
+    assert pytest.fuzzy_equal(mu_spin, mu_single, rtol=1e-10, atol=1e-12)
+
+    # With a spin-independent disorder both copies see the same potential, and again only one of them is iterated.
+    # With an independent disorder for every spin the copies differ and the full lattice is iterated. The traces
+    # then only agree on average over the disorder and the random vectors: the statistical error of every moment
+    # is about 1/sqrt(num_random * orbitals) for the reduced lattice, and the largest of 64 moments stays within
+    # a few of those
+    mu_reduced = dos_moments(square_spin(), tmp_path, "dos-reduced", disorder=[(['up', 'down'], 1.0)],
+                             random_seed="3")
+    mu_full = dos_moments(square_spin(), tmp_path, "dos-full", disorder=[(['up'], 1.0), (['down'], 1.0)],
+                          random_seed="5")
+    assert np.max(np.abs(mu_reduced - mu_full)) < 10 / np.sqrt(4 * 128 * 128)
+
+
+def test_field_profile(tmp_path):
+    # A uniform field profile has the same Peierls phases as the uniform field with the same flux, and with the
+    # deterministic vectors of SEED=ones the moments are the same up to the rounding errors
+    hbar = 6.58211899 * 10 ** -16
+    phi0 = 2 * np.pi * hbar
+    length, flux = 64, 3
+    for lattice in (square(t=-1), hexagonal()):
+        vectors = np.asarray(lattice.vectors)
+        unit_cell_area = abs(np.linalg.det(vectors[:, :2])) * 1e-18
+        results = []
+        for modification in (kite.Modification(flux=flux / length),
+                             kite.Modification(field_profile=np.full(length, flux * phi0 / (length * unit_cell_area)))):
+            configuration = kite.Configuration(divisions=[2, 2], length=[length, length],
+                                               boundaries=["periodic", "periodic"], is_complex=True, precision=1,
+                                               spectrum_range=[-5, 5])
+            calculation = kite.Calculation(configuration)
+            calculation.dos(num_points=1000, num_moments=128, num_random=1, num_disorder=1)
+            filename = str(tmp_path / "field-{}.h5".format(len(results)))
+            kite.config_system(lattice, configuration, calculation, modification=modification, filename=filename)
+            os.environ["SEED"] = "ones"
+            kite.execute.kitex(filename)
+            with h5py.File(filename, 'r') as hdf5_file:
+                results.append(np.array(hdf5_file["/Calculation/dos/MU"][:]))
+        assert pytest.fuzzy_equal(results[1], results[0], rtol=1e-10, atol=1e-12)
+
+    # With open boundaries along the last lattice vector, the total flux does not have to be an integer
+    lattice, flux = square(t=-1), 0.5
+    unit_cell_area = 1e-18
+    configuration = kite.Configuration(divisions=[2, 2], length=[length, length], boundaries=["periodic", "open"],
+                                       is_complex=True, precision=1, spectrum_range=[-5, 5])
+    calculation = kite.Calculation(configuration)
+    calculation.dos(num_points=1000, num_moments=128, num_random=1, num_disorder=1)
+    filename = str(tmp_path / "field-open.h5")
+    kite.config_system(lattice, configuration, calculation, filename=filename,
+                       modification=kite.Modification(field_profile=np.full(length, flux * phi0 / (length * unit_cell_area))))
+    kite.execute.kitex(filename)
+    with h5py.File(filename, 'r') as hdf5_file:
+        assert np.sum(hdf5_file["/Hamiltonian/MagneticFieldProfile"][:]) == pytest.approx(flux)
+        assert "MU" in hdf5_file["/Calculation/dos"]
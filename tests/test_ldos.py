@@ -139,3 +139,38 @@ def test_structuraldisorder(params, baseline, tmp_path):
     results.append(read_ldos_files(str(tmp_path)))
     expected = baseline(results)
     assert pytest.fuzzy_equal(results, expected, rtol=1e-6, atol=3e-2)
+
+
+def ldos_energies(directory):
+    """Read the LDOS files written by KITE-tools in a directory, as arrays of energies and values at the first site"""
+    data = read_ldos_files(str(directory))
+    energies = np.array(sorted(data.keys()))
+    return energies, np.array([np.atleast_2d(data[e])[0, 3] for e in energies])
+
+
+def test_ldos_recursion(tmp_path):
+    # LDOS of a clean square lattice with the broadening eta, from the Haydock recursion and from the Chebyshev
+    # moments with the green kernel, compared with the exact -Im G(E + i eta)/pi of the finite periodic lattice
+    length, eta = 32, 0.1
+    energies = np.linspace(-3.5, 3.5, 15)
+    results = {}
+    for method, num_moments in (('recursion', 256), ('chebyshev', 1024)):
+        configuration = kite.Configuration(divisions=[2, 2], length=[length, length],
+                                           boundaries=["periodic", "periodic"], is_complex=False, precision=1,
+                                           spectrum_range=[-4.1, 4.1])
+        calculation = kite.Calculation(configuration)
+        calculation.ldos(energy=energies, num_moments=num_moments, num_disorder=1, position=[[4, 3]], sublattice='A',
+                         method=method)
+        filename = str(tmp_path / (method + ".h5"))
+        kite.config_system(square(t=-1), configuration, calculation, filename=filename)
+        kite.execute.kitex(filename)
+        (tmp_path / method).mkdir()
+        kite.execute.kitetools("{0} --LDOS -K green {1} -N {2}".format(filename, eta, str(tmp_path / method / "ldos")))
+        results[method] = ldos_energies(tmp_path / method)
+
+    k = 2 * np.pi * np.arange(length) / length
+    bands = (-2 * np.cos(k)[:, None] - 2 * np.cos(k)[None, :]).reshape(-1)
+    exact = np.mean(-np.imag(1 / (energies[:, None] + 1j * eta - bands[None, :])), axis=1) / np.pi
+    for method, (energies_kite, ldos) in results.items():
+        assert np.max(np.abs(energies_kite - energies)) < 1e-6
+        assert pytest.fuzzy_equal(ldos, exact, rtol=1e-3, atol=1e-4), method